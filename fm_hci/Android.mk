@@ -3,7 +3,9 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
-    fm_hci.cpp
+    fm_hci.cpp \
+    fm_log.cpp \
+    fm_snoop.cpp
 
 LOCAL_SHARED_LIBRARIES := \
          libdl \
@@ -28,3 +30,88 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE_CLASS := SHARED_LIBRARIES
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Loopback fake SoC, answers fm_hci commands without IFmHci
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    fm_fake_soc.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+         liblog \
+
+LOCAL_CFLAGS := -Wno-unused-parameter
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../helium \
+        $(LOCAL_PATH)/fm_hci
+
+LOCAL_MODULE := libfm-hci-fake
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# libfm-hci on top of the fake SoC, for running the transport and the
+# helium hal on the build host
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    fm_hci.cpp \
+    fm_log.cpp \
+    fm_snoop.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+         libfm-hci-fake \
+
+LOCAL_SHARED_LIBRARIES := \
+         liblog \
+         libutils \
+
+LOCAL_CFLAGS := -Wno-unused-parameter -DFM_HCI_FAKE_SOC
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../helium \
+        $(LOCAL_PATH)/fm_hci
+
+LOCAL_MODULE := libfm-hci-fake-host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+# Host benchmark: fm_hci + helium hal against the fake SoC
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    fm_hci_bench.cpp \
+    ../helium/radio_helium_hal.c \
+    ../helium/radio_helium_hal_cmds.c \
+    ../helium/radio_helium_rds.c \
+    ../helium/radio_helium_cb.c
+
+LOCAL_SHARED_LIBRARIES := \
+         libfm-hci-fake-host \
+         liblog \
+
+LOCAL_CFLAGS := -Wno-unused-parameter
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../helium \
+        $(LOCAL_PATH)/fm_hci
+
+LOCAL_MODULE := fm_hci_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host decoder for the btsnoop files from fm_hci_snoop_dump
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    fm_snoop_parse.c
+
+LOCAL_CFLAGS := -Wno-unused-parameter
+
+LOCAL_MODULE := fm_snoop_parse
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,770 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "fm_fake_soc"
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <utility>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Log.h>
+
+#include "fm_hci_api.h"
+#include "fm_fake_soc.h"
+#include "radio-helium.h"
+
+#define FAKE_OPCODE(ogf, ocf)   hci_opcode_pack(ogf, ocf)
+#define FAKE_MAX_STATIONS       32
+#define FAKE_SRCH_LIST_MAX      20
+
+typedef std::unique_lock<std::mutex> Lock;
+typedef std::chrono::steady_clock fake_clock;
+
+enum fake_tag_t {
+    FAKE_TAG_NONE,
+    FAKE_TAG_SEARCH,    /* dropped by HCI_OCF_FM_CANCEL_SEARCH */
+    FAKE_TAG_INIT,
+};
+
+struct fake_pending_t {
+    int tag;
+    std::vector<uint8_t> evt;
+};
+
+/* pending replies, ordered by due time, then by scheduling order */
+typedef std::pair<fake_clock::time_point, uint64_t> fake_key_t;
+
+/* get command and the set command whose parameters it reads back */
+struct fake_reg_t {
+    uint16_t get_opcode;
+    uint16_t set_opcode;
+    uint8_t len;
+};
+
+static const struct fake_reg_t fake_regs[] = {
+    { FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_RECV_CONF_REQ),
+      FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SET_RECV_CONF_REQ),
+      sizeof(struct hci_fm_recv_conf_req) },
+    { FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_SIGNAL_THRESHOLD),
+      FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SET_SIGNAL_THRESHOLD),
+      sizeof(char) },
+    { FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_CH_DET_THRESHOLD),
+      FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SET_CH_DET_THRESHOLD),
+      sizeof(struct hci_fm_ch_det_threshold) },
+    { FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_BLND_TBL),
+      FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SET_BLND_TBL),
+      sizeof(struct hci_fm_blend_table) },
+    { FAKE_OPCODE(HCI_OGF_FM_TRANS_CTRL_CMD_REQ, HCI_OCF_FM_GET_TRANS_CONF_REQ),
+      FAKE_OPCODE(HCI_OGF_FM_TRANS_CTRL_CMD_REQ, HCI_OCF_FM_SET_TRANS_CONF_REQ),
+      sizeof(struct hci_fm_trans_conf_req_struct) },
+    /* mode and entry count at least, no entries until one is set */
+    { FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_GET_SPUR_TABLE),
+      FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_SET_SPUR_TABLE),
+      offsetof(struct hci_fm_set_spur_table_req, spur_data) },
+    { FAKE_OPCODE(HCI_OGF_FM_STATUS_PARAMETERS_CMD_REQ, HCI_OCF_FM_READ_GRP_COUNTERS),
+      0, sizeof(struct hci_fm_rds_grp_cntrs_params) },
+    { FAKE_OPCODE(HCI_OGF_FM_STATUS_PARAMETERS_CMD_REQ, HCI_OCF_FM_READ_GRP_COUNTERS_EXT),
+      0, sizeof(struct hci_fm_rds_grp_cntrs_params) },
+    { FAKE_OPCODE(HCI_OGF_FM_DIAGNOSTIC_CMD_REQ, HCI_OCF_FM_SSBI_PEEK_REG),
+      0, sizeof(char) },
+    { FAKE_OPCODE(HCI_OGF_FM_DIAGNOSTIC_CMD_REQ, HCI_OCF_FM_STATION_DBG_PARAM),
+      0, sizeof(struct hci_fm_dbg_param_rsp) },
+};
+
+static struct fake_soc_t {
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::thread worker;
+    bool running;
+    uint64_t order;
+    std::map<fake_key_t, fake_pending_t> pending;
+
+    struct fm_fake_soc_callbacks_t cb;
+    struct fm_fake_soc_config_t cfg;
+    bool cfg_set;
+    struct fm_fake_soc_stats_t stats;
+
+    std::map<uint16_t, std::vector<uint8_t> > regs;
+    std::map<uint8_t, std::vector<uint8_t> > def_data;
+    std::vector<uint32_t> stations;
+    uint32_t band_low;
+    uint32_t band_high;
+    uint32_t freq;
+    bool rx_on;
+} soc;
+
+static void fake_put32(std::vector<uint8_t> &v, uint32_t val)
+{
+    v.push_back(val & 0xff);
+    v.push_back((val >> 8) & 0xff);
+    v.push_back((val >> 16) & 0xff);
+    v.push_back((val >> 24) & 0xff);
+}
+
+/* called with soc.mtx held */
+static void fake_schedule(fake_clock::time_point due, int tag, uint8_t evt_code,
+                          const uint8_t *params, size_t len)
+{
+    fake_pending_t p;
+
+    if (len > MAX_FM_EVT_PARAMS)
+        len = MAX_FM_EVT_PARAMS;
+    p.tag = tag;
+    p.evt.reserve(len + 2);
+    p.evt.push_back(evt_code);
+    p.evt.push_back(len);
+    p.evt.insert(p.evt.end(), params, params + len);
+    soc.pending.emplace(fake_key_t(due, ++soc.order), std::move(p));
+    soc.cond.notify_all();
+}
+
+static void fake_schedule(fake_clock::time_point due, int tag, uint8_t evt_code,
+                          const std::vector<uint8_t> &params)
+{
+    fake_schedule(due, tag, evt_code, params.data(), params.size());
+}
+
+static void fake_cmd_complete(fake_clock::time_point due, uint16_t opcode,
+                              uint8_t status, const uint8_t *rsp, size_t len)
+{
+    std::vector<uint8_t> params;
+
+    params.push_back(soc.cfg.credits);
+    params.push_back(opcode & 0xff);
+    params.push_back(opcode >> 8);
+    params.push_back(status);
+    if (rsp && len)
+        params.insert(params.end(), rsp, rsp + len);
+    fake_schedule(due, FAKE_TAG_NONE, HCI_EV_CMD_COMPLETE, params);
+    soc.stats.cmd_completes++;
+}
+
+static void fake_cmd_status(fake_clock::time_point due, uint16_t opcode, uint8_t status)
+{
+    uint8_t params[4] = { status, soc.cfg.credits,
+                          (uint8_t)(opcode & 0xff), (uint8_t)(opcode >> 8) };
+
+    fake_schedule(due, FAKE_TAG_NONE, HCI_EV_CMD_STATUS, params, sizeof(params));
+    soc.stats.cmd_status++;
+}
+
+static bool fake_has_station(uint32_t freq)
+{
+    for (size_t i = 0; i < soc.stations.size(); i++)
+        if (soc.stations[i] == freq)
+            return true;
+    return false;
+}
+
+/* struct hci_ev_tune_status, without the leading sub_event when !sub */
+static std::vector<uint8_t> fake_tune_status(bool sub)
+{
+    std::vector<uint8_t> st;
+    bool found = fake_has_station(soc.freq);
+
+    if (sub)
+        st.push_back(0);
+    fake_put32(st, soc.freq);
+    st.push_back(found);                    /* serv_avble */
+    st.push_back(found ? soc.cfg.rssi : 0);
+    st.push_back(found);                    /* stereo_prg */
+    st.push_back(found);                    /* rds_sync_status */
+    st.push_back(0);                        /* mute_mode */
+    st.push_back(found ? soc.cfg.sinr : 0);
+    st.push_back(0);                        /* intf_det_th */
+    return st;
+}
+
+/* made up, but stable per station */
+static uint16_t fake_pi(uint32_t freq)
+{
+    return 0xc000 | ((freq / 100) & 0x0fff);
+}
+
+/* the RDS getters answer with the layout of the matching event */
+static std::vector<uint8_t> fake_rds_ps()
+{
+    std::vector<uint8_t> ps(RDS_PS_DATA_OFFSET + RDS_STRING, 0);
+    uint16_t pi = fake_pi(soc.freq);
+    char name[RDS_STRING + 1];
+
+    ps[RDS_PID_HIGHER] = pi >> 8;
+    ps[RDS_PID_LOWER] = pi & 0xff;
+    ps[RDS_PTYPE] = 10;                     /* pop music */
+    ps[RDS_PS_LENGTH_OFFSET] = 1;
+    snprintf(name, sizeof(name), "FM%4u.%u", soc.freq / 1000 % 10000,
+             soc.freq % 1000 / 100);
+    memcpy(&ps[RDS_PS_DATA_OFFSET], name, RDS_STRING);
+    return ps;
+}
+
+static std::vector<uint8_t> fake_rds_rt()
+{
+    static const char text[] = "Fake SoC radio text";
+    std::vector<uint8_t> rt(RDS_OFFSET, 0);
+    uint16_t pi = fake_pi(soc.freq);
+
+    rt[RDS_PID_HIGHER] = pi >> 8;
+    rt[RDS_PID_LOWER] = pi & 0xff;
+    rt[RDS_PTYPE] = 10;
+    rt[RT_A_B_FLAG_OFFSET] = 0;
+    rt.insert(rt.end(), text, text + sizeof(text) - 1);
+    rt.push_back(0x0d);
+    return rt;
+}
+
+/* the other stations in band stand in for alternative frequencies */
+static std::vector<uint8_t> fake_af_list()
+{
+    std::vector<uint8_t> af;
+    uint16_t pi = fake_pi(soc.freq);
+    uint8_t cnt = 0;
+
+    fake_put32(af, soc.freq);
+    af.push_back(pi & 0xff);                /* __le16 pi */
+    af.push_back(pi >> 8);
+    af.push_back(0);                        /* AF_SIZE_OFFSET */
+    for (size_t i = 0; i < soc.stations.size() && cnt < AF_LIST_MAX; i++) {
+        uint32_t f = soc.stations[i];
+
+        if (f == soc.freq || f < soc.band_low || f > soc.band_high)
+            continue;
+        fake_put32(af, f);
+        cnt++;
+    }
+    af[AF_SIZE_OFFSET] = cnt;
+    return af;
+}
+
+/* struct hci_cc_do_calibration_rsp, without the status */
+static std::vector<uint8_t> fake_calibration(uint8_t mode)
+{
+    size_t len;
+
+    switch (mode) {
+    case PROCS_CALIB_MODE:
+        len = PROCS_CALIB_SIZE;
+        break;
+    case DC_CALIB_MODE:
+        len = DC_CALIB_SIZE;
+        break;
+    case RSB_CALIB_MODE:
+        len = RSB_CALIB_SIZE;
+        break;
+    default:
+        len = MAX_CALIB_SIZE;
+        break;
+    }
+    std::vector<uint8_t> cal(1 + len, 0);
+    cal[0] = mode;
+    return cal;
+}
+
+/* next station from soc.freq in the given direction, wrapping at band edges */
+static bool fake_next_station(bool up, uint32_t *freq)
+{
+    uint32_t best = 0, wrap = 0;
+    bool have_best = false, have_wrap = false;
+
+    for (size_t i = 0; i < soc.stations.size(); i++) {
+        uint32_t f = soc.stations[i];
+
+        if (f < soc.band_low || f > soc.band_high)
+            continue;
+        if (up ? f > soc.freq : f < soc.freq) {
+            if (!have_best || (up ? f < best : f > best)) {
+                best = f;
+                have_best = true;
+            }
+        }
+        if (!have_wrap || (up ? f < wrap : f > wrap)) {
+            wrap = f;
+            have_wrap = true;
+        }
+    }
+    if (!have_best && !have_wrap)
+        return false;
+    *freq = have_best ? best : wrap;
+    return true;
+}
+
+static void fake_search(fake_clock::time_point due, const uint8_t *params,
+                        size_t len, uint8_t complete_evt)
+{
+    uint8_t mode = len > 0 ? params[0] : (uint8_t)SEEK;
+    bool up = len > 2 ? params[2] == 0 : true;
+    uint32_t start = soc.freq, freq;
+    fake_clock::duration step = std::chrono::microseconds(soc.cfg.tune_latency_us);
+    size_t n = 0;
+
+    while (fake_next_station(up, &freq) && n < soc.stations.size()) {
+        soc.freq = freq;
+        due += step;
+        fake_schedule(due, FAKE_TAG_SEARCH, HCI_EV_TUNE_STATUS, fake_tune_status(true));
+        n++;
+        if (mode == SEEK || mode == RDS_SEEK_PTY || mode == RDS_SEEK_PI
+                || soc.freq == start)
+            break;
+    }
+    fake_schedule(due + step, FAKE_TAG_SEARCH, complete_evt, NULL, 0);
+}
+
+static void fake_search_list(fake_clock::time_point due, const uint8_t *params,
+                             size_t len)
+{
+    std::vector<uint8_t> evt;
+    int max = FAKE_SRCH_LIST_MAX;
+    uint8_t cnt = 0;
+
+    if (len >= 6) {
+        int req = params[2] | (params[3] << 8) | (params[4] << 16) | (params[5] << 24);
+        if (req > 0 && req < max)
+            max = req;
+    }
+
+    evt.push_back(0);
+    evt.push_back(0);   /* STN_NUM_OFFSET */
+    for (size_t i = 0; i < soc.stations.size() && cnt < max; i++) {
+        uint32_t f = soc.stations[i];
+
+        if (f < soc.band_low || f > soc.band_high)
+            continue;
+        fake_put32(evt, f);
+        evt.push_back(soc.cfg.rssi);
+        evt.push_back(soc.cfg.sinr);
+        evt.push_back(0);
+        evt.push_back(0);
+        cnt++;
+    }
+    evt[STN_NUM_OFFSET] = cnt;
+    fake_schedule(due + std::chrono::microseconds(soc.cfg.tune_latency_us),
+                  FAKE_TAG_SEARCH, HCI_EV_SEARCH_LIST_COMPLETE, evt);
+}
+
+static void fake_cancel_search()
+{
+    for (auto it = soc.pending.begin(); it != soc.pending.end(); ) {
+        if (it->second.tag == FAKE_TAG_SEARCH)
+            it = soc.pending.erase(it);
+        else
+            ++it;
+    }
+}
+
+static const struct fake_reg_t *fake_find_get(uint16_t opcode)
+{
+    for (size_t i = 0; i < sizeof(fake_regs) / sizeof(fake_regs[0]); i++)
+        if (fake_regs[i].get_opcode == opcode)
+            return &fake_regs[i];
+    return NULL;
+}
+
+static bool fake_is_set(uint16_t opcode)
+{
+    for (size_t i = 0; i < sizeof(fake_regs) / sizeof(fake_regs[0]); i++)
+        if (fake_regs[i].set_opcode == opcode)
+            return true;
+    return false;
+}
+
+/* called with soc.mtx held */
+static void fake_handle_cmd(uint16_t opcode, const uint8_t *params, size_t len)
+{
+    fake_clock::time_point due = fake_clock::now()
+            + std::chrono::microseconds(soc.cfg.cmd_latency_us);
+    fake_clock::duration tune = std::chrono::microseconds(soc.cfg.tune_latency_us);
+    const struct fake_reg_t *reg;
+    std::vector<uint8_t> rsp;
+
+    soc.stats.cmds++;
+
+    if (fake_is_set(opcode)) {
+        soc.regs[opcode].assign(params, params + len);
+        if (opcode == FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ,
+                                  HCI_OCF_FM_SET_RECV_CONF_REQ)
+                && len >= sizeof(struct hci_fm_recv_conf_req)) {
+            struct hci_fm_recv_conf_req conf;
+
+            memcpy(&conf, params, sizeof(conf));
+            soc.band_low = conf.band_low_limit;
+            soc.band_high = conf.band_high_limit;
+        }
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        return;
+    }
+
+    reg = fake_find_get(opcode);
+    if (reg) {
+        auto it = reg->set_opcode ? soc.regs.find(reg->set_opcode) : soc.regs.end();
+
+        if (it != soc.regs.end())
+            rsp = it->second;
+        rsp.resize(std::max(rsp.size(), (size_t)reg->len), 0);
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        return;
+    }
+
+    switch (opcode) {
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_ENABLE_RECV_REQ):
+        soc.rx_on = true;
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        fake_schedule(due + tune, FAKE_TAG_NONE, HCI_EV_TUNE_STATUS,
+                      fake_tune_status(true));
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_DISABLE_RECV_REQ):
+        soc.rx_on = false;
+        fake_cancel_search();
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_TUNE_STATION_REQ):
+        if (len >= sizeof(int))
+            soc.freq = params[0] | (params[1] << 8) | (params[2] << 16) | (params[3] << 24);
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        fake_schedule(due + tune, FAKE_TAG_NONE, HCI_EV_TUNE_STATUS,
+                      fake_tune_status(true));
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_STATION_PARAM_REQ):
+        rsp = fake_tune_status(false);
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SEARCH_STATIONS):
+        fake_cmd_status(due, opcode, 0);
+        fake_search(due, params, len, HCI_EV_SEARCH_COMPLETE);
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SEARCH_RDS_STATIONS):
+        fake_cmd_status(due, opcode, 0);
+        fake_search(due, params, len, HCI_EV_SEARCH_RDS_COMPLETE);
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_SEARCH_STATIONS_LIST):
+        fake_cmd_status(due, opcode, 0);
+        fake_search_list(due, params, len);
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_CANCEL_SEARCH):
+        fake_cancel_search();
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        fake_schedule(due + tune, FAKE_TAG_NONE, HCI_EV_SEARCH_COMPLETE, NULL, 0);
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_DEFAULT_DATA_WRITE):
+        if (len >= 2)
+            soc.def_data[params[0]].assign(params + 2,
+                                           params + std::min(len, (size_t)params[1] + 2));
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_DEFAULT_DATA_READ): {
+        uint8_t mode = len > 0 ? params[0] : 0;
+        uint8_t want = len > 1 ? params[1] : 0;
+        auto it = soc.def_data.find(mode);
+
+        if (it != soc.def_data.end())
+            rsp = it->second;
+        rsp.resize(std::max(rsp.size(), (size_t)want), 0);
+        if (rsp.size() > DEFAULT_DATA_SIZE)
+            rsp.resize(DEFAULT_DATA_SIZE);
+        rsp.insert(rsp.begin(), (uint8_t)rsp.size());
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    }
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_PROGRAM_SERVICE_REQ):
+        rsp = fake_rds_ps();
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_RADIO_TEXT_REQ):
+        rsp = fake_rds_rt();
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_RECV_CTRL_CMD_REQ, HCI_OCF_FM_GET_AF_LIST_REQ):
+        rsp = fake_af_list();
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_GET_FEATURE_LIST):
+        rsp.push_back(0x01);                /* feature_mask */
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_COMMON_CTRL_CMD_REQ, HCI_OCF_FM_DO_CALIBRATION):
+        rsp = fake_calibration(len > 0 ? params[0] : 0);
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    case FAKE_OPCODE(HCI_OGF_FM_DIAGNOSTIC_CMD_REQ, HCI_OCF_FM_PEEK_DATA): {
+        struct hci_fm_riva_data req = {};
+
+        memcpy(&req, params, std::min(len, sizeof(req)));
+        rsp.assign(std::min((uint8_t)req.length, (uint8_t)MAX_RIVA_PEEK_RSP_SIZE), 0);
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    }
+    case FAKE_OPCODE(HCI_OGF_FM_DIAGNOSTIC_CMD_REQ, HCI_FM_SET_GET_RESET_AGC):
+        /* struct hci_fm_set_get_reset_agc, read back as set */
+        rsp.assign(params, params + std::min(len, sizeof(struct hci_fm_set_get_reset_agc)));
+        rsp.resize(sizeof(struct hci_fm_set_get_reset_agc), 0);
+        fake_cmd_complete(due, opcode, 0, rsp.data(), rsp.size());
+        break;
+    default:
+        fake_cmd_complete(due, opcode, 0, NULL, 0);
+        break;
+    }
+}
+
+static void fake_worker()
+{
+    Lock lk(soc.mtx);
+
+    while (soc.running) {
+        if (soc.pending.empty()) {
+            soc.cond.wait(lk);
+            continue;
+        }
+
+        auto it = soc.pending.begin();
+        if (it->first.first > fake_clock::now()) {
+            soc.cond.wait_until(lk, it->first.first);
+            continue;
+        }
+
+        fake_pending_t p = std::move(it->second);
+        soc.pending.erase(it);
+        struct fm_fake_soc_callbacks_t cb = soc.cb;
+        lk.unlock();
+
+        /* deliver without the lock, fm_hci may send the next command
+         * from within the callback */
+        if (p.tag == FAKE_TAG_INIT) {
+            if (cb.initialization_complete)
+                cb.initialization_complete(1);
+        } else if (cb.hci_event_received) {
+            cb.hci_event_received(p.evt.data(), p.evt.size());
+        }
+
+        lk.lock();
+        if (p.tag != FAKE_TAG_INIT)
+            soc.stats.events++;
+    }
+}
+
+void fm_fake_soc_default_config(struct fm_fake_soc_config_t *cfg)
+{
+    if (!cfg)
+        return;
+    cfg->credits = 1;
+    cfg->init_delay_us = 1000;
+    cfg->cmd_latency_us = 200;
+    cfg->tune_latency_us = 5000;
+    cfg->rssi = 0xa0;
+    cfg->sinr = 20;
+}
+
+void fm_fake_soc_set_config(const struct fm_fake_soc_config_t *cfg)
+{
+    Lock lk(soc.mtx);
+
+    if (cfg) {
+        soc.cfg = *cfg;
+        if (soc.cfg.credits == 0)
+            soc.cfg.credits = 1;
+    }
+    soc.cfg_set = cfg != NULL;
+}
+
+int fm_fake_soc_initialize(const struct fm_fake_soc_callbacks_t *cb,
+                           const struct fm_fake_soc_config_t *cfg)
+{
+    static const uint32_t default_stations[] = { 88100, 91500, 95300, 101100, 106700 };
+
+    if (!cb)
+        return -EINVAL;
+
+    fm_fake_soc_close();
+
+    Lock lk(soc.mtx);
+    soc.cb = *cb;
+    if (cfg)
+        soc.cfg = *cfg;
+    else if (!soc.cfg_set)
+        fm_fake_soc_default_config(&soc.cfg);
+    if (soc.cfg.credits == 0)
+        soc.cfg.credits = 1;
+    memset(&soc.stats, 0, sizeof(soc.stats));
+    soc.regs.clear();
+    soc.def_data.clear();
+    if (soc.stations.empty())
+        soc.stations.assign(default_stations, default_stations
+                + sizeof(default_stations) / sizeof(default_stations[0]));
+    soc.band_low = 87500;
+    soc.band_high = 108000;
+    soc.freq = soc.band_low;
+    soc.rx_on = false;
+    soc.order = 0;
+
+    soc.running = true;
+    soc.worker = std::thread(fake_worker);
+    fake_schedule(fake_clock::now() + std::chrono::microseconds(soc.cfg.init_delay_us),
+                  FAKE_TAG_INIT, 0, NULL, 0);
+    ALOGI("%s: credits %d, cmd latency %u us", __func__, soc.cfg.credits,
+            soc.cfg.cmd_latency_us);
+    return 0;
+}
+
+int fm_fake_soc_send_cmd(const uint8_t *pkt, size_t len)
+{
+    const struct fm_command_header_t *hdr = (const struct fm_command_header_t *)pkt;
+
+    if (!pkt || len < sizeof(*hdr) || len < sizeof(*hdr) + hdr->len) {
+        ALOGE("%s: malformed command, len %zu", __func__, len);
+        return -EINVAL;
+    }
+
+    Lock lk(soc.mtx);
+    if (!soc.running)
+        return -ENODEV;
+    fake_handle_cmd(hdr->opcode, hdr->params, hdr->len);
+    return 0;
+}
+
+void fm_fake_soc_close(void)
+{
+    {
+        Lock lk(soc.mtx);
+        soc.running = false;
+        soc.pending.clear();
+        soc.cond.notify_all();
+    }
+    if (soc.worker.joinable()) {
+        if (soc.worker.get_id() == std::this_thread::get_id())
+            soc.worker.detach();
+        else
+            soc.worker.join();
+    }
+}
+
+int fm_fake_soc_set_stations(const uint32_t *freq_khz, int count)
+{
+    if ((!freq_khz && count) || count < 0 || count > FAKE_MAX_STATIONS)
+        return -EINVAL;
+
+    Lock lk(soc.mtx);
+    soc.stations.assign(freq_khz, freq_khz + count);
+    return 0;
+}
+
+int fm_fake_soc_replay(const struct fm_fake_soc_event_t *evts, int count,
+                       uint32_t rate_hz)
+{
+    fake_clock::time_point due;
+
+    if (!evts || count < 0)
+        return -EINVAL;
+
+    Lock lk(soc.mtx);
+    if (!soc.running)
+        return -ENODEV;
+
+    due = fake_clock::now();
+    for (int i = 0; i < count; i++) {
+        if (rate_hz)
+            due += std::chrono::microseconds(i ? 1000000 / rate_hz : 0);
+        else
+            due += std::chrono::microseconds(evts[i].delay_us);
+        fake_schedule(due, FAKE_TAG_NONE, evts[i].evt_code, evts[i].params, evts[i].len);
+    }
+    soc.stats.replayed += count;
+    return count;
+}
+
+int fm_fake_soc_replay_file(const char *path, uint32_t rate_hz)
+{
+    std::vector<std::vector<uint8_t> > params;
+    std::vector<struct fm_fake_soc_event_t> evts;
+    char line[1024];
+    FILE *fp;
+
+    if (!path)
+        return -EINVAL;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        ALOGE("%s: cannot open %s", __func__, path);
+        return -errno;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        struct fm_fake_soc_event_t evt;
+        char *p = strchr(line, '#'), *end;
+        unsigned long v;
+
+        if (p)
+            *p = '\0';
+        p = line;
+        v = strtoul(p, &end, 10);
+        if (end == p)
+            continue;
+        evt.delay_us = v;
+        p = end;
+        v = strtoul(p, &end, 16);
+        if (end == p || v > 0xff) {
+            ALOGE("%s: bad event code in %s", __func__, line);
+            continue;
+        }
+        evt.evt_code = v;
+
+        params.push_back(std::vector<uint8_t>());
+        for (p = end; ; p = end) {
+            v = strtoul(p, &end, 16);
+            if (end == p)
+                break;
+            params.back().push_back(v & 0xff);
+        }
+        evt.len = std::min(params.back().size(), (size_t)MAX_FM_EVT_PARAMS);
+        evts.push_back(evt);
+    }
+    fclose(fp);
+
+    /* params only stops reallocating once all lines are read */
+    for (size_t i = 0; i < evts.size(); i++)
+        evts[i].params = params[i].data();
+
+    return fm_fake_soc_replay(evts.data(), evts.size(), rate_hz);
+}
+
+void fm_fake_soc_get_stats(struct fm_fake_soc_stats_t *stats)
+{
+    if (!stats)
+        return;
+
+    Lock lk(soc.mtx);
+    *stats = soc.stats;
+    stats->pending = soc.pending.size();
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_FAKE_SOC__
+#define __FM_FAKE_SOC__
+
+/*
+ * Loopback stand-in for the FM SoC behind IFmHci.
+ *
+ * It takes the same packets fm_hci hands to IFmHci::sendHciCommand and
+ * answers through the same two callbacks IFmHciCallbacks has, from its own
+ * thread, so libfm-hci built with FM_HCI_FAKE_SOC runs unchanged on a
+ * build host. Every command is answered with a CC (or CS for searches)
+ * carrying the configured credit count; "get" commands return what the
+ * matching "set" stored, and tune/search/enable commands are followed by
+ * the tune status and search events a real SoC sends. RDS and other
+ * unsolicited events can be replayed from a script.
+ *
+ * Everything is deterministic: replies are ordered by due time and then by
+ * the order they were scheduled in.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*fm_fake_soc_init_cb_t)(int success);
+typedef void (*fm_fake_soc_event_cb_t)(const uint8_t *evt, size_t len);
+
+struct fm_fake_soc_callbacks_t {
+    fm_fake_soc_init_cb_t initialization_complete;
+    fm_fake_soc_event_cb_t hci_event_received;
+};
+
+struct fm_fake_soc_config_t {
+    uint8_t credits;            /* num_pkts reported in CC/CS */
+    uint32_t init_delay_us;     /* initialize() to initialization_complete */
+    uint32_t cmd_latency_us;    /* command to its CC/CS */
+    uint32_t tune_latency_us;   /* CC to the tune status that follows */
+    uint8_t rssi;
+    uint8_t sinr;
+};
+
+/* One scripted event; delay_us is relative to the previous one */
+struct fm_fake_soc_event_t {
+    uint32_t delay_us;
+    uint8_t evt_code;
+    uint8_t len;
+    const uint8_t *params;
+};
+
+struct fm_fake_soc_stats_t {
+    uint32_t cmds;
+    uint32_t cmd_completes;
+    uint32_t cmd_status;
+    uint32_t events;            /* all events delivered, CC/CS included */
+    uint32_t replayed;
+    uint32_t pending;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Defaults used when fm_fake_soc_initialize gets a NULL config */
+void fm_fake_soc_default_config(struct fm_fake_soc_config_t *cfg);
+
+/*
+ * Config used by fm_fake_soc_initialize when it gets a NULL config, e.g.
+ * from fm_hci; also applies to a running fake from its next command on.
+ */
+void fm_fake_soc_set_config(const struct fm_fake_soc_config_t *cfg);
+
+/* IFmHci::initialize; initialization_complete follows from the fake's thread */
+int fm_fake_soc_initialize(const struct fm_fake_soc_callbacks_t *cb,
+                           const struct fm_fake_soc_config_t *cfg);
+
+/* IFmHci::sendHciCommand, pkt is a struct fm_command_header_t */
+int fm_fake_soc_send_cmd(const uint8_t *pkt, size_t len);
+
+/* IFmHci::close, drops everything still pending */
+void fm_fake_soc_close(void);
+
+/* Frequencies in kHz that searches and tunes find a station on */
+int fm_fake_soc_set_stations(const uint32_t *freq_khz, int count);
+
+/*
+ * Queue scripted events. With rate_hz set they are spaced 1/rate_hz apart
+ * and delay_us is ignored.
+ */
+int fm_fake_soc_replay(const struct fm_fake_soc_event_t *evts, int count,
+                       uint32_t rate_hz);
+
+/*
+ * Queue events from a text script, one per line:
+ *     <delay_us> <evt_code> [param bytes...]
+ * all numbers in hex except delay_us; '#' starts a comment.
+ * Returns the number of events queued or a negative errno.
+ */
+int fm_fake_soc_replay_file(const char *path, uint32_t rate_hz);
+
+void fm_fake_soc_get_stats(struct fm_fake_soc_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,14 +41,21 @@
 #include <condition_variable> // std::condition_variable
 #include <cstdlib>
 #include <thread>
+#include <chrono>
 
 #include <utils/Log.h>
 #include <unistd.h>
 
+#include "fm_hci.h"
+#include "fm_log.h"
+#include "fm_snoop.h"
+
+#ifdef FM_HCI_FAKE_SOC
+#include "fm_fake_soc.h"
+#else
 #include <vendor/qti/hardware/fm/1.0/IFmHci.h>
 #include <vendor/qti/hardware/fm/1.0/IFmHciCallbacks.h>
 #include <vendor/qti/hardware/fm/1.0/types.h>
-#include "fm_hci.h"
 
 #include <hwbinder/ProcessState.h>
 
@@ -60,15 +67,21 @@ using android::hardware::ProcessState;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
 using ::android::hardware::hidl_vec;
+#endif
 
 static struct fm_hci_t hci;
 
 typedef std::unique_lock<std::mutex> Lock;
+#ifndef FM_HCI_FAKE_SOC
 android::sp<IFmHci> fmHci;
+#endif
 
 static int enqueue_fm_rx_event(struct fm_event_header_t *hdr);
+static struct fm_hci_cmd_wait_t *find_cmd_wait(uint32_t token);
+static struct fm_hci_cmd_wait_t *claim_cmd_wait(uint32_t seq);
+static void release_cmd_wait(struct fm_hci_cmd_wait_t *wait);
 static void dequeue_fm_rx_event();
-static int enqueue_fm_tx_cmd(struct fm_command_header_t *hdr);
+static int enqueue_fm_tx_cmd(struct fm_command_header_t *hdr, uint32_t *token);
 static void dequeue_fm_tx_cmd();
 static void  hci_tx_thread();
 static void hci_rx_thread();
@@ -97,19 +110,215 @@ static void hci_close();
 static int enqueue_fm_rx_event(struct fm_event_header_t *hdr)
 {
 
-    hci.rx_queue_mtx.lock();
-    hci.rx_event_queue.push(hdr);
-    hci.rx_queue_mtx.unlock();
+    if (hci.queue_mode == FM_HCI_QUEUE_RING) {
+        /* CC/CS events carry command credits and must not be lost, so a
+         * full ring back-pressures the hidl callback until rx catches up */
+        while (!hci.rx_ring.push(hdr)) {
+            if (hci.state == FM_RADIO_DISABLING || hci.state == FM_RADIO_DISABLED) {
+                ALOGE("%s: rx ring full while closing, dropping evt 0x%x",
+                        __func__, hdr->evt_code);
+                hci.rx_ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                hci.evt_pool.discard(hdr);
+                return FM_HC_STATUS_BUSY;
+            }
+            std::this_thread::yield();
+        }
+    } else {
+        hci.rx_queue_mtx.lock();
+        hci.rx_event_queue.push(hdr);
+        hci.rx_queue_mtx.unlock();
+    }
 
     if (hci.is_rx_processing == false) {
+        Lock lk(hci.rx_cond_mtx);
         hci.rx_cond.notify_all();
     }
 
-    ALOGI("%s: FM-Event ENQUEUED SUCCESSFULLY", __func__);
 
     return FM_HC_STATUS_SUCCESS;
 }
 
+/*******************************************************************************
+**
+** Function         fetch_fm_rx_event
+**
+** Description      This function is called in the rx thread context to take
+**                  the next FM event from the RX queue or RX ring.
+**
+** Parameters:      void
+**
+**
+** Returns          fm_event_header_t *, NULL when no event is pending
+**
+*******************************************************************************/
+static struct fm_event_header_t *fetch_fm_rx_event()
+{
+    struct fm_event_header_t *evt_buf = NULL;
+
+    if (hci.queue_mode == FM_HCI_QUEUE_RING) {
+        evt_buf = hci.rx_ring.pop();
+        if (evt_buf == NULL) {
+            hci.is_rx_processing = false;
+            /* recheck after publishing the flag, an enqueue may have
+             * seen is_rx_processing still set and skipped the notify */
+            if (!hci.rx_ring.empty()) {
+                hci.is_rx_processing = true;
+                evt_buf = hci.rx_ring.pop();
+            }
+        } else {
+            hci.is_rx_processing = true;
+        }
+        return evt_buf;
+    }
+
+    hci.rx_queue_mtx.lock();
+    if (hci.rx_event_queue.empty()) {
+        hci.is_rx_processing = false;
+    } else {
+        hci.is_rx_processing = true;
+        evt_buf = hci.rx_event_queue.front();
+        hci.rx_event_queue.pop();
+    }
+    hci.rx_queue_mtx.unlock();
+
+    return evt_buf;
+}
+
+/*******************************************************************************
+**
+** Function         find_cmd_wait
+**
+** Description      This function is called with cmd_wait_mtx held to look up
+**                  the completion record of a token, 0 looks up a free one.
+**
+** Parameters:      token - completion token
+**
+**
+** Returns          fm_hci_cmd_wait_t *, NULL when there is none
+**
+*******************************************************************************/
+static struct fm_hci_cmd_wait_t *find_cmd_wait(uint32_t token)
+{
+    struct fm_hci_cmd_wait_t *wait;
+    int i;
+
+    for (i = 0; i < FM_HCI_CMD_WAITS; i++) {
+        wait = &hci.cmd_waits[(token + i) & (FM_HCI_CMD_WAITS - 1)];
+        if (wait->token == token)
+            return wait;
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function         claim_cmd_wait
+**
+** Description      This function is called by the tx producers, before the
+**                  command with sequence number seq is queued, to set aside
+**                  the record its completion is kept in until it is read.
+**
+** Parameters:      seq - sequence number, i.e. token, of the command
+**
+**
+** Returns          fm_hci_cmd_wait_t *, NULL when all records are unread
+**
+*******************************************************************************/
+static struct fm_hci_cmd_wait_t *claim_cmd_wait(uint32_t seq)
+{
+    struct fm_hci_cmd_wait_t *wait = NULL;
+    int i;
+
+    hci.cmd_wait_mtx.lock();
+    for (i = 0; i < FM_HCI_CMD_WAITS; i++) {
+        if (hci.cmd_waits[(seq + i) & (FM_HCI_CMD_WAITS - 1)].token == 0) {
+            wait = &hci.cmd_waits[(seq + i) & (FM_HCI_CMD_WAITS - 1)];
+            wait->token = seq;
+            wait->done = false;
+            wait->status = 0;
+            break;
+        }
+    }
+    hci.cmd_wait_mtx.unlock();
+    return wait;
+}
+
+static void release_cmd_wait(struct fm_hci_cmd_wait_t *wait)
+{
+    hci.cmd_wait_mtx.lock();
+    wait->token = 0;
+    hci.cmd_wait_mtx.unlock();
+}
+
+static uint64_t fm_hci_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*******************************************************************************
+**
+** Function         complete_fm_cmd
+**
+** Description      This function is called in the rx thread context, with
+**                  credit_mtx held, to match a CC/CS event to the oldest
+**                  in-flight command with the same opcode & wake its waiters.
+**                  A CC that follows the CS of its command matches that
+**                  command again, for its latency only.
+**
+** Parameters:      opcode - opcode carried by the CC/CS event
+**                  status - controller status of the command
+**                  cc - true for a CC, false for a CS
+**
+**
+** Returns          void
+**
+*******************************************************************************/
+static void complete_fm_cmd(uint16_t opcode, uint8_t status, bool cc)
+{
+    struct fm_hci_cmd_slot_t *match = NULL, *acked = NULL;
+    struct fm_hci_cmd_wait_t *wait;
+    int i;
+
+    for (i = 0; i < FM_HCI_CMD_SLOTS; i++) {
+        struct fm_hci_cmd_slot_t *slot = &hci.cmd_slots[i];
+
+        if (slot->seq == 0 || slot->opcode != opcode)
+            continue;
+        if (slot->done) {
+            if (cc && slot->cs
+                    && (acked == NULL || (int32_t)(slot->seq - acked->seq) < 0))
+                acked = slot;
+            continue;
+        }
+        if (match == NULL || (int32_t)(slot->seq - match->seq) < 0)
+            match = slot;
+    }
+
+    if (match == NULL && acked != NULL) {
+        acked->cs = false;
+        hci.rx_cmd_latency_ns = fm_hci_now_ns() - acked->sent_ns;
+        return;
+    }
+    if (match == NULL) {
+        ALOGV("%s: no in-flight command for opcode 0x%x", __func__, opcode);
+        return;
+    }
+    match->done = true;
+    match->cs = !cc;
+    match->status = status;
+    hci.rx_cmd_latency_ns = fm_hci_now_ns() - match->sent_ns;
+
+    hci.cmd_wait_mtx.lock();
+    wait = find_cmd_wait(match->seq);
+    if (wait) {
+        wait->done = true;
+        wait->status = status;
+        hci.cmd_done_cond.notify_all();
+    }
+    hci.cmd_wait_mtx.unlock();
+}
+
 /*******************************************************************************
 **
 ** Function         dequeue_fm_rx_event
@@ -127,44 +336,40 @@ static void dequeue_fm_rx_event()
 {
     fm_event_header_t *evt_buf;
 
-    ALOGI("%s", __func__);
     while (1) {
-        hci.rx_queue_mtx.lock();
-        if (hci.rx_event_queue.empty()) {
-            ALOGI("No more FM Events are available in the RX Queue");
-            hci.is_rx_processing = false;
-            hci.rx_queue_mtx.unlock();
+        evt_buf = fetch_fm_rx_event();
+        if (evt_buf == NULL) {
+            FM_LOGV("No more FM Events are available in the RX Queue");
             return;
-        } else {
-            hci.is_rx_processing = true;
         }
 
-        evt_buf = hci.rx_event_queue.front();
-        hci.rx_event_queue.pop();
-        hci.rx_queue_mtx.unlock();
-
         hci.credit_mtx.lock();
+        hci.rx_cmd_latency_ns = 0;
+        /* num_hci_cmd_pkts is the number of commands the SoC can accept
+         * now, not an increment */
         if (evt_buf->evt_code == FM_CMD_COMPLETE) {
-            ALOGI("%s: %d Credits got from the SOC", __func__, evt_buf->params[0]);
-            hci.command_credits += evt_buf->params[0];
+            FM_TRACE(FM_TRACE_CREDITS, evt_buf->evt_code, evt_buf->params[0]);
+            hci.command_credits = evt_buf->params[0];
             hci.cmd_credits_cond.notify_all();
+            complete_fm_cmd(evt_buf->params[1] | (evt_buf->params[2] << 8),
+                    evt_buf->evt_len > 3 ? evt_buf->params[3] : 0, true);
         } else if (evt_buf->evt_code == FM_CMD_STATUS) {
-            ALOGI("%s: %d Credits got from the SOC", __func__, evt_buf->params[1]);
-            hci.command_credits += evt_buf->params[1];
+            FM_TRACE(FM_TRACE_CREDITS, evt_buf->evt_code, evt_buf->params[1]);
+            hci.command_credits = evt_buf->params[1];
             hci.cmd_credits_cond.notify_all();
+            complete_fm_cmd(evt_buf->params[2] | (evt_buf->params[3] << 8),
+                    evt_buf->params[0], false);
         } else if (evt_buf->evt_code == FM_HW_ERR_EVENT) {
             ALOGI("%s: FM H/w Err Event Recvd. Event Code: 0x%x", __func__, evt_buf->evt_code);
-        } else {
-            ALOGE("%s: Not CS/CC Event: Recvd. Event Code: 0x%x", __func__, evt_buf->evt_code);
         }
 
         hci.credit_mtx.unlock();
         if (hci.cb && hci.cb->process_event) {
-            ALOGI("%s: processing the event", __func__);
+            FM_TRACE(FM_TRACE_RX_DISPATCH, evt_buf->evt_code, evt_buf->evt_len);
             hci.cb->process_event(NULL, (uint8_t *)evt_buf);
         }
 
-        free(evt_buf);
+        hci.evt_pool.put(evt_buf);
         evt_buf = NULL;
     }
 
@@ -183,23 +388,112 @@ static void dequeue_fm_rx_event()
 ** Returns          int
 **
 *******************************************************************************/
-static int enqueue_fm_tx_cmd(struct fm_command_header_t *hdr)
+static int enqueue_fm_tx_cmd(struct fm_command_header_t *hdr, uint32_t *token)
 {
-    ALOGI("%s:  opcode 0x%x len:%d", __func__,  hdr->opcode, hdr->len);
+    struct fm_hci_cmd_wait_t *wait = NULL;
+    uint32_t seq;
+
+    FM_TRACE(FM_TRACE_TX_ENQUEUE, hdr->opcode, hdr->len);
+
+    /* commands leave the queue in push order, so the tx thread can
+     * recover each command's sequence number by counting */
+    if (hci.queue_mode == FM_HCI_QUEUE_RING) {
+        bool queued = false;
+
+        hci.tx_producer_mtx.lock();
+        seq = hci.tx_seq_next + 1;
+        if (token)
+            wait = claim_cmd_wait(seq);
+        if (!token || wait)
+            queued = hci.tx_ring.push(hdr);
+        if (queued)
+            hci.tx_seq_next = seq;
+        else if (wait)
+            release_cmd_wait(wait);
+        hci.tx_producer_mtx.unlock();
+        if (!queued) {
+            if (token && !wait)
+                ALOGE("%s: %d tokens unread, rejecting opcode 0x%x", __func__,
+                        FM_HCI_CMD_WAITS, hdr->opcode);
+            else
+                ALOGE("%s: tx ring full, rejecting opcode 0x%x", __func__, hdr->opcode);
+            hci.tx_ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            free(hdr);
+            return FM_HC_STATUS_BUSY;
+        }
+    } else {
+        hci.tx_queue_mtx.lock();
+        seq = hci.tx_seq_next + 1;
+        if (token)
+            wait = claim_cmd_wait(seq);
+        if (!token || wait) {
+            hci.tx_seq_next = seq;
+            hci.tx_cmd_queue.push(hdr);
+        }
+        hci.tx_queue_mtx.unlock();
+        if (token && !wait) {
+            ALOGE("%s: %d tokens unread, rejecting opcode 0x%x", __func__,
+                    FM_HCI_CMD_WAITS, hdr->opcode);
+            free(hdr);
+            return FM_HC_STATUS_BUSY;
+        }
+    }
 
-    hci.tx_queue_mtx.lock();
-    hci.tx_cmd_queue.push(hdr);
-    hci.tx_queue_mtx.unlock();
+    if (token)
+        *token = seq;
 
     if (hci.is_tx_processing == false) {
+        Lock lk(hci.tx_cond_mtx);
         hci.tx_cond.notify_all();
     }
 
-    ALOGI("%s: FM-CMD ENQUEUED SUCCESSFULLY", __func__);
-
     return FM_HC_STATUS_SUCCESS;
 }
 
+/*******************************************************************************
+**
+** Function         fetch_fm_tx_cmd
+**
+** Description      This function is called in the tx thread context to take
+**                  the next FM command from the TX queue or TX ring.
+**
+** Parameters:      void
+**
+**
+** Returns          fm_command_header_t *, NULL when no command is pending
+**
+*******************************************************************************/
+static struct fm_command_header_t *fetch_fm_tx_cmd()
+{
+    struct fm_command_header_t *hdr = NULL;
+
+    if (hci.queue_mode == FM_HCI_QUEUE_RING) {
+        hdr = hci.tx_ring.pop();
+        if (hdr == NULL) {
+            hci.is_tx_processing = false;
+            if (!hci.tx_ring.empty()) {
+                hci.is_tx_processing = true;
+                hdr = hci.tx_ring.pop();
+            }
+        } else {
+            hci.is_tx_processing = true;
+        }
+        return hdr;
+    }
+
+    hci.tx_queue_mtx.lock();
+    if (hci.tx_cmd_queue.empty()) {
+        hci.is_tx_processing = false;
+    } else {
+        hci.is_tx_processing = true;
+        hdr = hci.tx_cmd_queue.front();
+        hci.tx_cmd_queue.pop();
+    }
+    hci.tx_queue_mtx.unlock();
+
+    return hdr;
+}
+
 /*******************************************************************************
 **
 ** Function         dequeue_fm_tx_cmd
@@ -215,36 +509,58 @@ static int enqueue_fm_tx_cmd(struct fm_command_header_t *hdr)
 *******************************************************************************/
 static void dequeue_fm_tx_cmd()
 {
+    struct fm_command_header_t *burst[FM_HCI_TX_BURST];
     fm_command_header_t *hdr;
-
-    ALOGI("%s", __func__);
+    uint64_t now_ns;
+    int cnt, i;
 
     while (1) {
-        hci.tx_queue_mtx.lock();
-        if(hci.tx_cmd_queue.empty()){
-            ALOGI("No more FM CMDs are available in the Queue");
-            hci.is_tx_processing = false;
-            hci.tx_queue_mtx.unlock();
+        hdr = fetch_fm_tx_cmd();
+        if (hdr == NULL) {
+            FM_LOGV("No more FM CMDs are available in the Queue");
             return;
-        } else {
-            hci.is_tx_processing = true;
         }
 
-        hdr = hci.tx_cmd_queue.front();
-        hci.tx_cmd_queue.pop();
-        hci.tx_queue_mtx.unlock();
-
         Lock lk(hci.credit_mtx);
         while (hci.command_credits == 0) {
-            ALOGI("%s: waiting for credits", __func__);
+            FM_TRACE(FM_TRACE_TX_CREDIT_WAIT, hdr->opcode, hci.command_credits);
             hci.cmd_credits_cond.wait(lk);
-            ALOGI("%s: %d Credits Remaining", __func__, hci.command_credits);
+            FM_LOGD("%s: %d Credits Remaining", __func__, hci.command_credits);
             if (hci.command_credits) {
                  break;
             }
         }
-        hci.command_credits--;
-        hci_transmit(hdr);
+
+        /* keep pulling queued commands while the SoC has credits left,
+         * so they go out back to back without a CC round trip each. Only
+         * the dequeue & credit accounting are batched: sendHciCommand
+         * carries one packet, so each command is still its own call */
+        burst[0] = hdr;
+        cnt = 1;
+        while (cnt < hci.command_credits && cnt < FM_HCI_TX_BURST
+                && (hdr = fetch_fm_tx_cmd()) != NULL)
+            burst[cnt++] = hdr;
+        hci.command_credits -= cnt;
+
+        now_ns = fm_hci_now_ns();
+        for (i = 0; i < cnt; i++) {
+            uint32_t seq = ++hci.tx_seq_sent;
+            struct fm_hci_cmd_slot_t *slot = &hci.cmd_slots[seq & (FM_HCI_CMD_SLOTS - 1)];
+
+            slot->seq = seq;
+            slot->opcode = burst[i]->opcode;
+            slot->done = false;
+            slot->cs = false;
+            slot->status = 0;
+            slot->sent_ns = now_ns;
+        }
+        lk.unlock();
+
+        FM_LOGV("%s: sending %d cmds", __func__, cnt);
+        for (i = 0; i < cnt; i++) {
+            fm_snoop_capture(FM_SNOOP_CMD, (const uint8_t *)burst[i], 3 + burst[i]->len);
+            hci_transmit(burst[i]);
+        }
     }
 }
 
@@ -264,13 +580,25 @@ static void dequeue_fm_tx_cmd()
 static void  hci_tx_thread()
 {
     ALOGI("%s: ##### starting hci_tx_thread Worker thread!!! #####", __func__);
-    hci.is_tx_thread_running = true;
+    {
+        Lock lk(hci.on_mtx);
+        hci.is_tx_thread_running = true;
+        hci.on_cond.notify_all();
+    }
 
     while (hci.state != FM_RADIO_DISABLING && hci.state != FM_RADIO_DISABLED) {
         //wait  for tx cmd
         Lock lk(hci.tx_cond_mtx);
-        hci.tx_cond.wait(lk);
-        ALOGV("%s: dequeueing the tx cmd!!!" , __func__);
+        if (hci.queue_mode == FM_HCI_QUEUE_RING) {
+            hci.tx_cond.wait(lk, [] {
+                return !hci.tx_ring.empty() || hci.state == FM_RADIO_DISABLING
+                        || hci.state == FM_RADIO_DISABLED;
+            });
+            lk.unlock();
+        } else {
+            hci.tx_cond.wait(lk);
+        }
+        FM_LOGV("%s: dequeueing the tx cmd!!!" , __func__);
         dequeue_fm_tx_cmd();
     }
 
@@ -294,12 +622,24 @@ static void hci_rx_thread()
 {
 
     ALOGI("%s: ##### starting hci_rx_thread Worker thread!!! #####", __func__);
-    hci.is_rx_thread_running = true;
+    {
+        Lock lk(hci.on_mtx);
+        hci.is_rx_thread_running = true;
+        hci.on_cond.notify_all();
+    }
 
     while (hci.state != FM_RADIO_DISABLING && hci.state != FM_RADIO_DISABLED) {
         //wait for rx event
         Lock lk(hci.rx_cond_mtx);
-        hci.rx_cond.wait(lk);
+        if (hci.queue_mode == FM_HCI_QUEUE_RING) {
+            hci.rx_cond.wait(lk, [] {
+                return !hci.rx_ring.empty() || hci.state == FM_RADIO_DISABLING
+                        || hci.state == FM_RADIO_DISABLED;
+            });
+            lk.unlock();
+        } else {
+            hci.rx_cond.wait(lk);
+        }
         dequeue_fm_rx_event();
     }
 
@@ -346,14 +686,14 @@ static int start_tx_thread()
 *******************************************************************************/
 static void stop_tx_thread()
 {
-    int ret;
-
     ALOGI("%s:stop_tx_thread ++", __func__);
     if (hci.is_tx_processing == false) {
+        Lock lk(hci.tx_cond_mtx);
         hci.tx_cond.notify_all();
     }
 
-    hci.tx_thread_.join();
+    if (hci.tx_thread_.joinable())
+        hci.tx_thread_.join();
     ALOGI("%s:stop_tx_thread --", __func__);
 }
 
@@ -399,10 +739,12 @@ static void stop_rx_thread()
 {
     ALOGI("%s:stop_rx_thread ++", __func__);
     if (hci.is_rx_processing == false) {
+        Lock lk(hci.rx_cond_mtx);
         hci.rx_cond.notify_all();
     }
 
-    hci.rx_thread_.join();
+    if (hci.rx_thread_.joinable())
+        hci.rx_thread_.join();
     ALOGI("%s:stop_rx_thread --", __func__);
 }
 
@@ -424,6 +766,53 @@ static void cleanup_threads()
     stop_tx_thread();
 }
 
+/*******************************************************************************
+**
+** Function         drain_queues
+**
+** Description      This function is called from fm_hci_close, once the tx
+**                  thread is gone & on or after the rx thread, to free the
+**                  commands & events nobody will dequeue anymore.
+**
+** Parameters:      void
+**
+**
+** Returns          void
+**
+*******************************************************************************/
+static void drain_queues()
+{
+    struct fm_command_header_t *hdr;
+    struct fm_event_header_t *evt;
+    int cmds = 0, evts = 0;
+
+    while ((hdr = hci.tx_ring.pop()) != NULL) {
+        free(hdr);
+        cmds++;
+    }
+    while ((evt = hci.rx_ring.pop()) != NULL) {
+        hci.evt_pool.put(evt);
+        evts++;
+    }
+
+    hci.tx_queue_mtx.lock();
+    for (; !hci.tx_cmd_queue.empty(); cmds++) {
+        free(hci.tx_cmd_queue.front());
+        hci.tx_cmd_queue.pop();
+    }
+    hci.tx_queue_mtx.unlock();
+
+    hci.rx_queue_mtx.lock();
+    for (; !hci.rx_event_queue.empty(); evts++) {
+        hci.evt_pool.put(hci.rx_event_queue.front());
+        hci.rx_event_queue.pop();
+    }
+    hci.rx_queue_mtx.unlock();
+
+    if (cmds || evts)
+        ALOGI("%s: dropped %d commands & %d events", __func__, cmds, evts);
+}
+
 /*******************************************************************************
 **
 ** Function         initialization_complete
@@ -440,34 +829,117 @@ static void cleanup_threads()
 static void initialization_complete(bool is_hci_initialize)
 {
     int ret;
+    fm_power_state_t state = FM_RADIO_DISABLING;
     ALOGI("++%s: is_hci_initialize: %d", __func__, is_hci_initialize);
 
     while (is_hci_initialize) {
         ret = start_tx_thread();
         if (ret)
-        {
-            cleanup_threads();
-            hci.state = FM_RADIO_DISABLING;
             break;
-        }
 
         ret = start_rx_thread();
         if (ret)
-        {
-            cleanup_threads();
-            hci.state = FM_RADIO_DISABLING;
             break;
-        }
 
-        hci.state = FM_RADIO_ENABLED;
+        state = FM_RADIO_ENABLED;
         break;
     }
 
-    hci.on_cond.notify_all();
+    {
+        Lock lk(hci.on_mtx);
+        if (hci.state == FM_RADIO_ENABLING) {
+            hci.state = state;
+        } else {
+            /* fm_hci_init already gave up waiting for us */
+            ALOGE("%s: late initialization complete, state: %d", __func__, hci.state);
+            state = FM_RADIO_DISABLING;
+        }
+        hci.on_cond.notify_all();
+    }
+
+    /* state is DISABLING/DISABLED here, so started threads will exit */
+    if (state != FM_RADIO_ENABLED && is_hci_initialize)
+        cleanup_threads();
     ALOGI("--%s: is_hci_initialize: %d", __func__, is_hci_initialize);
 
 }
 
+/*******************************************************************************
+**
+** Function         hci_event_received
+**
+** Description      This function is called by the transport for every event
+**                  from the SoC, & queues a copy of it for the rx thread.
+**
+** Parameters:      data - raw event, starting with struct fm_event_header_t
+**                  len - length of data
+**
+** Returns          void
+**
+*******************************************************************************/
+static void hci_event_received(const uint8_t *data, size_t len)
+{
+    struct fm_event_header_t *temp;
+
+    fm_snoop_capture(FM_SNOOP_EVT, data, len);
+    temp = hci.evt_pool.get(len);
+    if(temp) {
+        memcpy(temp, data, len);
+        FM_TRACE(FM_TRACE_RX_EVENT, temp->evt_code, temp->evt_len);
+        enqueue_fm_rx_event(temp);
+    }
+    else {
+        ALOGE("%s: Memory Allocation failed for event buffer ",__func__);
+    }
+}
+
+#ifdef FM_HCI_FAKE_SOC
+/*******************************************************************************
+**
+** Function         hci_initialize
+**
+** Description      This function is used to initialize the loopback fake SoC
+**                  transport, in place of the fm hci hidl transport.
+**
+** Parameters:      void
+**
+**
+** Returns          bool
+**
+*******************************************************************************/
+static bool hci_initialize()
+{
+    struct fm_fake_soc_callbacks_t callbacks;
+
+    ALOGI("%s: using fake SoC", __func__);
+
+    callbacks.initialization_complete = [](int success) {
+        initialization_complete(success != 0);
+    };
+    callbacks.hci_event_received = hci_event_received;
+
+    hci.state = FM_RADIO_ENABLING;
+    if (fm_fake_soc_initialize(&callbacks, NULL)) {
+        hci.state = FM_RADIO_DISABLED;
+        return false;
+    }
+    return true;
+}
+
+static void hci_transmit(struct fm_command_header_t *hdr) {
+    FM_TRACE(FM_TRACE_TX_SEND, hdr->opcode, hdr->len);
+
+    fm_fake_soc_send_cmd((const uint8_t *)hdr, 3 + hdr->len);
+    free(hdr);
+}
+
+static void hci_close()
+{
+    ALOGI("%s", __func__);
+
+    fm_fake_soc_close();
+}
+#else
 /*******************************************************************************
 **
 ** Class            FmHciCallbacks
@@ -499,15 +971,7 @@ class FmHciCallbacks : public IFmHciCallbacks {
         }
 
         Return<void> hciEventReceived(const hidl_vec<uint8_t>& event) {
-            struct fm_event_header_t *temp = (struct fm_event_header_t *) malloc(event.size());
-            if(temp) {
-                memcpy(temp, event.data(), event.size());
-                ALOGI("%s: evt_code:  0x%x", __func__, temp->evt_code);
-                enqueue_fm_rx_event(temp);
-            }
-            else {
-                ALOGE("%s: Memory Allocation failed for event buffer ",__func__);
-            }
+            hci_event_received(event.data(), event.size());
             return Void();
         }
 };
@@ -557,7 +1021,7 @@ static bool hci_initialize()
 static void hci_transmit(struct fm_command_header_t *hdr) {
     HciPacket data;
 
-    ALOGI("%s: opcode 0x%x len:%d", __func__, hdr->opcode, hdr->len);
+    FM_TRACE(FM_TRACE_TX_SEND, hdr->opcode, hdr->len);
 
     if (fmHci != nullptr) {
         data.setToExternal((uint8_t *)hdr, 3 + hdr->len);
@@ -591,6 +1055,13 @@ static void hci_close()
         fmHci = nullptr;
     }
 }
+#endif
+
+static uint32_t elapsed_us(std::chrono::steady_clock::time_point from,
+                           std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
 
 /*******************************************************************************
 **
@@ -607,6 +1078,7 @@ static void hci_close()
 int fm_hci_init(fm_hci_hal_t *hci_hal)
 {
     int ret = FM_HC_STATUS_FAIL;
+    std::chrono::steady_clock::time_point start, mark;
 
     ALOGD("++%s", __func__);
 
@@ -615,35 +1087,52 @@ int fm_hci_init(fm_hci_hal_t *hci_hal)
         return FM_HC_STATUS_NULL_POINTER;
     }
 
-    memset(&hci, 0, sizeof(struct fm_hci_t));
+    hci.reset();
+    fm_log_init();
+    fm_snoop_init();
 
     hci.cb = hci_hal->cb;
+    hci.queue_mode = hci_hal->queue_mode;
     hci.command_credits = 1;
-    hci.is_tx_processing = false;
-    hci.is_rx_processing = false;
-    hci.is_tx_thread_running = false;
-    hci.is_rx_thread_running = false;
-    hci.state = FM_RADIO_DISABLED;
     hci_hal->hci = &hci;
 
+    start = std::chrono::steady_clock::now();
     if (hci_initialize()) {
+        mark = std::chrono::steady_clock::now();
+        hci.power_on.get_service_us = elapsed_us(start, mark);
+
         //wait for iniialization complete
         ALOGD("--%s waiting for iniialization complete hci state: %d ",
                 __func__, hci.state);
-        if(hci.state == FM_RADIO_ENABLING){
-            Lock lk(hci.on_mtx);
-            hci.on_cond.wait(lk);
+        Lock lk(hci.on_mtx);
+        if (!hci.on_cond.wait_for(lk, std::chrono::milliseconds(FM_HCI_INIT_TIMEOUT_MS),
+                [] { return hci.state != FM_RADIO_ENABLING; })) {
+            ALOGE("%s: no initialization complete in %d ms", __func__,
+                    FM_HCI_INIT_TIMEOUT_MS);
+            hci.power_on.timed_out = 1;
+            hci.state = FM_RADIO_DISABLING;
         }
+        hci.power_on.initialize_us = elapsed_us(mark, std::chrono::steady_clock::now());
+        mark = std::chrono::steady_clock::now();
+
+        if (hci.state == FM_RADIO_ENABLED
+                && !hci.on_cond.wait_for(lk,
+                    std::chrono::milliseconds(FM_HCI_THREAD_START_TIMEOUT_MS), [] {
+                        return hci.is_tx_thread_running && hci.is_rx_thread_running;
+                    })) {
+            ALOGE("%s: worker threads did not start in %d ms", __func__,
+                    FM_HCI_THREAD_START_TIMEOUT_MS);
+            hci.power_on.timed_out = 1;
+            hci.state = FM_RADIO_DISABLING;
+            lk.unlock();
+            cleanup_threads();
+            lk.lock();
+        }
+        hci.power_on.threads_us = elapsed_us(mark, std::chrono::steady_clock::now());
     }
+    hci.power_on.total_us = elapsed_us(start, std::chrono::steady_clock::now());
 
     if (hci.state == FM_RADIO_ENABLED) {
-        while (hci.is_tx_thread_running == false
-            || hci.is_rx_thread_running == false)
-        {
-            /* checking tx & rx thread running status after every
-               5ms before notifying on to upper layer */
-            usleep(5000);
-        }
         ALOGD("--%s success", __func__);
         ret = FM_HC_STATUS_SUCCESS;
     } else {
@@ -651,6 +1140,9 @@ int fm_hci_init(fm_hci_hal_t *hci_hal)
        hci_close();
        hci.state = FM_RADIO_DISABLED;
     }
+    ALOGI("%s: power on took %u us (service %u, initialize %u, threads %u)",
+            __func__, hci.power_on.total_us, hci.power_on.get_service_us,
+            hci.power_on.initialize_us, hci.power_on.threads_us);
     return ret;
 }
 
@@ -674,7 +1166,107 @@ int fm_hci_transmit(void *p_hci, struct fm_command_header_t *hdr)
         return FM_HC_STATUS_NULL_POINTER;
     }
 
-    return enqueue_fm_tx_cmd(hdr);
+    return enqueue_fm_tx_cmd(hdr, NULL);
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_transmit_cmd
+**
+** Description      This function is called by helium hal to enqueue a tx
+**                  command & get a token to wait for its completion.
+**
+** Parameters:      p_hci - contains the fm helium hal hci pointer
+**                  hdr - contains the fm command header pointer
+**                  token - filled with the command completion token
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_transmit_cmd(void *p_hci, struct fm_command_header_t *hdr,
+                        uint32_t *token)
+{
+    if (!hdr || !token) {
+        ALOGE("NULL input arguments");
+        return FM_HC_STATUS_NULL_POINTER;
+    }
+
+    return enqueue_fm_tx_cmd(hdr, token);
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_wait_cmd
+**
+** Description      This function blocks the caller until the command with
+**                  the given token is completed by a CC/CS event.
+**
+** Parameters:      p_hci - contains the fm helium hal hci pointer
+**                  token - completion token from fm_hci_transmit_cmd
+**                  timeout_ms - maximum time to wait
+**                  cmd_status - filled with the controller status byte
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_wait_cmd(void *p_hci, uint32_t token, uint32_t timeout_ms,
+                    uint8_t *cmd_status)
+{
+    struct fm_hci_cmd_wait_t *wait;
+    int ret = FM_HC_STATUS_NOT_READY;
+
+    if (token == 0)
+        return FM_HC_STATUS_FAIL;
+
+    Lock lk(hci.cmd_wait_mtx);
+    wait = find_cmd_wait(token);
+    if (wait == NULL) {
+        ALOGE("%s: token %u is not outstanding", __func__, token);
+        return FM_HC_STATUS_FAIL;
+    }
+    hci.cmd_done_cond.wait_for(lk, std::chrono::milliseconds(timeout_ms), [&] {
+        return wait->done
+                || hci.state == FM_RADIO_DISABLING || hci.state == FM_RADIO_DISABLED;
+    });
+
+    /* the record stays claimed after a timeout, for the caller to wait
+     * again or to drop it with fm_hci_release_cmd */
+    if (wait->done) {
+        if (cmd_status)
+            *cmd_status = wait->status;
+        wait->token = 0;
+        ret = FM_HC_STATUS_SUCCESS;
+    } else if (hci.state == FM_RADIO_DISABLING || hci.state == FM_RADIO_DISABLED) {
+        wait->token = 0;
+        ret = FM_HC_STATUS_FAIL;
+    }
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_release_cmd
+**
+** Description      This function drops the completion record of a token that
+**                  will not be waited for anymore.
+**
+** Parameters:      p_hci - contains the fm helium hal hci pointer
+**                  token - completion token from fm_hci_transmit_cmd
+**
+** Returns          void
+**
+*******************************************************************************/
+void fm_hci_release_cmd(void *p_hci, uint32_t token)
+{
+    struct fm_hci_cmd_wait_t *wait;
+
+    if (token == 0)
+        return;
+
+    Lock lk(hci.cmd_wait_mtx);
+    wait = find_cmd_wait(token);
+    if (wait)
+        wait->token = 0;
 }
 
 /*******************************************************************************
@@ -693,10 +1285,24 @@ void fm_hci_close(void *p_hci)
 {
     ALOGI("%s", __func__);
     hci.state = FM_RADIO_DISABLING;
+    {
+        Lock lk(hci.cmd_wait_mtx);
+        hci.cmd_done_cond.notify_all();
+    }
 
     hci_close();
     stop_tx_thread();
 
+    /* the helium hal closes from its event handlers, i.e. on the rx
+     * thread itself; that thread leaves its loop once it returns */
+    if (hci.rx_thread_.joinable()) {
+        if (hci.rx_thread_.get_id() == std::this_thread::get_id())
+            hci.rx_thread_.detach();
+        else
+            stop_rx_thread();
+    }
+    drain_queues();
+
     if (hci.cb && hci.cb->fm_hci_close_done) {
         ALOGI("%s:Notify FM OFF to hal", __func__);
         hci.cb->fm_hci_close_done();
@@ -705,3 +1311,97 @@ void fm_hci_close(void *p_hci)
     hci.state = FM_RADIO_DISABLED;
 }
 
+/*******************************************************************************
+**
+** Function         fm_hci_get_queue_stats
+**
+** Description      This function is used to read the TX command & RX event
+**                  queue statistics.
+**
+** Parameters:      p_hci - contains the fm hci pointer
+**                  tx - filled with the tx command queue statistics
+**                  rx - filled with the rx event queue statistics
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_get_queue_stats(void *p_hci, struct fm_hci_queue_stats_t *tx,
+                           struct fm_hci_queue_stats_t *rx)
+{
+    if (!tx || !rx) {
+        ALOGE("NULL input arguments");
+        return FM_HC_STATUS_NULL_POINTER;
+    }
+
+    hci.tx_ring.get_stats(tx);
+    hci.rx_ring.get_stats(rx);
+    return FM_HC_STATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_get_pool_stats
+**
+** Description      This function is used to read the rx event buffer pool
+**                  statistics.
+**
+** Parameters:      p_hci - contains the fm hci pointer
+**                  stats - filled with the pool statistics
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_get_pool_stats(void *p_hci, struct fm_hci_pool_stats_t *stats)
+{
+    if (!stats) {
+        ALOGE("NULL input arguments");
+        return FM_HC_STATUS_NULL_POINTER;
+    }
+
+    hci.evt_pool.get_stats(stats);
+    return FM_HC_STATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_cmd_latency_ns
+**
+** Description      This function is called from process_event, in the rx
+**                  thread context, to read the send to CC/CS time of the
+**                  command matched by the event being dispatched.
+**
+** Parameters:      p_hci - contains the fm hci pointer
+**
+** Returns          uint64_t
+**
+*******************************************************************************/
+uint64_t fm_hci_cmd_latency_ns(void *p_hci)
+{
+    return hci.rx_cmd_latency_ns;
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_get_power_on_timeline
+**
+** Description      This function is used to read the duration of each phase
+**                  of the last fm_hci_init.
+**
+** Parameters:      p_hci - contains the fm hci pointer
+**                  timeline - filled with the power-on phase durations
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_get_power_on_timeline(void *p_hci,
+                                 struct fm_hci_power_on_timeline_t *timeline)
+{
+    if (!timeline) {
+        ALOGE("NULL input arguments");
+        return FM_HC_STATUS_NULL_POINTER;
+    }
+
+    Lock lk(hci.on_mtx);
+    *timeline = hci.power_on;
+    return FM_HC_STATUS_SUCCESS;
+}
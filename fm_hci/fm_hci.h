@@ -30,20 +30,228 @@
 #ifndef __FM_HCI__
 #define __FM_HCI__
 
+#include <atomic>
 #include "fm_hci_api.h"
 
 #define FM_CMD_COMPLETE 0x0f
 #define FM_CMD_STATUS   0x10
 #define FM_HW_ERR_EVENT 0x1A
 
+/* Ring capacities, must be a power of 2 */
+#define FM_HCI_TX_RING_SIZE 32
+#define FM_HCI_RX_RING_SIZE 128
+
+/* In-flight commands tracked for completion tokens, must be a power of 2 */
+#define FM_HCI_CMD_SLOTS 64
+/* Most queued commands dequeued under one credit check, each is still
+ * sent with its own hci_transmit */
+#define FM_HCI_TX_BURST 8
+
+struct fm_hci_cmd_slot_t {
+    uint32_t seq;
+    uint16_t opcode;
+    bool done;
+    bool cs;            /* done by a CS, a CC may still follow */
+    uint8_t status;
+    uint64_t sent_ns;   /* steady clock, when handed to the transport */
+};
+
+/* Results of commands sent with a token, kept until fm_hci_wait_cmd has
+ * read them or fm_hci_release_cmd drops them; must be a power of 2 */
+#define FM_HCI_CMD_WAITS 64
+
+struct fm_hci_cmd_wait_t {
+    uint32_t token;     /* 0 when free */
+    bool done;
+    uint8_t status;
+};
+
+/* Preallocated rx event buffers: a full rx ring, plus the one the hidl
+ * callback is filling and the one the rx thread is dispatching */
+#define FM_HCI_EVT_POOL_SIZE (FM_HCI_RX_RING_SIZE + 2)
+/* Free list capacity, a power of 2 above FM_HCI_EVT_POOL_SIZE */
+#define FM_HCI_EVT_FREE_RING_SIZE 256
+#define FM_HCI_EVT_BUF_SIZE \
+        (sizeof(struct fm_event_header_t) + MAX_FM_EVT_PARAMS)
+
+/*
+ * Fixed capacity single-producer/single-consumer ring. push() is only
+ * called from the producer thread and pop() only from the consumer thread,
+ * so neither side needs a lock: the producer owns tail, the consumer owns
+ * head, and the acquire/release pair on them publishes the slot contents.
+ */
+template <typename T, uint32_t N>
+struct fm_hci_ring_t {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of 2");
+
+    T *slots[N];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+
+    std::atomic<uint32_t> enqueued;
+    std::atomic<uint32_t> dequeued;
+    std::atomic<uint32_t> full_hits;
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> high_watermark;
+
+    void reset() {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        enqueued.store(0, std::memory_order_relaxed);
+        dequeued.store(0, std::memory_order_relaxed);
+        full_hits.store(0, std::memory_order_relaxed);
+        dropped.store(0, std::memory_order_relaxed);
+        high_watermark.store(0, std::memory_order_relaxed);
+    }
+
+    bool push(T *item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t depth = t - head.load(std::memory_order_acquire);
+
+        if (depth == N) {
+            full_hits.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+
+        enqueued.fetch_add(1, std::memory_order_relaxed);
+        if (depth + 1 > high_watermark.load(std::memory_order_relaxed))
+            high_watermark.store(depth + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    T *pop() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        T *item;
+
+        if (h == tail.load(std::memory_order_acquire))
+            return NULL;
+        item = slots[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        dequeued.fetch_add(1, std::memory_order_relaxed);
+        return item;
+    }
+
+    /* Consumer side only: gives back the item pop() just returned. Safe
+     * only while the ring holds fewer than N - 1 items, the producer
+     * never reaches the slot in front of head then */
+    void unpop(T *item) {
+        uint32_t h = head.load(std::memory_order_relaxed) - 1;
+
+        slots[h & (N - 1)] = item;
+        head.store(h, std::memory_order_release);
+        dequeued.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) ==
+                tail.load(std::memory_order_acquire);
+    }
+
+    void get_stats(struct fm_hci_queue_stats_t *stats) const {
+        stats->enqueued = enqueued.load(std::memory_order_relaxed);
+        stats->dequeued = dequeued.load(std::memory_order_relaxed);
+        stats->full_hits = full_hits.load(std::memory_order_relaxed);
+        stats->dropped = dropped.load(std::memory_order_relaxed);
+        stats->high_watermark = high_watermark.load(std::memory_order_relaxed);
+        stats->capacity = N;
+    }
+};
+
+/*
+ * Slab of fixed size event buffers. Buffers are taken by the hidl callback
+ * thread and given back by the rx thread once process_event returns, so the
+ * free list is itself an SPSC ring running in the opposite direction.
+ * When the slab runs dry, or an event does not fit, the heap is used.
+ */
+struct fm_hci_evt_pool_t {
+    static_assert(FM_HCI_EVT_FREE_RING_SIZE > FM_HCI_EVT_POOL_SIZE + 1,
+            "discard() relies on free_bufs never filling up");
+
+    uint8_t slab[FM_HCI_EVT_POOL_SIZE][FM_HCI_EVT_BUF_SIZE]
+            __attribute__((aligned(sizeof(void *))));
+    fm_hci_ring_t<uint8_t, FM_HCI_EVT_FREE_RING_SIZE> free_bufs;
+
+    std::atomic<uint32_t> allocs;
+    std::atomic<uint32_t> exhausted;
+    std::atomic<uint32_t> oversized;
+
+    void reset() {
+        free_bufs.reset();
+        for (uint32_t i = 0; i < FM_HCI_EVT_POOL_SIZE; i++)
+            free_bufs.push(slab[i]);
+        allocs.store(0, std::memory_order_relaxed);
+        exhausted.store(0, std::memory_order_relaxed);
+        oversized.store(0, std::memory_order_relaxed);
+    }
+
+    bool owns(const void *buf) const {
+        const uint8_t *p = (const uint8_t *)buf;
+        return p >= &slab[0][0] && p < &slab[0][0] + sizeof(slab);
+    }
+
+    struct fm_event_header_t *get(size_t len) {
+        uint8_t *buf = NULL;
+
+        if (len <= FM_HCI_EVT_BUF_SIZE) {
+            buf = free_bufs.pop();
+            if (buf == NULL)
+                exhausted.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            oversized.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (buf == NULL)
+            buf = (uint8_t *)malloc(len);
+        else
+            allocs.fetch_add(1, std::memory_order_relaxed);
+        return (struct fm_event_header_t *)buf;
+    }
+
+    void put(struct fm_event_header_t *evt) {
+        if (owns(evt))
+            free_bufs.push((uint8_t *)evt);
+        else
+            free(evt);
+    }
+
+    /* For the hidl thread, which consumes free_bufs: a slab buffer it
+     * took is handed back in front of head rather than pushed, since
+     * pushing from this side would break SPSC. free_bufs holds at most
+     * FM_HCI_EVT_POOL_SIZE - 1 buffers meanwhile, see unpop() */
+    void discard(struct fm_event_header_t *evt) {
+        if (owns(evt))
+            free_bufs.unpop((uint8_t *)evt);
+        else
+            free(evt);
+    }
+
+    void get_stats(struct fm_hci_pool_stats_t *stats) const {
+        stats->allocs = allocs.load(std::memory_order_relaxed);
+        stats->exhausted = exhausted.load(std::memory_order_relaxed);
+        stats->oversized = oversized.load(std::memory_order_relaxed);
+        stats->in_use = FM_HCI_EVT_POOL_SIZE -
+                (free_bufs.tail.load(std::memory_order_acquire) -
+                 free_bufs.head.load(std::memory_order_acquire));
+        stats->capacity = FM_HCI_EVT_POOL_SIZE;
+    }
+};
+
+/* Bound on waiting for the hal daemon & worker threads at power on */
+#define FM_HCI_INIT_TIMEOUT_MS 3000
+#define FM_HCI_THREAD_START_TIMEOUT_MS 500
+
 struct fm_hci_t {
     public:
+        /* state changes during power on, and the thread running flags,
+         * are published under on_mtx & signalled through on_cond */
         fm_power_state_t state;
         std::condition_variable on_cond;
         std::mutex on_mtx;
+        struct fm_hci_power_on_timeline_t power_on;
 
-        bool is_tx_processing;
-        bool is_rx_processing;
+        std::atomic<bool> is_tx_processing;
+        std::atomic<bool> is_rx_processing;
 
         bool is_tx_thread_running;
         bool is_rx_thread_running;
@@ -63,11 +271,59 @@ struct fm_hci_t {
         std::queue<struct fm_command_header_t *> tx_cmd_queue;
         std::queue<struct fm_event_header_t *> rx_event_queue;
 
+        /* FM_HCI_QUEUE_RING: JNI callers may race on fm_hci_transmit, so
+         * tx producers are serialized by tx_producer_mtx; the hidl callback
+         * is the only rx producer and the worker threads the only consumers */
+        fm_hci_queue_mode_t queue_mode;
+        std::mutex tx_producer_mtx;
+        fm_hci_ring_t<struct fm_command_header_t, FM_HCI_TX_RING_SIZE> tx_ring;
+        fm_hci_ring_t<struct fm_event_header_t, FM_HCI_RX_RING_SIZE> rx_ring;
+
+        struct fm_hci_evt_pool_t evt_pool;
+
         volatile uint16_t command_credits;
+
+        /* tx_seq_next is advanced under the tx producer lock, tx_seq_sent by
+         * the tx thread; cmd_slots are guarded by credit_mtx, cmd_waits &
+         * cmd_done_cond by cmd_wait_mtx, which is always taken last */
+        uint32_t tx_seq_next;
+        uint32_t tx_seq_sent;
+        struct fm_hci_cmd_slot_t cmd_slots[FM_HCI_CMD_SLOTS];
+        /* send to CC/CS time of the event being dispatched, rx thread only */
+        uint64_t rx_cmd_latency_ns;
+        std::mutex cmd_wait_mtx;
+        struct fm_hci_cmd_wait_t cmd_waits[FM_HCI_CMD_WAITS];
+        std::condition_variable cmd_done_cond;
+
         struct fm_hci_callbacks_t *cb;
 
         std::thread tx_thread_;
         std::thread rx_thread_;
+
+        /* Back to the power off state, for fm_hci_init; the locks, the
+         * condition variables & the (joined) threads are left as they are */
+        void reset() {
+            state = FM_RADIO_DISABLED;
+            power_on = {};
+            is_tx_processing = false;
+            is_rx_processing = false;
+            is_tx_thread_running = false;
+            is_rx_thread_running = false;
+            std::queue<struct fm_command_header_t *>().swap(tx_cmd_queue);
+            std::queue<struct fm_event_header_t *>().swap(rx_event_queue);
+            tx_ring.reset();
+            rx_ring.reset();
+            evt_pool.reset();
+            command_credits = 0;
+            tx_seq_next = 0;
+            tx_seq_sent = 0;
+            for (auto &slot : cmd_slots)
+                slot = {};
+            rx_cmd_latency_ns = 0;
+            for (auto &wait : cmd_waits)
+                wait = {};
+            cb = NULL;
+        }
 };
 
 #endif
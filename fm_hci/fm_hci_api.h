@@ -63,6 +63,44 @@ typedef enum {
     FM_RADIO_ENABLING
 } fm_power_state_t;
 
+/* Largest parameter block an FM event can carry (evt_len is 8 bits) */
+#define MAX_FM_EVT_PARAMS 255
+
+/* TX/RX queueing used between the callers and the fm_hci worker threads */
+typedef enum {
+    FM_HCI_QUEUE_LOCKED,
+    FM_HCI_QUEUE_RING
+} fm_hci_queue_mode_t;
+
+/* Snapshot of one fm_hci queue; the counters are only meaningful
+ * for FM_HCI_QUEUE_RING */
+struct fm_hci_queue_stats_t {
+    uint32_t enqueued;
+    uint32_t dequeued;
+    uint32_t full_hits;
+    uint32_t dropped;
+    uint32_t high_watermark;
+    uint32_t capacity;
+};
+
+/* Snapshot of the preallocated rx event buffer pool */
+struct fm_hci_pool_stats_t {
+    uint32_t allocs;
+    uint32_t exhausted;
+    uint32_t oversized;
+    uint32_t in_use;
+    uint32_t capacity;
+};
+
+/* Power-on phases of the last fm_hci_init, in microseconds */
+struct fm_hci_power_on_timeline_t {
+    uint32_t get_service_us;    /* IFmHci::getService */
+    uint32_t initialize_us;     /* initialize until initializationComplete */
+    uint32_t threads_us;        /* worker threads up & running */
+    uint32_t total_us;
+    int timed_out;
+};
+
 typedef int (*event_notification_cb_t)(void *hal, unsigned char *buf);
 typedef int (*hci_close_done_cb_t)();
 
@@ -76,6 +114,7 @@ typedef struct {
     void *hci;
     void *hal;
     struct fm_hci_callbacks_t *cb;
+    fm_hci_queue_mode_t queue_mode;
 }fm_hci_hal_t;
 
 struct fm_command_header_t {
@@ -122,6 +161,58 @@ int fm_hci_init(fm_hci_hal_t *hal_hci);
 **
 *******************************************************************************/
 int fm_hci_transmit(void *p_hci, struct fm_command_header_t *hdr);
+
+/*******************************************************************************
+**
+** Function         fm_hci_transmit_cmd
+**
+** Description      This function is the same as fm_hci_transmit, but also
+**                  returns a completion token for fm_hci_wait_cmd.
+**
+** Parameters:     p_hci - contains the fm helium hal hci pointer
+**                      hdr - contains the fm command header pointer
+**                      token - filled with the command completion token
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_transmit_cmd(void *p_hci, struct fm_command_header_t *hdr,
+                        uint32_t *token);
+
+/*******************************************************************************
+**
+** Function         fm_hci_wait_cmd
+**
+** Description      This function blocks until the CC/CS event matching the
+**                  command identified by token arrives, or timeout expires.
+**
+** Parameters:     p_hci - contains the fm helium hal hci pointer
+**                      token - completion token from fm_hci_transmit_cmd
+**                      timeout_ms - maximum time to wait
+**                      cmd_status - filled with the controller status byte
+**
+** Returns          int, FM_HC_STATUS_NOT_READY on timeout
+**
+*******************************************************************************/
+int fm_hci_wait_cmd(void *p_hci, uint32_t token, uint32_t timeout_ms,
+                    uint8_t *cmd_status);
+
+/*******************************************************************************
+**
+** Function         fm_hci_release_cmd
+**
+** Description      This function drops the result of a command sent with
+**                  fm_hci_transmit_cmd that will not be waited for. Results
+**                  are kept until read; with FM_HCI_CMD_WAITS of them unread
+**                  fm_hci_transmit_cmd returns FM_HC_STATUS_BUSY.
+**
+** Parameters:     p_hci - contains the fm helium hal hci pointer
+**                      token - completion token from fm_hci_transmit_cmd
+**
+** Returns          void
+**
+*******************************************************************************/
+void fm_hci_release_cmd(void *p_hci, uint32_t token);
 /*******************************************************************************
 **
 ** Function         fm_hci_close
@@ -136,6 +227,83 @@ int fm_hci_transmit(void *p_hci, struct fm_command_header_t *hdr);
 *******************************************************************************/
 void fm_hci_close(void *p_hci);
 
+/*******************************************************************************
+**
+** Function         fm_hci_get_queue_stats
+**
+** Description      This function is used to read the TX command & RX event
+**                  queue statistics (ring mode back-pressure counters).
+**
+** Parameters:      p_hci: contains the fm hci pointer
+**                  tx - filled with the tx command queue statistics
+**                  rx - filled with the rx event queue statistics
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_get_queue_stats(void *p_hci, struct fm_hci_queue_stats_t *tx,
+                           struct fm_hci_queue_stats_t *rx);
+
+/*******************************************************************************
+**
+** Function         fm_hci_get_pool_stats
+**
+** Description      This function is used to read the rx event buffer pool
+**                  statistics (allocations & heap fallbacks on exhaustion).
+**
+** Parameters:      p_hci: contains the fm hci pointer
+**                  stats - filled with the pool statistics
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_get_pool_stats(void *p_hci, struct fm_hci_pool_stats_t *stats);
+
+/*******************************************************************************
+**
+** Function         fm_hci_get_power_on_timeline
+**
+** Description      This function is used to read how long each phase of the
+**                  last fm_hci_init took.
+**
+** Parameters:      p_hci: contains the fm hci pointer
+**                  timeline - filled with the power-on phase durations
+**
+** Returns          int
+**
+*******************************************************************************/
+int fm_hci_get_power_on_timeline(void *p_hci,
+                                 struct fm_hci_power_on_timeline_t *timeline);
+
+/*******************************************************************************
+**
+** Function         fm_hci_cmd_latency_ns
+**
+** Description      This function returns how long the controller took to
+**                  answer the command that the CC/CS event being handed to
+**                  process_event completes. Only valid from process_event.
+**
+** Parameters:      p_hci: contains the fm hci pointer
+**
+** Returns          uint64_t, nanoseconds, 0 when no sent command matched
+**
+*******************************************************************************/
+uint64_t fm_hci_cmd_latency_ns(void *p_hci);
+
+/*******************************************************************************
+**
+** Function         fm_hci_snoop_dump
+**
+** Description      This function writes the last FM HCI commands & events
+**                  that crossed the transport to a btsnoop file.
+**
+** Parameters:      path - file to create, FM_SNOOP_PATH when NULL
+**
+** Returns          int, number of packets written or a negative errno
+**
+*******************************************************************************/
+int fm_hci_snoop_dump(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host benchmark for the fm_hci transport and the helium hal event path,
+ * running against the loopback fake SoC (libfm-hci-fake-host).
+ *
+ *   fm_hci_bench [-n cmds] [-e events] [-t threads] [-c credits] [-o file]
+ *
+ * -c sets the credits the fake SoC grants, i.e. how many commands may be in
+ * flight; the commands of a burst still reach the SoC one transmit each.
+ *
+ * Results are written as one JSON object, to stdout unless -o is given:
+ *   cmd_rtt        command to CC round trip through fm_hci_wait_cmd
+ *   rx_throughput  burst of RDS events through dequeue_fm_rx_event and
+ *                  radio_hci_event_packet, incl. allocations per event
+ *                  (glibc builds only, null elsewhere)
+ *   contention     -t threads sending commands at once; time spent in
+ *                  fm_hci_transmit_cmd against a single sender
+ *   token_hold     a waiter holding several tokens sleeps while more than
+ *                  FM_HCI_CMD_SLOTS other commands go out, then reads them
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fm_hci_api.h"
+#include "fm_fake_soc.h"
+
+extern "C" {
+#include "radio-helium.h"
+#include "radio-helium-commands.h"
+
+extern struct fm_hal_t *hal;
+extern const struct fm_interface_t FM_HELIUM_LIB_INTERFACE;
+}
+
+#define BENCH_WAIT_MS       1000
+/* tokens held by the sleeping waiter, and commands sent meanwhile */
+#define BENCH_HOLD_TOKENS   4
+#define BENCH_HOLD_FLOOD    200
+#define BENCH_RDS_PI        0x5211
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::atomic<uint64_t> bench_allocs;
+
+#ifdef __GLIBC__
+/* count every heap allocation in the process, new/delete included */
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    bench_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    bench_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    bench_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+#define BENCH_COUNTS_ALLOCS 1
+#else
+/* no way to interpose malloc here, allocs_per_event is reported as null */
+#define BENCH_COUNTS_ALLOCS 0
+#endif
+
+struct bench_pct_t {
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t samples;
+};
+
+static struct bench_pct_t bench_percentiles(std::vector<uint32_t> &ns)
+{
+    struct bench_pct_t pct;
+
+    memset(&pct, 0, sizeof(pct));
+    if (ns.empty())
+        return pct;
+    std::sort(ns.begin(), ns.end());
+    pct.p50_us = ns[ns.size() / 2] / 1000;
+    pct.p99_us = ns[(ns.size() * 99) / 100] / 1000;
+    pct.max_us = ns.back() / 1000;
+    pct.samples = ns.size();
+    return pct;
+}
+
+static uint32_t bench_ns(bench_clock::time_point from, bench_clock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+static void bench_noop_void() {}
+static void bench_noop_int(int) {}
+static void bench_noop_int2(int, int) {}
+static void bench_noop_bool(bool) {}
+static void bench_noop_str(char *) {}
+static void bench_noop_u16(uint16_t *) {}
+static void bench_noop_uint(unsigned int) {}
+static void bench_noop_ct(struct rds_ct_t *) {}
+static void bench_noop_eon(struct rds_eon_t *) {}
+
+static fm_hal_callbacks_t bench_cb;
+
+static void bench_init_callbacks()
+{
+    memset(&bench_cb, 0, sizeof(bench_cb));
+    bench_cb.size = sizeof(bench_cb);
+    bench_cb.enabled_cb = bench_noop_void;
+    bench_cb.tune_cb = bench_noop_int;
+    bench_cb.seek_cmpl_cb = bench_noop_int;
+    bench_cb.scan_next_cb = bench_noop_void;
+    bench_cb.srch_list_cb = bench_noop_u16;
+    bench_cb.stereo_status_cb = bench_noop_bool;
+    bench_cb.rds_avail_status_cb = bench_noop_bool;
+    bench_cb.af_list_update_cb = bench_noop_u16;
+    bench_cb.rt_update_cb = bench_noop_str;
+    bench_cb.ps_update_cb = bench_noop_str;
+    bench_cb.oda_update_cb = bench_noop_void;
+    bench_cb.rt_plus_update_cb = bench_noop_str;
+    bench_cb.ert_update_cb = bench_noop_str;
+    bench_cb.disabled_cb = bench_noop_void;
+    bench_cb.rds_grp_cntrs_rsp_cb = bench_noop_str;
+    bench_cb.rds_grp_cntrs_ext_rsp_cb = bench_noop_str;
+    bench_cb.fm_peek_rsp_cb = bench_noop_str;
+    bench_cb.fm_ssbi_peek_rsp_cb = bench_noop_str;
+    bench_cb.fm_agc_gain_rsp_cb = bench_noop_str;
+    bench_cb.fm_ch_det_th_rsp_cb = bench_noop_str;
+    bench_cb.ext_country_code_cb = bench_noop_str;
+    bench_cb.thread_evt_cb = bench_noop_uint;
+    bench_cb.fm_get_sig_thres_cb = bench_noop_int2;
+    bench_cb.fm_get_ch_det_thr_cb = bench_noop_int2;
+    bench_cb.fm_def_data_read_cb = bench_noop_int2;
+    bench_cb.fm_get_blend_cb = bench_noop_int2;
+    bench_cb.fm_set_ch_det_thr_cb = bench_noop_int;
+    bench_cb.fm_def_data_write_cb = bench_noop_int;
+    bench_cb.fm_set_blend_cb = bench_noop_int;
+    bench_cb.fm_get_station_param_cb = bench_noop_int2;
+    bench_cb.fm_get_station_debug_param_cb = bench_noop_int2;
+    bench_cb.enable_slimbus_cb = bench_noop_int;
+    bench_cb.ct_update_cb = bench_noop_ct;
+    bench_cb.ptyn_update_cb = bench_noop_str;
+    bench_cb.eon_update_cb = bench_noop_eon;
+}
+
+/* HCI_OCF_FM_GET_SIGNAL_THRESHOLD: no parameters, short CC, no side effects */
+static int bench_send_cmd(uint32_t *token)
+{
+    struct fm_command_header_t *hdr;
+
+    hdr = (struct fm_command_header_t *)malloc(sizeof(*hdr));
+    if (!hdr)
+        return -ENOMEM;
+    hdr->opcode = hci_opcode_pack(HCI_OGF_FM_RECV_CTRL_CMD_REQ,
+                                  HCI_OCF_FM_GET_SIGNAL_THRESHOLD);
+    hdr->len = 0;
+    return fm_hci_transmit_cmd(hal->private_data, hdr, token);
+}
+
+static int bench_cmd_rtt(int iterations, struct bench_pct_t *pct)
+{
+    std::vector<uint32_t> ns;
+    uint32_t token;
+    uint8_t status;
+    int i, ret;
+
+    ns.reserve(iterations);
+    for (i = 0; i < iterations; i++) {
+        bench_clock::time_point start = bench_clock::now();
+
+        ret = bench_send_cmd(&token);
+        if (ret == FM_HC_STATUS_SUCCESS)
+            ret = fm_hci_wait_cmd(hal->private_data, token, BENCH_WAIT_MS, &status);
+        if (ret != FM_HC_STATUS_SUCCESS) {
+            fprintf(stderr, "cmd %d failed: %d\n", i, ret);
+            return -ETIMEDOUT;
+        }
+        ns.push_back(bench_ns(start, bench_clock::now()));
+    }
+    *pct = bench_percentiles(ns);
+    return 0;
+}
+
+/* 0A groups cycling through two PS names, so every PS completes & differs */
+static void bench_rds_group(uint8_t *params, int n)
+{
+    static const char ps[2][8] = { { 'F', 'M', ' ', 'B', 'E', 'N', 'C', 'H' },
+                                   { 'R', 'D', 'S', ' ', 'R', 'A', 'T', 'E' } };
+    int seg = n & 3;
+    const char *name = ps[(n >> 2) & 1];
+    uint16_t blk[RDS_BLOCKS_NUM] = {
+        BENCH_RDS_PI,
+        (uint16_t)(seg),
+        0,
+        (uint16_t)((name[seg * 2] << 8) | name[seg * 2 + 1]),
+    };
+    int i;
+
+    params[0] = 0;
+    for (i = 0; i < RDS_BLOCKS_NUM; i++) {
+        params[RDSGRP_DATA_OFFSET + i * 2] = blk[i] & 0xff;
+        params[RDSGRP_DATA_OFFSET + i * 2 + 1] = blk[i] >> 8;
+    }
+}
+
+struct bench_rx_t {
+    uint32_t events;
+    uint32_t elapsed_us;
+    uint32_t events_per_sec;
+    double allocs_per_event;
+    struct fm_hci_pool_stats_t pool;
+    struct fm_hci_queue_stats_t rx;
+};
+
+static int bench_rx_throughput(int count, struct bench_rx_t *res)
+{
+    const int grp_len = RDSGRP_DATA_OFFSET + RDS_BLOCKS_NUM * 2;
+    std::vector<struct fm_fake_soc_event_t> evts(count);
+    std::vector<uint8_t> params(count * grp_len);
+    struct hci_dispatch_stats_t st;
+    struct fm_hci_queue_stats_t tx;
+    bench_clock::time_point first, last, deadline;
+    uint32_t base, seen;
+    uint64_t allocs;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        bench_rds_group(&params[i * grp_len], i);
+        evts[i].delay_us = i ? 0 : 2000;
+        evts[i].evt_code = HCI_EV_RDS_RX_DATA;
+        evts[i].len = grp_len;
+        evts[i].params = &params[i * grp_len];
+    }
+
+    hci_get_ev_stats(HCI_EV_RDS_RX_DATA, &st);
+    base = st.count;
+    if (fm_fake_soc_replay(evts.data(), count, 0) != count)
+        return -EINVAL;
+
+    /* the first event is due 2ms out, everything after it is back to back */
+    allocs = bench_allocs.load(std::memory_order_relaxed);
+    deadline = bench_clock::now() + std::chrono::seconds(30);
+    do {
+        hci_get_ev_stats(HCI_EV_RDS_RX_DATA, &st);
+        first = bench_clock::now();
+    } while (st.count == base && first < deadline);
+    do {
+        hci_get_ev_stats(HCI_EV_RDS_RX_DATA, &st);
+        seen = st.count - base;
+        last = bench_clock::now();
+        if (seen < (uint32_t)count)
+            std::this_thread::yield();
+    } while (seen < (uint32_t)count && last < deadline);
+
+    memset(res, 0, sizeof(*res));
+    res->events = seen;
+    res->elapsed_us = bench_ns(first, last) / 1000;
+    if (res->elapsed_us)
+        res->events_per_sec = (uint64_t)seen * 1000000 / res->elapsed_us;
+    if (seen)
+        res->allocs_per_event = (double)(bench_allocs.load(std::memory_order_relaxed)
+                - allocs) / seen;
+    fm_hci_get_pool_stats(hal->private_data, &res->pool);
+    fm_hci_get_queue_stats(hal->private_data, &tx, &res->rx);
+    return seen == (uint32_t)count ? 0 : -ETIMEDOUT;
+}
+
+struct bench_contention_t {
+    int threads;
+    struct bench_pct_t single_enqueue;
+    struct bench_pct_t enqueue;
+    struct bench_pct_t rtt;
+    struct fm_hci_queue_stats_t tx;
+};
+
+static void bench_sender(int iterations, std::vector<uint32_t> *enq,
+                         std::vector<uint32_t> *rtt, std::atomic<int> *failed)
+{
+    uint32_t token;
+    uint8_t status;
+    int i;
+
+    for (i = 0; i < iterations; i++) {
+        bench_clock::time_point start = bench_clock::now(), sent;
+
+        if (bench_send_cmd(&token) != FM_HC_STATUS_SUCCESS) {
+            failed->fetch_add(1);
+            continue;
+        }
+        sent = bench_clock::now();
+        if (fm_hci_wait_cmd(hal->private_data, token, BENCH_WAIT_MS, &status)) {
+            failed->fetch_add(1);
+            continue;
+        }
+        enq->push_back(bench_ns(start, sent));
+        rtt->push_back(bench_ns(start, bench_clock::now()));
+    }
+}
+
+static int bench_contention(int threads, int iterations, struct bench_contention_t *res)
+{
+    std::vector<std::vector<uint32_t> > enq(threads), rtt(threads);
+    std::vector<uint32_t> all_enq, all_rtt, single, single_rtt;
+    std::vector<std::thread> workers;
+    struct fm_hci_queue_stats_t rx;
+    std::atomic<int> failed(0);
+    int i;
+
+    bench_sender(iterations, &single, &single_rtt, &failed);
+
+    for (i = 0; i < threads; i++) {
+        enq[i].reserve(iterations);
+        rtt[i].reserve(iterations);
+        workers.push_back(std::thread(bench_sender, iterations, &enq[i], &rtt[i], &failed));
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].join();
+        all_enq.insert(all_enq.end(), enq[i].begin(), enq[i].end());
+        all_rtt.insert(all_rtt.end(), rtt[i].begin(), rtt[i].end());
+    }
+
+    res->threads = threads;
+    res->single_enqueue = bench_percentiles(single);
+    res->enqueue = bench_percentiles(all_enq);
+    res->rtt = bench_percentiles(all_rtt);
+    fm_hci_get_queue_stats(hal->private_data, &res->tx, &rx);
+    return failed.load() ? -ETIMEDOUT : 0;
+}
+
+struct bench_token_hold_t {
+    int held;
+    int flood;
+    int completed;
+};
+
+static void bench_holder(std::atomic<bool> *flooded, struct bench_token_hold_t *res)
+{
+    uint32_t tokens[BENCH_HOLD_TOKENS];
+    uint8_t status;
+    int i;
+
+    for (i = 0; i < BENCH_HOLD_TOKENS; i++) {
+        if (bench_send_cmd(&tokens[i]) != FM_HC_STATUS_SUCCESS)
+            tokens[i] = 0;
+    }
+    while (!flooded->load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (i = 0; i < BENCH_HOLD_TOKENS; i++) {
+        if (tokens[i] && fm_hci_wait_cmd(hal->private_data, tokens[i],
+                BENCH_WAIT_MS, &status) == FM_HC_STATUS_SUCCESS)
+            res->completed++;
+    }
+}
+
+static int bench_token_hold(struct bench_token_hold_t *res)
+{
+    std::atomic<bool> flooded(false);
+    std::thread holder;
+    uint32_t token;
+    uint8_t status;
+    int i;
+
+    memset(res, 0, sizeof(*res));
+    res->held = BENCH_HOLD_TOKENS;
+    holder = std::thread(bench_holder, &flooded, res);
+    for (i = 0; i < BENCH_HOLD_FLOOD; i++) {
+        if (bench_send_cmd(&token) == FM_HC_STATUS_SUCCESS
+                && fm_hci_wait_cmd(hal->private_data, token, BENCH_WAIT_MS,
+                    &status) == FM_HC_STATUS_SUCCESS)
+            res->flood++;
+    }
+    flooded.store(true);
+    holder.join();
+    return (res->completed == res->held && res->flood == BENCH_HOLD_FLOOD)
+            ? 0 : -ETIMEDOUT;
+}
+
+static void bench_print_pct(FILE *fp, const char *name, const struct bench_pct_t *pct,
+                            const char *sep)
+{
+    fprintf(fp, "    \"%s\": { \"p50_us\": %u, \"p99_us\": %u, \"max_us\": %u, "
+            "\"samples\": %u }%s\n", name, pct->p50_us, pct->p99_us, pct->max_us,
+            pct->samples, sep);
+}
+
+int main(int argc, char **argv)
+{
+    struct fm_fake_soc_config_t cfg;
+    struct bench_pct_t rtt;
+    struct bench_rx_t rx;
+    struct bench_contention_t cont;
+    struct bench_token_hold_t hold;
+    int iterations = 1000, events = 20000, threads = 4, credits = 1;
+    int ret_rtt, ret_rx, ret_cont, ret_hold, opt;
+    const char *out = NULL;
+    FILE *fp = stdout;
+
+    while ((opt = getopt(argc, argv, "n:e:t:c:o:")) != -1) {
+        switch (opt) {
+        case 'n': iterations = atoi(optarg); break;
+        case 'e': events = atoi(optarg); break;
+        case 't': threads = atoi(optarg); break;
+        case 'c': credits = atoi(optarg); break;
+        case 'o': out = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-n cmds] [-e events] [-t threads] "
+                    "[-c credits] [-o file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0 || events <= 0 || threads <= 0 || credits <= 0 || credits > 255) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    /* no artificial SoC latency, measure the host side only */
+    fm_fake_soc_default_config(&cfg);
+    cfg.credits = credits;
+    cfg.init_delay_us = 0;
+    cfg.cmd_latency_us = 0;
+    cfg.tune_latency_us = 0;
+    fm_fake_soc_set_config(&cfg);
+
+    bench_init_callbacks();
+    if (FM_HELIUM_LIB_INTERFACE.init(&bench_cb) != FM_HC_STATUS_SUCCESS) {
+        fprintf(stderr, "hal init failed\n");
+        return 1;
+    }
+    if (FM_HELIUM_LIB_INTERFACE.set_fm_ctrl(HCI_FM_HELIUM_RDS_SW_DECODE, 1) < 0)
+        fprintf(stderr, "software RDS decoding not enabled\n");
+
+    ret_rtt = bench_cmd_rtt(iterations, &rtt);
+    ret_rx = bench_rx_throughput(events, &rx);
+    ret_cont = bench_contention(threads, iterations, &cont);
+    ret_hold = bench_token_hold(&hold);
+
+    fm_hci_close(hal->private_data);
+
+    if (out) {
+        fp = fopen(out, "w");
+        if (!fp) {
+            fprintf(stderr, "cannot open %s: %s\n", out, strerror(errno));
+            return 1;
+        }
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"config\": { \"cmds\": %d, \"events\": %d, \"threads\": %d, "
+            "\"credits\": %d },\n", iterations, events, threads, credits);
+    fprintf(fp, "  \"cmd_rtt\": {\n");
+    fprintf(fp, "    \"ok\": %s,\n", ret_rtt ? "false" : "true");
+    bench_print_pct(fp, "rtt", &rtt, "");
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"rx_throughput\": {\n");
+    fprintf(fp, "    \"ok\": %s,\n", ret_rx ? "false" : "true");
+    fprintf(fp, "    \"events\": %u,\n", rx.events);
+    fprintf(fp, "    \"elapsed_us\": %u,\n", rx.elapsed_us);
+    fprintf(fp, "    \"events_per_sec\": %u,\n", rx.events_per_sec);
+    if (BENCH_COUNTS_ALLOCS)
+        fprintf(fp, "    \"allocs_per_event\": %.2f,\n", rx.allocs_per_event);
+    else
+        fprintf(fp, "    \"allocs_per_event\": null,\n");
+    fprintf(fp, "    \"pool_exhausted\": %u,\n", rx.pool.exhausted);
+    fprintf(fp, "    \"rx_full_hits\": %u,\n", rx.rx.full_hits);
+    fprintf(fp, "    \"rx_high_watermark\": %u\n", rx.rx.high_watermark);
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"contention\": {\n");
+    fprintf(fp, "    \"ok\": %s,\n", ret_cont ? "false" : "true");
+    fprintf(fp, "    \"threads\": %d,\n", cont.threads);
+    bench_print_pct(fp, "single_enqueue", &cont.single_enqueue, ",");
+    bench_print_pct(fp, "enqueue", &cont.enqueue, ",");
+    bench_print_pct(fp, "rtt", &cont.rtt, ",");
+    fprintf(fp, "    \"tx_full_hits\": %u,\n", cont.tx.full_hits);
+    fprintf(fp, "    \"tx_high_watermark\": %u\n", cont.tx.high_watermark);
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"token_hold\": {\n");
+    fprintf(fp, "    \"ok\": %s,\n", ret_hold ? "false" : "true");
+    fprintf(fp, "    \"held\": %d,\n", hold.held);
+    fprintf(fp, "    \"completed\": %d,\n", hold.completed);
+    fprintf(fp, "    \"sent_meanwhile\": %d\n", hold.flood);
+    fprintf(fp, "  }\n");
+    fprintf(fp, "}\n");
+
+    if (fp != stdout)
+        fclose(fp);
+    return (ret_rtt || ret_rx || ret_cont || ret_hold) ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "fm_hci"
+
+#include <atomic>
+#include <stdio.h>
+#include <time.h>
+
+#include <utils/Log.h>
+#ifdef __ANDROID__
+#include <cutils/properties.h>
+#endif
+
+#include "fm_log.h"
+
+int fm_log_level = FM_LOG_DEFAULT_LEVEL;
+
+static struct fm_trace_rec_t trace_ring[FM_TRACE_ENTRIES];
+static std::atomic<uint32_t> trace_head;
+
+static const char *trace_names[FM_TRACE_MAX] = {
+    "?",
+    "tx_enqueue",
+    "tx_send",
+    "tx_credit_wait",
+    "rx_event",
+    "rx_dispatch",
+    "credits",
+    "hal_event",
+    "hal_cmd_status",
+    "hal_cmd_complete",
+};
+
+void fm_log_init(void)
+{
+#ifdef __ANDROID__
+    fm_log_set_level(property_get_int32(FM_LOG_LEVEL_PROP, FM_LOG_DEFAULT_LEVEL));
+#endif
+}
+
+void fm_log_set_level(int level)
+{
+    if (level < FM_LOG_ERROR)
+        level = FM_LOG_ERROR;
+    else if (level > FM_LOG_VERBOSE)
+        level = FM_LOG_VERBOSE;
+    __atomic_store_n(&fm_log_level, level, __ATOMIC_RELAXED);
+}
+
+int fm_log_get_level(void)
+{
+    return __atomic_load_n(&fm_log_level, __ATOMIC_RELAXED);
+}
+
+/*
+ * Any thread may add records. seq is cleared while a slot is rewritten and
+ * published last, so the dump can tell a complete record from one that
+ * is being overwritten under it.
+ */
+void fm_trace(uint16_t id, uint16_t arg0, uint32_t arg1)
+{
+    uint32_t seq = trace_head.fetch_add(1, std::memory_order_relaxed) + 1;
+    struct fm_trace_rec_t *rec = &trace_ring[(seq - 1) & (FM_TRACE_ENTRIES - 1)];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+    rec->id = id;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    __atomic_store_n(&rec->seq, seq, __ATOMIC_RELEASE);
+}
+
+int fm_trace_dump(int fd)
+{
+    uint32_t head = trace_head.load(std::memory_order_acquire);
+    uint32_t seq = head > FM_TRACE_ENTRIES ? head - FM_TRACE_ENTRIES + 1 : 1;
+    int cnt = 0;
+
+    for (; seq != head + 1; seq++) {
+        const struct fm_trace_rec_t *slot = &trace_ring[(seq - 1) & (FM_TRACE_ENTRIES - 1)];
+        struct fm_trace_rec_t rec;
+        const char *name;
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+            continue;
+        rec = *slot;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        name = rec.id < FM_TRACE_MAX ? trace_names[rec.id] : trace_names[0];
+        if (fd >= 0)
+            dprintf(fd, "%u %llu.%06llu %s 0x%x %u\n", rec.seq,
+                    (unsigned long long)(rec.ts_ns / 1000000000ull),
+                    (unsigned long long)(rec.ts_ns % 1000000000ull) / 1000,
+                    name, rec.arg0, rec.arg1);
+        else
+            ALOGI("trace %u %llu.%06llu %s 0x%x %u", rec.seq,
+                    (unsigned long long)(rec.ts_ns / 1000000000ull),
+                    (unsigned long long)(rec.ts_ns % 1000000000ull) / 1000,
+                    name, rec.arg0, rec.arg1);
+        cnt++;
+    }
+    return cnt;
+}
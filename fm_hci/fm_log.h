@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_LOG__
+#define __FM_LOG__
+
+/*
+ * Verbosity control for the per command/per event paths of fm_hci and
+ * the helium hal.
+ *
+ * FM_LOGD/FM_LOGV are compiled out above FM_LOG_MAX_LEVEL and otherwise
+ * only reach logcat when the runtime level (persist.vendor.fm.log_level,
+ * or fm_log_set_level) allows it. What is needed to follow traffic after
+ * the fact goes to FM_TRACE instead: a fixed size binary ring that costs
+ * a few stores per record and can be dumped on demand.
+ */
+
+#include <stdint.h>
+
+#define FM_LOG_ERROR    0
+#define FM_LOG_WARN     1
+#define FM_LOG_INFO     2
+#define FM_LOG_DEBUG    3
+#define FM_LOG_VERBOSE  4
+
+#ifndef FM_LOG_MAX_LEVEL
+#define FM_LOG_MAX_LEVEL    FM_LOG_DEBUG
+#endif
+
+#define FM_LOG_DEFAULT_LEVEL    FM_LOG_INFO
+#define FM_LOG_LEVEL_PROP       "persist.vendor.fm.log_level"
+
+/* Trace ring capacity, must be a power of 2 */
+#define FM_TRACE_ENTRIES    1024
+
+enum fm_trace_id {
+    FM_TRACE_TX_ENQUEUE = 1,    /* opcode, len */
+    FM_TRACE_TX_SEND,           /* opcode, len */
+    FM_TRACE_TX_CREDIT_WAIT,    /* opcode, credits */
+    FM_TRACE_RX_EVENT,          /* evt_code, len */
+    FM_TRACE_RX_DISPATCH,       /* evt_code, len */
+    FM_TRACE_CREDITS,           /* evt_code, credits */
+    FM_TRACE_HAL_EVENT,         /* evt_code, len */
+    FM_TRACE_HAL_CMD_STATUS,    /* opcode, status */
+    FM_TRACE_HAL_CMD_COMPLETE,  /* opcode, status */
+    FM_TRACE_MAX
+};
+
+struct fm_trace_rec_t {
+    uint32_t seq;
+    uint16_t id;
+    uint16_t arg0;
+    uint32_t arg1;
+    uint64_t ts_ns;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+extern int fm_log_level;
+
+/* Picks up FM_LOG_LEVEL_PROP, called from fm_hci_init */
+void fm_log_init(void);
+void fm_log_set_level(int level);
+int fm_log_get_level(void);
+
+void fm_trace(uint16_t id, uint16_t arg0, uint32_t arg1);
+
+/* Writes the records still in the ring, oldest first, as text to fd,
+ * or to the log when fd < 0. Returns the number of records. */
+int fm_trace_dump(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define FM_LOG_ON(lvl) \
+    ((lvl) <= FM_LOG_MAX_LEVEL && (lvl) <= __atomic_load_n(&fm_log_level, __ATOMIC_RELAXED))
+
+#define FM_LOGD(...) \
+    do { if (FM_LOG_ON(FM_LOG_DEBUG)) ALOGD(__VA_ARGS__); } while (0)
+#define FM_LOGV(...) \
+    do { if (FM_LOG_ON(FM_LOG_VERBOSE)) ALOGD(__VA_ARGS__); } while (0)
+
+#ifdef FM_TRACE_DISABLED
+#define FM_TRACE(id, arg0, arg1)    do { } while (0)
+#else
+#define FM_TRACE(id, arg0, arg1)    fm_trace((id), (arg0), (arg1))
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "fm_hci"
+
+#include <atomic>
+#include <mutex>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+#ifdef __ANDROID__
+#include <cutils/properties.h>
+#endif
+
+#include "fm_hci_api.h"
+#include "fm_snoop.h"
+
+static struct fm_snoop_rec_t snoop_ring[FM_SNOOP_ENTRIES];
+static std::atomic<uint32_t> snoop_head;
+static std::atomic<bool> snoop_on(true);
+
+void fm_snoop_init(void)
+{
+#ifdef __ANDROID__
+    snoop_on.store(property_get_bool(FM_SNOOP_PROP, true), std::memory_order_relaxed);
+#endif
+}
+
+/*
+ * Called from the tx thread and the transport callback thread. A slot's
+ * seq is cleared while it is being rewritten and set last, so the dump
+ * skips packets that are overwritten while it copies them.
+ */
+void fm_snoop_capture(fm_snoop_dir_t dir, const uint8_t *pkt, uint16_t len)
+{
+    struct fm_snoop_rec_t *rec;
+    struct timespec ts;
+    uint16_t orig_len;
+    uint32_t seq;
+
+    if (!snoop_on.load(std::memory_order_relaxed))
+        return;
+
+    seq = snoop_head.fetch_add(1, std::memory_order_relaxed) + 1;
+    rec = &snoop_ring[(seq - 1) & (FM_SNOOP_ENTRIES - 1)];
+    orig_len = len;
+    if (len > FM_SNOOP_MAX_PKT)
+        len = FM_SNOOP_MAX_PKT;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+    rec->dir = dir;
+    rec->len = len;
+    rec->orig_len = orig_len;
+    rec->ts_us = (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    memcpy(rec->data, pkt, len);
+    __atomic_store_n(&rec->seq, seq, __ATOMIC_RELEASE);
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void put_be64(uint8_t *p, uint64_t v)
+{
+    put_be32(p, v >> 32);
+    put_be32(p + 4, (uint32_t)v);
+}
+
+static bool write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*******************************************************************************
+**
+** Function         fm_hci_snoop_dump
+**
+** Description      This function writes the captured packets, oldest first,
+**                  to a btsnoop file.
+**
+** Parameters:      path - file to create, FM_SNOOP_PATH when NULL
+**
+** Returns          int, number of packets written or a negative errno
+**
+*******************************************************************************/
+int fm_hci_snoop_dump(const char *path)
+{
+    static std::mutex dump_mtx;
+    struct fm_snoop_rec_t rec;
+    uint8_t hdr[24 + 1];
+    uint32_t head, seq, drops = 0;
+    int fd, cnt = 0;
+
+    if (!path)
+        path = FM_SNOOP_PATH;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        ALOGE("%s: cannot create %s: %s", __func__, path, strerror(errno));
+        return -errno;
+    }
+
+    memcpy(hdr, BTSNOOP_MAGIC, 8);
+    put_be32(hdr + 8, BTSNOOP_VERSION);
+    put_be32(hdr + 12, BTSNOOP_DLT_H4);
+    if (!write_all(fd, hdr, 16))
+        goto fail;
+
+    {
+        std::lock_guard<std::mutex> lk(dump_mtx);
+
+        head = snoop_head.load(std::memory_order_acquire);
+        seq = head > FM_SNOOP_ENTRIES ? head - FM_SNOOP_ENTRIES + 1 : 1;
+        drops = seq - 1;
+        for (; seq != head + 1; seq++) {
+            const struct fm_snoop_rec_t *slot =
+                    &snoop_ring[(seq - 1) & (FM_SNOOP_ENTRIES - 1)];
+
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+                continue;
+            memcpy(&rec, slot, sizeof(rec));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+                continue;
+
+            /* H4 packet type byte ahead of the FM HCI packet */
+            put_be32(hdr, rec.orig_len + 1);
+            put_be32(hdr + 4, rec.len + 1);
+            put_be32(hdr + 8, BTSNOOP_FLAG_CMD_EVT
+                    | (rec.dir == FM_SNOOP_EVT ? BTSNOOP_FLAG_RECEIVED : 0));
+            put_be32(hdr + 12, drops);
+            put_be64(hdr + 16, rec.ts_us + BTSNOOP_EPOCH_DELTA_US);
+            hdr[24] = rec.dir == FM_SNOOP_EVT ? H4_TYPE_EVT : H4_TYPE_CMD;
+            if (!write_all(fd, hdr, sizeof(hdr)) || !write_all(fd, rec.data, rec.len))
+                goto fail;
+            cnt++;
+        }
+    }
+
+    close(fd);
+    ALOGI("%s: %d packets written to %s", __func__, cnt, path);
+    return cnt;
+
+fail:
+    ALOGE("%s: write to %s failed: %s", __func__, path, strerror(errno));
+    close(fd);
+    return -EIO;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_SNOOP__
+#define __FM_SNOOP__
+
+/*
+ * Always-on capture of the FM HCI traffic crossing the transport, kept in
+ * a fixed ring of FM_SNOOP_ENTRIES packets and written out in btsnoop
+ * format (datalink H4) by fm_hci_snoop_dump(). Capturing a packet is a
+ * slot claim, a timestamp and a memcpy; nothing is allocated or locked.
+ */
+
+#include <stdint.h>
+
+/* Ring capacity, must be a power of 2 */
+#define FM_SNOOP_ENTRIES    256
+/* Largest packet: command header + 255 parameter bytes */
+#define FM_SNOOP_MAX_PKT    258
+
+#define FM_SNOOP_PROP       "persist.vendor.fm.snoop"
+#define FM_SNOOP_PATH       "/data/vendor/fm/fm_hci_snoop.log"
+
+/* btsnoop file layout, all fields big endian */
+#define BTSNOOP_MAGIC           "btsnoop"
+#define BTSNOOP_VERSION         1
+#define BTSNOOP_DLT_H4          1002
+#define BTSNOOP_FLAG_RECEIVED   0x01
+#define BTSNOOP_FLAG_CMD_EVT    0x02
+/* microseconds from 0000-01-01 to the unix epoch */
+#define BTSNOOP_EPOCH_DELTA_US  0x00dcddb30f2f8000ULL
+
+#define H4_TYPE_CMD     0x01
+#define H4_TYPE_EVT     0x04
+
+typedef enum {
+    FM_SNOOP_CMD,
+    FM_SNOOP_EVT
+} fm_snoop_dir_t;
+
+struct fm_snoop_rec_t {
+    uint32_t seq;
+    uint8_t dir;
+    uint16_t len;       /* bytes kept in data */
+    uint16_t orig_len;  /* size of the packet on the wire */
+    uint64_t ts_us;     /* CLOCK_REALTIME */
+    uint8_t data[FM_SNOOP_MAX_PKT];
+};
+
+void fm_snoop_init(void);
+void fm_snoop_capture(fm_snoop_dir_t dir, const uint8_t *pkt, uint16_t len);
+
+#endif
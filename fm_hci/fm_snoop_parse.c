@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015-2017 The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above
+ *            copyright notice, this list of conditions and the following
+ *            disclaimer in the documentation and/or other materials provided
+ *            with the distribution.
+ *        * Neither the name of The Linux Foundation nor the names of its
+ *            contributors may be used to endorse or promote products derived
+ *            from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host tool decoding the btsnoop files written by fm_hci_snoop_dump().
+ *
+ *   fm_snoop_parse [-x] <file>
+ *
+ * Prints one line per packet: index, time since the first packet,
+ * direction, opcode (OGF/OCF) or event code, and CC/CS status; -x adds
+ * the parameter bytes.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fm_snoop.h"
+
+#define FM_CMD_COMPLETE 0x0f
+#define FM_CMD_STATUS   0x10
+
+static const char *ogf_names[] = {
+    [0x13] = "recv",
+    [0x14] = "trans",
+    [0x15] = "common",
+    [0x16] = "status",
+    [0x17] = "test",
+};
+
+static const char *evt_names[] = {
+    [0x01] = "tune_status",
+    [0x02] = "rds_lock_status",
+    [0x03] = "stereo_status",
+    [0x04] = "service_available",
+    [0x05] = "search_progress",
+    [0x06] = "search_rds_progress",
+    [0x07] = "search_list_progress",
+    [0x08] = "rds_rx_data",
+    [0x09] = "program_service",
+    [0x0a] = "radio_text",
+    [0x0b] = "af_list",
+    [0x0c] = "tx_rds_grp_avble",
+    [0x0d] = "tx_rds_grp_compl",
+    [0x0e] = "tx_rds_cont_grp_compl",
+    [0x0f] = "cmd_complete",
+    [0x10] = "cmd_status",
+    [0x11] = "tune_complete",
+    [0x12] = "search_complete",
+    [0x13] = "search_rds_complete",
+    [0x14] = "search_list_complete",
+    [0x17] = "ext_country_code",
+    [0x18] = "rt_plus_id",
+    [0x19] = "rt_plus_tag",
+    [0x1a] = "hw_err",
+};
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const uint8_t *p)
+{
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static void print_opcode(uint16_t opcode)
+{
+    uint16_t ogf = opcode >> 10, ocf = opcode & 0x3ff;
+    const char *name = ogf < sizeof(ogf_names) / sizeof(ogf_names[0]) ? ogf_names[ogf] : NULL;
+
+    if (ogf == 0x3f)
+        name = "diag";
+    printf("opcode 0x%04x (%s ocf 0x%02x)", opcode, name ? name : "?", ocf);
+}
+
+static void print_packet(const uint8_t *pkt, uint32_t len, bool hex)
+{
+    uint32_t i, plen = 0;
+    const uint8_t *params = NULL;
+
+    if (len < 1) {
+        printf("empty\n");
+        return;
+    }
+
+    if (pkt[0] == H4_TYPE_CMD && len >= 4) {
+        printf("CMD ");
+        print_opcode(pkt[1] | (pkt[2] << 8));
+        plen = pkt[3];
+        params = pkt + 4;
+        printf(" len %u", plen);
+    } else if (pkt[0] == H4_TYPE_EVT && len >= 3) {
+        uint8_t code = pkt[1];
+        const char *name = code < sizeof(evt_names) / sizeof(evt_names[0])
+                ? evt_names[code] : NULL;
+
+        plen = pkt[2];
+        params = pkt + 3;
+        printf("EVT 0x%02x %s len %u", code, name ? name : "?", plen);
+        if (code == FM_CMD_COMPLETE && plen >= 3) {
+            printf(" credits %u ", params[0]);
+            print_opcode(params[1] | (params[2] << 8));
+            if (plen >= 4)
+                printf(" status %u", params[3]);
+        } else if (code == FM_CMD_STATUS && plen >= 4) {
+            printf(" status %u credits %u ", params[0], params[1]);
+            print_opcode(params[2] | (params[3] << 8));
+        }
+    } else {
+        printf("unknown H4 type 0x%02x", pkt[0]);
+    }
+
+    if (params && params + plen > pkt + len) {
+        printf(" (truncated)");
+        plen = pkt + len - params;
+    }
+    if (hex && params) {
+        printf("\n   ");
+        for (i = 0; i < plen; i++)
+            printf(" %02x", params[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t hdr[24], pkt[FM_SNOOP_MAX_PKT + 1];
+    uint64_t first_ts = 0, ts;
+    uint32_t incl_len, flags, drops, last_drops = 0;
+    bool hex = false;
+    int opt, idx = 0;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "x")) != -1) {
+        if (opt == 'x') {
+            hex = true;
+        } else {
+            fprintf(stderr, "usage: %s [-x] <btsnoop file>\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-x] <btsnoop file>\n", argv[0]);
+        return 2;
+    }
+
+    fp = fopen(argv[optind], "rb");
+    if (!fp) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if (fread(hdr, 1, 16, fp) != 16 || memcmp(hdr, BTSNOOP_MAGIC, 8)
+            || get_be32(hdr + 8) != BTSNOOP_VERSION) {
+        fprintf(stderr, "%s: not a btsnoop v1 file\n", argv[optind]);
+        fclose(fp);
+        return 1;
+    }
+    if (get_be32(hdr + 12) != BTSNOOP_DLT_H4)
+        fprintf(stderr, "warning: datalink %u, expected H4\n", get_be32(hdr + 12));
+
+    while (fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr)) {
+        incl_len = get_be32(hdr + 4);
+        flags = get_be32(hdr + 8);
+        drops = get_be32(hdr + 12);
+        ts = get_be64(hdr + 16);
+
+        if (incl_len > sizeof(pkt)) {
+            fprintf(stderr, "packet %d: bad length %u\n", idx, incl_len);
+            break;
+        }
+        if (fread(pkt, 1, incl_len, fp) != incl_len) {
+            fprintf(stderr, "packet %d: truncated\n", idx);
+            break;
+        }
+
+        if (idx == 0) {
+            first_ts = ts;
+            if (drops)
+                printf("(%u earlier packets overwritten)\n", drops);
+        } else if (drops != last_drops) {
+            printf("(%u packets lost)\n", drops - last_drops);
+        }
+        last_drops = drops;
+
+        printf("%5d %10.6f %s ", idx, (double)(ts - first_ts) / 1000000.0,
+                (flags & BTSNOOP_FLAG_RECEIVED) ? "<" : ">");
+        print_packet(pkt, incl_len, hex);
+        idx++;
+    }
+
+    fclose(fp);
+    return 0;
+}
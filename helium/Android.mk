@@ -6,7 +6,9 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
         radio_helium_hal.c \
-        radio_helium_hal_cmds.c
+        radio_helium_hal_cmds.c \
+        radio_helium_rds.c \
+        radio_helium_cb.c
 
 LOCAL_SHARED_LIBRARIES := \
          libfm-hci \
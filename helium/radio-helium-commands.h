@@ -101,6 +101,14 @@ enum helium_cmd_t {
     HCI_FM_HELIUM_AGC_UCCTRL = 0x8000043, /* 0x8000043 */
     HCI_FM_HELIUM_AGC_GAIN_STATE,
     HCI_FM_HELIUM_ENABLE_LPF,
+    HCI_FM_HELIUM_RDS_SW_DECODE,
+    HCI_FM_HELIUM_RDS_COALESCE_MS,
+    HCI_FM_HELIUM_LOG_LEVEL,
+    HCI_FM_HELIUM_TRACE_DUMP,
+    HCI_FM_HELIUM_SNOOP_DUMP,
+    HCI_FM_HELIUM_LATENCY_HIST,
+    HCI_FM_HELIUM_LATENCY_RESET,
+    HCI_FM_HELIUM_CB_STATS,
 
     /*using private CIDs under userclass*/
     HCI_FM_HELIUM_READ_DEFAULT = 0x00980928,
@@ -140,6 +140,23 @@ typedef enum {
 
 #define TUNE_PARAM 16
 #define SIZE_ARRAY(x)  (sizeof(x) / sizeof((x)[0]))
+/* Decoded 4A clock time, local_offset in half hours */
+struct rds_ct_t {
+    uint32_t mjd;
+    uint8_t hour;
+    uint8_t minute;
+    int8_t local_offset;
+};
+
+/* Other network from 14A/14B groups */
+struct rds_eon_t {
+    uint16_t pi_on;
+    uint8_t pty;
+    uint8_t tp;
+    uint8_t ta;
+    char ps[8];
+};
+
 typedef void (*enb_result_cb)();
 typedef void (*tune_rsp_cb)(int Freq);
 typedef void (*seek_rsp_cb)(int Freq);
@@ -172,6 +189,10 @@ typedef void (*fm_set_blnd_cb) (int status);
 typedef void (*fm_get_stn_prm_cb) (int val, int status);
 typedef void (*fm_get_stn_dbg_prm_cb) (int val, int status);
 typedef void (*fm_enable_slimbus_cb) (int status);
+typedef void (*rds_ct_cb) (struct rds_ct_t *ct);
+typedef void (*rds_ptyn_cb) (char *ptyn);
+typedef void (*rds_eon_cb) (struct rds_eon_t *eon);
+typedef void (*callback_batch_event) (unsigned int evt);
 
 typedef struct {
     size_t  size;
@@ -208,6 +229,12 @@ typedef struct {
     fm_get_stn_prm_cb fm_get_station_param_cb;
     fm_get_stn_dbg_prm_cb fm_get_station_debug_param_cb;
     fm_enable_slimbus_cb enable_slimbus_cb;
+    /* software RDS decoder, only called when 'size' covers them */
+    rds_ct_cb ct_update_cb;
+    rds_ptyn_cb ptyn_update_cb;
+    rds_eon_cb eon_update_cb;
+    /* 0 before and 1 after each run of callbacks the dispatcher delivers */
+    callback_batch_event batch_evt_cb;
 } fm_hal_callbacks_t;
 
 /* Opcode OCF */
@@ -298,6 +325,40 @@ typedef struct {
 #define hci_diagnostic_cmd_op_pack(ocf) \
      (uint16_t) hci_opcode_pack(HCI_OGF_FM_DIAGNOSTIC_CMD_REQ, ocf)
 
+/* Event dispatch tables: CC handlers by [OGF group][OCF], others by code */
+#define HCI_CC_OGF_GRPS     6
+#define HCI_CC_OCF_MAX      0x20
+#define HCI_EV_MAX          0x20
+
+typedef void (*hci_cc_handler_t)(char *ev_buff);
+
+/* Latency histogram buckets, see hci_lat_bounds_us; the last one is open */
+#define HCI_LAT_BUCKETS 12
+
+struct hci_dispatch_stats_t {
+    uint32_t count;
+    uint32_t last_latency_us;
+    uint32_t max_latency_us;
+    uint32_t samples;
+    uint64_t total_latency_us;
+    uint32_t hist[HCI_LAT_BUCKETS];
+};
+
+/*
+ * get_fm_ctrl(HCI_FM_HELIUM_LATENCY_HIST, &val) takes a selector in val
+ * and returns the selected value of one opcode's or event's stats in it.
+ * Fields below HCI_LAT_BUCKETS select a histogram bucket.
+ */
+#define HCI_LAT_KIND_CMD        0
+#define HCI_LAT_KIND_EVT        1
+#define HCI_LAT_FIELD_COUNT     0x80
+#define HCI_LAT_FIELD_LAST      0x81
+#define HCI_LAT_FIELD_MAX       0x82
+#define HCI_LAT_FIELD_AVG       0x83
+#define HCI_LAT_FIELD_BOUND     0x84    /* upper bound of bucket (code) in us */
+#define HCI_LAT_SEL(kind, code, field) \
+    (((kind) << 24) | (((code) & 0xffff) << 8) | ((field) & 0xff))
+
 /* HCI commands with no arguments*/
 #define HCI_FM_ENABLE_RECV_CMD 1
 #define HCI_FM_DISABLE_RECV_CMD 2
@@ -548,6 +609,7 @@ struct hci_fm_def_data_rd {
 
 #define GRP_3A               0x6
 #define RT_PLUS_AID          0x4bd7
+#define RDS_RT_PLUS_LEN      8
 
 /*ERT*/
 #define ERT_AID              0x6552
@@ -1131,6 +1193,92 @@ static inline int is_valid_blend_value(int val)
         return 0;
 }
 
+/* Per-station record of the last PS/RT/eRT reported to the client */
+#define RDS_CACHE_STATIONS  8
+
+enum rds_cache_field {
+    RDS_CACHE_PS,
+    RDS_CACHE_RT,
+    RDS_CACHE_ERT,
+    RDS_CACHE_FIELDS
+};
+
+struct rds_station_cache {
+    unsigned short pi;
+    unsigned int lru;
+    unsigned char emitted_mask;
+    unsigned int emitted_hash[RDS_CACHE_FIELDS];
+    unsigned int last_emit_ms[RDS_CACHE_FIELDS];
+} __attribute__((packed));
+
+/*
+ * Client callbacks are not called from the fm_hci rx thread: event
+ * handlers turn them into fm_cb records, and a dispatcher thread, the
+ * one attached through thread_evt_cb, delivers them in batches.
+ */
+#define FM_CB_QUEUE_SIZE    64      /* power of 2 */
+#define FM_CB_RDS_LIMIT     48      /* RDS records beyond this depth are dropped */
+#define FM_CB_BATCH         16
+#define FM_CB_POST_WAIT_MS  100
+#define FM_CB_DATA_MAX      260     /* eRT; JNI copies STD_BUF_SIZE of lists */
+
+enum fm_cb_type {
+    FM_CB_ENABLED,
+    FM_CB_DISABLED,
+    FM_CB_TUNE,
+    FM_CB_SEEK_CMPL,
+    FM_CB_SCAN_NEXT,
+    FM_CB_SRCH_LIST,
+    FM_CB_STEREO,
+    FM_CB_RDS_AVAIL,
+    FM_CB_AF_LIST,
+    FM_CB_RT,
+    FM_CB_PS,
+    FM_CB_ODA,
+    FM_CB_RT_PLUS,
+    FM_CB_ERT,
+    FM_CB_ECC,
+    FM_CB_CT,
+    FM_CB_PTYN,
+    FM_CB_EON,
+    FM_CB_RDS_GRP_CNTRS,
+    FM_CB_RDS_GRP_CNTRS_EXT,
+    FM_CB_PEEK,
+    FM_CB_SSBI_PEEK,
+    FM_CB_AGC_GAIN,
+    FM_CB_GET_SIG_THRES,
+    FM_CB_GET_CH_DET_THR,
+    FM_CB_SET_CH_DET_THR,
+    FM_CB_DEF_DATA_READ,
+    FM_CB_DEF_DATA_WRITE,
+    FM_CB_GET_BLEND,
+    FM_CB_SET_BLEND,
+    FM_CB_STATION_PARAM,
+    FM_CB_STATION_DBG_PARAM,
+    FM_CB_ENABLE_SLIMBUS,
+    FM_CB_MAX
+};
+
+struct fm_cb_rec_t {
+    int a;                  /* freq, value or status */
+    int b;                  /* status of (val, status) callbacks */
+    uint16_t len;
+    uint8_t type;
+    char data[FM_CB_DATA_MAX];
+};
+
+/* get_fm_ctrl(HCI_FM_HELIUM_CB_STATS, &val) returns the field given in val */
+enum fm_cb_stat {
+    FM_CB_STAT_DEPTH,
+    FM_CB_STAT_HIGH_WM,
+    FM_CB_STAT_POSTED,
+    FM_CB_STAT_DELIVERED,
+    FM_CB_STAT_MERGED,
+    FM_CB_STAT_DROPPED,
+    FM_CB_STAT_BATCHES,
+    FM_CB_STAT_MAX
+};
+
 struct radio_helium_device {
     int tune_req;
     unsigned int mode;
@@ -1152,6 +1300,7 @@ struct radio_helium_device {
     unsigned char power_mode;
     int search_on;
     unsigned char spur_table_size;
+    unsigned char feature_mask;
     unsigned char g_scan_time;
     unsigned int g_antenna;
     unsigned int g_rds_grp_proc_ps;
@@ -1166,6 +1315,11 @@ struct radio_helium_device {
     struct hci_fm_ch_det_threshold ch_det_threshold;
     struct hci_fm_data_rd_rsp def_data;
     struct hci_fm_blend_table blend_tbl;
+    struct rds_station_cache rds_cache[RDS_CACHE_STATIONS];
+    unsigned int rds_cache_tick;
+    unsigned short rds_cur_pi;
+    unsigned int rds_coalesce_ms;
+    unsigned int rds_suppressed;
 } __attribute__((packed));
 
 #define set_bit(flag, bit_pos)      ((flag) |= (1 << (bit_pos)))
@@ -1235,6 +1389,23 @@ int hci_fm_default_data_write_req(struct hci_fm_def_data_wr_req * data_wrt);
 int hci_fm_get_station_dbg_param_req();
 int hci_fm_get_station_cmd_param_req();
 int hci_fm_enable_slimbus(uint8_t enable);
+void rds_decode_group(struct rds_grp_data *grp);
+void rds_decoder_reset(void);
+void rds_decoder_enable(int on);
+int rds_decoder_enabled(void);
+int rds_decoder_oda_mask(void);
+int rds_decoder_grp_mask(void);
+int rds_cache_changed(int field, unsigned short pi, const char *buf, int len);
+void rds_cache_tune(void);
+int hci_cc_register_handler(uint16_t opcode, hci_cc_handler_t handler);
+int hci_get_cc_stats(uint16_t opcode, struct hci_dispatch_stats_t *stats);
+int hci_get_ev_stats(uint8_t evt, struct hci_dispatch_stats_t *stats);
+void hci_reset_dispatch_stats(void);
+int fm_cb_start(void);
+void fm_cb_stop(void);
+void fm_cb_wait_stopped(void);
+int fm_cb_post(int type, int a, int b, const void *data, int len);
+int fm_cb_get_stat(int field, int *val);
 
 struct fm_hal_t {
     struct radio_helium_device *radio;
@@ -1246,6 +1417,8 @@ struct fm_interface_t {
     int (*init)(const fm_hal_callbacks_t *p_cb);
     int (*set_fm_ctrl)(int opcode, int val);
     void (*get_fm_ctrl) (int opcode, int *val);
+    int (*get_fm_ctrl_async) (int opcode, uint32_t *req);
+    int (*wait_fm_ctrl) (uint32_t req, int timeout_ms, int *val);
 };
 
 #endif /* __UAPI_RADIO_HCI_CORE_H */
@@ -0,0 +1,412 @@
+/*
+Copyright (c) 2015-2016 The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Client callback dispatcher.
+ *
+ * Event handlers run on the fm_hci rx thread, which also returns credits
+ * to the tx side, so they only post a fm_cb_rec_t here. The dispatcher
+ * thread takes up to FM_CB_BATCH records per wakeup and calls into
+ * fm_hal_callbacks_t without holding the queue lock. A client with
+ * batch_evt_cb is told where each batch starts and ends, so it can hand
+ * the batch on in one go.
+ *
+ * RDS records are expendable: one still waiting in the queue is replaced
+ * by a newer one of the same type instead of queuing both, and past
+ * FM_CB_RDS_LIMIT they are dropped so room is left for the command and
+ * tune callbacks. Any other record ends the merge window, so a merged
+ * record is never delivered ahead of a tune it came after.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <utils/Log.h>
+#include "radio-helium-commands.h"
+#include "radio-helium.h"
+#include "fm_hci_api.h"
+#include "fm_log.h"
+
+#define LOG_TAG "radio_helium"
+
+extern struct fm_hal_t *hal;
+
+#define FM_CB_F_MERGE   0x1     /* a queued record is replaced by a newer one */
+#define FM_CB_F_DROP    0x2     /* may be dropped past FM_CB_RDS_LIMIT */
+
+#define FM_CB_NONE      0xffffffffu
+
+/* Same as RDS_HAS_CB, for callbacks newer than the first table */
+#define FM_CB_HAS(field) \
+    (hal->jni_cb->size >= offsetof(fm_hal_callbacks_t, field) + \
+        sizeof(hal->jni_cb->field) && hal->jni_cb->field != NULL)
+
+static const uint8_t fm_cb_flags[FM_CB_MAX] = {
+    [FM_CB_STEREO]      = FM_CB_F_MERGE,
+    [FM_CB_RDS_AVAIL]   = FM_CB_F_MERGE,
+    [FM_CB_AF_LIST]     = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_RT]          = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_PS]          = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_ODA]         = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_RT_PLUS]     = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_ERT]         = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_ECC]         = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_CT]          = FM_CB_F_MERGE | FM_CB_F_DROP,
+    [FM_CB_PTYN]        = FM_CB_F_MERGE | FM_CB_F_DROP,
+    /* one record per other network, so these are never merged */
+    [FM_CB_EON]         = FM_CB_F_DROP,
+};
+
+struct fm_cb_queue_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* records posted, or stop */
+    pthread_cond_t space_cond;  /* records taken, or thread gone */
+    char running;
+    char stop;
+    uint32_t head;              /* next record to post */
+    uint32_t tail;              /* next record to deliver */
+    uint32_t pending[FM_CB_MAX];/* queued record a newer one may replace */
+    uint32_t stats[FM_CB_STAT_MAX];
+    struct fm_cb_rec_t ring[FM_CB_QUEUE_SIZE];
+};
+
+static struct fm_cb_queue_t cbq = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .space_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void fm_cb_clear_pending(void)
+{
+    int i;
+
+    for (i = 0; i < FM_CB_MAX; i++)
+        cbq.pending[i] = FM_CB_NONE;
+}
+
+static void fm_cb_deliver(const struct fm_cb_rec_t *rec)
+{
+    fm_hal_callbacks_t *cb = hal->jni_cb;
+    char *data = (char *)rec->data;
+
+    switch (rec->type) {
+    case FM_CB_ENABLED:
+        cb->enabled_cb();
+        break;
+    case FM_CB_DISABLED:
+        cb->disabled_cb();
+        break;
+    case FM_CB_TUNE:
+        cb->tune_cb(rec->a);
+        break;
+    case FM_CB_SEEK_CMPL:
+        cb->seek_cmpl_cb(rec->a);
+        break;
+    case FM_CB_SCAN_NEXT:
+        cb->scan_next_cb();
+        break;
+    case FM_CB_SRCH_LIST:
+        cb->srch_list_cb((uint16_t *)data);
+        break;
+    case FM_CB_STEREO:
+        cb->stereo_status_cb(rec->a);
+        break;
+    case FM_CB_RDS_AVAIL:
+        cb->rds_avail_status_cb(rec->a);
+        break;
+    case FM_CB_AF_LIST:
+        cb->af_list_update_cb((uint16_t *)data);
+        break;
+    case FM_CB_RT:
+        cb->rt_update_cb(data);
+        break;
+    case FM_CB_PS:
+        cb->ps_update_cb(data);
+        break;
+    case FM_CB_ODA:
+        cb->oda_update_cb();
+        break;
+    case FM_CB_RT_PLUS:
+        cb->rt_plus_update_cb(data);
+        break;
+    case FM_CB_ERT:
+        cb->ert_update_cb(data);
+        break;
+    case FM_CB_ECC:
+        cb->ext_country_code_cb(data);
+        break;
+    case FM_CB_CT:
+        cb->ct_update_cb((struct rds_ct_t *)data);
+        break;
+    case FM_CB_PTYN:
+        cb->ptyn_update_cb(data);
+        break;
+    case FM_CB_EON:
+        cb->eon_update_cb((struct rds_eon_t *)data);
+        break;
+    case FM_CB_RDS_GRP_CNTRS:
+        cb->rds_grp_cntrs_rsp_cb(data);
+        break;
+    case FM_CB_RDS_GRP_CNTRS_EXT:
+        cb->rds_grp_cntrs_ext_rsp_cb(data);
+        break;
+    case FM_CB_PEEK:
+        cb->fm_peek_rsp_cb(data);
+        break;
+    case FM_CB_SSBI_PEEK:
+        cb->fm_ssbi_peek_rsp_cb(data);
+        break;
+    case FM_CB_AGC_GAIN:
+        cb->fm_agc_gain_rsp_cb(data);
+        break;
+    case FM_CB_GET_SIG_THRES:
+        cb->fm_get_sig_thres_cb(rec->a, rec->b);
+        break;
+    case FM_CB_GET_CH_DET_THR:
+        cb->fm_get_ch_det_thr_cb(rec->a, rec->b);
+        break;
+    case FM_CB_SET_CH_DET_THR:
+        cb->fm_set_ch_det_thr_cb(rec->a);
+        break;
+    case FM_CB_DEF_DATA_READ:
+        cb->fm_def_data_read_cb(rec->a, rec->b);
+        break;
+    case FM_CB_DEF_DATA_WRITE:
+        cb->fm_def_data_write_cb(rec->a);
+        break;
+    case FM_CB_GET_BLEND:
+        cb->fm_get_blend_cb(rec->a, rec->b);
+        break;
+    case FM_CB_SET_BLEND:
+        cb->fm_set_blend_cb(rec->a);
+        break;
+    case FM_CB_STATION_PARAM:
+        cb->fm_get_station_param_cb(rec->a, rec->b);
+        break;
+    case FM_CB_STATION_DBG_PARAM:
+        cb->fm_get_station_debug_param_cb(rec->a, rec->b);
+        break;
+    case FM_CB_ENABLE_SLIMBUS:
+        cb->enable_slimbus_cb(rec->a);
+        break;
+    default:
+        ALOGE("%s: unknown callback %d", __func__, rec->type);
+        break;
+    }
+}
+
+static void *fm_cb_thread(void *arg)
+{
+    struct fm_cb_rec_t batch[FM_CB_BATCH];
+    uint32_t n, i;
+
+    hal->jni_cb->thread_evt_cb(0);
+
+    pthread_mutex_lock(&cbq.lock);
+    for (;;) {
+        while (cbq.head == cbq.tail && !cbq.stop)
+            pthread_cond_wait(&cbq.cond, &cbq.lock);
+        if (cbq.head == cbq.tail)
+            break;
+
+        n = cbq.head - cbq.tail;
+        if (n > FM_CB_BATCH)
+            n = FM_CB_BATCH;
+        for (i = 0; i < n; i++)
+            batch[i] = cbq.ring[(cbq.tail + i) & (FM_CB_QUEUE_SIZE - 1)];
+        cbq.tail += n;
+        cbq.stats[FM_CB_STAT_BATCHES]++;
+        pthread_cond_broadcast(&cbq.space_cond);
+        pthread_mutex_unlock(&cbq.lock);
+
+        if (FM_CB_HAS(batch_evt_cb))
+            hal->jni_cb->batch_evt_cb(0);
+        for (i = 0; i < n; i++)
+            fm_cb_deliver(&batch[i]);
+        if (FM_CB_HAS(batch_evt_cb))
+            hal->jni_cb->batch_evt_cb(1);
+
+        pthread_mutex_lock(&cbq.lock);
+        cbq.stats[FM_CB_STAT_DELIVERED] += n;
+    }
+    pthread_mutex_unlock(&cbq.lock);
+
+    hal->jni_cb->thread_evt_cb(1);
+
+    pthread_mutex_lock(&cbq.lock);
+    cbq.running = 0;
+    pthread_cond_broadcast(&cbq.space_cond);
+    pthread_mutex_unlock(&cbq.lock);
+    return NULL;
+}
+
+/* Called from hal_init, before fm_hci can deliver any event */
+int fm_cb_start(void)
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    int ret;
+
+    pthread_mutex_lock(&cbq.lock);
+    /* a previous session's thread may still be delivering disabled_cb */
+    while (cbq.running)
+        pthread_cond_wait(&cbq.space_cond, &cbq.lock);
+    cbq.head = cbq.tail = 0;
+    cbq.stop = 0;
+    memset(cbq.stats, 0, sizeof(cbq.stats));
+    fm_cb_clear_pending();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&tid, &attr, fm_cb_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret == 0)
+        cbq.running = 1;
+    else
+        ALOGE("%s: failed to start the callback thread: %d", __func__, ret);
+    pthread_mutex_unlock(&cbq.lock);
+
+    return ret ? -FM_HC_STATUS_FAIL : FM_HC_STATUS_SUCCESS;
+}
+
+/* Records already posted are still delivered before the thread detaches */
+void fm_cb_stop(void)
+{
+    pthread_mutex_lock(&cbq.lock);
+    cbq.stop = 1;
+    pthread_cond_signal(&cbq.cond);
+    pthread_mutex_unlock(&cbq.lock);
+}
+
+/* Wait for a stopped thread to deliver what is left and go away */
+void fm_cb_wait_stopped(void)
+{
+    pthread_mutex_lock(&cbq.lock);
+    while (cbq.running)
+        pthread_cond_wait(&cbq.space_cond, &cbq.lock);
+    pthread_mutex_unlock(&cbq.lock);
+}
+
+/*
+ * Queue a callback; data, if any, is copied into the record and handed to
+ * the callback in place of the handler's buffer.
+ */
+int fm_cb_post(int type, int a, int b, const void *data, int len)
+{
+    struct fm_cb_rec_t *rec;
+    struct timespec ts;
+    uint32_t depth;
+    int ret = 0;
+
+    if (type < 0 || type >= FM_CB_MAX || len < 0 || len > FM_CB_DATA_MAX)
+        return -EINVAL;
+
+    pthread_mutex_lock(&cbq.lock);
+    if (!cbq.running || cbq.stop) {
+        ret = -FM_HC_STATUS_FAIL;
+        goto drop;
+    }
+
+    if (fm_cb_flags[type] & FM_CB_F_MERGE) {
+        uint32_t seq = cbq.pending[type];
+
+        if (seq != FM_CB_NONE && (int32_t)(seq - cbq.tail) >= 0) {
+            rec = &cbq.ring[seq & (FM_CB_QUEUE_SIZE - 1)];
+            cbq.stats[FM_CB_STAT_MERGED]++;
+            goto fill;
+        }
+    } else if (!(fm_cb_flags[type] & FM_CB_F_DROP)) {
+        fm_cb_clear_pending();
+    }
+
+    depth = cbq.head - cbq.tail;
+    if ((fm_cb_flags[type] & FM_CB_F_DROP) && depth >= FM_CB_RDS_LIMIT) {
+        ret = -FM_HC_STATUS_NOMEM;
+        goto drop;
+    }
+    if (depth >= FM_CB_QUEUE_SIZE) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += FM_CB_POST_WAIT_MS * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        while (cbq.head - cbq.tail >= FM_CB_QUEUE_SIZE && cbq.running && ret == 0)
+            ret = pthread_cond_timedwait(&cbq.space_cond, &cbq.lock, &ts);
+        if (cbq.head - cbq.tail >= FM_CB_QUEUE_SIZE || !cbq.running) {
+            ALOGE("%s: callback %d lost, dispatcher stalled", __func__, type);
+            ret = -ETIMEDOUT;
+            goto drop;
+        }
+        ret = 0;
+    }
+
+    if (fm_cb_flags[type] & FM_CB_F_MERGE)
+        cbq.pending[type] = cbq.head;
+    rec = &cbq.ring[cbq.head & (FM_CB_QUEUE_SIZE - 1)];
+    cbq.head++;
+    depth = cbq.head - cbq.tail;
+    if (depth > cbq.stats[FM_CB_STAT_HIGH_WM])
+        cbq.stats[FM_CB_STAT_HIGH_WM] = depth;
+    pthread_cond_signal(&cbq.cond);
+
+fill:
+    rec->type = type;
+    rec->a = a;
+    rec->b = b;
+    rec->len = len;
+    if (len)
+        memcpy(rec->data, data, len);
+    memset(rec->data + len, 0, FM_CB_DATA_MAX - len);
+    cbq.stats[FM_CB_STAT_POSTED]++;
+    pthread_mutex_unlock(&cbq.lock);
+    return FM_HC_STATUS_SUCCESS;
+
+drop:
+    cbq.stats[FM_CB_STAT_DROPPED]++;
+    pthread_mutex_unlock(&cbq.lock);
+    FM_LOGV("%s: dropped callback %d", __func__, type);
+    return ret;
+}
+
+int fm_cb_get_stat(int field, int *val)
+{
+    if (field < 0 || field >= FM_CB_STAT_MAX || !val)
+        return -EINVAL;
+
+    pthread_mutex_lock(&cbq.lock);
+    if (field == FM_CB_STAT_DEPTH)
+        *val = cbq.head - cbq.tail;
+    else
+        *val = cbq.stats[field];
+    pthread_mutex_unlock(&cbq.lock);
+    return FM_HC_STATUS_SUCCESS;
+}
@@ -35,22 +35,16 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "radio-helium-commands.h"
 #include "radio-helium.h"
 #include "fm_hci_api.h"
+#include "fm_log.h"
 #include <dlfcn.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 int hci_fm_get_signal_threshold();
 int hci_fm_enable_recv_req();
 int hci_fm_mute_mode_req(struct hci_fm_mute_mode_req *);
-static int oda_agt;
 static int grp_mask;
-static int rt_plus_carrier = -1;
-static int ert_carrier = -1;
-static unsigned char ert_buf[256];
-static unsigned char ert_len;
-static unsigned char c_byt_pair_index;
-static char utf_8_flag;
-static char rt_ert_flag;
-static char formatting_dir;
 static uint32_t ch_det_th_mask_flag;
 static uint32_t def_data_rd_mask_flag;
 static uint32_t blend_tbl_mask_flag;
@@ -59,6 +53,38 @@ static uint32_t station_dbg_param_mask_flag;
 uint64_t flag;
 struct fm_hal_t *hal = NULL;
 
+/* Outstanding get_fm_ctrl reads. CC events carry no request id, so a
+ * response goes to the oldest pending read with the same opcode */
+#define FM_REQ_SLOTS 16
+/* An unanswered read older than this is taken to have lost its CC */
+#define FM_REQ_EXPIRE_MS 2000
+
+enum fm_req_state {
+    FM_REQ_FREE,
+    FM_REQ_PENDING,
+    FM_REQ_DONE,
+    FM_REQ_ABANDONED,
+};
+
+struct fm_req_t {
+    uint32_t seq;
+    uint16_t opcode;
+    int cmd;
+    int state;
+    char waited;
+    int status;
+    int val;
+    uint64_t sent_ns;
+};
+
+static uint64_t hci_now_ns(void);
+
+static struct fm_req_t fm_reqs[FM_REQ_SLOTS];
+static uint32_t fm_req_seq;
+static pthread_mutex_t fm_req_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fm_req_cond;
+static pthread_once_t fm_req_once = PTHREAD_ONCE_INIT;
+
 #define LOG_TAG "radio_helium"
 static void radio_hci_req_complete(char result)
 {
@@ -70,6 +96,32 @@ static void radio_hci_status_complete(int result)
    ALOGD("%s:enetred %s", LOG_TAG, __func__);
 }
 
+/* End of the event being handled, only valid on the rx thread */
+static char *hci_evt_end;
+
+/* Bytes of the current event from p on, as much as a callback record takes */
+static int hci_evt_left(const char *p)
+{
+    int left = hci_evt_end - p;
+
+    if (left < 0)
+        return 0;
+    return left > FM_CB_DATA_MAX ? FM_CB_DATA_MAX : left;
+}
+
+/* Copies a default data read response, data_len comes from the SoC */
+static void hci_copy_def_data(const char *rsp)
+{
+    int len = (unsigned char)rsp[1] + sizeof(char);
+    int left = hci_evt_end - &rsp[1];
+
+    if (len > (int)sizeof(hal->radio->def_data))
+        len = sizeof(hal->radio->def_data);
+    if (len > left)
+        len = left > 0 ? left : 0;
+    memcpy(&hal->radio->def_data, &rsp[1], len);
+}
+
 static void hci_cc_fm_enable_rsp(char *ev_rsp)
 {
     struct hci_fm_conf_rsp  *rsp;
@@ -80,7 +132,7 @@ static void hci_cc_fm_enable_rsp(char *ev_rsp)
     }
     rsp = (struct hci_fm_conf_rsp *)ev_rsp;
     radio_hci_req_complete(rsp->status);
-    hal->jni_cb->enabled_cb();
+    fm_cb_post(FM_CB_ENABLED, 0, 0, NULL, 0);
     if (rsp->status == FM_HC_STATUS_SUCCESS)
         hal->radio->mode = FM_RECV;
 }
@@ -143,7 +195,7 @@ static void hci_cc_rds_grp_cntrs_rsp(char *ev_buff)
     if (status < 0) {
         ALOGE("%s:%s, read rds_grp_cntrs failed status=%d\n", LOG_TAG, __func__,status);
     }
-    hal->jni_cb->rds_grp_cntrs_rsp_cb(&ev_buff[1]);
+    fm_cb_post(FM_CB_RDS_GRP_CNTRS, 0, 0, &ev_buff[1], hci_evt_left(&ev_buff[1]));
 }
 
 static void hci_cc_rds_grp_cntrs_ext_rsp(char *ev_buff)
@@ -159,7 +211,7 @@ static void hci_cc_rds_grp_cntrs_ext_rsp(char *ev_buff)
     if (status < 0) {
         ALOGE("%s:%s, read rds_grp_cntrs_ext failed status=%d\n", LOG_TAG, __func__,status);
     }
-    hal->jni_cb->rds_grp_cntrs_ext_rsp_cb(&ev_buff[1]);
+    fm_cb_post(FM_CB_RDS_GRP_CNTRS_EXT, 0, 0, &ev_buff[1], hci_evt_left(&ev_buff[1]));
 }
 
 static void hci_cc_riva_peek_rsp(char *ev_buff)
@@ -175,7 +227,8 @@ static void hci_cc_riva_peek_rsp(char *ev_buff)
     if (status < 0) {
         ALOGE("%s:%s, peek failed=%d\n", LOG_TAG, __func__, status);
     }
-    hal->jni_cb->fm_peek_rsp_cb(&ev_buff[PEEK_DATA_OFSET]);
+    fm_cb_post(FM_CB_PEEK, 0, 0, &ev_buff[PEEK_DATA_OFSET],
+               hci_evt_left(&ev_buff[PEEK_DATA_OFSET]));
     radio_hci_req_complete(status);
 }
 
@@ -192,7 +245,8 @@ static void hci_cc_ssbi_peek_rsp(char *ev_buff)
     if (status < 0) {
         ALOGE("%s:%s,ssbi peek failed=%d\n", LOG_TAG, __func__, status);
     }
-    hal->jni_cb->fm_ssbi_peek_rsp_cb(&ev_buff[PEEK_DATA_OFSET]);
+    fm_cb_post(FM_CB_SSBI_PEEK, 0, 0, &ev_buff[PEEK_DATA_OFSET],
+               hci_evt_left(&ev_buff[PEEK_DATA_OFSET]));
     radio_hci_req_complete(status);
 }
 
@@ -209,7 +263,7 @@ static void hci_cc_agc_rsp(char *ev_buff)
     if (status != 0) {
         ALOGE("%s:%s,agc gain failed=%d\n", LOG_TAG, __func__, status);
     } else {
-        hal->jni_cb->fm_agc_gain_rsp_cb(&ev_buff[1]);
+        fm_cb_post(FM_CB_AGC_GAIN, 0, 0, &ev_buff[1], hci_evt_left(&ev_buff[1]));
     }
     radio_hci_req_complete(status);
 }
@@ -241,14 +295,14 @@ static void hci_cc_get_ch_det_threshold_rsp(char *ev_buff)
             val = hal->radio->ch_det_threshold.high_th;
     }
     clear_all_bit(ch_det_th_mask_flag);
-    hal->jni_cb->fm_get_ch_det_thr_cb(val, status);
+    fm_cb_post(FM_CB_GET_CH_DET_THR, val, status, NULL, 0);
 }
 
 static void hci_cc_set_ch_det_threshold_rsp(char *ev_buff)
 {
     int status = ev_buff[0];
 
-    hal->jni_cb->fm_set_ch_det_thr_cb(status);
+    fm_cb_post(FM_CB_SET_CH_DET_THR, status, 0, NULL, 0);
 }
 
 static void hci_cc_sig_threshold_rsp(char *ev_buff)
@@ -263,12 +317,12 @@ static void hci_cc_sig_threshold_rsp(char *ev_buff)
     } else {
         val = ev_buff[1];
     }
-    hal->jni_cb->fm_get_sig_thres_cb(val, status);
+    fm_cb_post(FM_CB_GET_SIG_THRES, val, status, NULL, 0);
 }
 
 static void hci_cc_default_data_read_rsp(char *ev_buff)
 {
-    int status, val= 0, data_len = 0;
+    int status, val= 0;
 
     if (ev_buff == NULL) {
         ALOGE("Response buffer is null");
@@ -276,9 +330,8 @@ static void hci_cc_default_data_read_rsp(char *ev_buff)
     }
     status = ev_buff[0];
     if (status == 0) {
-        data_len = ev_buff[1];
-        ALOGV("hci_cc_default_data_read_rsp:data_len = %d", data_len);
-        memcpy(&hal->radio->def_data, &ev_buff[1], data_len + sizeof(char));
+        ALOGV("hci_cc_default_data_read_rsp:data_len = %d", ev_buff[1]);
+        hci_copy_def_data(ev_buff);
 
         if (test_bit(def_data_rd_mask_flag, CMD_DEFRD_AF_RMSSI_TH)) {
             val = hal->radio->def_data.data[AF_RMSSI_TH_OFFSET];
@@ -307,14 +360,14 @@ static void hci_cc_default_data_read_rsp(char *ev_buff)
         ALOGE("%s: Error: Status= 0x%x", __func__, status);
     }
     clear_all_bit(def_data_rd_mask_flag);
-    hal->jni_cb->fm_def_data_read_cb(val, status);
+    fm_cb_post(FM_CB_DEF_DATA_READ, val, status, NULL, 0);
 }
 
 static void hci_cc_default_data_write_rsp(char *ev_buff)
 {
     int status = ev_buff[0];
 
-    hal->jni_cb->fm_def_data_write_cb(status);
+    fm_cb_post(FM_CB_DEF_DATA_WRITE, status, 0, NULL, 0);
 }
 
 static void hci_cc_get_blend_tbl_rsp(char *ev_buff)
@@ -344,14 +397,14 @@ static void hci_cc_get_blend_tbl_rsp(char *ev_buff)
         }
     }
     clear_all_bit(blend_tbl_mask_flag);
-    hal->jni_cb->fm_get_blend_cb(val, status);
+    fm_cb_post(FM_CB_GET_BLEND, val, status, NULL, 0);
 }
 
 static void hci_cc_set_blend_tbl_rsp(char *ev_buff)
 {
     int status = ev_buff[0];
 
-    hal->jni_cb->fm_set_blend_cb(status);
+    fm_cb_post(FM_CB_SET_BLEND, status, 0, NULL, 0);
 }
 
 static void hci_cc_station_rsp(char *ev_buff)
@@ -371,7 +424,7 @@ static void hci_cc_station_rsp(char *ev_buff)
     }
     ALOGE("hci_cc_station_rsp: val =%x, status = %x", val, status);
 
-    hal->jni_cb->fm_get_station_param_cb(val, status);
+    fm_cb_post(FM_CB_STATION_PARAM, val, status, NULL, 0);
     clear_all_bit(station_param_mask_flag);
 }
 
@@ -389,163 +442,512 @@ static void hci_cc_dbg_param_rsp(char *ev_buff)
         }
     }
     ALOGE("hci_cc_dbg_param_rsp: val =%x, status = %x", val, status);
-    hal->jni_cb->fm_get_station_debug_param_cb(val, status);
+    fm_cb_post(FM_CB_STATION_DBG_PARAM, val, status, NULL, 0);
     clear_all_bit(station_dbg_param_mask_flag);
 }
 
 static void hci_cc_enable_slimbus_rsp(char *ev_buff)
 {
     ALOGV("%s status %d", __func__, ev_buff[0]);
-    hal->jni_cb->thread_evt_cb(0);
-    hal->jni_cb->enable_slimbus_cb(ev_buff[0]);
+    fm_cb_post(FM_CB_ENABLE_SLIMBUS, ev_buff[0], 0, NULL, 0);
 }
 
-static inline void hci_cmd_complete_event(char *buff)
+static void hci_ev_program_service(char *buff);
+static void hci_ev_radio_text(char *buff);
+static void hci_ev_af_list(char *buff);
+
+/* The RDS getters answer with a status byte and then the matching event. */
+static void hci_cc_prg_srv_rsp(char *ev_buff)
 {
-    uint16_t opcode;
-    uint8_t *pbuf;
+    if (ev_buff[0]) {
+        ALOGE("%s: status %d", __func__, ev_buff[0]);
+        return;
+    }
+    hci_ev_program_service(&ev_buff[1]);
+}
 
-    if (buff == NULL) {
-        ALOGE("%s:%s, buffer is null\n", LOG_TAG, __func__);
+static void hci_cc_radio_txt_rsp(char *ev_buff)
+{
+    if (ev_buff[0]) {
+        ALOGE("%s: status %d", __func__, ev_buff[0]);
         return;
     }
-    ALOGV("%s:buff[1] = 0x%x buff[2] = 0x%x", LOG_TAG, buff[1], buff[2]);
-    opcode = ((buff[2] << 8) | buff[1]);
-    ALOGV("%s: Received HCI CMD COMPLETE EVENT for the opcode: 0x%x", __func__, opcode);
-    pbuf = &buff[3];
+    hci_ev_radio_text(&ev_buff[1]);
+}
 
-    switch (opcode) {
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_ENABLE_RECV_REQ):
-            ALOGE("%s: Recvd. CC event for FM_ENABLE_RECV_REQ", __func__);
-            hci_cc_fm_enable_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_RECV_CONF_REQ):
-            hci_cc_conf_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_DISABLE_RECV_REQ):
-            hci_cc_fm_disable_rsp(pbuf);
-            break;
+static void hci_cc_af_list_rsp(char *ev_buff)
+{
+    if (ev_buff[0]) {
+        ALOGE("%s: status %d", __func__, ev_buff[0]);
+        return;
+    }
+    hci_ev_af_list(&ev_buff[1]);
+}
 
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_RECV_CONF_REQ):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_MUTE_MODE_REQ):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_STEREO_MODE_REQ):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_ANTENNA):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_SIGNAL_THRESHOLD):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_CANCEL_SEARCH):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_RDS_GRP):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_RDS_GRP_PROCESS):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_EN_WAN_AVD_CTRL):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_EN_NOTCH_CTRL):
-            hci_cc_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_CH_DET_THRESHOLD):
-            hci_cc_set_ch_det_threshold_rsp(pbuf);
-            break;
-    case hci_common_cmd_op_pack(HCI_OCF_FM_RESET):
-    case hci_diagnostic_cmd_op_pack(HCI_OCF_FM_SSBI_POKE_REG):
-    case hci_diagnostic_cmd_op_pack(HCI_OCF_FM_POKE_DATA):
-    case hci_diagnostic_cmd_op_pack(HCI_FM_SET_INTERNAL_TONE_GENRATOR):
-    case hci_common_cmd_op_pack(HCI_OCF_FM_SET_CALIBRATION):
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_EVENT_MASK):
-    case hci_common_cmd_op_pack(HCI_OCF_FM_SET_SPUR_TABLE):
-            hci_cc_rsp(pbuf);
-            break;
-    case hci_status_param_op_pack(HCI_OCF_FM_READ_GRP_COUNTERS):
-            hci_cc_rds_grp_cntrs_rsp(pbuf);
-            break;
-    case hci_status_param_op_pack(HCI_OCF_FM_READ_GRP_COUNTERS_EXT):
-            hci_cc_rds_grp_cntrs_ext_rsp(pbuf);
-            break;
-    case hci_diagnostic_cmd_op_pack(HCI_OCF_FM_PEEK_DATA):
-            hci_cc_riva_peek_rsp(buff);
-            break;
-    case hci_diagnostic_cmd_op_pack(HCI_OCF_FM_SSBI_PEEK_REG):
-            hci_cc_ssbi_peek_rsp(buff);
-            break;
-    case hci_diagnostic_cmd_op_pack(HCI_FM_SET_GET_RESET_AGC):
-            hci_cc_agc_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_CH_DET_THRESHOLD):
-            hci_cc_get_ch_det_threshold_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_SIGNAL_THRESHOLD):
-            hci_cc_sig_threshold_rsp(pbuf);
-            break;
-    case hci_common_cmd_op_pack(HCI_OCF_FM_DEFAULT_DATA_READ):
-            hci_cc_default_data_read_rsp(pbuf);
-            break;
-    case hci_common_cmd_op_pack(HCI_OCF_FM_DEFAULT_DATA_WRITE):
-            hci_cc_default_data_write_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_BLND_TBL):
-            hci_cc_get_blend_tbl_rsp(pbuf);
-            break;
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_SET_BLND_TBL):
-            hci_cc_set_blend_tbl_rsp(pbuf);
-            break;
+static void hci_cc_feature_list_rsp(char *ev_buff)
+{
+    struct hci_fm_feature_list_rsp *rsp = (struct hci_fm_feature_list_rsp *)ev_buff;
 
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_STATION_PARAM_REQ):
-            hci_cc_station_rsp(pbuf);
-            break;
+    if (rsp->status) {
+        ALOGE("%s: status %d", __func__, rsp->status);
+        return;
+    }
+    hal->radio->feature_mask = rsp->feature_mask;
+    ALOGI("%s: feature mask 0x%x", __func__, (unsigned char)rsp->feature_mask);
+}
 
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_LOW_PASS_FILTER_CTRL):
-            ALOGI("%s: recived LPF enable event", __func__);
-            hci_cc_rsp(pbuf);
-            break;
+static void hci_cc_get_spur_tbl_rsp(char *ev_buff)
+{
+    struct hci_fm_set_spur_table_req *tbl;
 
-    case hci_diagnostic_cmd_op_pack(HCI_OCF_FM_STATION_DBG_PARAM):
-            hci_cc_dbg_param_rsp(pbuf);
-            break;
+    if (ev_buff[0]) {
+        ALOGE("%s: status %d", __func__, ev_buff[0]);
+        return;
+    }
+    tbl = (struct hci_fm_set_spur_table_req *)&ev_buff[1];
+    ALOGI("%s: mode %d, %d entries", __func__, tbl->mode,
+          (unsigned char)tbl->no_of_freqs_entries);
+}
 
-    case hci_diagnostic_cmd_op_pack(HCI_OCF_FM_ENABLE_SLIMBUS):
-            hci_cc_enable_slimbus_rsp(pbuf);
-            break;
+static void hci_cc_do_calibration_rsp(char *ev_buff)
+{
+    struct hci_cc_do_calibration_rsp *rsp = (struct hci_cc_do_calibration_rsp *)ev_buff;
 
-/*    case hci_common_cmd_op_pack(HCI_OCF_FM_GET_SPUR_TABLE):
-            hci_cc_get_spur_tbl(buff);
-            break;
+    if (rsp->status) {
+        ALOGE("%s: mode %d, status %d", __func__, rsp->mode, rsp->status);
+        return;
+    }
+    ALOGI("%s: mode %d done", __func__, rsp->mode);
+}
 
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_PROGRAM_SERVICE_REQ):
-            hci_cc_prg_srv_rsp(buff);
-            break;
+static void fm_req_cond_init(void)
+{
+    pthread_condattr_t attr;
 
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_RADIO_TEXT_REQ):
-            hci_cc_rd_txt_rsp(buff);
-            break;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&fm_req_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
 
-    case hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_AF_LIST_REQ):
-            hci_cc_af_list_rsp(buff);
-            break;
+/*
+ * Called with fm_req_lock held. A read nobody waits for, or whose waiter
+ * gave up, keeps its slot until its CC comes, so a late CC still finds it
+ * rather than the next read of that opcode; past FM_REQ_EXPIRE_MS the CC
+ * is taken as lost and the slot is reused.
+ */
+static struct fm_req_t *fm_req_alloc(uint16_t opcode, int cmd, char waited)
+{
+    struct fm_req_t *stale = NULL, *req = NULL;
+    uint64_t now = hci_now_ns();
+    int i;
 
-    case hci_common_cmd_op_pack(HCI_OCF_FM_GET_FEATURE_LIST):
-            hci_cc_feature_list_rsp(buff);
+    for (i = 0; i < FM_REQ_SLOTS; i++) {
+        if (fm_reqs[i].state == FM_REQ_FREE) {
+            req = &fm_reqs[i];
             break;
+        }
+        if (fm_reqs[i].state != FM_REQ_ABANDONED
+                && !(fm_reqs[i].state == FM_REQ_PENDING && !fm_reqs[i].waited))
+            continue;
+        if (now - fm_reqs[i].sent_ns < FM_REQ_EXPIRE_MS * 1000000ULL)
+            continue;
+        if (stale == NULL || (int32_t)(fm_reqs[i].seq - stale->seq) < 0)
+            stale = &fm_reqs[i];
+    }
+    if (req == NULL && stale != NULL) {
+        ALOGW("%s: no CC for opcode 0x%x in %d ms, reusing its slot", __func__,
+                stale->opcode, FM_REQ_EXPIRE_MS);
+        req = stale;
+    }
+    if (req == NULL)
+        return NULL;
+
+    if (++fm_req_seq == 0)
+        ++fm_req_seq;
+    req->seq = fm_req_seq;
+    req->opcode = opcode;
+    req->cmd = cmd;
+    req->state = FM_REQ_PENDING;
+    req->waited = waited;
+    req->status = 0;
+    req->val = 0;
+    req->sent_ns = now;
+    return req;
+}
 
-    case hci_status_param_op_pack(HCI_OCF_FM_READ_GRP_COUNTERS):
-            hci_cc_rds_grp_cntrs_rsp(buff);
-            break;
-    case hci_common_cmd_op_pack(HCI_OCF_FM_DO_CALIBRATION):
-            hci_cc_do_calibration_rsp(buff);
-            break;
+/* Called with fm_req_lock held */
+static struct fm_req_t *fm_req_find(uint32_t seq)
+{
+    int i;
+
+    for (i = 0; i < FM_REQ_SLOTS; i++) {
+        if (fm_reqs[i].state != FM_REQ_FREE && fm_reqs[i].seq == seq)
+            return &fm_reqs[i];
+    }
+    return NULL;
+}
+
+/* Copies a read response into the radio cache, returns the value of 'cmd' */
+static int fm_req_rsp_val(int cmd, char *rsp)
+{
+    unsigned char *tmp;
+    int val = 0;
+
+    switch (cmd) {
+    case HCI_FM_HELIUM_SINR_SAMPLES:
+    case HCI_FM_HELIUM_SINR_THRESHOLD:
+    case HCI_FM_HELIUM_INTF_LOW_THRESHOLD:
+    case HCI_FM_HELIUM_INTF_HIGH_THRESHOLD:
+        memcpy(&hal->radio->ch_det_threshold, &rsp[1],
+                sizeof(struct hci_fm_ch_det_threshold));
+        if (cmd == HCI_FM_HELIUM_SINR_THRESHOLD)
+            val = hal->radio->ch_det_threshold.sinr;
+        else if (cmd == HCI_FM_HELIUM_SINR_SAMPLES)
+            val = hal->radio->ch_det_threshold.sinr_samples;
+        else if (cmd == HCI_FM_HELIUM_INTF_LOW_THRESHOLD)
+            val = hal->radio->ch_det_threshold.low_th;
+        else
+            val = hal->radio->ch_det_threshold.high_th;
+        break;
+    case HCI_FM_HELIUM_SINRFIRSTSTAGE:
+    case HCI_FM_HELIUM_RMSSIFIRSTSTAGE:
+    case HCI_FM_HELIUM_CF0TH12:
+    case HCI_FM_HELIUM_SRCHALGOTYPE:
+    case HCI_FM_HELIUM_AF_RMSSI_TH:
+    case HCI_FM_HELIUM_GOOD_CH_RMSSI_TH:
+    case HCI_FM_HELIUM_AF_RMSSI_SAMPLES:
+    case HCI_FM_HELIUM_RXREPEATCOUNT:
+        hci_copy_def_data(rsp);
+        if (cmd == HCI_FM_HELIUM_AF_RMSSI_TH) {
+            val = hal->radio->def_data.data[AF_RMSSI_TH_OFFSET];
+        } else if (cmd == HCI_FM_HELIUM_AF_RMSSI_SAMPLES) {
+            val = hal->radio->def_data.data[AF_RMSSI_SAMPLES_OFFSET];
+        } else if (cmd == HCI_FM_HELIUM_GOOD_CH_RMSSI_TH) {
+            val = hal->radio->def_data.data[GD_CH_RMSSI_TH_OFFSET];
+            if (val > MAX_GD_CH_RMSSI_TH)
+                val -= 256;
+        } else if (cmd == HCI_FM_HELIUM_SRCHALGOTYPE) {
+            val = hal->radio->def_data.data[SRCH_ALGO_TYPE_OFFSET];
+        } else if (cmd == HCI_FM_HELIUM_SINRFIRSTSTAGE) {
+            val = hal->radio->def_data.data[SINRFIRSTSTAGE_OFFSET];
+            if (val > MAX_SINR_FIRSTSTAGE)
+                val -= 256;
+        } else if (cmd == HCI_FM_HELIUM_RMSSIFIRSTSTAGE) {
+            val = hal->radio->def_data.data[RMSSIFIRSTSTAGE_OFFSET];
+        } else if (cmd == HCI_FM_HELIUM_CF0TH12) {
+            val = (hal->radio->def_data.data[CF0TH12_BYTE1_OFFSET] |
+                    (hal->radio->def_data.data[CF0TH12_BYTE2_OFFSET] << 8));
+        } else {
+            val = hal->radio->def_data.data[RX_REPEATE_BYTE_OFFSET];
+        }
+        break;
+    case HCI_FM_HELIUM_BLEND_SINRHI:
+    case HCI_FM_HELIUM_BLEND_RMSSIHI:
+        memcpy(&hal->radio->blend_tbl, &rsp[1],
+                sizeof(struct hci_fm_blend_table));
+        if (cmd == HCI_FM_HELIUM_BLEND_SINRHI)
+            val = hal->radio->blend_tbl.BlendSinrHi;
+        else
+            val = hal->radio->blend_tbl.BlendRmssiHi;
+        break;
+    case HCI_FM_HELIUM_IOVERC:
+    case HCI_FM_HELIUM_INTDET:
+        memcpy(&hal->radio->st_dbg_param, &rsp[1],
+                sizeof(struct hci_fm_dbg_param_rsp));
+        if (cmd == HCI_FM_HELIUM_INTDET)
+            val = hal->radio->st_dbg_param.in_det_out;
+        else
+            val = hal->radio->st_dbg_param.io_verc;
+        break;
+    case HCI_FM_HELIUM_GET_SINR:
+    case HCI_FM_HELIUM_RMSSI:
+        tmp = (unsigned char *)(&hal->radio->fm_st_rsp.station_rsp)
+                + sizeof(char);
+        memcpy(tmp, &rsp[1],
+                sizeof(struct hci_ev_tune_status) - sizeof(char));
+        if (cmd == HCI_FM_HELIUM_GET_SINR)
+            val = hal->radio->fm_st_rsp.station_rsp.sinr;
+        else
+            val = hal->radio->fm_st_rsp.station_rsp.rssi;
+        break;
+    default:
+        break;
+    }
+    return val;
+}
+
+/*
+ * Matches a CC event to the oldest pending read for its opcode.
+ * Returns 1 when the response was consumed by a get_fm_ctrl_async
+ * caller, 0 when it should go through the jni callback path.
+ */
+static int fm_req_complete(uint16_t opcode, char *rsp)
+{
+    struct fm_req_t *req = NULL;
+    int i, consumed = 0;
+
+    pthread_mutex_lock(&fm_req_lock);
+    for (i = 0; i < FM_REQ_SLOTS; i++) {
+        if ((fm_reqs[i].state != FM_REQ_PENDING
+                && fm_reqs[i].state != FM_REQ_ABANDONED)
+                || fm_reqs[i].opcode != opcode)
+            continue;
+        if (req == NULL || (int32_t)(fm_reqs[i].seq - req->seq) < 0)
+            req = &fm_reqs[i];
+    }
+
+    if (req != NULL) {
+        if (!req->waited) {
+            req->state = FM_REQ_FREE;
+        } else if (req->state == FM_REQ_ABANDONED) {
+            ALOGW("%s: late response for opcode 0x%x dropped", __func__, opcode);
+            req->state = FM_REQ_FREE;
+            consumed = 1;
+        } else {
+            req->status = rsp[0];
+            if (req->status == 0)
+                req->val = fm_req_rsp_val(req->cmd, rsp);
+            req->state = FM_REQ_DONE;
+            pthread_cond_broadcast(&fm_req_cond);
+            consumed = 1;
+        }
+    }
+    pthread_mutex_unlock(&fm_req_lock);
+
+    return consumed;
+}
+
+/* Fails every outstanding read, the controller will not answer them */
+static void fm_req_flush(void)
+{
+    int i;
 
+    pthread_mutex_lock(&fm_req_lock);
+    for (i = 0; i < FM_REQ_SLOTS; i++) {
+        if (fm_reqs[i].state == FM_REQ_PENDING && fm_reqs[i].waited) {
+            fm_reqs[i].status = -FM_HC_STATUS_FAIL;
+            fm_reqs[i].state = FM_REQ_DONE;
+        } else if (fm_reqs[i].state != FM_REQ_DONE) {
+            fm_reqs[i].state = FM_REQ_FREE;
+        }
+    }
+    pthread_cond_broadcast(&fm_req_cond);
+    pthread_mutex_unlock(&fm_req_lock);
+}
+
+/* OGFs used by the FM SoC, in command complete dispatch table order */
+static int hci_ogf_index(uint16_t ogf)
+{
+    switch (ogf) {
+    case HCI_OGF_FM_RECV_CTRL_CMD_REQ:
+        return 0;
+    case HCI_OGF_FM_TRANS_CTRL_CMD_REQ:
+        return 1;
+    case HCI_OGF_FM_COMMON_CTRL_CMD_REQ:
+        return 2;
+    case HCI_OGF_FM_STATUS_PARAMETERS_CMD_REQ:
+        return 3;
+    case HCI_OGF_FM_TEST_CMD_REQ:
+        return 4;
+    case HCI_OGF_FM_DIAGNOSTIC_CMD_REQ:
+        return 5;
     default:
-            ALOGE("opcode 0x%x", opcode);
-            break; */
+        return -1;
+    }
+}
+
+#define HCI_CC_RECV     0
+#define HCI_CC_COMMON   2
+#define HCI_CC_STATUS   3
+#define HCI_CC_DIAG     5
+
+/*
+ * 'evt' handlers get the whole CC event instead of its return parameters.
+ * Opcodes without an entry can be hooked up with hci_cc_register_handler.
+ */
+#define HCI_CC(fn)      { fn, 0, {0, 0} }
+#define HCI_CC_EVT(fn)  { fn, 1, {0, 0} }
+
+struct hci_cc_entry_t {
+    hci_cc_handler_t handler;
+    char evt;
+    struct hci_dispatch_stats_t stats;
+};
+
+static struct hci_cc_entry_t hci_cc_tbl[HCI_CC_OGF_GRPS][HCI_CC_OCF_MAX] = {
+    [HCI_CC_RECV] = {
+        [HCI_OCF_FM_ENABLE_RECV_REQ]        = HCI_CC(hci_cc_fm_enable_rsp),
+        [HCI_OCF_FM_GET_RECV_CONF_REQ]      = HCI_CC(hci_cc_conf_rsp),
+        [HCI_OCF_FM_DISABLE_RECV_REQ]       = HCI_CC(hci_cc_fm_disable_rsp),
+        [HCI_OCF_FM_SET_RECV_CONF_REQ]      = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_MUTE_MODE_REQ]      = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_STEREO_MODE_REQ]    = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_ANTENNA]            = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_SIGNAL_THRESHOLD]   = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_CANCEL_SEARCH]          = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_RDS_GRP]                = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_RDS_GRP_PROCESS]        = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_EN_WAN_AVD_CTRL]        = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_EN_NOTCH_CTRL]          = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_EVENT_MASK]         = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_CH_DET_THRESHOLD]   = HCI_CC(hci_cc_set_ch_det_threshold_rsp),
+        [HCI_OCF_FM_GET_CH_DET_THRESHOLD]   = HCI_CC(hci_cc_get_ch_det_threshold_rsp),
+        [HCI_OCF_FM_GET_SIGNAL_THRESHOLD]   = HCI_CC(hci_cc_sig_threshold_rsp),
+        [HCI_OCF_FM_GET_BLND_TBL]           = HCI_CC(hci_cc_get_blend_tbl_rsp),
+        [HCI_OCF_FM_SET_BLND_TBL]           = HCI_CC(hci_cc_set_blend_tbl_rsp),
+        [HCI_OCF_FM_GET_STATION_PARAM_REQ]  = HCI_CC(hci_cc_station_rsp),
+        [HCI_OCF_FM_LOW_PASS_FILTER_CTRL]   = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_GET_PROGRAM_SERVICE_REQ] = HCI_CC(hci_cc_prg_srv_rsp),
+        [HCI_OCF_FM_GET_RADIO_TEXT_REQ]     = HCI_CC(hci_cc_radio_txt_rsp),
+        [HCI_OCF_FM_GET_AF_LIST_REQ]        = HCI_CC(hci_cc_af_list_rsp),
+    },
+    [HCI_CC_COMMON] = {
+        [HCI_OCF_FM_RESET]                  = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_GET_FEATURE_LIST]       = HCI_CC(hci_cc_feature_list_rsp),
+        [HCI_OCF_FM_DO_CALIBRATION]         = HCI_CC(hci_cc_do_calibration_rsp),
+        [HCI_OCF_FM_GET_SPUR_TABLE]         = HCI_CC(hci_cc_get_spur_tbl_rsp),
+        [HCI_OCF_FM_SET_CALIBRATION]        = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_SET_SPUR_TABLE]         = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_DEFAULT_DATA_READ]      = HCI_CC(hci_cc_default_data_read_rsp),
+        [HCI_OCF_FM_DEFAULT_DATA_WRITE]     = HCI_CC(hci_cc_default_data_write_rsp),
+    },
+    [HCI_CC_STATUS] = {
+        [HCI_OCF_FM_READ_GRP_COUNTERS]      = HCI_CC(hci_cc_rds_grp_cntrs_rsp),
+        [HCI_OCF_FM_READ_GRP_COUNTERS_EXT]  = HCI_CC(hci_cc_rds_grp_cntrs_ext_rsp),
+    },
+    [HCI_CC_DIAG] = {
+        [HCI_OCF_FM_SSBI_POKE_REG]          = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_POKE_DATA]              = HCI_CC(hci_cc_rsp),
+        [HCI_FM_SET_INTERNAL_TONE_GENRATOR] = HCI_CC(hci_cc_rsp),
+        [HCI_OCF_FM_PEEK_DATA]              = HCI_CC_EVT(hci_cc_riva_peek_rsp),
+        [HCI_OCF_FM_SSBI_PEEK_REG]          = HCI_CC_EVT(hci_cc_ssbi_peek_rsp),
+        [HCI_FM_SET_GET_RESET_AGC]          = HCI_CC(hci_cc_agc_rsp),
+        [HCI_OCF_FM_STATION_DBG_PARAM]      = HCI_CC(hci_cc_dbg_param_rsp),
+        [HCI_OCF_FM_ENABLE_SLIMBUS]         = HCI_CC(hci_cc_enable_slimbus_rsp),
+    },
+};
+
+static uint64_t hci_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct hci_cc_entry_t *hci_cc_entry(uint16_t opcode)
+{
+    int grp = hci_ogf_index(hci_opcode_ogf(opcode));
+    uint16_t ocf = hci_opcode_ocf(opcode);
+
+    if (grp < 0 || ocf >= HCI_CC_OCF_MAX)
+        return NULL;
+    return &hci_cc_tbl[grp][ocf];
+}
+
+static const uint32_t hci_lat_bounds_us[HCI_LAT_BUCKETS - 1] = {
+    50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+/* Only called from the fm_hci rx thread */
+static void hci_stats_record(struct hci_dispatch_stats_t *st, uint64_t latency_ns)
+{
+    uint32_t us = latency_ns / 1000;
+    int i;
+
+    for (i = 0; i < HCI_LAT_BUCKETS - 1 && us >= hci_lat_bounds_us[i]; i++)
+        ;
+    st->hist[i]++;
+    st->samples++;
+    st->total_latency_us += us;
+    st->last_latency_us = us;
+    if (us > st->max_latency_us)
+        st->max_latency_us = us;
+}
+
+/* Installs, or with NULL removes, the CC handler of an opcode */
+int hci_cc_register_handler(uint16_t opcode, hci_cc_handler_t handler)
+{
+    struct hci_cc_entry_t *entry = hci_cc_entry(opcode);
+
+    if (!entry) {
+        ALOGE("%s: opcode 0x%x out of table range", __func__, opcode);
+        return -EINVAL;
+    }
+    entry->evt = 0;
+    __atomic_store_n(&entry->handler, handler, __ATOMIC_RELEASE);
+    return FM_HC_STATUS_SUCCESS;
+}
+
+int hci_get_cc_stats(uint16_t opcode, struct hci_dispatch_stats_t *stats)
+{
+    struct hci_cc_entry_t *entry = hci_cc_entry(opcode);
+
+    if (!entry || !stats)
+        return -EINVAL;
+    *stats = entry->stats;
+    return FM_HC_STATUS_SUCCESS;
+}
+
+static inline void hci_cmd_complete_event(char *buff)
+{
+    uint16_t opcode;
+    uint8_t *pbuf;
+    struct hci_cc_entry_t *entry;
+    hci_cc_handler_t handler;
+    uint64_t latency_ns;
+
+    if (buff == NULL) {
+        ALOGE("%s:%s, buffer is null\n", LOG_TAG, __func__);
+        return;
+    }
+    opcode = ((buff[2] << 8) | buff[1]);
+    pbuf = &buff[3];
+    FM_TRACE(FM_TRACE_HAL_CMD_COMPLETE, opcode, pbuf[0]);
+
+    entry = hci_cc_entry(opcode);
+    if (entry) {
+        entry->stats.count++;
+        latency_ns = fm_hci_cmd_latency_ns(hal->private_data);
+        if (latency_ns)
+            hci_stats_record(&entry->stats, latency_ns);
+    }
+
+    if (fm_req_complete(opcode, (char *)pbuf))
+        return;
+
+    handler = entry ? __atomic_load_n(&entry->handler, __ATOMIC_ACQUIRE) : NULL;
+    if (handler == NULL) {
+        ALOGE("opcode 0x%x", opcode);
+        return;
     }
+    handler(entry->evt ? buff : (char *)pbuf);
 }
 
 static inline void hci_cmd_status_event(char *st_rsp)
 {
     struct hci_ev_cmd_status *ev = (void *) st_rsp;
+    struct hci_cc_entry_t *entry;
     uint16_t opcode;
+    uint64_t latency_ns;
 
     if (st_rsp == NULL) {
         ALOGE("%s:%s, buffer is null\n", LOG_TAG, __func__);
         return;
     }
-    ALOGE("%s:st_rsp[2] = 0x%x st_rsp[3] = 0x%x", LOG_TAG, st_rsp[2], st_rsp[3]);
     opcode = ((st_rsp[3] << 8) | st_rsp[2]);
-    ALOGE("%s: Received HCI CMD STATUS EVENT for opcode: 0x%x", __func__, opcode);
+    FM_TRACE(FM_TRACE_HAL_CMD_STATUS, opcode, (uint8_t)ev->status);
+
+    /* searches are only acknowledged with a CS; opcodes with a CC handler
+     * are counted when their CC comes, and opcode 0 only returns credits */
+    entry = opcode ? hci_cc_entry(opcode) : NULL;
+    if (entry && __atomic_load_n(&entry->handler, __ATOMIC_ACQUIRE) == NULL) {
+        entry->stats.count++;
+        latency_ns = fm_hci_cmd_latency_ns(hal->private_data);
+        if (latency_ns)
+            hci_stats_record(&entry->stats, latency_ns);
+    }
 
     radio_hci_status_complete(ev->status);
 }
@@ -557,25 +959,27 @@ static inline void hci_ev_tune_status(char *buff)
                                sizeof(struct hci_ev_tune_status));
     char *freq = &hal->radio->fm_st_rsp.station_rsp.station_freq;
     ALOGD("freq = %d", hal->radio->fm_st_rsp.station_rsp.station_freq);
-    hal->jni_cb->tune_cb(hal->radio->fm_st_rsp.station_rsp.station_freq);
+    fm_cb_post(FM_CB_TUNE, hal->radio->fm_st_rsp.station_rsp.station_freq, 0, NULL, 0);
 
     //    if (hal->radio->fm_st_rsp.station_rsp.serv_avble)
           // todo callback for threshould
 
     if (hal->radio->fm_st_rsp.station_rsp.stereo_prg)
-        hal->jni_cb->stereo_status_cb(true);
+        fm_cb_post(FM_CB_STEREO, true, 0, NULL, 0);
     else if (hal->radio->fm_st_rsp.station_rsp.stereo_prg == 0)
-        hal->jni_cb->stereo_status_cb(false);
+        fm_cb_post(FM_CB_STEREO, false, 0, NULL, 0);
 
+    rds_decoder_reset();
+    rds_cache_tune();
     if (hal->radio->fm_st_rsp.station_rsp.rds_sync_status)
-        hal->jni_cb->rds_avail_status_cb(true);
+        fm_cb_post(FM_CB_RDS_AVAIL, true, 0, NULL, 0);
     else
-        hal->jni_cb->rds_avail_status_cb(false);
+        fm_cb_post(FM_CB_RDS_AVAIL, false, 0, NULL, 0);
 }
 
 static inline void hci_ev_search_next(char *buff)
 {
-    hal->jni_cb->scan_next_cb();
+    fm_cb_post(FM_CB_SCAN_NEXT, 0, 0, NULL, 0);
 }
 
 static inline void hci_ev_stereo_status(char *buff)
@@ -588,9 +992,9 @@ static inline void hci_ev_stereo_status(char *buff)
     }
     st_status =  buff[0];
     if (st_status)
-        hal->jni_cb->stereo_status_cb(true);
+        fm_cb_post(FM_CB_STEREO, true, 0, NULL, 0);
     else
-        hal->jni_cb->stereo_status_cb(false);
+        fm_cb_post(FM_CB_STEREO, false, 0, NULL, 0);
 }
 
 static void hci_ev_rds_lock_status(char *buff)
@@ -605,16 +1009,20 @@ static void hci_ev_rds_lock_status(char *buff)
     rds_status = buff[0];
 
     if (rds_status)
-        hal->jni_cb->rds_avail_status_cb(true);
+        fm_cb_post(FM_CB_RDS_AVAIL, true, 0, NULL, 0);
     else
-        hal->jni_cb->rds_avail_status_cb(false);
+        fm_cb_post(FM_CB_RDS_AVAIL, false, 0, NULL, 0);
 }
 
-static inline void hci_ev_program_service(char *buff)
+static void hci_ev_program_service(char *buff)
 {
     int len;
     char *data;
 
+    /* decoded from raw groups instead */
+    if (rds_decoder_enabled())
+        return;
+
     len = (buff[RDS_PS_LENGTH_OFFSET] * RDS_STRING) + RDS_OFFSET;
     data = malloc(len);
     if (!data) {
@@ -630,13 +1038,16 @@ static inline void hci_ev_program_service(char *buff)
 
     memcpy(data+RDS_OFFSET, &buff[RDS_PS_DATA_OFFSET], len-RDS_OFFSET);
 
-    ALOGV("call ps-callback");
-    hal->jni_cb->ps_update_cb(data);
+    if (rds_cache_changed(RDS_CACHE_PS, ((unsigned char)data[2] << 8) | (unsigned char)data[3],
+                          data, len)) {
+        ALOGV("call ps-callback");
+        fm_cb_post(FM_CB_PS, 0, 0, data, len);
+    }
 
     free(data);
 }
 
-static inline void hci_ev_radio_text(char *buff)
+static void hci_ev_radio_text(char *buff)
 {
     int len = 0;
     char *data;
@@ -645,6 +1056,8 @@ static inline void hci_ev_radio_text(char *buff)
         ALOGE("%s:%s, buffer is null\n", LOG_TAG,__func__);
         return;
     }
+    if (rds_decoder_enabled())
+        return;
 
     while ((buff[len+RDS_OFFSET] != 0x0d) && (len < MAX_RT_LENGTH))
            len++;
@@ -667,7 +1080,9 @@ static inline void hci_ev_radio_text(char *buff)
     memcpy(data+RDS_OFFSET, &buff[RDS_OFFSET], len);
 
     data[len+RDS_OFFSET] = 0x00;
-    hal->jni_cb->rt_update_cb(data);
+    if (rds_cache_changed(RDS_CACHE_RT, ((unsigned char)data[2] << 8) | (unsigned char)data[3],
+                          data, len + RDS_OFFSET))
+        fm_cb_post(FM_CB_RT, 0, 0, data, len + RDS_OFFSET + 1);
     free(data);
 }
 
@@ -688,7 +1103,7 @@ static void hci_ev_af_list(char *buff)
     }
     memcpy(&ev.af_list[0], &buff[AF_LIST_OFFSET],
                                         ev.af_size * sizeof(int));
-    hal->jni_cb->af_list_update_cb(&ev);
+    fm_cb_post(FM_CB_AF_LIST, 0, 0, &ev, sizeof(ev));
 }
 
 static inline void hci_ev_search_compl(char *buff)
@@ -698,7 +1113,7 @@ static inline void hci_ev_search_compl(char *buff)
         return;
     }
     hal->radio->search_on = 0;
-    hal->jni_cb->seek_cmpl_cb(hal->radio->fm_st_rsp.station_rsp.station_freq);
+    fm_cb_post(FM_CB_SEEK_CMPL, hal->radio->fm_st_rsp.station_rsp.station_freq, 0, NULL, 0);
 }
 
 static inline void hci_ev_srch_st_list_compl(char *buff)
@@ -737,7 +1152,7 @@ static inline void hci_ev_srch_st_list_compl(char *buff)
     }
 
     len = ev->num_stations_found * 2 + sizeof(ev->num_stations_found);
-    hal->jni_cb->srch_list_cb((char*)ev);
+    fm_cb_post(FM_CB_SRCH_LIST, 0, 0, ev, sizeof(*ev));
     free(ev);
 }
 
@@ -747,7 +1162,7 @@ static inline void hci_ev_rt_plus_id(char *buff)
     int len = 15;
     unsigned short int agt;
 
-    ALOGD("%s:%s: start", LOG_TAG, __func__);
+    FM_LOGD("%s:%s: start", LOG_TAG, __func__);
     data = malloc(len);
     if (data != NULL) {
        data[0] = len;
@@ -757,7 +1172,7 @@ static inline void hci_ev_rt_plus_id(char *buff)
        data[4] = buff[3];
 
       memcpy(&data[RDS_OFFSET], &buff[4], len-RDS_OFFSET);
-      ALOGD("%s:%s: RT+ ID grouptype=0x%x%x\n", LOG_TAG, __func__,data[4]);
+      FM_LOGD("%s:%s: RT+ ID grouptype=0x%x%x\n", LOG_TAG, __func__,data[4]);
       free(data);
     } else {
         ALOGE("%s:memory allocation failed\n", LOG_TAG);
@@ -770,18 +1185,18 @@ static void hci_ev_rt_plus_tag(char *buff)
     int len = 15;
     unsigned short int agt;
 
-    ALOGD("%s:%s: start", LOG_TAG, __func__);
+    FM_LOGD("%s:%s: start", LOG_TAG, __func__);
     data = malloc(len);
     if (data != NULL) {
         data[0] = len;
-        ALOGI("%s:%s: data length=%d\n", LOG_TAG, __func__,data[0]);
+        FM_LOGD("%s:%s: data length=%d\n", LOG_TAG, __func__,data[0]);
         data[1] = buff[RDS_PTYPE];
         data[2] = buff[RDS_PID_LOWER];
         data[3] = buff[RDS_PID_HIGHER];
         data[4] = buff[3];
         memcpy(&data[RDS_OFFSET], &buff[4], len-RDS_OFFSET);
         // data[len] = 0x00;
-        hal->jni_cb->rt_plus_update_cb(data);
+        fm_cb_post(FM_CB_RT_PLUS, 0, 0, data, len);
         free(data);
      } else {
         ALOGE("%s:memory allocation failed\n", LOG_TAG);
@@ -792,102 +1207,33 @@ static void  hci_ev_ext_country_code(char *buff)
 {
     char *data = NULL;
     int len = ECC_EVENT_BUFSIZE;
-    ALOGD("%s:%s: start", LOG_TAG, __func__);
+    FM_LOGD("%s:%s: start", LOG_TAG, __func__);
     data = malloc(len);
     if (data != NULL) {
         data[0] = len;
-        ALOGI("%s:%s: data length=%d\n", LOG_TAG, __func__,data[0]);
+        FM_LOGD("%s:%s: data length=%d\n", LOG_TAG, __func__,data[0]);
         data[1] = buff[RDS_PTYPE];
         data[2] = buff[RDS_PID_LOWER];
         data[3] = buff[RDS_PID_HIGHER];
         data[4] = buff[3];
         memcpy(&data[RDS_OFFSET], &buff[4], len-RDS_OFFSET);
-        hal->jni_cb->ext_country_code_cb(data);
+        fm_cb_post(FM_CB_ECC, 0, 0, data, len);
         free(data);
     } else {
         ALOGE("%s:memory allocation failed\n", LOG_TAG);
     }
 }
 
-static void hci_ev_ert()
-{
-    char *data = NULL;
-
-    if (ert_len <= 0)
-        return;
-    data = malloc(ert_len + 3);
-    if (data != NULL) {
-        data[0] = ert_len;
-        data[1] = utf_8_flag;
-        data[2] = formatting_dir;
-        memcpy((data + 3), ert_buf, ert_len);
-        hal->jni_cb->ert_update_cb(data);
-        free(data);
-    }
-}
-
 static void hci_ev_hw_error(char *buff)
 {
    ALOGE("%s:%s: start", LOG_TAG, __func__);
    fm_hci_close(hal->private_data);
 }
 
-static void hci_buff_ert(struct rds_grp_data *rds_buf)
-{
-    int i;
-    unsigned short int info_byte = 0;
-    unsigned short int byte_pair_index;
-
-    if (rds_buf == NULL) {
-        ALOGE("%s:%s, rds buffer is null\n", LOG_TAG, __func__);
-        return;
-    }
-    byte_pair_index = AGT(rds_buf->rdsBlk[1].rdsLsb);
-    if (byte_pair_index == 0) {
-        c_byt_pair_index = 0;
-        ert_len = 0;
-    }
-    if (c_byt_pair_index == byte_pair_index) {
-        c_byt_pair_index++;
-        for (i = 2; i <= 3; i++) {
-             info_byte = rds_buf->rdsBlk[i].rdsLsb;
-             info_byte |= (rds_buf->rdsBlk[i].rdsMsb << 8);
-             ert_buf[ert_len++] = rds_buf->rdsBlk[i].rdsMsb;
-             ert_buf[ert_len++] = rds_buf->rdsBlk[i].rdsLsb;
-             if ((utf_8_flag == 0) && (info_byte == CARRIAGE_RETURN)) {
-                 ert_len -= 2;
-                 break;
-             } else if ((utf_8_flag == 1) &&
-                        (rds_buf->rdsBlk[i].rdsMsb == CARRIAGE_RETURN)) {
-                 info_byte = CARRIAGE_RETURN;
-                 ert_len -= 2;
-                 break;
-             } else if ((utf_8_flag == 1) &&
-                        (rds_buf->rdsBlk[i].rdsLsb == CARRIAGE_RETURN)) {
-                 info_byte = CARRIAGE_RETURN;
-                 ert_len--;
-                 break;
-             }
-        }
-        if ((byte_pair_index == MAX_ERT_SEGMENT) ||
-            (info_byte == CARRIAGE_RETURN)) {
-            hci_ev_ert();
-            c_byt_pair_index = 0;
-            ert_len = 0;
-        }
-    } else {
-        ert_len = 0;
-        c_byt_pair_index = 0;
-    }
-}
-
 static void hci_ev_raw_rds_group_data(char *buff)
 {
     unsigned char blocknum, index;
     struct rds_grp_data temp;
-    unsigned int mask_bit;
-    unsigned short int aid, agt, gtc;
-    unsigned short int carrier;
 
     index = RDSGRP_DATA_OFFSET;
 
@@ -902,139 +1248,129 @@ static void hci_ev_raw_rds_group_data(char *buff)
          index = index + 2;
     }
 
-    aid = AID(temp.rdsBlk[3].rdsLsb, temp.rdsBlk[3].rdsMsb);
-    gtc = GTC(temp.rdsBlk[1].rdsMsb);
-    agt = AGT(temp.rdsBlk[1].rdsLsb);
-
-    if (gtc == GRP_3A) {
-        switch (aid) {
-        case ERT_AID:
-            /* calculate the grp mask for RDS grp
-             * which will contain actual eRT text
-             *
-             * Bit Pos  0  1  2  3  4   5  6   7
-             * Grp Type 0A 0B 1A 1B 2A  2B 3A  3B
-             *
-             * similary for rest grps
-             */
-             mask_bit = (((agt >> 1) << 1) + (agt & 1));
-             oda_agt = (1 << mask_bit);
-             utf_8_flag = (temp.rdsBlk[2].rdsLsb & 1);
-             formatting_dir = EXTRACT_BIT(temp.rdsBlk[2].rdsLsb,
-                                               ERT_FORMAT_DIR_BIT);
-             if (ert_carrier != agt)
-                 hal->jni_cb->oda_update_cb();
-             ert_carrier = agt;
-             break;
-        case RT_PLUS_AID:
-            /* calculate the grp mask for RDS grp
-             * which will contain actual eRT text
-             *
-             * Bit Pos  0  1  2  3  4   5  6   7
-             * Grp Type 0A 0B 1A 1B 2A  2B 3A  3B
-             *
-             * similary for rest grps
-             */
-             mask_bit = (((agt >> 1) << 1) + (agt & 1));
-             oda_agt =  (1 << mask_bit);
-             /*Extract 5th bit of MSB (b7b6b5b4b3b2b1b0)*/
-             rt_ert_flag = EXTRACT_BIT(temp.rdsBlk[2].rdsMsb,
-                                              RT_ERT_FLAG_BIT);
-             if (rt_plus_carrier != agt)
-                 hal->jni_cb->oda_update_cb();
-             rt_plus_carrier = agt;
-             break;
-        default:
-             oda_agt = 0;
-             break;
-        }
-    } else {
-        carrier = gtc;
-        if ((carrier == rt_plus_carrier)) {
-         //    hci_ev_rt_plus(temp);
-        }
-        else if (carrier == ert_carrier) {
-             ALOGI("%s:: calling event ert", __func__);
-             hci_buff_ert(&temp);
-       }
-    }
+    rds_decode_group(&temp);
 }
 
-static void radio_hci_event_packet(char *evt_buf)
+struct hci_ev_entry_t {
+    hci_cc_handler_t handler;
+    struct hci_dispatch_stats_t stats;
+};
+
+/* Indexed by event code, handlers get the event parameters */
+static struct hci_ev_entry_t hci_ev_tbl[HCI_EV_MAX] = {
+    [HCI_EV_TUNE_STATUS]            = { hci_ev_tune_status, {0, 0} },
+    [HCI_EV_SEARCH_PROGRESS]        = { hci_ev_search_next, {0, 0} },
+    [HCI_EV_SEARCH_RDS_PROGRESS]    = { hci_ev_search_next, {0, 0} },
+    [HCI_EV_SEARCH_LIST_PROGRESS]   = { hci_ev_search_next, {0, 0} },
+    [HCI_EV_STEREO_STATUS]          = { hci_ev_stereo_status, {0, 0} },
+    [HCI_EV_RDS_LOCK_STATUS]        = { hci_ev_rds_lock_status, {0, 0} },
+    [HCI_EV_RDS_RX_DATA]            = { hci_ev_raw_rds_group_data, {0, 0} },
+    [HCI_EV_PROGRAM_SERVICE]        = { hci_ev_program_service, {0, 0} },
+    [HCI_EV_RADIO_TEXT]             = { hci_ev_radio_text, {0, 0} },
+    [HCI_EV_FM_AF_LIST]             = { hci_ev_af_list, {0, 0} },
+    [HCI_EV_CMD_COMPLETE]           = { hci_cmd_complete_event, {0, 0} },
+    [HCI_EV_CMD_STATUS]             = { hci_cmd_status_event, {0, 0} },
+    [HCI_EV_SEARCH_COMPLETE]        = { hci_ev_search_compl, {0, 0} },
+    [HCI_EV_SEARCH_RDS_COMPLETE]    = { hci_ev_search_compl, {0, 0} },
+    [HCI_EV_SEARCH_LIST_COMPLETE]   = { hci_ev_srch_st_list_compl, {0, 0} },
+    [HCI_EV_RADIO_TEXT_PLUS_ID]     = { hci_ev_rt_plus_id, {0, 0} },
+    [HCI_EV_RADIO_TEXT_PLUS_TAG]    = { hci_ev_rt_plus_tag, {0, 0} },
+    [HCI_EV_EXT_COUNTRY_CODE]       = { hci_ev_ext_country_code, {0, 0} },
+    [HCI_EV_HW_ERR_EVENT]           = { hci_ev_hw_error, {0, 0} },
+};
+
+/* Latencies of an event entry are the time spent in its handler */
+int hci_get_ev_stats(uint8_t evt, struct hci_dispatch_stats_t *stats)
 {
-    char evt;
+    if (evt >= HCI_EV_MAX || !stats)
+        return -EINVAL;
+    *stats = hci_ev_tbl[evt].stats;
+    return FM_HC_STATUS_SUCCESS;
+}
 
-    ALOGE("%s:%s: Received %d bytes of HCI EVENT PKT from Controller", LOG_TAG,
-                                      __func__, ((struct fm_event_header_t *)evt_buf)->evt_len);
-    evt = ((struct fm_event_header_t *)evt_buf)->evt_code;
-    ALOGE("%s:evt: %d", LOG_TAG, evt);
+/* Racing the rx thread at worst loses the sample being recorded */
+void hci_reset_dispatch_stats(void)
+{
+    int grp, ocf, evt;
 
-    switch(evt) {
-    case HCI_EV_TUNE_STATUS:
-        hci_ev_tune_status(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_SEARCH_PROGRESS:
-    case HCI_EV_SEARCH_RDS_PROGRESS:
-    case HCI_EV_SEARCH_LIST_PROGRESS:
-        hci_ev_search_next(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_STEREO_STATUS:
-        hci_ev_stereo_status(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_RDS_LOCK_STATUS:
-        hci_ev_rds_lock_status(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-/*    case HCI_EV_SERVICE_AVAILABLE:
-        hci_ev_service_available(hdev, skb);
-        break; */
-    case HCI_EV_RDS_RX_DATA:
-        hci_ev_raw_rds_group_data(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_PROGRAM_SERVICE:
-        hci_ev_program_service(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_RADIO_TEXT:
-        hci_ev_radio_text(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_FM_AF_LIST:
-        hci_ev_af_list(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_CMD_COMPLETE:
-        ALOGE("%s:%s: Received HCI_EV_CMD_COMPLETE", LOG_TAG, __func__);
-        hci_cmd_complete_event(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_CMD_STATUS:
-        hci_cmd_status_event(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_SEARCH_COMPLETE:
-    case HCI_EV_SEARCH_RDS_COMPLETE:
-        hci_ev_search_compl(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_SEARCH_LIST_COMPLETE:
-        hci_ev_srch_st_list_compl(((struct fm_event_header_t *)evt_buf)->params);
-        break;
-    case HCI_EV_RADIO_TEXT_PLUS_ID:
-        hci_ev_rt_plus_id(((struct fm_event_header_t *)evt_buf)->params);
+    for (grp = 0; grp < HCI_CC_OGF_GRPS; grp++)
+        for (ocf = 0; ocf < HCI_CC_OCF_MAX; ocf++)
+            memset(&hci_cc_tbl[grp][ocf].stats, 0, sizeof(struct hci_dispatch_stats_t));
+    for (evt = 0; evt < HCI_EV_MAX; evt++)
+        memset(&hci_ev_tbl[evt].stats, 0, sizeof(struct hci_dispatch_stats_t));
+}
+
+/* Reads one value of the stats picked by an HCI_LAT_SEL selector */
+static int hci_get_latency_field(int sel, int *val)
+{
+    struct hci_dispatch_stats_t st;
+    int kind = (sel >> 24) & 0xff, field = sel & 0xff;
+    uint16_t code = (sel >> 8) & 0xffff;
+    int ret;
+
+    if (field == HCI_LAT_FIELD_BOUND) {
+        if (code >= HCI_LAT_BUCKETS)
+            return -EINVAL;
+        *val = code < HCI_LAT_BUCKETS - 1 ? (int)hci_lat_bounds_us[code] : -1;
+        return FM_HC_STATUS_SUCCESS;
+    }
+
+    if (kind == HCI_LAT_KIND_CMD)
+        ret = hci_get_cc_stats(code, &st);
+    else if (kind == HCI_LAT_KIND_EVT && code <= 0xff)
+        ret = hci_get_ev_stats(code, &st);
+    else
+        ret = -EINVAL;
+    if (ret < 0)
+        return ret;
+
+    if (field < HCI_LAT_BUCKETS) {
+        *val = st.hist[field];
+        return FM_HC_STATUS_SUCCESS;
+    }
+    switch (field) {
+    case HCI_LAT_FIELD_COUNT:
+        *val = st.count;
         break;
-    case HCI_EV_RADIO_TEXT_PLUS_TAG:
-        hci_ev_rt_plus_tag(((struct fm_event_header_t *)evt_buf)->params);
+    case HCI_LAT_FIELD_LAST:
+        *val = st.last_latency_us;
         break;
-    case HCI_EV_EXT_COUNTRY_CODE:
-        hci_ev_ext_country_code(((struct fm_event_header_t *)evt_buf)->params);
+    case HCI_LAT_FIELD_MAX:
+        *val = st.max_latency_us;
         break;
-    case HCI_EV_HW_ERR_EVENT:
-        hci_ev_hw_error(((struct fm_event_header_t *)evt_buf)->params);
+    case HCI_LAT_FIELD_AVG:
+        *val = st.samples ? st.total_latency_us / st.samples : 0;
         break;
     default:
-        break;
+        return -EINVAL;
     }
+    return FM_HC_STATUS_SUCCESS;
+}
+
+static void radio_hci_event_packet(char *evt_buf)
+{
+    uint8_t evt;
+    struct hci_ev_entry_t *entry;
+    uint64_t start_ns;
+
+    evt = ((struct fm_event_header_t *)evt_buf)->evt_code;
+    hci_evt_end = (char *)((struct fm_event_header_t *)evt_buf)->params +
+                          ((struct fm_event_header_t *)evt_buf)->evt_len;
+    FM_TRACE(FM_TRACE_HAL_EVENT, evt, ((struct fm_event_header_t *)evt_buf)->evt_len);
+
+    if (evt >= HCI_EV_MAX || hci_ev_tbl[evt].handler == NULL)
+        return;
+
+    entry = &hci_ev_tbl[evt];
+    start_ns = hci_now_ns();
+    entry->handler((char *)((struct fm_event_header_t *)evt_buf)->params);
+    entry->stats.count++;
+    hci_stats_record(&entry->stats, hci_now_ns() - start_ns);
 }
 
 /* 'evt_buf' contains the event received from Controller */
 int process_event(void *hal, unsigned char *evt_buf)
 {
-    ALOGI("%s: %s: Received event notification from FM-HCI thread. EVT CODE: %d ",
-                            LOG_TAG,  __func__, ((struct fm_event_header_t *)evt_buf)->evt_code);
     radio_hci_event_packet(evt_buf);
     return 0;
 }
@@ -1044,9 +1380,10 @@ int fm_hci_close_done()
     ALOGI("fm_hci_close_done");
     if(hal != NULL){
         ALOGI("Notifying FM OFF to JNI");
+        fm_req_flush();
         hal->radio->mode = FM_OFF;
-        hal->jni_cb->disabled_cb();
-        hal->jni_cb->thread_evt_cb(1);
+        fm_cb_post(FM_CB_DISABLED, 0, 0, NULL, 0);
+        fm_cb_stop();
     }
     return 0;
 }
@@ -1177,14 +1514,23 @@ int hal_init(fm_hal_callbacks_t *cb)
     }
 
     memset(hal->radio, 0,  sizeof(struct radio_helium_device));
+    pthread_once(&fm_req_once, fm_req_cond_init);
+
+    ret = fm_cb_start();
+    if (ret != FM_HC_STATUS_SUCCESS)
+        goto out;
 
     hci_hal.hal = hal;
     hci_hal.cb = &hal_cb;
+    hci_hal.queue_mode = FM_HCI_QUEUE_RING;
 
     /* Initialize the FM-HCI */
     ret = fm_hci_init(&hci_hal);
     if (ret != FM_HC_STATUS_SUCCESS) {
         ALOGE("%s:fm_hci_init failed", __func__);
+        /* the dispatcher still uses hal->jni_cb until it exits */
+        fm_cb_stop();
+        fm_cb_wait_stopped();
         goto out;
     }
     hal->private_data = hci_hal.hci;
@@ -1332,7 +1678,8 @@ static int set_fm_ctrl(int cmd, int val)
          break;
     case HCI_FM_HELIUM_RDSGROUP_MASK:
          saved_val = hal->radio->rds_grp.rds_grp_enable_mask;
-         grp_mask = (grp_mask | oda_agt | val);
+         grp_mask = (grp_mask | rds_decoder_oda_mask() | val);
+         grp_mask |= rds_decoder_grp_mask();
          hal->radio->rds_grp.rds_grp_enable_mask = grp_mask;
          hal->radio->rds_grp.rds_buf_size = 1;
          hal->radio->rds_grp.en_rds_change_filter = 0;
@@ -1624,6 +1971,45 @@ static int set_fm_ctrl(int cmd, int val)
              ALOGI("%s: command sent sucessfully", __func__, val);
          }
          break;
+    case HCI_FM_HELIUM_RDS_SW_DECODE:
+         rds_decoder_enable(val);
+         if (!val)
+             break;
+         /* decoding needs the raw groups, ask the SoC for them */
+         saved_val = hal->radio->rds_grp.rds_grp_enable_mask;
+         grp_mask |= rds_decoder_grp_mask();
+         hal->radio->rds_grp.rds_grp_enable_mask = grp_mask;
+         hal->radio->rds_grp.rds_buf_size = 1;
+         hal->radio->rds_grp.en_rds_change_filter = 0;
+         ret = helium_rds_grp_mask_req(&hal->radio->rds_grp);
+         if (ret < 0) {
+             ALOGE("%s:error in setting group mask\n", LOG_TAG);
+             hal->radio->rds_grp.rds_grp_enable_mask = saved_val;
+             rds_decoder_enable(0);
+             goto end;
+         }
+         break;
+    case HCI_FM_HELIUM_RDS_COALESCE_MS:
+         if (val < 0) {
+             ret = -EINVAL;
+             goto end;
+         }
+         hal->radio->rds_coalesce_ms = val;
+         break;
+    case HCI_FM_HELIUM_LOG_LEVEL:
+         fm_log_set_level(val);
+         break;
+    case HCI_FM_HELIUM_TRACE_DUMP:
+         fm_trace_dump(-1);
+         break;
+    case HCI_FM_HELIUM_LATENCY_RESET:
+         hci_reset_dispatch_stats();
+         break;
+    case HCI_FM_HELIUM_SNOOP_DUMP:
+         ret = fm_hci_snoop_dump(NULL);
+         if (ret > 0)
+             ret = 0;
+         break;
     case HCI_FM_HELIUM_AUDIO:
          ALOGE("%s slimbus port", val ? "enable" : "disable");
          ret = hci_fm_enable_slimbus(val);
@@ -1639,10 +2025,98 @@ end:
     return ret;
 }
 
+/*
+ * Sends the controller read behind 'cmd' and registers it in the request
+ * table first, so the CC cannot race the registration. 'waited' reads are
+ * answered through wait_fm_ctrl, others through the jni callbacks.
+ */
+static int fm_ctrl_read(int cmd, char waited, uint32_t *seq)
+{
+    struct hci_fm_def_data_rd_req def_data_rd;
+    struct fm_req_t *req;
+    uint16_t opcode;
+    int ret;
+
+    memset(&def_data_rd, 0, sizeof(def_data_rd));
+    switch (cmd) {
+    case HCI_FM_HELIUM_SINR_SAMPLES:
+    case HCI_FM_HELIUM_SINR_THRESHOLD:
+    case HCI_FM_HELIUM_INTF_LOW_THRESHOLD:
+    case HCI_FM_HELIUM_INTF_HIGH_THRESHOLD:
+        opcode = hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_CH_DET_THRESHOLD);
+        break;
+    case HCI_FM_HELIUM_SINRFIRSTSTAGE:
+    case HCI_FM_HELIUM_RMSSIFIRSTSTAGE:
+    case HCI_FM_HELIUM_CF0TH12:
+    case HCI_FM_HELIUM_SRCHALGOTYPE:
+        def_data_rd.mode = FM_SRCH_CONFG_MODE;
+        def_data_rd.length = FM_SRCH_CNFG_LEN;
+        opcode = hci_common_cmd_op_pack(HCI_OCF_FM_DEFAULT_DATA_READ);
+        break;
+    case HCI_FM_HELIUM_AF_RMSSI_TH:
+    case HCI_FM_HELIUM_GOOD_CH_RMSSI_TH:
+    case HCI_FM_HELIUM_AF_RMSSI_SAMPLES:
+        def_data_rd.mode = FM_AFJUMP_CONFG_MODE;
+        def_data_rd.length = FM_AFJUMP_CNFG_LEN;
+        opcode = hci_common_cmd_op_pack(HCI_OCF_FM_DEFAULT_DATA_READ);
+        break;
+    case HCI_FM_HELIUM_RXREPEATCOUNT:
+        def_data_rd.mode = RDS_PS0_XFR_MODE;
+        def_data_rd.length = RDS_PS0_LEN;
+        opcode = hci_common_cmd_op_pack(HCI_OCF_FM_DEFAULT_DATA_READ);
+        break;
+    case HCI_FM_HELIUM_BLEND_SINRHI:
+    case HCI_FM_HELIUM_BLEND_RMSSIHI:
+        opcode = hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_BLND_TBL);
+        break;
+    case HCI_FM_HELIUM_IOVERC:
+    case HCI_FM_HELIUM_INTDET:
+        opcode = hci_diagnostic_cmd_op_pack(HCI_OCF_FM_STATION_DBG_PARAM);
+        break;
+    case HCI_FM_HELIUM_GET_SINR:
+    case HCI_FM_HELIUM_RMSSI:
+        if (hal->radio->mode != FM_RECV) {
+            ALOGE("%s: radio is not in recv mode", __func__);
+            return -EINVAL;
+        }
+        opcode = hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_STATION_PARAM_REQ);
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&fm_req_lock);
+    req = fm_req_alloc(opcode, cmd, waited);
+    if (req && seq)
+        *seq = req->seq;
+    pthread_mutex_unlock(&fm_req_lock);
+    if (!req) {
+        ALOGE("%s: too many outstanding reads", __func__);
+        return -FM_HC_STATUS_BUSY;
+    }
+
+    if (opcode == hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_CH_DET_THRESHOLD))
+        ret = hci_fm_get_ch_det_th();
+    else if (opcode == hci_common_cmd_op_pack(HCI_OCF_FM_DEFAULT_DATA_READ))
+        ret = hci_fm_default_data_read_req(&def_data_rd);
+    else if (opcode == hci_recv_ctrl_cmd_op_pack(HCI_OCF_FM_GET_BLND_TBL))
+        ret = hci_fm_get_blend_req();
+    else if (opcode == hci_diagnostic_cmd_op_pack(HCI_OCF_FM_STATION_DBG_PARAM))
+        ret = hci_fm_get_station_dbg_param_req();
+    else
+        ret = hci_fm_get_station_cmd_param_req();
+
+    if (ret != FM_HC_STATUS_SUCCESS) {
+        pthread_mutex_lock(&fm_req_lock);
+        req->state = FM_REQ_FREE;
+        pthread_mutex_unlock(&fm_req_lock);
+    }
+    return ret;
+}
+
 static int get_fm_ctrl(int cmd, int *val)
 {
     int ret = 0;
-    struct hci_fm_def_data_rd_req def_data_rd;
 
     if (!hal) {
         ALOGE("%s:ALERT: command sent before hal_init", __func__);
@@ -1671,111 +2145,100 @@ static int get_fm_ctrl(int cmd, int *val)
             return -FM_HC_STATUS_NULL_POINTER;
         *val = hal->radio->mute_mode.hard_mute;
         break;
+    case HCI_FM_HELIUM_LATENCY_HIST:
+        if (!val)
+            return -FM_HC_STATUS_NULL_POINTER;
+        ret = hci_get_latency_field(*val, val);
+        break;
+    case HCI_FM_HELIUM_CB_STATS:
+        if (!val)
+            return -FM_HC_STATUS_NULL_POINTER;
+        ret = fm_cb_get_stat(*val, val);
+        break;
     case HCI_FM_HELIUM_SINR_SAMPLES:
         set_bit(ch_det_th_mask_flag, CMD_CHDET_SINR_SAMPLE);
-        ret = hci_fm_get_ch_det_th();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(ch_det_th_mask_flag, CMD_CHDET_SINR_SAMPLE);
         break;
     case HCI_FM_HELIUM_SINR_THRESHOLD:
         set_bit(ch_det_th_mask_flag, CMD_CHDET_SINR_TH);
-        ret = hci_fm_get_ch_det_th();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(ch_det_th_mask_flag, CMD_CHDET_SINR_TH);
         break;
     case HCI_FM_HELIUM_INTF_LOW_THRESHOLD:
         set_bit(ch_det_th_mask_flag, CMD_CHDET_INTF_TH_LOW);
-        ret = hci_fm_get_ch_det_th();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(ch_det_th_mask_flag, CMD_CHDET_INTF_TH_LOW);
         break;
     case HCI_FM_HELIUM_INTF_HIGH_THRESHOLD:
         set_bit(ch_det_th_mask_flag, CMD_CHDET_INTF_TH_HIGH);
-        ret = hci_fm_get_ch_det_th();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(ch_det_th_mask_flag, CMD_CHDET_INTF_TH_HIGH);
         break;
     case HCI_FM_HELIUM_SINRFIRSTSTAGE:
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_SINR_FIRST_STAGE);
-        def_data_rd.mode = FM_SRCH_CONFG_MODE;
-        def_data_rd.length = FM_SRCH_CNFG_LEN;
         goto cmd;
     case HCI_FM_HELIUM_RMSSIFIRSTSTAGE:
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_RMSSI_FIRST_STAGE);
-        def_data_rd.mode = FM_SRCH_CONFG_MODE;
-        def_data_rd.length = FM_SRCH_CNFG_LEN;
         goto cmd;
     case HCI_FM_HELIUM_CF0TH12:
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_CF0TH12);
-        def_data_rd.mode = FM_SRCH_CONFG_MODE;
-        def_data_rd.length = FM_SRCH_CNFG_LEN;
         goto cmd;
     case HCI_FM_HELIUM_SRCHALGOTYPE:
-        def_data_rd.mode = FM_SRCH_CONFG_MODE;
-        def_data_rd.length = FM_SRCH_CNFG_LEN;
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_SEARCH_ALGO);
         goto cmd;
     case HCI_FM_HELIUM_AF_RMSSI_TH:
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_AF_RMSSI_TH);
-        def_data_rd.mode = FM_AFJUMP_CONFG_MODE;
-        def_data_rd.length = FM_AFJUMP_CNFG_LEN;
         goto cmd;
     case HCI_FM_HELIUM_GOOD_CH_RMSSI_TH:
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_GD_CH_RMSSI_TH);
-        def_data_rd.mode = FM_AFJUMP_CONFG_MODE;
-        def_data_rd.length = FM_AFJUMP_CNFG_LEN;
         goto cmd;
     case HCI_FM_HELIUM_AF_RMSSI_SAMPLES:
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_AF_RMSSI_SAMPLE);
-        def_data_rd.mode = FM_AFJUMP_CONFG_MODE;
-        def_data_rd.length = FM_AFJUMP_CNFG_LEN;
 
 cmd:
-        def_data_rd.param_len = 0;
-        def_data_rd.param = 0;
-
-        ret = hci_fm_default_data_read_req(&def_data_rd);
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_all_bit(def_data_rd_mask_flag);
         break;
     case HCI_FM_HELIUM_RXREPEATCOUNT:
-        def_data_rd.mode = RDS_PS0_XFR_MODE;
-        def_data_rd.length = RDS_PS0_LEN;
-        def_data_rd.param_len = 0;
-        def_data_rd.param = 0;
         set_bit(def_data_rd_mask_flag, CMD_DEFRD_REPEATCOUNT);
-
-        ret = hci_fm_default_data_read_req(&def_data_rd);
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(def_data_rd_mask_flag, CMD_DEFRD_REPEATCOUNT);
         break;
     case HCI_FM_HELIUM_BLEND_SINRHI:
         set_bit(blend_tbl_mask_flag, CMD_BLENDTBL_SINR_HI);
-        ret = hci_fm_get_blend_req();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(blend_tbl_mask_flag, CMD_BLENDTBL_SINR_HI);
+        break;
     case HCI_FM_HELIUM_BLEND_RMSSIHI:
         set_bit(blend_tbl_mask_flag, CMD_BLENDTBL_RMSSI_HI);
-        ret = hci_fm_get_blend_req();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(blend_tbl_mask_flag, CMD_BLENDTBL_RMSSI_HI);
         break;
     case HCI_FM_HELIUM_IOVERC:
         set_bit(station_dbg_param_mask_flag, CMD_STNDBGPARAM_IOVERC);
-        ret = hci_fm_get_station_dbg_param_req();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(station_dbg_param_mask_flag, CMD_STNDBGPARAM_IOVERC);
         break;
     case HCI_FM_HELIUM_INTDET:
         set_bit(station_dbg_param_mask_flag, CMD_STNDBGPARAM_INFDETOUT);
-        ret = hci_fm_get_station_dbg_param_req();
+        ret = fm_ctrl_read(cmd, 0, NULL);
         if (ret != FM_HC_STATUS_SUCCESS)
             clear_bit(station_dbg_param_mask_flag, CMD_STNDBGPARAM_INFDETOUT);
         break;
     case HCI_FM_HELIUM_GET_SINR:
         if (hal->radio->mode == FM_RECV) {
             set_bit(station_param_mask_flag, CMD_STNPARAM_SINR);
-            ret = hci_fm_get_station_cmd_param_req();
+            ret = fm_ctrl_read(cmd, 0, NULL);
             if (ret != FM_HC_STATUS_SUCCESS)
                 clear_bit(station_param_mask_flag, CMD_STNPARAM_SINR);
         } else {
@@ -1786,7 +2249,7 @@ cmd:
     case HCI_FM_HELIUM_RMSSI:
         if (hal->radio->mode == FM_RECV) {
             set_bit(station_param_mask_flag, CMD_STNPARAM_RSSI);
-            ret = hci_fm_get_station_cmd_param_req();
+            ret = fm_ctrl_read(cmd, 0, NULL);
             if (ret != FM_HC_STATUS_SUCCESS)
                 clear_bit(station_param_mask_flag, CMD_STNPARAM_RSSI);
         } else if (hal->radio->mode == FM_TRANS) {
@@ -1802,8 +2265,96 @@ cmd:
     return ret;
 }
 
+/* Issues a read of 'cmd' and returns a request id to wait on */
+static int get_fm_ctrl_async(int cmd, uint32_t *req_id)
+{
+    struct fm_req_t *req;
+    int ret, val = 0;
+
+    if (!hal) {
+        ALOGE("%s:ALERT: command sent before hal_init", __func__);
+        return -FM_HC_STATUS_FAIL;
+    }
+    if (!req_id)
+        return -FM_HC_STATUS_NULL_POINTER;
+
+    switch (cmd) {
+    case HCI_FM_HELIUM_FREQ:
+    case HCI_FM_HELIUM_UPPER_BAND:
+    case HCI_FM_HELIUM_LOWER_BAND:
+    case HCI_FM_HELIUM_AUDIO_MUTE:
+        /* served from the local cache, the request completes right away */
+        ret = get_fm_ctrl(cmd, &val);
+        if (ret < 0)
+            return ret;
+        pthread_mutex_lock(&fm_req_lock);
+        req = fm_req_alloc(0, cmd, 1);
+        if (req) {
+            req->val = val;
+            req->state = FM_REQ_DONE;
+            *req_id = req->seq;
+        }
+        pthread_mutex_unlock(&fm_req_lock);
+        return req ? FM_HC_STATUS_SUCCESS : -FM_HC_STATUS_BUSY;
+    default:
+        ret = fm_ctrl_read(cmd, 1, req_id);
+        break;
+    }
+    if (ret < 0)
+        ALOGE("%s:%s: %d cmd failed", LOG_TAG, __func__, cmd);
+    return ret;
+}
+
+/* Waits up to timeout_ms for a get_fm_ctrl_async read to complete */
+static int wait_fm_ctrl(uint32_t req_id, int timeout_ms, int *val)
+{
+    struct fm_req_t *req;
+    struct timespec ts;
+    int ret = 0;
+
+    if (!val)
+        return -FM_HC_STATUS_NULL_POINTER;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&fm_req_lock);
+    req = fm_req_find(req_id);
+    if (!req || !req->waited || req->state == FM_REQ_ABANDONED) {
+        pthread_mutex_unlock(&fm_req_lock);
+        return -EINVAL;
+    }
+    while (req->state == FM_REQ_PENDING && ret != ETIMEDOUT)
+        ret = pthread_cond_timedwait(&fm_req_cond, &fm_req_lock, &ts);
+
+    if (req->state == FM_REQ_DONE) {
+        if (req->status == 0) {
+            *val = req->val;
+            ret = FM_HC_STATUS_SUCCESS;
+        } else {
+            ALOGE("%s: cmd %d failed, status 0x%x", __func__, req->cmd, req->status);
+            ret = -FM_HC_STATUS_FAIL;
+        }
+        req->state = FM_REQ_FREE;
+    } else {
+        ALOGE("%s: cmd %d timed out after %d ms", __func__, req->cmd, timeout_ms);
+        req->state = FM_REQ_ABANDONED;
+        ret = -ETIMEDOUT;
+    }
+    pthread_mutex_unlock(&fm_req_lock);
+
+    return ret;
+}
+
 const struct fm_interface_t FM_HELIUM_LIB_INTERFACE = {
     hal_init,
     set_fm_ctrl,
-    get_fm_ctrl
+    get_fm_ctrl,
+    get_fm_ctrl_async,
+    wait_fm_ctrl
 };
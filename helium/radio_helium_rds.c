@@ -0,0 +1,686 @@
+/*
+Copyright (c) 2015-2016 The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Software RDS/RBDS group decoder.
+ *
+ * Raw groups from HCI_EV_RDS_RX_DATA are fed to rds_decode_group(), which
+ * dispatches on the group type code (GTC: type << 1 | version) through
+ * rds_grp_tbl. Multi-group fields (PS, RT, PTYN, EON PS, eRT) are collected
+ * segment by segment and only reported to the jni callbacks once complete
+ * and different from what was last reported.
+ *
+ * 3A ODA announcements and eRT are always decoded, as before. The other
+ * groups are only decoded with HCI_FM_HELIUM_RDS_SW_DECODE on, since the
+ * SoC reports PS/RT/RT+ through its own events otherwise.
+ *
+ * Groups are decoded on the rx thread while enable/reset also come from the
+ * jni thread, so the decoder state is only touched with rds_lock held.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Log.h>
+#include "radio-helium-commands.h"
+#include "radio-helium.h"
+#include "fm_hci_api.h"
+#include "fm_log.h"
+
+#define LOG_TAG "radio_helium"
+
+extern struct fm_hal_t *hal;
+
+#define RDS_PS_SEGS         4
+#define RDS_RT_A_SEGS       16
+#define RDS_RT_B_SEGS       16
+#define RDS_PTYN_SEGS       2
+#define RDS_EON_MAX         8
+#define RDS_GTC_MAX         32
+
+/* Callbacks added after the first fm_hal_callbacks_t, only used when the
+ * client's table is large enough to carry them */
+#define RDS_HAS_CB(field) \
+    (hal->jni_cb->size >= offsetof(fm_hal_callbacks_t, field) + \
+        sizeof(hal->jni_cb->field) && hal->jni_cb->field != NULL)
+
+struct rds_eon_entry_t {
+    struct rds_eon_t eon;
+    uint8_t ps_seg_mask;
+    char published;
+};
+
+struct rds_decoder_t {
+    char enabled;
+    uint16_t pi;
+    uint8_t pty;
+
+    char ps[RDS_STRING];
+    uint8_t ps_seg_mask;
+
+    char rt[MAX_RT_LENGTH];
+    uint16_t rt_seg_mask;
+    uint8_t rt_len;
+    char rt_ab;
+    char rt_ab_valid;
+    char rt_is_b;
+
+    struct rds_ct_t ct;
+    char ct_published;
+
+    char ptyn[RDS_STRING];
+    char ptyn_out[RDS_STRING];
+    uint8_t ptyn_seg_mask;
+    char ptyn_ab;
+    char ptyn_published;
+
+    struct rds_eon_entry_t eon[RDS_EON_MAX];
+
+    /* 3A ODA: group types carrying RT+ & eRT, and their flags */
+    int oda_agt;
+    int rt_plus_carrier;
+    int ert_carrier;
+    char rt_ert_flag;
+    char utf_8_flag;
+    char formatting_dir;
+    char rt_plus_out[RDS_RT_PLUS_LEN];
+    char rt_plus_published;
+
+    unsigned char ert_buf[256];
+    unsigned char ert_len;
+    unsigned char c_byt_pair_index;
+    /* len, utf-8 flag, direction, text */
+    char ert_out[3 + 256];
+};
+
+static struct rds_decoder_t rds = {
+    .rt_plus_carrier = -1,
+    .ert_carrier = -1,
+};
+static pthread_mutex_t rds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void rds_reset_locked(void);
+
+typedef void (*rds_grp_handler_t)(const uint16_t *blk);
+
+static inline uint16_t rds_blk(const struct rds_grp_data *grp, int i)
+{
+    return ((unsigned char)grp->rdsBlk[i].rdsMsb << 8) |
+            (unsigned char)grp->rdsBlk[i].rdsLsb;
+}
+
+/* 'len' bytes: {len, pty, pi hi, pi lo, extra} header used by the SoC events */
+static void rds_fill_hdr(char *data, char len, char extra)
+{
+    data[0] = len;
+    data[1] = rds.pty;
+    data[2] = rds.pi >> 8;
+    data[3] = rds.pi & 0xff;
+    data[4] = extra;
+}
+
+static void rds_publish_ps(void)
+{
+    char data[RDS_OFFSET + RDS_STRING];
+
+    rds_fill_hdr(data, 1, 0);
+    memcpy(&data[RDS_OFFSET], rds.ps, RDS_STRING);
+    if (!rds_cache_changed(RDS_CACHE_PS, rds.pi, data, sizeof(data)))
+        return;
+    fm_cb_post(FM_CB_PS, 0, 0, data, sizeof(data));
+}
+
+static void rds_publish_rt(void)
+{
+    char data[RDS_OFFSET + MAX_RT_LENGTH + 1];
+
+    if (rds.rt_len == 0)
+        return;
+
+    rds_fill_hdr(data, rds.rt_len, rds.rt_ab);
+    memcpy(&data[RDS_OFFSET], rds.rt, rds.rt_len);
+    data[RDS_OFFSET + rds.rt_len] = 0x00;
+    if (!rds_cache_changed(RDS_CACHE_RT, rds.pi, data, RDS_OFFSET + rds.rt_len))
+        return;
+    fm_cb_post(FM_CB_RT, 0, 0, data, RDS_OFFSET + rds.rt_len + 1);
+}
+
+static void rds_grp_ps(const uint16_t *blk)
+{
+    int seg = blk[1] & 0x3;
+
+    rds.ps[seg * 2] = blk[3] >> 8;
+    rds.ps[seg * 2 + 1] = blk[3] & 0xff;
+    /* segments must arrive in order to build a consistent name */
+    if (seg == 0)
+        rds.ps_seg_mask = 0;
+    rds.ps_seg_mask |= (1 << seg);
+    if (rds.ps_seg_mask == (1 << RDS_PS_SEGS) - 1)
+        rds_publish_ps();
+}
+
+static void rds_rt_put(int pos, uint8_t c)
+{
+    if (pos >= MAX_RT_LENGTH)
+        return;
+    if (c == CARRIAGE_RETURN) {
+        rds.rt_len = pos;
+        return;
+    }
+    rds.rt[pos] = c;
+}
+
+static void rds_grp_rt(const uint16_t *blk, int is_b)
+{
+    int seg = blk[1] & 0xf;
+    char ab = (blk[1] >> 4) & 1;
+    int segs = is_b ? RDS_RT_B_SEGS : RDS_RT_A_SEGS;
+    int chars = is_b ? 2 : 4;
+    int pos = seg * chars;
+
+    if (!rds.rt_ab_valid || rds.rt_ab != ab || rds.rt_is_b != is_b) {
+        /* A/B flag toggle means a new text, drop the partial one */
+        memset(rds.rt, ' ', sizeof(rds.rt));
+        rds.rt_seg_mask = 0;
+        rds.rt_len = 0;
+        rds.rt_ab = ab;
+        rds.rt_ab_valid = 1;
+        rds.rt_is_b = is_b;
+    }
+
+    if (is_b) {
+        rds_rt_put(pos, blk[3] >> 8);
+        rds_rt_put(pos + 1, blk[3] & 0xff);
+    } else {
+        rds_rt_put(pos, blk[2] >> 8);
+        rds_rt_put(pos + 1, blk[2] & 0xff);
+        rds_rt_put(pos + 2, blk[3] >> 8);
+        rds_rt_put(pos + 3, blk[3] & 0xff);
+    }
+    rds.rt_seg_mask |= (1 << seg);
+
+    if (rds.rt_len == 0 && rds.rt_seg_mask == (uint16_t)((1 << segs) - 1))
+        rds.rt_len = segs * chars;
+    /* complete once every segment up to the end of text is in */
+    if (rds.rt_len) {
+        int need = (rds.rt_len + chars - 1) / chars;
+
+        if ((rds.rt_seg_mask & ((1 << need) - 1)) == (1 << need) - 1)
+            rds_publish_rt();
+    }
+}
+
+static void rds_grp_rt_a(const uint16_t *blk)
+{
+    rds_grp_rt(blk, 0);
+}
+
+static void rds_grp_rt_b(const uint16_t *blk)
+{
+    rds_grp_rt(blk, 1);
+}
+
+static void rds_grp_ct(const uint16_t *blk)
+{
+    struct rds_ct_t ct;
+    int offset;
+
+    ct.mjd = ((uint32_t)(blk[1] & 0x3) << 15) | (blk[2] >> 1);
+    ct.hour = ((blk[2] & 1) << 4) | (blk[3] >> 12);
+    ct.minute = (blk[3] >> 6) & 0x3f;
+    offset = blk[3] & 0x1f;
+    ct.local_offset = (blk[3] & 0x20) ? -offset : offset;
+
+    if (ct.hour > 23 || ct.minute > 59 || ct.mjd == 0)
+        return;
+    if (rds.ct_published && !memcmp(&ct, &rds.ct, sizeof(ct)))
+        return;
+    rds.ct = ct;
+    rds.ct_published = 1;
+
+    if (RDS_HAS_CB(ct_update_cb))
+        fm_cb_post(FM_CB_CT, 0, 0, &rds.ct, sizeof(rds.ct));
+}
+
+static void rds_grp_ptyn(const uint16_t *blk)
+{
+    char data[RDS_OFFSET + RDS_STRING];
+    int seg = blk[1] & 1;
+    char ab = (blk[1] >> 4) & 1;
+
+    if (rds.ptyn_ab != ab) {
+        rds.ptyn_seg_mask = 0;
+        rds.ptyn_ab = ab;
+    }
+    rds.ptyn[seg * 4] = blk[2] >> 8;
+    rds.ptyn[seg * 4 + 1] = blk[2] & 0xff;
+    rds.ptyn[seg * 4 + 2] = blk[3] >> 8;
+    rds.ptyn[seg * 4 + 3] = blk[3] & 0xff;
+    rds.ptyn_seg_mask |= (1 << seg);
+
+    if (rds.ptyn_seg_mask != (1 << RDS_PTYN_SEGS) - 1)
+        return;
+    if (rds.ptyn_published && !memcmp(rds.ptyn, rds.ptyn_out, RDS_STRING))
+        return;
+    memcpy(rds.ptyn_out, rds.ptyn, RDS_STRING);
+    rds.ptyn_published = 1;
+
+    if (RDS_HAS_CB(ptyn_update_cb)) {
+        rds_fill_hdr(data, 1, 0);
+        memcpy(&data[RDS_OFFSET], rds.ptyn, RDS_STRING);
+        fm_cb_post(FM_CB_PTYN, 0, 0, data, sizeof(data));
+    }
+}
+
+static struct rds_eon_entry_t *rds_eon_find(uint16_t pi_on)
+{
+    struct rds_eon_entry_t *free_slot = NULL;
+    int i;
+
+    for (i = 0; i < RDS_EON_MAX; i++) {
+        if (rds.eon[i].eon.pi_on == pi_on)
+            return &rds.eon[i];
+        if (rds.eon[i].eon.pi_on == 0 && free_slot == NULL)
+            free_slot = &rds.eon[i];
+    }
+    if (free_slot) {
+        memset(free_slot, 0, sizeof(*free_slot));
+        memset(free_slot->eon.ps, ' ', RDS_STRING);
+        free_slot->eon.pi_on = pi_on;
+    }
+    return free_slot;
+}
+
+static void rds_eon_publish(struct rds_eon_entry_t *on, struct rds_eon_t *prev)
+{
+    if (on->published && !memcmp(prev, &on->eon, sizeof(*prev)))
+        return;
+    on->published = 1;
+    if (RDS_HAS_CB(eon_update_cb))
+        fm_cb_post(FM_CB_EON, 0, 0, &on->eon, sizeof(on->eon));
+}
+
+static void rds_grp_eon_a(const uint16_t *blk)
+{
+    struct rds_eon_entry_t *on;
+    struct rds_eon_t prev;
+    int variant = blk[1] & 0xf;
+
+    if (blk[3] == 0 || (on = rds_eon_find(blk[3])) == NULL)
+        return;
+    prev = on->eon;
+    on->eon.tp = (blk[1] >> 4) & 1;
+
+    if (variant < RDS_PS_SEGS) {
+        on->eon.ps[variant * 2] = blk[2] >> 8;
+        on->eon.ps[variant * 2 + 1] = blk[2] & 0xff;
+        on->ps_seg_mask |= (1 << variant);
+        if (on->ps_seg_mask != (1 << RDS_PS_SEGS) - 1)
+            return;
+    } else if (variant == 13) {
+        on->eon.pty = blk[2] >> 11;
+        on->eon.ta = blk[2] & 1;
+    } else {
+        return;
+    }
+    rds_eon_publish(on, &prev);
+}
+
+static void rds_grp_eon_b(const uint16_t *blk)
+{
+    struct rds_eon_entry_t *on;
+    struct rds_eon_t prev;
+
+    if (blk[3] == 0 || (on = rds_eon_find(blk[3])) == NULL)
+        return;
+    prev = on->eon;
+    on->eon.tp = (blk[1] >> 4) & 1;
+    on->eon.ta = (blk[1] >> 3) & 1;
+    rds_eon_publish(on, &prev);
+}
+
+static void rds_grp_rt_plus(const uint16_t *blk)
+{
+    char data[RDS_RT_PLUS_LEN];
+
+    /* RT+ tags: content type 6 bits, start 6 bits, length marker 6/5 bits */
+    data[0] = RDS_RT_PLUS_LEN;
+    data[1] = rds.rt_ert_flag;
+    data[2] = ((blk[1] & 0x7) << 3) | (blk[2] >> 13);
+    data[3] = (blk[2] >> 7) & 0x3f;
+    data[4] = ((blk[2] >> 1) & 0x3f) + 1;
+    data[5] = ((blk[2] & 1) << 5) | (blk[3] >> 11);
+    data[6] = (blk[3] >> 5) & 0x3f;
+    data[7] = (blk[3] & 0x1f) + 1;
+
+    if (rds.rt_plus_published && !memcmp(data, rds.rt_plus_out, sizeof(data)))
+        return;
+    memcpy(rds.rt_plus_out, data, sizeof(data));
+    rds.rt_plus_published = 1;
+    fm_cb_post(FM_CB_RT_PLUS, 0, 0, data, sizeof(data));
+}
+
+static void rds_ev_ert(void)
+{
+    char *data = rds.ert_out;
+
+    if (rds.ert_len <= 0)
+        return;
+    data[0] = rds.ert_len;
+    data[1] = rds.utf_8_flag;
+    data[2] = rds.formatting_dir;
+    memcpy((data + 3), rds.ert_buf, rds.ert_len);
+    if (rds_cache_changed(RDS_CACHE_ERT, hal->radio->rds_cur_pi, data,
+                          rds.ert_len + 3))
+        fm_cb_post(FM_CB_ERT, 0, 0, data, rds.ert_len + 3);
+}
+
+static void rds_grp_ert(const uint16_t *blk)
+{
+    int i;
+    unsigned short int info_byte = 0;
+    unsigned short int byte_pair_index;
+
+    byte_pair_index = AGT(blk[1]);
+    if (byte_pair_index == 0) {
+        rds.c_byt_pair_index = 0;
+        rds.ert_len = 0;
+    }
+    if (rds.c_byt_pair_index == byte_pair_index) {
+        rds.c_byt_pair_index++;
+        for (i = 2; i <= 3; i++) {
+             info_byte = blk[i];
+             rds.ert_buf[rds.ert_len++] = blk[i] >> 8;
+             rds.ert_buf[rds.ert_len++] = blk[i] & 0xff;
+             if ((rds.utf_8_flag == 0) && (info_byte == CARRIAGE_RETURN)) {
+                 rds.ert_len -= 2;
+                 break;
+             } else if ((rds.utf_8_flag == 1) &&
+                        ((blk[i] >> 8) == CARRIAGE_RETURN)) {
+                 info_byte = CARRIAGE_RETURN;
+                 rds.ert_len -= 2;
+                 break;
+             } else if ((rds.utf_8_flag == 1) &&
+                        ((blk[i] & 0xff) == CARRIAGE_RETURN)) {
+                 info_byte = CARRIAGE_RETURN;
+                 rds.ert_len--;
+                 break;
+             }
+        }
+        if ((byte_pair_index == MAX_ERT_SEGMENT) ||
+            (info_byte == CARRIAGE_RETURN)) {
+            rds_ev_ert();
+            rds.c_byt_pair_index = 0;
+            rds.ert_len = 0;
+        }
+    } else {
+        rds.ert_len = 0;
+        rds.c_byt_pair_index = 0;
+    }
+}
+
+static void rds_grp_oda(const uint16_t *blk)
+{
+    unsigned int mask_bit;
+    unsigned short int aid = blk[3];
+    unsigned short int agt = AGT(blk[1]);
+
+    /*
+     * Bit Pos  0  1  2  3  4   5  6   7
+     * Grp Type 0A 0B 1A 1B 2A  2B 3A  3B
+     *
+     * similary for rest grps
+     */
+    mask_bit = (((agt >> 1) << 1) + (agt & 1));
+
+    switch (aid) {
+    case ERT_AID:
+         rds.oda_agt = (1 << mask_bit);
+         rds.utf_8_flag = (blk[2] & 1);
+         rds.formatting_dir = EXTRACT_BIT(blk[2], ERT_FORMAT_DIR_BIT);
+         if (rds.ert_carrier != agt)
+             fm_cb_post(FM_CB_ODA, 0, 0, NULL, 0);
+         rds.ert_carrier = agt;
+         break;
+    case RT_PLUS_AID:
+         rds.oda_agt = (1 << mask_bit);
+         /*Extract 5th bit of MSB (b7b6b5b4b3b2b1b0)*/
+         rds.rt_ert_flag = EXTRACT_BIT(blk[2] >> 8, RT_ERT_FLAG_BIT);
+         if (rds.rt_plus_carrier != agt)
+             fm_cb_post(FM_CB_ODA, 0, 0, NULL, 0);
+         rds.rt_plus_carrier = agt;
+         break;
+    default:
+         rds.oda_agt = 0;
+         break;
+    }
+}
+
+/* Indexed by GTC, i.e. group type << 1 | B version */
+static const rds_grp_handler_t rds_grp_tbl[RDS_GTC_MAX] = {
+    [0x00] = rds_grp_ps,        /* 0A */
+    [0x01] = rds_grp_ps,        /* 0B */
+    [0x04] = rds_grp_rt_a,      /* 2A */
+    [0x05] = rds_grp_rt_b,      /* 2B */
+    [0x08] = rds_grp_ct,        /* 4A */
+    [0x14] = rds_grp_ptyn,      /* 10A */
+    [0x1c] = rds_grp_eon_a,     /* 14A */
+    [0x1d] = rds_grp_eon_b,     /* 14B */
+};
+
+/*
+ * Group types decoded in software, as an rds_grp_enable_mask:
+ * 0A 0B 2A 2B 3A 4A 10A 14A 14B
+ */
+#define RDS_SW_DECODE_GRPS  ((1 << 0x00) | (1 << 0x01) | (1 << 0x04) | \
+        (1 << 0x05) | (1 << GRP_3A) | (1 << 0x08) | (1 << 0x14) | \
+        (1 << 0x1c) | (1 << 0x1d))
+
+void rds_decode_group(struct rds_grp_data *grp)
+{
+    uint16_t blk[RDS_BLOCKS_NUM];
+    uint16_t gtc;
+    int i;
+
+    if (grp == NULL) {
+        ALOGE("%s:%s, rds group is null\n", LOG_TAG, __func__);
+        return;
+    }
+
+    for (i = 0; i < RDS_BLOCKS_NUM; i++)
+        blk[i] = rds_blk(grp, i);
+    gtc = GTC((unsigned char)grp->rdsBlk[1].rdsMsb);
+
+    pthread_mutex_lock(&rds_lock);
+    if (gtc == GRP_3A) {
+        rds_grp_oda(blk);
+        goto out;
+    }
+    if (gtc == rds.ert_carrier) {
+        FM_LOGD("%s:: calling event ert", __func__);
+        rds_grp_ert(blk);
+        goto out;
+    }
+
+    if (!rds.enabled)
+        goto out;
+
+    if (blk[0] != rds.pi) {
+        /* different station, nothing collected so far applies */
+        rds_reset_locked();
+        rds.pi = blk[0];
+    }
+    rds.pty = (blk[1] >> 5) & 0x1f;
+
+    if (gtc == rds.rt_plus_carrier)
+        rds_grp_rt_plus(blk);
+    else if (rds_grp_tbl[gtc] != NULL)
+        rds_grp_tbl[gtc](blk);
+out:
+    pthread_mutex_unlock(&rds_lock);
+}
+
+static void rds_reset_locked(void)
+{
+    char enabled = rds.enabled;
+    int rt_plus_carrier = rds.rt_plus_carrier;
+    int ert_carrier = rds.ert_carrier;
+    int oda_agt = rds.oda_agt;
+
+    memset(&rds, 0, sizeof(rds));
+    memset(rds.ps, ' ', RDS_STRING);
+    memset(rds.ptyn, ' ', RDS_STRING);
+    rds.enabled = enabled;
+    /* ODA carriers are only announced every few seconds, keep them */
+    rds.rt_plus_carrier = rt_plus_carrier;
+    rds.ert_carrier = ert_carrier;
+    rds.oda_agt = oda_agt;
+}
+
+void rds_decoder_reset(void)
+{
+    pthread_mutex_lock(&rds_lock);
+    rds_reset_locked();
+    pthread_mutex_unlock(&rds_lock);
+}
+
+void rds_decoder_enable(int on)
+{
+    pthread_mutex_lock(&rds_lock);
+    rds.enabled = !!on;
+    rds_reset_locked();
+    pthread_mutex_unlock(&rds_lock);
+}
+
+int rds_decoder_enabled(void)
+{
+    return rds.enabled;
+}
+
+int rds_decoder_oda_mask(void)
+{
+    return rds.oda_agt;
+}
+
+int rds_decoder_grp_mask(void)
+{
+    return rds.enabled ? RDS_SW_DECODE_GRPS : 0;
+}
+
+static uint32_t rds_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a */
+static uint32_t rds_hash(const char *buf, int len)
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)buf[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct rds_station_cache *rds_cache_station(unsigned short pi)
+{
+    struct rds_station_cache *victim = &hal->radio->rds_cache[0];
+    struct rds_station_cache *entry;
+    int i;
+
+    for (i = 0; i < RDS_CACHE_STATIONS; i++) {
+        entry = &hal->radio->rds_cache[i];
+        if (entry->pi == pi && (entry->lru || pi == 0))
+            goto found;
+        if (entry->lru < victim->lru)
+            victim = entry;
+    }
+    entry = victim;
+    memset(entry, 0, sizeof(*entry));
+    entry->pi = pi;
+found:
+    entry->lru = ++hal->radio->rds_cache_tick;
+    return entry;
+}
+
+/*
+ * Returns 1 when 'buf' should be reported for 'field' of station 'pi':
+ * it differs from what was last reported, and the coalescing window since
+ * that report has passed. A suppressed change is reported by a later
+ * repeat of the same payload, so the latest text always gets through.
+ */
+int rds_cache_changed(int field, unsigned short pi, const char *buf, int len)
+{
+    struct rds_station_cache *entry;
+    uint32_t hash, now;
+
+    if (!hal || !hal->radio || field < 0 || field >= RDS_CACHE_FIELDS)
+        return 1;
+
+    hal->radio->rds_cur_pi = pi;
+    entry = rds_cache_station(pi);
+    hash = rds_hash(buf, len);
+
+    if ((entry->emitted_mask & (1 << field)) && entry->emitted_hash[field] == hash) {
+        hal->radio->rds_suppressed++;
+        return 0;
+    }
+
+    now = rds_now_ms();
+    if ((entry->emitted_mask & (1 << field)) && hal->radio->rds_coalesce_ms &&
+            now - entry->last_emit_ms[field] < hal->radio->rds_coalesce_ms) {
+        hal->radio->rds_suppressed++;
+        return 0;
+    }
+
+    entry->emitted_mask |= (1 << field);
+    entry->emitted_hash[field] = hash;
+    entry->last_emit_ms[field] = now;
+    return 1;
+}
+
+/* The client drops its RDS data on tune, so everything must be re-reported */
+void rds_cache_tune(void)
+{
+    int i;
+
+    if (!hal || !hal->radio)
+        return;
+    for (i = 0; i < RDS_CACHE_STATIONS; i++)
+        hal->radio->rds_cache[i].emitted_mask = 0;
+}
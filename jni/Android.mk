@@ -6,12 +6,19 @@ LOCAL_SRC_FILES:= \
 android_hardware_fm.cpp \
 ConfFileParser.cpp \
 ConfigFmThs.cpp \
+FmEventLoop.cpp \
+FmHybridSrchList.cpp \
 FmIoctlsInterface.cpp \
-FmPerformanceParams.cpp
+FmJniRuntime.cpp \
+FmPerformanceParams.cpp \
+FmPropertyWait.cpp
 
 ifeq ($(BOARD_HAS_QCA_FM_SOC), "cherokee")
 LOCAL_CFLAGS += -DFM_SOC_TYPE_CHEROKEE
 endif
+ifneq ($(TARGET_BUILD_VARIANT),user)
+LOCAL_CFLAGS += -DFM_JNI_DEBUG
+endif
 LOCAL_LDLIBS += -ldl
 LOCAL_SHARED_LIBRARIES := \
         libandroid_runtime \
@@ -31,81 +31,69 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <limits.h>
-#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <utils/Log.h>
 
-//declaration of functions only specific to this file
-static char parse_line
-(
-  group_table *key_file,
-  const char *line,
-  char **cur_grp
-);
+//32 bit FNV-1a
+#define HASH_SEED 2166136261u
+#define HASH_PRIME 16777619u
+//empty slot in the hash tables, slots hold index + 1
+#define SLOT_EMPTY 0
 
-static char parse_load_frm_fhandler
-(
-  group_table *key_file,
-  FILE *fp
-);
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
 
-static char line_is_grp
+//declaration of functions only specific to this file
+static unsigned int hash_mem
 (
-  group_table *key_file,
+  unsigned int hash,
   const char *str,
-  char **cur_grp
-);
-
-static void free_grp_list
-(
-  group *a
-);
-
-static void free_key_list
-(
-  key_value_pair_list *a
+  unsigned int len
 );
 
-static char line_is_key_value_pair
+static char read_file
 (
   group_table *key_file,
-  const char *str,
-  const char *cur_grp
-);
-
-static char line_is_comment
-(
-  const char *str
+  const char *file
 );
 
-static char grp_exist
+static char parse_buf
 (
-  const group_table *key_file,
-  const char *new_grp
+  group_table *key_file,
+  char *buf,
+  size_t len
 );
 
-static char add_grp
+static char parse_grp
 (
   group_table *key_file,
-  const char *new_grp
+  char *str,
+  unsigned int line_no
 );
 
-static group *alloc_group
+static char parse_key_value_pair
 (
-  void
+  group_table *key_file,
+  char *str,
+  unsigned int line_no
 );
 
-static key_value_pair_list *alloc_key_value_pair
+static int find_grp
 (
-  void
+  const group_table *key_file,
+  const char *grp_name,
+  unsigned int hash
 );
 
-static char add_key_value_pair
+static int find_key
 (
-  group_table *key_file,
-  const char *cur_grp,
+  const group_table *key_file,
+  unsigned int grp,
   const char *key,
-  const char *val
+  unsigned int hash
 );
 
 
@@ -115,158 +103,94 @@ void free_strs
   char **str_array
 )
 {
-  char **str_array_cpy = str_array;
-  if(str_array != NULL) {
-     while(*str_array != NULL) {
-           free(*str_array);
-           str_array++;
-     }
-  }
-  free(str_array_cpy);
+  free(str_array);
 }
-//ToDo: Come up with code hashing
-//function
-unsigned int get_hash_code
-(
-  const char *str
-)
-{
-
-  unsigned len = strlen(str);
-  unsigned int i;
-  unsigned int hash_code = 0;
 
-  for(i = 0; len > 0; len--, i++) {
-      hash_code += (int)((str[i] * pow(2, len))) % INT_MAX;
-      hash_code %= INT_MAX;
-  }
-  return hash_code;
-}
-
-static key_value_pair_list *alloc_key_value_pair
+static unsigned int hash_mem
 (
-  void
+  unsigned int hash,
+  const char *str,
+  unsigned int len
 )
 {
-  key_value_pair_list *key_list = NULL;
-
-  key_list = (key_value_pair_list *)malloc(
-                                       sizeof(key_value_pair_list));
-  if(key_list != NULL) {
-     key_list->key = NULL;
-     key_list->next = NULL;
-     key_list->value = NULL;
+  while(len--) {
+      hash ^= (unsigned char)*str++;
+      hash *= HASH_PRIME;
   }
-  return key_list;
+  return hash;
 }
 
-static group * alloc_group
+unsigned int get_hash_code
 (
-  void
+  const char *str
 )
 {
-  group *grp = NULL;
-  unsigned int i;
-
-  grp = (group *)malloc(sizeof(group));
-  if(grp != NULL) {
-     grp->grp_name = NULL;
-     grp->grp_next = NULL;
-     grp->num_of_keys = 0;
-     grp->keys_hash_size = MAX_UNIQ_KEYS;
-     grp->list = (key_value_pair_list **)malloc
-                    (sizeof(key_value_pair_list *) * grp->keys_hash_size);
-     if(grp->list == NULL) {
-        ALOGE("Could not alloc group\n");
-        free(grp);
-        grp = NULL;
-     }else {
-        for(i = 0; i < grp->keys_hash_size; i++) {
-            grp->list[i] = NULL;
-        }
-     }
-  }
-  return grp;
+  return hash_mem(HASH_SEED, str, strlen(str));
 }
 
 group_table *get_key_file
 (
 )
 {
-  group_table *t = NULL;
-  unsigned int i;
-
-  t = (group_table *)malloc(sizeof(group_table));
-  if (t != NULL) {
-      t->grps_hash_size = MAX_UNIQ_GRPS;
-      t->num_of_grps = 0;
-      t->grps_hash = (group **)malloc(sizeof(group *)
-                                       * t->grps_hash_size);
-      if (t->grps_hash == NULL) {
-          free(t);
-          return NULL;
-      }
-      for(i = 0; i < t->grps_hash_size; i++) {
-          t->grps_hash[i] = NULL;
-      }
-  }
-  return t;
+  return (group_table *)calloc(1, sizeof(group_table));
 }
 
 void free_key_file(
   group_table *key_file
 )
 {
-  unsigned int i;
-
   if(key_file != NULL) {
-     if(key_file->grps_hash != NULL) {
-        for(i = 0; i < key_file->grps_hash_size; i++) {
-            free_grp_list(key_file->grps_hash[i]);
-        }
-     }
-     free(key_file->grps_hash);
+     free(key_file->arena);
      free(key_file);
   }
 }
 
-static void free_grp_list
+static int find_grp
 (
-  group *a
+  const group_table *key_file,
+  const char *grp_name,
+  unsigned int hash
 )
 {
-  group *next;
-  unsigned int i;
+  unsigned int mask = key_file->hash_size - 1;
+  unsigned int i = hash & mask;
+  unsigned int slot;
+  group *grp;
 
-  while(a != NULL) {
-       next = a->grp_next;
-       if(a->list != NULL) {
-          for(i = 0; i < a->keys_hash_size; i++) {
-              free_key_list(a->list[i]);
-          }
-       }
-       free(a->grp_name);
-       free(a->list);
-       free(a);
-       a = next;
+  while((slot = key_file->grps_hash[i]) != SLOT_EMPTY) {
+        grp = &key_file->grps[slot - 1];
+        if((grp->hash == hash) && !strcmp(grp->grp_name, grp_name))
+           return (slot - 1);
+        i = (i + 1) & mask;
   }
+  return -1;
 }
 
-static void free_key_list
+//keys of all groups share one table,
+//the key hash is seeded with the group hash
+static int find_key
 (
-  key_value_pair_list *a
+  const group_table *key_file,
+  unsigned int grp,
+  const char *key,
+  unsigned int hash
 )
 {
-  key_value_pair_list *next;
-
-  while(a != NULL) {
-       next = a->next;
-       free(a->key);
-       free(a->value);
-       free(a);
-       a = next;
-  }
+  unsigned int mask = key_file->hash_size - 1;
+  unsigned int i = hash & mask;
+  unsigned int slot;
+  key_value_pair *pair;
+
+  while((slot = key_file->keys_hash[i]) != SLOT_EMPTY) {
+        pair = &key_file->keys[slot - 1];
+        if((pair->hash == hash) && (pair->grp == grp)
+           && !strcmp(pair->key, key))
+           return (slot - 1);
+        i = (i + 1) & mask;
+  }
+  return -1;
 }
+
 //return all the groups
 //present in the file
 char **get_grps
@@ -274,41 +198,20 @@ char **get_grps
   const group_table *key_file
 )
 {
-  char **grps = NULL;
-  unsigned int i = 0;
-  unsigned int j = 0;
-  unsigned int grp_len;
-  group *grp_list;
-
-  if((key_file == NULL)
-     || (key_file->grps_hash == NULL)
-     || (key_file->grps_hash_size == 0)
-     || (key_file->num_of_grps == 0)) {
-     return grps;
+  char **grps;
+  unsigned int i;
+
+  if((key_file == NULL) || (key_file->num_of_grps == 0)) {
+     return NULL;
   }
-  grps = (char **)calloc((key_file->num_of_grps + 1),
-                           sizeof(char *));
+  grps = (char **)malloc((key_file->num_of_grps + 1) * sizeof(char *));
   if(grps == NULL) {
-     return grps;
+     return NULL;
   }
-  for(i = 0; i < key_file->grps_hash_size; i++) {
-      grp_list = key_file->grps_hash[i];
-      while(grp_list != NULL) {
-            grp_len = strlen(grp_list->grp_name);
-            grps[j] = (char *)malloc(sizeof(char) *
-                                     (grp_len + 1));
-            if(grps[j] == NULL) {
-               free_strs(grps);
-               grps = NULL;
-               return grps;
-            }
-            memcpy(grps[j], grp_list->grp_name,
-                   (grp_len + 1));
-            grp_list = grp_list->grp_next;
-            j++;
-      }
+  for(i = 0; i < key_file->num_of_grps; i++) {
+      grps[i] = key_file->grps[i].grp_name;
   }
-  grps[j] = NULL;
+  grps[i] = NULL;
   return grps;
 }
 
@@ -320,60 +223,31 @@ char **get_keys
   const char *grp_name
 )
 {
-  unsigned int grp_hash_code;
-  unsigned int grp_index;
-  unsigned int num_of_keys;
+  const group *grp;
+  char **keys;
   unsigned int i;
-  unsigned int j = 0;
-  unsigned int key_len;
-  group *grp;
-  key_value_pair_list *key_val_list;
-  char **keys = NULL;
+  int index;
 
   if((key_file == NULL) || (grp_name == NULL)
-     || (key_file->num_of_grps == 0) ||
-     (key_file->grps_hash_size == 0) ||
-     (key_file->grps_hash == NULL) ||
-     (!strcmp(grp_name, ""))) {
-      return keys;
+     || (key_file->num_of_grps == 0) || (*grp_name == '\0')) {
+      return NULL;
   }
-  grp_hash_code = get_hash_code(grp_name);
-  grp_index = (grp_hash_code % key_file->grps_hash_size);
-  grp = key_file->grps_hash[grp_index];
-  while(grp != NULL) {
-        if(!strcmp(grp_name, grp->grp_name)) {
-            if((grp->num_of_keys == 0)
-               || (grp->keys_hash_size == 0)
-               || (grp->list == 0)) {
-               return keys;
-            }
-            keys = (char **)calloc((grp->num_of_keys + 1),
-                                   sizeof(char *));
-            if(keys == NULL) {
-                return keys;
-            }
-            for(i = 0; i < grp->keys_hash_size; i++) {
-                key_val_list = grp->list[i];
-                while(key_val_list != NULL) {
-                     key_len = strlen(key_val_list->key);
-                     keys[j] = (char *)malloc(sizeof(char) *
-                                              (key_len + 1));
-                     if(keys[j] == NULL) {
-                         free_strs(keys);
-                         keys = NULL;
-                         return keys;
-                     }
-                     memcpy(keys[j], key_val_list->key,
-                            (key_len + 1));
-                     j++;
-                     key_val_list = key_val_list->next;
-                }
-            }
-            keys[j] = NULL;
-            return keys;
-        }
-        grp = grp->grp_next;
+  index = find_grp(key_file, grp_name, get_hash_code(grp_name));
+  if(index < 0) {
+     return NULL;
+  }
+  grp = &key_file->grps[index];
+  if(grp->num_of_keys == 0) {
+     return NULL;
+  }
+  keys = (char **)malloc((grp->num_of_keys + 1) * sizeof(char *));
+  if(keys == NULL) {
+     return NULL;
+  }
+  for(i = 0; i < grp->num_of_keys; i++) {
+      keys[i] = key_file->keys[grp->first_key + i].key;
   }
+  keys[i] = NULL;
   return keys;
 }
 
@@ -385,533 +259,295 @@ char *get_value
 )
 {
    unsigned int grp_hash_code;
-   unsigned int key_hash_code;
-   unsigned int grp_index;
-   unsigned int key_index;
-   unsigned val_len;
-   char *val = NULL;
-   group *grp;
-   key_value_pair_list *list;
-
-   if((key_file == NULL) || (grp_name == NULL)
-      || (key == NULL) || (key_file->grps_hash == NULL)
-      || (key_file->grps_hash_size == 0) || !strcmp(grp_name, "")
-      ||(!strcmp(key, ""))) {
+   int grp_index;
+   int key_index;
+
+   if((key_file == NULL) || (grp_name == NULL) || (key == NULL)
+      || (key_file->num_of_grps == 0) || (*grp_name == '\0')
+      || (*key == '\0')) {
        return NULL;
    }
    grp_hash_code = get_hash_code(grp_name);
-   key_hash_code = get_hash_code(key);
-   grp_index = (grp_hash_code % key_file->grps_hash_size);
-   grp = key_file->grps_hash[grp_index];
-   while(grp != NULL) {
-         if(!strcmp(grp_name, grp->grp_name) && grp->keys_hash_size
-            && grp->list) {
-            key_index = (key_hash_code % grp->keys_hash_size);
-            list = grp->list[key_index];
-            while((list != NULL) && (strcmp(list->key, key))) {
-                   list = list->next;
-            }
-            if(list != NULL) {
-                val_len = strlen(list->value);
-                val = (char *)malloc(sizeof(char) * (val_len + 1));
-                if(val != NULL) {
-                   memcpy(val, list->value, val_len);
-                   val[val_len] = '\0';
-                }
-            }
-            return val;
-         }
-         grp = grp->grp_next;
+   grp_index = find_grp(key_file, grp_name, grp_hash_code);
+   if(grp_index < 0) {
+      return NULL;
+   }
+   key_index = find_key(key_file, grp_index, key,
+                        hash_mem(grp_hash_code, key, strlen(key)));
+   if(key_index < 0) {
+      return NULL;
    }
-   return val;
+   return key_file->keys[key_index].value;
 }
+
 //open the file,
 //read, parse and load
-//returns PARSE_SUCCESS if successfully
-//loaded else PARSE_FAILED
+//returns TRUE if successfully
+//loaded else FALSE
 char parse_load_file
 (
   group_table *key_file,
   const char *file
 )
 {
-  FILE *fp;
-  char ret = FALSE;
-
+  if(key_file == NULL) {
+     ALOGE("key file is null\n");
+     return FALSE;
+  }
   if((file == NULL) || !strcmp(file, "")) {
      ALOGE("File name is null or empty \n");
-     return ret;
-  }
-
-  fp = fopen(file, "r");
-  if(fp == NULL) {
-     ALOGE("could not open file for read\n");
-     return ret;
+     return FALSE;
   }
 
-  ret = parse_load_frm_fhandler(key_file, fp);
-  fclose(fp);
-
-  return ret;
-}
+  free(key_file->arena);
+  memset(key_file, 0, sizeof(*key_file));
 
-//Read block of data from file handler
-//extract each line, check kind of line(comment,
-//group, key value pair)
-static char parse_load_frm_fhandler
-(
-  group_table *key_file,
-  FILE *fp
-)
-{
-  char buf[MAX_LINE_LEN];
-  char ret = TRUE;
-  char *line = NULL;
-  void *new_line;
-  char *cur_grp = NULL;
-  unsigned line_len = 0;
-  unsigned line_allocated = 0;
-  unsigned int bytes_read = 0;
-  unsigned int i;
-  bool has_carriage_rtn = false;
-
-  while((bytes_read = fread(buf, 1, MAX_LINE_LEN, fp))) {
-        for(i = 0; i < bytes_read; i++) {
-            if(line_len == line_allocated) {
-                line_allocated += 25;
-                new_line = realloc(line, line_allocated);
-                if(new_line == NULL) {
-                   ret = FALSE;
-                   ALOGE("memory allocation failed for line\n");
-                   break;
-                }
-                line = (char *)new_line;
-            }
-            if((buf[i] == '\n')) {
-                has_carriage_rtn = false;
-                line[line_len] = '\0';
-                ret = parse_line(key_file, line, &cur_grp);
-                line_len = 0;
-                if(ret == FALSE) {
-                   ALOGE("could not parse the line, line not proper\n");
-                   break;
-                }
-            }else if(buf[i] == '\r') {
-                ALOGE("File has carriage return\n");
-                has_carriage_rtn = true;
-            }else if(has_carriage_rtn) {
-                ALOGE("File format is not proper, no line character\
-                        after carraige return\n");
-                ret = FALSE;
-                break;
-            }else {
-                line[line_len] = buf[i];
-                line_len++;
-            }
-        }
-        if (!ret) {
-            break;
-        }
+  if(!read_file(key_file, file)) {
+     free(key_file->arena);
+     memset(key_file, 0, sizeof(*key_file));
+     return FALSE;
   }
-  free(line);
-  free(cur_grp);
-
-  return ret;
+  return TRUE;
 }
 
-//checks whether a line is
-//comment or grp or key pair value
-//and accordingly adds to list
-static char parse_line
+//Read the whole file into the arena,
+//size the tables from its line count
+//and parse it in place
+static char read_file
 (
   group_table *key_file,
-  const char *line,
-  char **cur_grp
+  const char *file
 )
 {
-  const char *line_begin;
-  char *grp_name;
-  unsigned int len;
-
-  if((line == NULL) || (key_file == NULL)) {
-      ALOGE("key file or line is null\n");
-      return FALSE;
+  struct stat st;
+  char *arena;
+  char *new_arena;
+  size_t len;
+  size_t done = 0;
+  size_t off;
+  unsigned int lines = 1;
+  unsigned int hash_size = 1;
+  ssize_t n;
+  int fd;
+  const char *p;
+
+  fd = open(file, O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+     ALOGE("could not open file for read\n");
+     return FALSE;
   }
-
-  for(line_begin = line; isspace(*line_begin);
-          line_begin++);
-
-  if(line_is_comment(line_begin)) {
-      ALOGE("line is comment\n");
-      return TRUE;
-  }else if(line_is_grp(key_file, line_begin, cur_grp)) {
-      ALOGE("line is grp\n");
-      return TRUE;
-  }else if(line_is_key_value_pair(key_file, line_begin, *cur_grp)) {
-      ALOGE("line is key value pair\n");
-      return TRUE;
-  }else {
-     ALOGE("line is neither comment, grp nor key value pair\n");
+  if((fstat(fd, &st) < 0) || (st.st_size > MAX_CONF_FILE_LEN)) {
+     ALOGE("could not size file or file too large\n");
+     close(fd);
      return FALSE;
   }
-}
-
-static char line_is_comment
-(
-  const char *str
-)
-{
-  if(str == NULL) {
-      return FALSE;
-  }else if(((*str) == '#') || ((*str) == '\0')
-       || ((*str) == '\n')) {
-      return TRUE;
-  }else {
-      ALOGE("line is not comment\n");
-      return FALSE;
+  len = st.st_size;
+  arena = (char *)malloc(len + 1);
+  if(arena == NULL) {
+     close(fd);
+     return FALSE;
   }
-}
-
-//return true if a group
-//name already exist
-//else false
-static char grp_exist
-(
-  const group_table *key_file,
-  const char *new_grp
-)
-{
-  unsigned hash_code;
-  unsigned int index;
-  group *grp;
-
-  if((key_file == NULL) || (new_grp == NULL)
-     || (!key_file->grps_hash_size)) {
+  key_file->arena = arena;
+  while(done < len) {
+        n = read(fd, arena + done, len - done);
+        if((n < 0) && (errno == EINTR))
+           continue;
+        if(n <= 0)
+           break;
+        done += n;
+  }
+  close(fd);
+  if(done != len) {
+     ALOGE("short read of %s\n", file);
      return FALSE;
-  }else {
-    hash_code = get_hash_code(new_grp);
-    index = hash_code % key_file->grps_hash_size;
-    grp = key_file->grps_hash[index];
-    while(grp != NULL) {
-          if (!strcmp(grp->grp_name, new_grp))
-              return TRUE;
-          grp = grp->grp_next;
-    }
-    return FALSE;
   }
+  arena[len] = '\0';
+
+  for(p = arena; (p = (const char *)memchr(p, '\n', arena + len - p)) != NULL;
+      p++)
+      lines++;
+  //at most one group or key per line, tables kept at most half full
+  while(hash_size < (lines * 2))
+        hash_size <<= 1;
+
+  off = ALIGN_UP(len + 1, sizeof(void *));
+  new_arena = (char *)realloc(arena, off
+                     + (lines * sizeof(group))
+                     + (lines * sizeof(key_value_pair))
+                     + (2 * hash_size * sizeof(unsigned int)));
+  if(new_arena == NULL) {
+     ALOGE("memory allocation failed for key file\n");
+     return FALSE;
+  }
+  arena = key_file->arena = new_arena;
+  key_file->grps = (group *)(arena + off);
+  off += lines * sizeof(group);
+  key_file->keys = (key_value_pair *)(arena + off);
+  off += lines * sizeof(key_value_pair);
+  key_file->grps_hash = (unsigned int *)(arena + off);
+  key_file->keys_hash = key_file->grps_hash + hash_size;
+  key_file->hash_size = hash_size;
+  memset(key_file->grps_hash, 0, 2 * hash_size * sizeof(unsigned int));
+
+  return parse_buf(key_file, arena, len);
 }
 
-//Add a group to group
-//table if it does not exist
-static char add_grp
+//split buf into lines, check kind of line
+//(comment, group, key value pair)
+//and add it to the tables
+static char parse_buf
 (
   group_table *key_file,
-  const char *new_grp
+  char *buf,
+  size_t len
 )
 {
-  unsigned int hash_code;
-  unsigned int index;
-  unsigned int grp_name_len;
-  group *grp;
-
-  if(!grp_exist(key_file, new_grp)) {
-      if((key_file == NULL) || (new_grp == NULL)
-         || !key_file->grps_hash_size) {
-         return FALSE;
-      }
-      hash_code = get_hash_code(new_grp);
-      ALOGE("group hash code is: %u\n", hash_code);
-      index = hash_code % key_file->grps_hash_size;
-      ALOGE("group index is: %u\n", index);
-      grp = alloc_group();
-      if(grp == NULL) {
-         return FALSE;
-      }
-      grp_name_len = strlen(new_grp);
-      grp->grp_name = (char *)malloc(
-                                  sizeof(char) * (grp_name_len + 1));
-      if(grp->grp_name == NULL) {
-         ALOGE("could not alloc memory for group name\n");
-         ALOGE("Add group failed\n");
-         free_grp_list(grp);
-         return FALSE;
-      }else {
-         memcpy(grp->grp_name, new_grp, (grp_name_len + 1));
-      }
-      grp->grp_next = key_file->grps_hash[index];
-      key_file->grps_hash[index] = grp;
-      key_file->num_of_grps++;
-      return TRUE;
-  }else {
-     return FALSE;
+  char *line = buf;
+  char *end = buf + len;
+  char *eol;
+  char *p;
+  unsigned int line_no = 0;
+
+  while(line < end) {
+        line_no++;
+        eol = (char *)memchr(line, '\n', end - line);
+        if(eol == NULL)
+           eol = end;
+        *eol = '\0';
+        for(p = eol; (p > line) && (p[-1] == '\r'); p--)
+            p[-1] = '\0';
+        if(memchr(line, '\r', p - line) != NULL) {
+           ALOGE("line %u: no new line after carriage return\n", line_no);
+           return FALSE;
+        }
+        for(p = line; isspace((unsigned char)*p); p++);
+
+        if((*p == '#') || (*p == '\0')) {
+           //comment or empty line
+        }else if(*p == '[') {
+           if(!parse_grp(key_file, p, line_no))
+              return FALSE;
+        }else if(!parse_key_value_pair(key_file, p, line_no)) {
+           return FALSE;
+        }
+        line = eol + 1;
   }
+  return TRUE;
 }
 
-//checks validity of a group
 //a valid group is
 //inside [] group name must be
-//alphanumeric
-//Example: [grpName]
-static char line_is_grp
+//alphanumeric, only spaces may follow.
+//One '.' may split it in two
+//alphanumeric parts
+//Example: [grpName] [grpName.sub]
+static char parse_grp
 (
   group_table *key_file,
-  const char *str,
-  char **cur_grp
+  char *str,
+  unsigned int line_no
 )
 {
-  const char *g_start;
-  const char *g_end;
-  char *new_grp;
-  unsigned int grp_len;
-
-  if ((str == NULL) || (key_file == NULL)) {
-      ALOGE("str is null or key file is null\n");
-      return FALSE;
-  }
-  //checks start mark char ']'
-  if(((*str) != '[')) {
-      ALOGE("start mark is not '['\n");
-      return FALSE;
-  }else {
-      str++;
-      g_start = str;
-  }
-  //checks the end char '['
-  while((*str != '\0') && ((*str) != ']')) {
-        str++;
-  }
-  //if end mark group not found
-  if ((*str) != ']') {
-       ALOGE("grp end mark is not '['\n");
-       return FALSE;
-  }else {
-       g_end = (str - 1);
-  }
+  char *name = str + 1;
+  char *g_end;
+  char *dot = NULL;
+  char *p;
+  group *grp;
+  unsigned int hash;
+  unsigned int i;
 
-  str++;
-  //if end mark found checks the rest chars as well
-  //rest chars should be space
-  while(((*str) == ' ') || ((*str) == '\t')) {
-        str++;
-  }
-  if(*str) {
-     ALOGE("after ']' there are some character\n");
+  g_end = strchr(name, ']');
+  if((g_end == NULL) || (g_end == name)) {
+     ALOGE("line %u: group name not inside []\n", line_no);
      return FALSE;
   }
-
-  str = g_start;
-  while((*g_start != '\0') && (g_start != g_end)
-         && isalnum(*g_start)) {
-        g_start++;
-  }
-  if((g_start == g_end) && isalnum(*g_start)) {
-      //look up if already exist
-      //return false else insert the grp in grp table
-      grp_len = (g_end - str + 1);
-      new_grp = (char *)malloc(sizeof(char) * (grp_len + 1));
-      if (new_grp == NULL) {
-          ALOGE("could not alloc memory for new group\n");
-          return FALSE;
-      }
-      memcpy(new_grp, str, grp_len);
-      new_grp[grp_len] = '\0';
-
-      if(add_grp(key_file, new_grp)) {
-          free(*cur_grp);
-         *cur_grp = new_grp;
-         return TRUE;
-      }else {
-         ALOGE("could not add group to group table\n");
+  for(p = name; p != g_end; p++) {
+      if((*p == '.') && (dot == NULL) && (p != name) && (p + 1 != g_end)) {
+         dot = p;
+      }else if(!isalnum((unsigned char)*p)) {
+         ALOGE("line %u: group name is not alpha numeric\n", line_no);
          return FALSE;
       }
-  }else {
-      return FALSE;
   }
-}
+  for(p = g_end + 1; (*p == ' ') || (*p == '\t'); p++);
+  if(*p != '\0') {
+     ALOGE("line %u: characters after ']'\n", line_no);
+     return FALSE;
+  }
+  *g_end = '\0';
 
-static char key_exist
-(
-  const group_table *key_file,
-  const char *cur_grp,
-  const char *key
-)
-{
-  unsigned int grp_hash_code;
-  unsigned int key_hash_code;
-  unsigned int grp_index;
-  unsigned int key_index;
-  group *grp = NULL;
-  key_value_pair_list *list = NULL;
-
-  if((key_file != NULL) && (cur_grp != NULL)
-      && (key != NULL) && ((key_file->grps_hash != NULL))
-      && (strcmp(key, ""))) {
-     grp_hash_code = get_hash_code(cur_grp);
-     grp_index = (grp_hash_code % key_file->grps_hash_size);
-     grp = key_file->grps_hash[grp_index];
-     key_hash_code = get_hash_code(key);
-     while((grp != NULL)) {
-           if(!strcmp(cur_grp, grp->grp_name)) {
-              key_index = (key_hash_code % grp->keys_hash_size);
-              if(grp->list)
-                 list = grp->list[key_index];
-              while((list != NULL) && strcmp(key, list->key)) {
-                    list = list->next;
-              }
-              if(list != NULL){
-                  return TRUE;
-              }else{
-                  return FALSE;
-              }
-           }
-           grp = grp->grp_next;
-     }
-     if(!grp) {
-        return TRUE;
-     }else {
-        return FALSE;
-     }
-  }else {
+  hash = hash_mem(HASH_SEED, name, g_end - name);
+  if(find_grp(key_file, name, hash) >= 0) {
+     ALOGE("line %u: group %s repeated\n", line_no, name);
      return FALSE;
   }
+  grp = &key_file->grps[key_file->num_of_grps];
+  grp->grp_name = name;
+  grp->hash = hash;
+  grp->first_key = key_file->num_of_keys;
+  grp->num_of_keys = 0;
+
+  i = hash & (key_file->hash_size - 1);
+  while(key_file->grps_hash[i] != SLOT_EMPTY)
+        i = (i + 1) & (key_file->hash_size - 1);
+  key_file->grps_hash[i] = ++key_file->num_of_grps;
+  return TRUE;
 }
 
-//checks validity of key
 //a valid key must start in
 //a seperate line and key must
 //be alphanumeric and before '='
 //there must not be any space
 //Example: key=value
-static char line_is_key_value_pair
+static char parse_key_value_pair
 (
   group_table *key_file,
-  const char *str,
-  const char *cur_grp
+  char *str,
+  unsigned int line_no
 )
 {
-  const char *equal_start;
-  char *key;
-  char *val;
-  unsigned key_len;
-  unsigned val_len;
-
-  if((str == NULL) || (cur_grp == NULL) ||
-     !strcmp(cur_grp, "") || (key_file == NULL)) {
-     ALOGE("line is null or cur group or key file is null or empty\n");
+  char *equal_start;
+  char *p;
+  group *grp;
+  key_value_pair *pair;
+  unsigned int cur_grp;
+  unsigned int hash;
+  unsigned int i;
+
+  if(key_file->num_of_grps == 0) {
+     ALOGE("line %u: key outside of a group\n", line_no);
      return FALSE;
   }
   equal_start = strchr(str, '=');
-  key_len = (equal_start - str);
   if((equal_start == NULL) || (equal_start == str)) {
-     ALOGE("line does not have '=' character or no key\n");
+     ALOGE("line %u: line does not have '=' character or no key\n", line_no);
      return FALSE;
   }
-  while((str != equal_start) && isalnum(*str))
-        str++;
-  if((str == equal_start)) {
-      key = (char *)malloc(sizeof(char) * (key_len + 1));
-      if(key == NULL) {
-         ALOGE("could not alloc memory for new key\n");
+  for(p = str; p != equal_start; p++) {
+      if(!isalnum((unsigned char)*p)) {
+         ALOGE("line %u: key name is not alpha numeric\n", line_no);
          return FALSE;
       }
-      equal_start++;
-      val_len = strlen(equal_start);
-      val = (char *)malloc(sizeof(char) * (val_len + 1));
-      if(val == NULL) {
-         ALOGE("could not alloc memory for value\n");
-         return FALSE;
-      }
-      memcpy(key, (str - key_len), key_len);
-      memcpy(val, equal_start, val_len);
-      key[key_len] = '\0';
-      val[val_len] = '\0';
-      ALOGE("Grp: %s, key: %s, value: %s\n", cur_grp, key, val);
-      return add_key_value_pair(key_file,
-                                 cur_grp, key, val);
-  }else {
-     ALOGE("key name doesnot have alpha numeric char\n");
-     return FALSE;
   }
-}
+  *equal_start = '\0';
 
-static char add_key_value_pair
-(
-  group_table *key_file,
-  const char *cur_grp,
-  const char *key,
-  const char *val
-)
-{
-  unsigned int grp_hash_code;
-  unsigned int key_hash_code;
-  unsigned int grp_index;
-  unsigned int key_index;
-  unsigned key_len, val_len;
-  group *grp = NULL;
-  key_value_pair_list *list = NULL;
-
-  if((key_file != NULL) && (cur_grp != NULL)
-      && (key != NULL) && ((key_file->grps_hash != NULL))
-      && (strcmp(key, ""))) {
-     grp_hash_code = get_hash_code(cur_grp);
-     ALOGE("grp hash code is %u\n", grp_hash_code);
-     grp_index = (grp_hash_code % key_file->grps_hash_size);
-     ALOGE("grp index is %u\n", grp_index);
-     grp = key_file->grps_hash[grp_index];
-     key_hash_code = get_hash_code(key);
-     while((grp != NULL)) {
-           if(!strcmp(cur_grp, grp->grp_name)) {
-              key_index = (key_hash_code % grp->keys_hash_size);
-              if(grp->list) {
-                 list = grp->list[key_index];
-              }else {
-                 ALOGE("group list is null\n");
-                 return FALSE;
-              }
-              while((list != NULL) && strcmp(key, list->key)) {
-                    list = list->next;
-              }
-              if(list != NULL) {
-                  ALOGE("group already contains the key\n");
-                  return FALSE;
-              }else{
-                  list = alloc_key_value_pair();
-                  if(list == NULL) {
-                     ALOGE("add key value failed as could not alloc memory for key\
-                            val pair\n");
-                     return FALSE;
-                  }
-                  key_len = strlen(key);
-                  list->key = (char *)malloc(sizeof(char) *
-                                              (key_len + 1));
-                  if(list->key == NULL) {
-                     ALOGE("could not alloc memory for key\n");
-                     free(list);
-                     return FALSE;
-                  }
-                  val_len = strlen(val);
-                  list->value = (char *)malloc(sizeof(char) *
-                                                (val_len + 1));
-                  if(!list->value) {
-                      free(list->key);
-                      free(list);
-                      return FALSE;
-                  }
-                  memcpy(list->key, key, key_len);
-                  memcpy(list->value, val, val_len);
-                  list->key[key_len] = '\0';
-                  list->value[val_len] = '\0';
-                  list->next = grp->list[key_index];
-                  grp->list[key_index] = list;
-                  grp->num_of_keys++;
-                  return TRUE;
-              }
-           }
-           grp = grp->grp_next;
-     }
-     ALOGE("group does not exist\n");
-     return FALSE;
-  }else {
+  cur_grp = key_file->num_of_grps - 1;
+  grp = &key_file->grps[cur_grp];
+  hash = hash_mem(grp->hash, str, equal_start - str);
+  if(find_key(key_file, cur_grp, str, hash) >= 0) {
+     ALOGE("line %u: group already contains the key %s\n", line_no, str);
      return FALSE;
   }
+  pair = &key_file->keys[key_file->num_of_keys];
+  pair->key = str;
+  pair->value = equal_start + 1;
+  pair->hash = hash;
+  pair->grp = cur_grp;
+
+  i = hash & (key_file->hash_size - 1);
+  while(key_file->keys_hash[i] != SLOT_EMPTY)
+        i = (i + 1) & (key_file->hash_size - 1);
+  key_file->keys_hash[i] = ++key_file->num_of_keys;
+  grp->num_of_keys++;
+  return TRUE;
 }
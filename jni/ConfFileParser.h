@@ -30,33 +30,44 @@
 #ifndef __CONF_FILE_PARSER_H__
 #define __CONF_FILE_PARSER_H__
 
-#define MAX_LINE_LEN 512
-#define MAX_UNIQ_KEYS 5
-#define MAX_UNIQ_GRPS 10
+/*
+ * The file is read once into a single arena, parsed in place and indexed
+ * by open addressing tables sized from its line count. Group names, keys
+ * and values handed out point into that arena: they stay valid, and may
+ * be modified by the caller, until free_key_file.
+ */
+
+/* Larger files are rejected rather than read */
+#define MAX_CONF_FILE_LEN (64 * 1024)
 #define TRUE 1
 #define FALSE 0
 
-struct key_value_pair_list
+struct key_value_pair
 {
    char *key;
    char *value;
-   key_value_pair_list *next;
+   unsigned int hash;
+   unsigned int grp;
 };
 
 struct group
 {
     char *grp_name;
+    unsigned int hash;
+    unsigned int first_key;
     unsigned int num_of_keys;
-    unsigned int keys_hash_size;
-    key_value_pair_list **list;
-    group *grp_next;
 };
 
 struct group_table
 {
-    unsigned int grps_hash_size;
+    char *arena;
+    group *grps;
+    key_value_pair *keys;
+    unsigned int *grps_hash;
+    unsigned int *keys_hash;
+    unsigned int hash_size;
     unsigned int num_of_grps;
-    group **grps_hash;
+    unsigned int num_of_keys;
 };
 
 enum CONF_PARSE_ERRO_CODE
@@ -71,11 +82,14 @@ enum CONF_PARSE_ERRO_CODE
 
 unsigned int get_hash_code(const char *str);
 group_table *get_key_file();
+//frees only the array returned by get_grps/get_keys
 void free_strs(char **str_array);
 void free_key_file(group_table *key_file);
 char parse_load_file(group_table *key_file, const char *file);
+//arrays are NULL terminated and in file order
 char **get_grps(const group_table *key_file);
 char **get_keys(const group_table *key_file, const char *grp);
+//returns the value in place, not to be freed
 char *get_value(const group_table *key_file, const char *grp,
                  const char *key);
 
@@ -28,10 +28,43 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <climits>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cutils/properties.h>
 #include "ConfigFmThs.h"
 #include "FmPerformanceParams.h"
 #include <utils/Log.h>
 
+struct PARAM_RANGE
+{
+   int min;
+   int max;
+};
+
+//Indexed by PERFORMANCE_AF_PARAMS
+static const PARAM_RANGE AF_PARAMS_RANGE[MAX_AF_PARAMS] =
+{
+   {AF_RMSSI_TH_MIN, AF_RMSSI_TH_MAX},
+   {AF_RMSSI_SAMPLES_MIN, AF_RMSSI_SAMPLES_MAX},
+   {GOOD_CH_RMSSI_TH_MIN, GOOD_CH_RMSSI_TH_MAX},
+};
+
+//Indexed by PERFORMANCE_SRCH_PARAMS
+static const PARAM_RANGE SRCH_PARAMS_RANGE[MAX_SRCH_PARAMS] =
+{
+   {SRCH_ALGO_TYPE_MIN, SRCH_ALGO_TYPE_MAX},
+   {INT_MIN, INT_MAX},
+   {SINR_FIRST_STAGE_MIN, SINR_FIRST_STAGE_MAX},
+   {SINR_FINAL_STAGE_MIN, SINR_FINAL_STAGE_MAX},
+   {RMSSI_FIRST_STAGE_MIN, RMSSI_FIRST_STAGE_MAX},
+   {INTF_LOW_TH_MIN, INTF_LOW_TH_MAX},
+   {INTF_HIGH_TH_MIN, INTF_HIGH_TH_MAX},
+   {SINR_SAMPLES_CNT_MIN, SINR_SAMPLES_CNT_MAX},
+};
+
 static int compare_name
 (
    const void *name1, const void *name2
@@ -43,486 +76,587 @@ static int compare_name
     return(strcmp(first, second->name));
 }
 
-ConfigFmThs :: ConfigFmThs
+static uint32_t profiles_hash
 (
+   const fm_ths_profile_set *p
 )
 {
-    keyfile = NULL;
+    const unsigned char *b = (const unsigned char *)p;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for(i = 0; i < offsetof(fm_ths_profile_set, hash); i++) {
+        hash ^= b[i];
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
-ConfigFmThs :: ~ConfigFmThs
+static int64_t mtime_ns
 (
+   const struct stat &st
 )
 {
-   free_key_file(keyfile);
+    return ((int64_t)st.st_mtim.tv_sec * 1000000000) + st.st_mtim.tv_nsec;
 }
 
-void ConfigFmThs :: set_af_ths
+//Keys of grp found in map with a value inside range
+//are stored in values, and flagged in set
+static void compile_params
 (
-   UINT fd
+   const group_table *keyfile,
+   const char *grp,
+   const NAME_MAP *map,
+   size_t map_cnt,
+   const PARAM_RANGE *range,
+   uint32_t &set,
+   int32_t *values
 )
 {
-    signed char ret = FM_SUCCESS;
     char **keys;
     char **keys_cpy;
     char *key_value;
     int value;
-    FmPerformanceParams perf_params;
     struct NAME_MAP *found;
 
-    if(keyfile != NULL) {
-       keys_cpy = keys = get_keys(keyfile, GRPS_MAP[0].name);
-       if(keys != NULL) {
-          while(*keys != NULL) {
-              ALOGE("key found is: %s\n", *keys);
-              found = (NAME_MAP *)bsearch(*keys, AF_PARAMS_MAP,
-                          MAX_AF_PARAMS, sizeof(NAME_MAP), compare_name);
-              if(found != NULL) {
-                 key_value = get_value(keyfile,
-                                     GRPS_MAP[0].name, found->name);
-                 if((key_value != NULL) && strcmp(key_value, "")) {
-                    value = atoi(key_value);
-                    switch(found->num) {
-                    case AF_RMSSI_TH:
-                         if((value >= AF_RMSSI_TH_MIN)
-                             && (value <= AF_RMSSI_TH_MAX)) {
-                             ALOGE("Set af rmssi th: %d\n", value);
-                             ret = perf_params.SetAfRmssiTh(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting Af Rmssi th\n");
-                                break;
-                             }
-                             unsigned short th;
-                             ret = perf_params.GetAfRmssiTh(fd, th);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read af rmssith: %hd\n", th);
-                             }else {
-                                ALOGE("Error in reading Af Rmssi th\n");
-                             }
-                         }
-                         break;
-                    case AF_RMSSI_SAMPLES:
-                         if((value >= AF_RMSSI_SAMPLES_MIN)
-                             && (value <= AF_RMSSI_SAMPLES_MAX)) {
-                             ALOGE("Set af rmssi samples cnt: %d\n", value);
-                             ret = perf_params.SetAfRmssiSamplesCnt(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting af rmssi samples\n");
-                                break;
-                             }
-                             unsigned char cnt;
-                             ret = perf_params.GetAfRmssiSamplesCnt(fd, cnt);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read af rmssi samples cnt: %hhd\n", cnt);
-                             }else {
-                                 ALOGE("Error in reading rmssi samples\n");
-                             }
-                         }
-                         break;
-                    case GOOD_CH_RMSSI_TH:
-                         if((value >= GOOD_CH_RMSSI_TH_MIN)
-                             && (value <= GOOD_CH_RMSSI_TH_MAX)) {
-                             ALOGE("Set Good channle rmssi th: %d\n", value);
-                             ret = perf_params.SetGoodChannelRmssiTh(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting Good channle rmssi th\n");
-                                break;
-                             }
-                             signed char th;
-                             ret = perf_params.GetGoodChannelRmssiTh(fd, th);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read good channel rmssi th: %d\n", th);
-                             }else {
-                                ALOGE("Error in reading Good channle rmssi th\n");
-                             }
-                         }
-                         break;
-                   }
-                 }else {
-                   ALOGE("key_val for key: %s is empty\n",
-                             *keys);
-                 }
-                 free(key_value);
+    keys_cpy = keys = get_keys(keyfile, grp);
+    if(keys == NULL) {
+       ALOGE("No of keys found is zero\n");
+       return;
+    }
+    while(*keys != NULL) {
+        found = (NAME_MAP *)bsearch(*keys, map, map_cnt,
+                    sizeof(NAME_MAP), compare_name);
+        if(found != NULL) {
+           key_value = get_value(keyfile, grp, found->name);
+           if((key_value != NULL) && strcmp(key_value, "")) {
+              value = atoi(key_value);
+              if((value >= range[found->num].min)
+                  && (value <= range[found->num].max)) {
+                  values[found->num] = value;
+                  set |= (1 << found->num);
+              }else {
+                  ALOGE("%s: %d out of range\n", found->name, value);
               }
-              keys++;
-          }
-       }else {
-          ALOGE("No of keys found is zero\n");
-       }
-       free_strs(keys_cpy);
-    }else {
-       ALOGE("key file is null\n");
+           }else {
+              ALOGE("key_value for key: %s is empty\n", *keys);
+           }
+        }
+        keys++;
     }
+    free_strs(keys_cpy);
+}
+
+pthread_mutex_t ConfigFmThs::profiles_lock = PTHREAD_MUTEX_INITIALIZER;
+fm_ths_profile_set *ConfigFmThs::profiles = NULL;
+char ConfigFmThs::active[MAX_THS_PROFILE_NAME];
+bool ConfigFmThs::active_selected = false;
+FmHybridSrchList ConfigFmThs::hybrd_list;
+
+ConfigFmThs :: ConfigFmThs
+(
+)
+{
+    keyfile = NULL;
+    set = NULL;
 }
 
-void ConfigFmThs :: set_srch_ths
+ConfigFmThs :: ~ConfigFmThs
 (
-    UINT fd
 )
 {
-    signed char ret = FM_SUCCESS;
+   free_key_file(keyfile);
+   free(set);
+}
+
+void ConfigFmThs :: compile_af_ths
+(
+   const char *grp, fm_ths_profile &p
+)
+{
+    compile_params(keyfile, grp, AF_PARAMS_MAP, MAX_AF_PARAMS,
+                   AF_PARAMS_RANGE, p.af_set, p.af);
+}
+
+void ConfigFmThs :: compile_srch_ths
+(
+    const char *grp, fm_ths_profile &p
+)
+{
+    compile_params(keyfile, grp, SEACH_PARAMS_MAP, MAX_SRCH_PARAMS,
+                   SRCH_PARAMS_RANGE, p.srch_set, p.srch);
+}
+
+void ConfigFmThs :: compile_hybrd_list
+(
+    const char *grp, fm_ths_profile &p
+)
+{
     char **keys = NULL;
     char **keys_cpy = NULL;
     char *key_value = NULL;
-    int value;
-    FmPerformanceParams perf_params;
-    struct NAME_MAP *found = NULL;
-
-    if(keyfile != NULL) {
-       keys_cpy = keys = get_keys(keyfile, GRPS_MAP[2].name);
-       if(keys != NULL) {
-          while(*keys != NULL) {
-              found = (NAME_MAP *)bsearch(*keys, SEACH_PARAMS_MAP,
-                           MAX_SRCH_PARAMS, sizeof(NAME_MAP), compare_name);
-              if(found != NULL) {
-                 key_value = get_value(keyfile, GRPS_MAP[2].name, found->name);
-                 ALOGE("found srch ths: %s: %s\n", found->name, key_value);
-                 if((key_value != NULL) && strcmp(key_value, "")) {
-                    value = atoi(key_value);
-                    switch(found->num) {
-                    case SINR_FIRST_STAGE:
-                         if((value >= SINR_FIRST_STAGE_MIN)
-                             && (value <= SINR_FIRST_STAGE_MAX)) {
-                             ALOGE("Set sinr first stage: %d\n", value);
-                             ret = perf_params.SetSinrFirstStage(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting sinr first stage\n");
-                                break;
-                             }
-                             signed char th;
-                             ret = perf_params.GetSinrFirstStage(fd, th);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read sinr first stage: %d\n", th);
-                             }else {
-                                ALOGE("Error in reading sinr first stage\n");
-                             }
-                         }
-                         break;
-                    case RMSSI_FIRST_STAGE:
-                         if((value >= RMSSI_FIRST_STAGE_MIN)
-                             && (value <= RMSSI_FIRST_STAGE_MAX)) {
-                             ALOGE("Set rmssi first stage: %d\n", value);
-                             ret = perf_params.SetRmssiFirstStage(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting rmssi first stage\n");
-                                break;
-                             }
-                             signed char th;
-                             ret = perf_params.GetRmssiFirstStage(fd, th);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read rmssi first stage: %d\n", th);
-                             }else {
-                                ALOGE("Error in reading rmssi first stage\n");
-                             }
-                         }
-                         break;
-                    case INTF_LOW_TH:
-                         if((value >= INTF_LOW_TH_MIN)
-                             && (value <= INTF_LOW_TH_MAX)) {
-                            ALOGE("Set intf low th: %d\n", value);
-                            ret = perf_params.SetIntfLowTh(fd, value);
-                            if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting intf low th\n");
-                                break;
-                            }
-                            unsigned char th;
-                            ret = perf_params.GetIntfLowTh(fd, th);
-                            if(ret == FM_SUCCESS) {
-                               ALOGE("Read intf low th: %u\n", th);
-                            }else {
-                               ALOGE("Error in reading intf low th\n");
-                            }
-                         }
-                         break;
-                    case INTF_HIGH_TH:
-                         if((value >= INTF_HIGH_TH_MIN)
-                             && (value <= INTF_HIGH_TH_MAX)) {
-                            ALOGE("Set intf high th: %d\n", value);
-                            ret = perf_params.SetIntfHighTh(fd, value);
-                            if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting intf high th\n");
-                                break;
-                            }
-                            unsigned char th;
-                            ret = perf_params.GetIntfHighTh(fd, th);
-                            if(ret == FM_SUCCESS) {
-                               ALOGE("Read intf high th: %u\n", th);
-                            }else {
-                               ALOGE("Error in reading intf high th\n");
-                            }
-                         }
-                         break;
-                    case CF0_TH:
-                         ALOGE("Set cf0 th: %d\n", value);
-                         ret = perf_params.SetCf0Th12(fd, value);
-                         if(ret == FM_FAILURE) {
-                            ALOGE("Error in setting cf0 th\n");
-                            break;
-                         }
-                         int th;
-                         ret = perf_params.GetCf0Th12(fd, th);
-                         if(ret == FM_SUCCESS) {
-                            ALOGE("Read CF012 th: %d\n", th);
-                         }else {
-                            ALOGE("Error in reading cf0 th\n");
-                         }
-                         break;
-                    case SRCH_ALGO_TYPE:
-                         if((value >= SRCH_ALGO_TYPE_MIN)
-                             && (value <= SRCH_ALGO_TYPE_MAX)) {
-                             ALOGE("Set search algo type: %d\n", value);
-                             ret = perf_params.SetSrchAlgoType(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting search algo type\n");
-                                break;
-                             }
-                             unsigned char algo;
-                             ret = perf_params.GetSrchAlgoType(fd, algo);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read algo type: %u\n", algo);
-                             }else {
-                                ALOGE("Error in reading search algo type\n");
-                             }
-                         }
-                         break;
-                    case SINR_SAMPLES:
-                         if((value >= SINR_SAMPLES_CNT_MIN)
-                             && (value <= SINR_SAMPLES_CNT_MAX)) {
-                             ALOGE("Set sinr samples count: %d\n", value);
-                             ret = perf_params.SetSinrSamplesCnt(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting sinr samples count\n");
-                                break;
-                             }
-                             unsigned char cnt;
-                             ret = perf_params.GetSinrSamplesCnt(fd, cnt);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read sinr samples cnt: %u\n", cnt);
-                             }else {
-                                ALOGE("Error in reading sinr samples count\n");
-                             }
-                         }
-                         break;
-                    case SINR:
-                         if((value >= SINR_FINAL_STAGE_MIN)
-                             && (value <= SINR_FINAL_STAGE_MAX)) {
-                             ALOGE("Set final stage sinr: %d\n", value);
-                             ret = perf_params.SetSinrFinalStage(fd, value);
-                             if(ret == FM_FAILURE) {
-                                ALOGE("Error in setting final stage sinr\n");
-                                break;
-                             }
-                             signed char th;
-                             ret = perf_params.GetSinrFinalStage(fd, th);
-                             if(ret == FM_SUCCESS) {
-                                ALOGE("Read final stage sinr: %d\n", th);
-                             }else {
-                                ALOGE("Error in reading final stage sinr\n");
-                             }
-                         }
-                         break;
-                    }
-                 }else {
-                    ALOGE("key_value for key: %s is empty\n",
-                                  *keys);
-                 }
-                 free(key_value);
+    char *freqs = NULL;
+    char *sinrs = NULL;
+    FmHybridSrchList list;
+    struct NAME_MAP *found;
+    int cnt;
+
+    keys_cpy = keys = get_keys(keyfile, grp);
+    if(keys != NULL) {
+       while(*keys != NULL) {
+           found = (NAME_MAP *)bsearch(*keys, HYBRD_SRCH_MAP,
+                        MAX_HYBRID_SRCH_PARAMS, sizeof(NAME_MAP), compare_name);
+           if(found != NULL) {
+              key_value = get_value(keyfile, grp, found->name);
+              if((key_value != NULL) && strcmp(key_value, "")) {
+                  switch(found->num) {
+                  case FREQ_LIST:
+                       freqs = key_value;
+                       break;
+                  case SINR_LIST:
+                       sinrs = key_value;
+                       break;
+                  default:
+                       break;
+                  }
               }
-              keys++;
-          }
-       }else {
-          ALOGE("No of keys found is zero\n");
+           }
+           keys++;
        }
        free_strs(keys_cpy);
     }else {
-       ALOGE("key file is null\n");
+       ALOGE("No of keys found is zero\n");
+    }
+
+    cnt = list.parse(freqs, sinrs);
+    if(cnt > 0) {
+       p.hybrd_cnt = list.store(p.hybrd_chans, p.hybrd_sinrs,
+                                MAX_HYBRID_SRCH_ENTRIES);
+    }else {
+       ALOGE("hybrid list of %s ignored\n", grp);
     }
 }
 
-void ConfigFmThs :: set_hybrd_list
+//Parse the text file into set
+bool ConfigFmThs :: compile
 (
-    UINT fd
+    const char *file, const struct stat &src
 )
 {
-    signed char ret = FM_SUCCESS;
-    char **keys = NULL;
-    char **keys_cpy = NULL;
-    char *key_value = NULL;
-    char *freqs = NULL;
-    unsigned int *freqs_array = NULL;
-    signed char *sinrs_array = NULL;
-    char *sinrs = NULL;
-    int value;
-    unsigned int freq_cnt = 0;
-    unsigned int sinr_cnt = 0;
-    FmPerformanceParams perf_params;
-    struct NAME_MAP *found;
+    char **grps = NULL;
+    bool ret = false;
 
-    ALOGE("Inside hybrid srch list\n");
-    if(keyfile != NULL) {
-       keys_cpy = keys = get_keys(keyfile, GRPS_MAP[1].name);
-       if(keys != NULL) {
-          while(*keys != NULL) {
-              found = (NAME_MAP *)bsearch(*keys, HYBRD_SRCH_MAP,
-                           MAX_HYBRID_SRCH_PARAMS, sizeof(NAME_MAP), compare_name);
-              if(found != NULL) {
-                 key_value = get_value(keyfile, GRPS_MAP[1].name, found->name);
-                 if((key_value != NULL) && strcmp(key_value, "")) {
-                     switch(found->num) {
-                     case FREQ_LIST:
-                          freqs = key_value;
-                          break;
-                     case SINR_LIST:
-                          sinrs = key_value;
-                          break;
-                     default:
-                          free(key_value);
-                          break;
-                     }
-                 }
-              }
-              keys++;
-          }
-          free_strs(keys_cpy);
+    memset(set, 0, sizeof(*set));
+    set->magic = FM_THS_PROFILE_MAGIC;
+    set->version = FM_THS_PROFILE_VERSION;
+    set->src_ino = src.st_ino;
+    set->src_size = src.st_size;
+    set->src_mtime_ns = mtime_ns(src);
+    set->cnt = 1;
+
+    keyfile = get_key_file();
+
+    ALOGE("file name is: %s\n", file);
+    if(!parse_load_file(keyfile, file)) {
+       ALOGE("Error in loading threshold file\n");
+    }else {
+       grps = get_grps(keyfile);
+       if(grps != NULL) {
+          //named profiles start as a copy of the default one
+          compile_grps(grps, false);
+          compile_grps(grps, true);
        }else {
-          ALOGE("No of keys found is zero\n");
+          ALOGE("No of groups found is zero\n");
        }
-    }else {
-       ALOGE("key file is null\n");
+       free_strs(grps);
+       set->hash = profiles_hash(set);
+       ret = true;
+    }
+    free_key_file(keyfile);
+    keyfile = NULL;
+    return ret;
+}
+
+//Compiles the plain groups into the default profile,
+//or the GROUP.name ones into profile name
+void ConfigFmThs :: compile_grps
+(
+    char **grps, bool named
+)
+{
+    struct NAME_MAP *found;
+    fm_ths_profile *def = &set->profiles[0];
+    fm_ths_profile *p;
+    char base[sizeof(GRPS_MAP[0].name)];
+    const char *dot;
+    size_t len;
+
+    for(; *grps != NULL; grps++) {
+        dot = strchr(*grps, '.');
+        if((dot != NULL) != named)
+           continue;
+        len = (dot != NULL) ? (size_t)(dot - *grps) : strlen(*grps);
+        if(len >= sizeof(base))
+           continue;
+        memcpy(base, *grps, len);
+        base[len] = '\0';
+        found = (NAME_MAP *)bsearch(base, GRPS_MAP, MAX_GRPS,
+                       sizeof(NAME_MAP), compare_name);
+        if(found == NULL)
+           continue;
+        p = named ? get_profile(dot + 1) : def;
+        if(p == NULL)
+           continue;
+        ALOGE("Found group: %s\n", *grps);
+        p->grps |= (1 << found->num);
+        switch(found->num) {
+        case AF_THS:
+             compile_af_ths(*grps, *p);
+             break;
+        case SRCH_THS:
+             compile_srch_ths(*grps, *p);
+             break;
+        case HYBRD_SRCH_LIST:
+             compile_hybrd_list(*grps, *p);
+             break;
+        }
+        if(p == def)
+           continue;
+        //Switching back has to restore whatever a profile set
+        if(((p->af_set & ~def->af_set) != 0)
+           || ((p->srch_set & ~def->srch_set) != 0)
+           || (p->hybrd_cnt && !def->hybrd_cnt)) {
+           ALOGE("%s: only what the default profile sets is kept\n", *grps);
+        }
+        p->grps &= def->grps;
+        p->af_set &= def->af_set;
+        p->srch_set &= def->srch_set;
+        if(def->hybrd_cnt == 0)
+           p->hybrd_cnt = 0;
     }
+}
+
+//Profile name of set, added as a copy of
+//the default profile when it is new
+fm_ths_profile *ConfigFmThs :: get_profile
+(
+    const char *name
+)
+{
+    int i = find_profile(set, name);
+
+    if(i >= 0)
+       return &set->profiles[i];
+    if((set->cnt == MAX_THS_PROFILES)
+       || (strlen(name) >= MAX_THS_PROFILE_NAME)) {
+       ALOGE("threshold profile %s ignored\n", name);
+       return NULL;
+    }
+    set->profiles[set->cnt] = set->profiles[0];
+    strcpy(set->profiles[set->cnt].name, name);
+    return &set->profiles[set->cnt++];
+}
+
+int ConfigFmThs :: find_profile
+(
+    const fm_ths_profile_set *s, const char *name
+)
+{
+    UINT i;
+
+    if(name == NULL)
+       name = "";
+    for(i = 0; i < s->cnt; i++) {
+        if(!strcmp(s->profiles[i].name, name))
+           return i;
+    }
+    return -1;
+}
+
+//Take the compiled profiles from cache if they are
+//intact and were compiled from src as it is now
+bool ConfigFmThs :: load_profiles
+(
+    const char *cache, const struct stat &src
+)
+{
+    ssize_t len;
+    UINT i;
+    int fd;
+
+    fd = open(cache, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+       return false;
+    }
+    do {
+       len = read(fd, set, sizeof(*set));
+    } while((len < 0) && (errno == EINTR));
+    close(fd);
 
-    freq_cnt = extract_comma_sep_freqs(freqs, &freqs_array, ",");
-    sinr_cnt = extract_comma_sep_sinrs(sinrs, &sinrs_array, ",");
+    if((len != (ssize_t)sizeof(*set))
+       || (set->magic != FM_THS_PROFILE_MAGIC)
+       || (set->version != FM_THS_PROFILE_VERSION)
+       || (set->hash != profiles_hash(set))
+       || (set->cnt == 0) || (set->cnt > MAX_THS_PROFILES)) {
+       ALOGE("%s is not a valid profile\n", cache);
+       return false;
+    }
+    if((set->src_ino != (uint64_t)src.st_ino)
+       || (set->src_size != (int64_t)src.st_size)
+       || (set->src_mtime_ns != mtime_ns(src))) {
+       ALOGD("%s is stale\n", cache);
+       return false;
+    }
+    for(i = 0; i < set->cnt; i++) {
+        if((set->profiles[i].hybrd_cnt > MAX_HYBRID_SRCH_ENTRIES)
+           || (set->profiles[i].name[MAX_THS_PROFILE_NAME - 1] != '\0'))
+           return false;
+    }
+    return true;
+}
 
-    if((freq_cnt == sinr_cnt) && (sinr_cnt > 0)) {
-       perf_params.SetHybridSrchList(fd, freqs_array, sinrs_array, freq_cnt);
+//Written to a temporary file and renamed, a reader
+//sees either the old or the new profiles. A torn write
+//after a crash fails the hash and is compiled again.
+void ConfigFmThs :: store_profiles
+(
+    const char *cache
+)
+{
+    char tmp[PATH_MAX];
+    ssize_t len;
+    int fd;
+
+    if(snprintf(tmp, sizeof(tmp), "%s.tmp", cache) >= (int)sizeof(tmp)) {
+       return;
+    }
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if(fd < 0) {
+       ALOGE("could not create %s: %s\n", tmp, strerror(errno));
+       return;
     }
+    do {
+       len = write(fd, set, sizeof(*set));
+    } while((len < 0) && (errno == EINTR));
+    close(fd);
 
-    free(freqs);
-    free(sinrs);
-    free(freqs_array);
-    free(sinrs_array);
+    if((len != (ssize_t)sizeof(*set)) || (rename(tmp, cache) < 0)) {
+       ALOGE("could not store %s\n", cache);
+       unlink(tmp);
+    }
 }
 
-unsigned int ConfigFmThs :: extract_comma_sep_freqs
+void ConfigFmThs :: apply_af_ths
 (
-    char *freqs,
-    unsigned int **freqs_arr,
-    const char *str
+    UINT fd, const fm_ths_profile &p
 )
 {
-    char *next_freq;
-    char *saveptr = NULL;
-    unsigned int freq;
-    unsigned int *freqs_new_arr;
-    unsigned int size = 0;
-    unsigned int len = 0;
-
-    next_freq = strtok_r(freqs, str, &saveptr);
-    while(next_freq != NULL) {
-          freq = atoi(next_freq);
-          ALOGD("HYBRID_SRCH freq: %u\n", freq);
-          if(size == len) {
-             size <<= 1;
-             if(size == 0)
-                size = 1;
-             freqs_new_arr = (unsigned int *)realloc(*freqs_arr,
-                                              size * sizeof(unsigned int));
-             if(freqs_new_arr == NULL) {
-                free(*freqs_arr);
-                *freqs_arr = NULL;
-                break;
-             }
-             *freqs_arr = freqs_new_arr;
-          }
-          (*freqs_arr)[len] = freq;
-          len++;
-          next_freq = strtok_r(NULL, str, &saveptr);
+    signed char ret;
+    FmPerformanceParams perf_params;
+    int i;
+
+    perf_params.BeginBatch();
+    for(i = 0; i < MAX_AF_PARAMS; i++) {
+        if(!(p.af_set & (1 << i)))
+           continue;
+        ALOGD("Set af param %d: %d\n", i, p.af[i]);
+        switch(i) {
+        case AF_RMSSI_TH:
+             ret = perf_params.SetAfRmssiTh(fd, p.af[i]);
+             break;
+        case AF_RMSSI_SAMPLES:
+             ret = perf_params.SetAfRmssiSamplesCnt(fd, p.af[i]);
+             break;
+        case GOOD_CH_RMSSI_TH:
+             ret = perf_params.SetGoodChannelRmssiTh(fd, p.af[i]);
+             break;
+        default:
+             ret = FM_SUCCESS;
+             break;
+        }
+        if(ret == FM_FAILURE)
+           ALOGE("Error in setting af param %d\n", i);
     }
-    return len;
+    if(perf_params.CommitBatch(fd) == FM_FAILURE)
+       ALOGE("Error in applying %s\n", __func__);
 }
 
-unsigned int ConfigFmThs :: extract_comma_sep_sinrs
+void ConfigFmThs :: apply_srch_ths
 (
-    char *sinrs,
-    signed char **sinrs_arr,
-    const char *str
+    UINT fd, const fm_ths_profile &p
 )
 {
-    char *next_sinr;
-    char *saveptr = NULL;
-    signed char *sinrs_new_arr;
-    unsigned int size = 0;
-    unsigned int len = 0;
-    signed char sinr;
-
-    next_sinr = strtok_r(sinrs, str, &saveptr);
-    while(next_sinr != NULL) {
-          sinr = atoi(next_sinr);
-          ALOGD("HYBRID_SRCH sinr: %d\n", sinr);
-          if(size == len) {
-             size <<= 1;
-             if(size == 0)
-                size = 1;
-             sinrs_new_arr = (signed char *)realloc(*sinrs_arr,
-                                               size * sizeof(signed char));
-             if(sinrs_new_arr == NULL) {
-                free(*sinrs_arr);
-                *sinrs_arr = NULL;
-                break;
-             }
-             *sinrs_arr = sinrs_new_arr;
-          }
-          (*sinrs_arr)[len] = sinr;
-          len++;
-          next_sinr = strtok_r(NULL, str, &saveptr);
+    signed char ret;
+    FmPerformanceParams perf_params;
+    int i;
+
+    perf_params.BeginBatch();
+    for(i = 0; i < MAX_SRCH_PARAMS; i++) {
+        if(!(p.srch_set & (1 << i)))
+           continue;
+        ALOGD("Set srch param %d: %d\n", i, p.srch[i]);
+        switch(i) {
+        case SRCH_ALGO_TYPE:
+             ret = perf_params.SetSrchAlgoType(fd, p.srch[i]);
+             break;
+        case CF0_TH:
+             ret = perf_params.SetCf0Th12(fd, p.srch[i]);
+             break;
+        case SINR_FIRST_STAGE:
+             ret = perf_params.SetSinrFirstStage(fd, p.srch[i]);
+             break;
+        case SINR:
+             ret = perf_params.SetSinrFinalStage(fd, p.srch[i]);
+             break;
+        case RMSSI_FIRST_STAGE:
+             ret = perf_params.SetRmssiFirstStage(fd, p.srch[i]);
+             break;
+        case INTF_LOW_TH:
+             ret = perf_params.SetIntfLowTh(fd, p.srch[i]);
+             break;
+        case INTF_HIGH_TH:
+             ret = perf_params.SetIntfHighTh(fd, p.srch[i]);
+             break;
+        case SINR_SAMPLES:
+             ret = perf_params.SetSinrSamplesCnt(fd, p.srch[i]);
+             break;
+        default:
+             ret = FM_SUCCESS;
+             break;
+        }
+        if(ret == FM_FAILURE)
+           ALOGE("Error in setting srch param %d\n", i);
     }
-    return len;
+    if(perf_params.CommitBatch(fd) == FM_FAILURE)
+       ALOGE("Error in applying %s\n", __func__);
+}
+
+//Called with profiles_lock held. Stations learned
+//from scans start over with every profile applied.
+void ConfigFmThs :: apply_hybrd_list
+(
+    UINT fd, const fm_ths_profile &p
+)
+{
+    FmPerformanceParams perf_params;
+
+    if(hybrd_list.load(p.hybrd_chans, p.hybrd_sinrs, p.hybrd_cnt) > 0) {
+       perf_params.SetHybridSrchList(fd, hybrd_list);
+    }
+}
+
+void ConfigFmThs :: apply_profile
+(
+    UINT fd, const fm_ths_profile &p
+)
+{
+    ALOGI("Applying threshold profile %s\n",
+          p.name[0] ? p.name : "default");
+    if(p.grps & (1 << AF_THS))
+       apply_af_ths(fd, p);
+    if(p.grps & (1 << SRCH_THS))
+       apply_srch_ths(fd, p);
+    if(p.grps & (1 << HYBRD_SRCH_LIST))
+       apply_hybrd_list(fd, p);
+    else
+       hybrd_list.clear();
 }
 
 void  ConfigFmThs :: SetRxSearchAfThs
 (
-    const char *file, UINT fd
+    const char *file, UINT fd, const char *cache
 )
 {
-    int index;
-    struct NAME_MAP *found;
-    char **grps = NULL;
-    char **grps_cpy = NULL;
+    struct stat src;
+    char name[PROPERTY_VALUE_MAX];
+    int i;
 
-    keyfile = get_key_file();
+    if(stat(file, &src) < 0) {
+       ALOGE("Error in loading threshold file %s\n", file);
+       return;
+    }
+    free(set);
+    set = (fm_ths_profile_set *)malloc(sizeof(*set));
+    if(set == NULL) {
+       return;
+    }
+    if((cache == NULL) || !load_profiles(cache, src)) {
+       if(!compile(file, src))
+          return;
+       if(cache != NULL)
+          store_profiles(cache);
+    }
 
-    ALOGE("file name is: %s\n", file);
-    if(!parse_load_file(keyfile, file)) {
-       ALOGE("Error in loading threshold file\n");
-    }else {
-       grps_cpy = grps = get_grps(keyfile);
-       if(grps != NULL) {
-          while(*grps != NULL) {
-              ALOGE("Search grp: %s\n", *grps);
-              found = (NAME_MAP *)bsearch(*grps, GRPS_MAP, MAX_GRPS,
-                             sizeof(NAME_MAP), compare_name);
-              if(found != NULL) {
-                 ALOGE("Found group: %s\n", found->name);
-                 switch(found->num) {
-                 case AF_THS:
-                      set_af_ths(fd);
-                      break;
-                 case SRCH_THS:
-                      set_srch_ths(fd);
-                      break;
-                 case HYBRD_SRCH_LIST:
-                      set_hybrd_list(fd);
-                      break;
-                 }
-              }
-              grps++;
-          }
-       }else {
-          ALOGE("No of groups found is zero\n");
+    pthread_mutex_lock(&profiles_lock);
+    free(profiles);
+    profiles = set;
+    set = NULL;
+    if(!active_selected) {
+       property_get(FM_THS_PROFILE_PROP, name, "");
+       if(strlen(name) >= MAX_THS_PROFILE_NAME) {
+          ALOGE("Threshold profile name %s too long, using the default\n", name);
+          name[0] = '\0';
        }
-       free_strs(grps_cpy);
+       snprintf(active, sizeof(active), "%s", name);
     }
-    free_key_file(keyfile);
-    keyfile = NULL;
+    i = find_profile(profiles, active);
+    if(i < 0) {
+       ALOGE("No threshold profile %s, using the default\n", active);
+       i = 0;
+    }
+    apply_profile(fd, profiles->profiles[i]);
+    pthread_mutex_unlock(&profiles_lock);
+}
+
+//A switch applies the whole profile under profiles_lock, so
+//it never interleaves with another switch or a reload
+int ConfigFmThs :: SelectProfile
+(
+    UINT fd, const char *name
+)
+{
+    int ret = FM_SUCCESS;
+    int i;
+
+    if(name == NULL)
+       name = "";
+    if(strlen(name) >= MAX_THS_PROFILE_NAME) {
+       ALOGE("Threshold profile name %s too long\n", name);
+       return FM_FAILURE;
+    }
+
+    pthread_mutex_lock(&profiles_lock);
+    if(profiles == NULL) {
+       //Nothing loaded yet, taken by the next load
+       snprintf(active, sizeof(active), "%s", name);
+       active_selected = true;
+    }else if((i = find_profile(profiles, name)) < 0) {
+       ALOGE("No threshold profile %s\n", name);
+       ret = FM_FAILURE;
+    }else {
+       snprintf(active, sizeof(active), "%s", name);
+       active_selected = true;
+       apply_profile(fd, profiles->profiles[i]);
+    }
+    pthread_mutex_unlock(&profiles_lock);
+    return ret;
+}
+
+//Scans only refine a hybrid list the active profile has
+int ConfigFmThs :: UpdateHybridSrchList
+(
+    UINT fd, const ULINT *khz, UINT n
+)
+{
+    FmPerformanceParams perf_params;
+    int ret = FM_SUCCESS;
+
+    pthread_mutex_lock(&profiles_lock);
+    if(hybrd_list.count() == 0) {
+       ret = FM_FAILURE;
+    }else if(hybrd_list.update_from_scan(khz, n)) {
+       ret = perf_params.SetHybridSrchList(fd, hybrd_list);
+    }
+    pthread_mutex_unlock(&profiles_lock);
+    return ret;
 }
@@ -44,6 +44,9 @@ const UINT CAL_DATA_SIZE = 23;
 #define STD_BUF_SIZE  256
 
 const char *const FM_PERFORMANCE_PARAMS = "/etc/fm/fm_srch_af_th.conf";
+const char *const FM_PERFORMANCE_PARAMS_CACHE = "/data/misc/fm/fm_srch_af_th.bin";
+//Threshold profile used from power on, the default one when unset
+const char *const FM_THS_PROFILE_PROP = "persist.vendor.fm.ths_profile";
 #ifdef FM_LEGACY_PATCHLOADER
 const char *const CALIB_DATA_NAME = "/data/app/Riva_fm_cal";
 #else
@@ -119,7 +122,8 @@ enum FM_V4L2_PRV_CONTROLS
     V4L2_CID_PRV_RDSON,
     V4L2_CID_PRV_RDSGROUP_PROC,
     V4L2_CID_PRV_LP_MODE,
-    V4L2_CID_PRV_INTDET = V4L2_CID_PRV_BASE + 25,
+    V4L2_CID_PRV_IOVERC = V4L2_CID_PRV_BASE + 24,
+    V4L2_CID_PRV_INTDET,
     V4L2_CID_PRV_AF_JUMP = V4L2_CID_PRV_BASE + 27,
     V4L2_CID_PRV_SOFT_MUTE = V4L2_CID_PRV_BASE + 30,
     V4L2_CID_PRV_AUDIO_PATH = V4L2_CID_PRV_BASE + 41,
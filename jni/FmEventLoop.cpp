@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "android_hardware_fm"
+
+#include "FmEventLoop.h"
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <utils/Log.h>
+
+char const * const FmEventLoop::LOGTAG = "FmEventLoop";
+
+FmEventLoop :: FmEventLoop
+(
+)
+{
+    epoll_fd = -1;
+    wake_fd = -1;
+    radio_fd = -1;
+    radio_polled = false;
+}
+
+FmEventLoop :: ~FmEventLoop
+(
+)
+{
+    if (wake_fd >= 0)
+        close(wake_fd);
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+}
+
+int FmEventLoop :: watch_radio
+(
+    int op
+)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN | EPOLLPRI;
+    ev.data.fd = radio_fd;
+    if (epoll_ctl(epoll_fd, op, radio_fd, &ev) < 0) {
+        ALOGE("%s: epoll_ctl(%d) on fd %d failed: %d", LOGTAG, op, radio_fd.load(), errno);
+        return -errno;
+    }
+    return 0;
+}
+
+int FmEventLoop :: open
+(
+    int fd
+)
+{
+    struct epoll_event ev;
+    uint64_t cnt;
+
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            ALOGE("%s: epoll_create1 failed: %d", LOGTAG, errno);
+            return -errno;
+        }
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0) {
+            ALOGE("%s: eventfd failed: %d", LOGTAG, errno);
+            close(epoll_fd);
+            epoll_fd = -1;
+            return -errno;
+        }
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    }
+    if (radio_fd >= 0)
+        unwatch_radio();
+    /* a release() nobody waited for must not end the first wait on fd */
+    while (read(wake_fd, &cnt, sizeof(cnt)) > 0)
+        ;
+
+    radio_fd = fd;
+    radio_polled = false;
+    return watch_radio(EPOLL_CTL_ADD);
+}
+
+void FmEventLoop :: unwatch_radio
+(
+    void
+)
+{
+    if (radio_fd >= 0 && !radio_polled)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, radio_fd, NULL);
+    radio_fd = -1;
+    radio_polled = false;
+}
+
+void FmEventLoop :: release
+(
+    void
+)
+{
+    unwatch_radio();
+    wake();
+}
+
+void FmEventLoop :: wake
+(
+    void
+)
+{
+    uint64_t one = 1;
+
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        ALOGE("%s: wake failed: %d", LOGTAG, errno);
+}
+
+void FmEventLoop :: radio_idle
+(
+    void
+)
+{
+    if (radio_fd >= 0 && !radio_polled) {
+        ALOGI("%s: fd %d has no poll support, polling every %d ms",
+              LOGTAG, radio_fd.load(), FM_EVT_POLL_MS);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, radio_fd, NULL);
+        radio_polled = true;
+    }
+}
+
+int FmEventLoop :: wait
+(
+    int timeout_ms
+)
+{
+    struct epoll_event evs[2];
+    uint64_t cnt;
+    int n, ret = WAIT_TIMEOUT;
+    bool poll_due = false;
+
+    if (epoll_fd < 0)
+        return -EBADF;
+
+    if (radio_polled && (timeout_ms < 0 || timeout_ms > FM_EVT_POLL_MS)) {
+        timeout_ms = FM_EVT_POLL_MS;
+        poll_due = true;
+    }
+
+    do {
+        n = epoll_wait(epoll_fd, evs, 2, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        ALOGE("%s: epoll_wait failed: %d", LOGTAG, errno);
+        return -errno;
+    }
+    if (n == 0)
+        return poll_due ? WAIT_RADIO : WAIT_TIMEOUT;
+
+    for (int i = 0; i < n; i++) {
+        if (evs[i].data.fd == wake_fd) {
+            while (read(wake_fd, &cnt, sizeof(cnt)) > 0)
+                ;
+            /* a wake up always wins, it carries shutdown */
+            return WAIT_WAKE;
+        }
+        if (evs[i].data.fd == radio_fd)
+            ret = WAIT_RADIO;
+    }
+    return ret;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_EVENT_LOOP_H__
+#define __FM_EVENT_LOOP_H__
+
+/*
+ * epoll wait on the radio fd plus an eventfd, shared by libqcomfm_jni and
+ * libfmjni.
+ *
+ * The event thread sleeps in wait() until the driver has an event queued,
+ * another thread calls wake(), or the timeout given by the owner of the
+ * loop runs out; shutdown and re-arming a deadline therefore no longer
+ * depend on the driver sending an event. The radio fd is expected to be
+ * non blocking. A driver without poll support reports the fd readable
+ * while VIDIOC_DQBUF still fails with EAGAIN; radio_idle() then drops the
+ * fd from the epoll set and wait() polls it every FM_EVT_POLL_MS instead.
+ * open() and release() run on the caller's thread while wait() runs on the
+ * event thread, hence the atomic radio fd state.
+ */
+
+#include <atomic>
+
+#define FM_EVT_POLL_MS  20
+
+class FmEventLoop
+{
+    private:
+        static char const * const LOGTAG;
+        int epoll_fd;
+        int wake_fd;
+        std::atomic<int> radio_fd;
+        std::atomic<bool> radio_polled;
+        int watch_radio(int op);
+        void unwatch_radio(void);
+    public:
+        enum {
+            WAIT_TIMEOUT,
+            WAIT_RADIO,
+            WAIT_WAKE,
+        };
+        FmEventLoop();
+        ~FmEventLoop();
+        /* Binds the radio fd, creating the epoll and eventfd on first use */
+        int open(int fd);
+        /* Unbinds the radio fd and wakes the waiter */
+        void release(void);
+        /* timeout_ms < 0 waits forever; returns WAIT_* or -errno */
+        int wait(int timeout_ms);
+        void wake(void);
+        /* The fd was reported readable but had nothing queued */
+        void radio_idle(void);
+};
+
+#endif //__FM_EVENT_LOOP_H__
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "android_hardware_fm"
+
+#include "FmHybridSrchList.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Log.h>
+
+#define HYBRID_SRCH_TOP_CHAN \
+    ((HYBRID_SRCH_TOP_KHZ - HYBRID_SRCH_BASE_KHZ) / HYBRID_SRCH_STEP_KHZ)
+
+static int compare_key
+(
+    const void *a, const void *b
+)
+{
+    uint32_t ka = *(const uint32_t *)a;
+    uint32_t kb = *(const uint32_t *)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+//Next number of a comma separated list, 0 at its end
+static int next_num
+(
+    const char *&p, long &val
+)
+{
+    char *end;
+
+    while((*p == ',') || isspace((unsigned char)*p))
+        p++;
+    if(*p == '\0')
+        return 0;
+    errno = 0;
+    val = strtol(p, &end, 10);
+    if((end == p) || (errno != 0))
+        return -EINVAL;
+    p = end;
+    if((*p != '\0') && (*p != ',') && !isspace((unsigned char)*p))
+        return -EINVAL;
+    return 1;
+}
+
+int FmHybridSrchList :: to_chan
+(
+    unsigned long khz
+)
+{
+    if((khz < HYBRID_SRCH_BASE_KHZ) || (khz > HYBRID_SRCH_TOP_KHZ)
+       || ((khz - HYBRID_SRCH_BASE_KHZ) % HYBRID_SRCH_STEP_KHZ))
+        return -1;
+    return (khz - HYBRID_SRCH_BASE_KHZ) / HYBRID_SRCH_STEP_KHZ;
+}
+
+//First entry at or above chan
+unsigned int FmHybridSrchList :: lower_bound
+(
+    uint16_t chan
+) const
+{
+    unsigned int lo = 0;
+    unsigned int hi = cnt;
+    unsigned int mid;
+
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(chans[mid] < chan)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+//Sorted on channel and then on the position in the file,
+//so the last entry of a channel is the one kept
+int FmHybridSrchList :: parse
+(
+    const char *freq_list, const char *sinr_list
+)
+{
+    uint32_t keys[MAX_HYBRID_SRCH_ENTRIES];
+    int8_t th[MAX_HYBRID_SRCH_ENTRIES];
+    long khz, sinr;
+    unsigned int n = 0;
+    unsigned int i;
+    int rf, rs;
+    int chan;
+
+    cnt = 0;
+    if((freq_list == NULL) || (sinr_list == NULL))
+        return -EINVAL;
+
+    while(n < MAX_HYBRID_SRCH_ENTRIES) {
+        rf = next_num(freq_list, khz);
+        rs = next_num(sinr_list, sinr);
+        if((rf < 0) || (rs < 0) || (rf != rs)) {
+            ALOGE("hybrid srch freqs and sinrs do not pair up\n");
+            return -EINVAL;
+        }
+        if(rf == 0)
+            break;
+        chan = to_chan(khz);
+        if((chan < 0) || (sinr < INT8_MIN) || (sinr > INT8_MAX)) {
+            ALOGE("hybrid srch entry %ld, %ld ignored\n", khz, sinr);
+            continue;
+        }
+        keys[n] = ((uint32_t)chan << 16) | n;
+        th[n] = sinr;
+        n++;
+    }
+    if(n == MAX_HYBRID_SRCH_ENTRIES)
+        ALOGE("hybrid srch list cut at %u entries\n", n);
+
+    qsort(keys, n, sizeof(keys[0]), compare_key);
+    for(i = 0; i < n; i++) {
+        if((i + 1 < n) && ((keys[i] >> 16) == (keys[i + 1] >> 16)))
+            continue;
+        chans[cnt] = keys[i] >> 16;
+        sinrs[cnt] = th[keys[i] & 0xffff];
+        hits[cnt] = HYBRID_SRCH_PINNED;
+        cnt++;
+    }
+    if(cnt < n)
+        ALOGE("hybrid srch list has %u duplicate freqs\n", n - cnt);
+    return cnt;
+}
+
+int FmHybridSrchList :: load
+(
+    const uint16_t *ch, const int8_t *th, unsigned int n
+)
+{
+    unsigned int i;
+
+    cnt = 0;
+    if(n > MAX_HYBRID_SRCH_ENTRIES)
+        return -EINVAL;
+    for(i = 0; i < n; i++) {
+        if((ch[i] > HYBRID_SRCH_TOP_CHAN) || ((i > 0) && (ch[i] <= ch[i - 1])))
+            return -EINVAL;
+    }
+    memcpy(chans, ch, n * sizeof(chans[0]));
+    memcpy(sinrs, th, n * sizeof(sinrs[0]));
+    memset(hits, HYBRID_SRCH_PINNED, n);
+    cnt = n;
+    return cnt;
+}
+
+unsigned int FmHybridSrchList :: store
+(
+    uint16_t *ch, int8_t *th, unsigned int max
+) const
+{
+    unsigned int n = (cnt < max) ? cnt : max;
+
+    memcpy(ch, chans, n * sizeof(chans[0]));
+    memcpy(th, sinrs, n * sizeof(sinrs[0]));
+    return n;
+}
+
+//A station found by a scan gets the lowest threshold of the
+//pinned entries. Without pinned entries nothing is learned.
+bool FmHybridSrchList :: update_from_scan
+(
+    const unsigned long *khz, unsigned int n
+)
+{
+    int8_t th = INT8_MAX;
+    bool pinned = false;
+    bool changed = false;
+    unsigned int i, j;
+    int chan;
+
+    for(i = 0; i < cnt; i++) {
+        if((hits[i] == HYBRID_SRCH_PINNED) && (sinrs[i] <= th)) {
+            th = sinrs[i];
+            pinned = true;
+        }
+    }
+    if(!pinned)
+        return false;
+
+    for(i = 0; i < cnt; i++) {
+        if(hits[i] != HYBRID_SRCH_PINNED)
+            hits[i] >>= 1;
+    }
+    for(j = 0; j < n; j++) {
+        chan = to_chan(khz[j]);
+        if(chan < 0)
+            continue;
+        i = lower_bound(chan);
+        if((i < cnt) && (chans[i] == chan)) {
+            if(hits[i] < HYBRID_SRCH_PINNED - HYBRID_SRCH_HIT)
+                hits[i] += HYBRID_SRCH_HIT;
+            continue;
+        }
+        if(cnt == MAX_HYBRID_SRCH_ENTRIES)
+            continue;
+        memmove(&chans[i + 1], &chans[i], (cnt - i) * sizeof(chans[0]));
+        memmove(&sinrs[i + 1], &sinrs[i], (cnt - i) * sizeof(sinrs[0]));
+        memmove(&hits[i + 1], &hits[i], (cnt - i) * sizeof(hits[0]));
+        chans[i] = chan;
+        sinrs[i] = th;
+        hits[i] = HYBRID_SRCH_HIT;
+        cnt++;
+        changed = true;
+    }
+    for(i = j = 0; i < cnt; i++) {
+        if(hits[i] == 0) {
+            changed = true;
+            continue;
+        }
+        chans[j] = chans[i];
+        sinrs[j] = sinrs[i];
+        hits[j] = hits[i];
+        j++;
+    }
+    cnt = j;
+    //Past MAX_HYBRID_SRCH_CNT the hits decide what is selected
+    return changed || (cnt > MAX_HYBRID_SRCH_CNT);
+}
+
+unsigned int FmHybridSrchList :: select
+(
+    unsigned long low_khz, unsigned long high_khz,
+    unsigned long spacing_khz, uint16_t *ch, int8_t *th,
+    unsigned int max
+) const
+{
+    uint16_t idx[MAX_HYBRID_SRCH_ENTRIES];
+    unsigned int by_hits[HYBRID_SRCH_PINNED + 1];
+    unsigned int n = 0;
+    unsigned int taken = 0;
+    unsigned int out = 0;
+    unsigned int lo, hi, i;
+    int t;
+
+    if(low_khz < HYBRID_SRCH_BASE_KHZ)
+        low_khz = HYBRID_SRCH_BASE_KHZ;
+    if(high_khz > HYBRID_SRCH_TOP_KHZ)
+        high_khz = HYBRID_SRCH_TOP_KHZ;
+    if((low_khz > high_khz) || (max == 0))
+        return 0;
+    if((spacing_khz == 0) || (spacing_khz % HYBRID_SRCH_STEP_KHZ))
+        spacing_khz = HYBRID_SRCH_STEP_KHZ;
+
+    lo = (low_khz - HYBRID_SRCH_BASE_KHZ + HYBRID_SRCH_STEP_KHZ - 1)
+          / HYBRID_SRCH_STEP_KHZ;
+    hi = (high_khz - HYBRID_SRCH_BASE_KHZ) / HYBRID_SRCH_STEP_KHZ;
+    memset(by_hits, 0, sizeof(by_hits));
+    for(i = lower_bound(lo); (i < cnt) && (chans[i] <= hi); i++) {
+        if((HYBRID_SRCH_BASE_KHZ + chans[i] * HYBRID_SRCH_STEP_KHZ
+            - low_khz) % spacing_khz)
+            continue;
+        idx[n++] = i;
+        by_hits[hits[i]]++;
+    }
+
+    //Everything above t is taken, and the lowest
+    //channels with t as many as still fit
+    t = 0;
+    if(n > max) {
+        for(t = HYBRID_SRCH_PINNED; t > 0; t--) {
+            if(taken + by_hits[t] >= max)
+                break;
+            taken += by_hits[t];
+        }
+    }
+    for(i = 0; i < n; i++) {
+        if(hits[idx[i]] < t)
+            continue;
+        if(hits[idx[i]] == t) {
+            if(taken == max)
+                continue;
+            taken++;
+        }
+        ch[out] = chans[idx[i]];
+        th[out] = sinrs[idx[i]];
+        out++;
+    }
+    return out;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_HYBRID_SRCH_LIST_H__
+#define __FM_HYBRID_SRCH_LIST_H__
+
+/*
+ * Channels the hybrid search checks first, with the SINR threshold for
+ * each one.
+ *
+ * The list is kept sorted by channel, one entry per channel, as parallel
+ * arrays in the unit the SoC takes (50 kHz steps above 76 MHz), so it is
+ * filtered against the band and spacing and sent without converting it
+ * again. Entries from the performance params file are pinned; stations
+ * that scans find are added with a hit count that decays on every scan
+ * that misses them, so the list follows what can actually be received.
+ */
+
+#include <stdint.h>
+
+#define HYBRID_SRCH_BASE_KHZ    76000
+#define HYBRID_SRCH_TOP_KHZ     108000
+#define HYBRID_SRCH_STEP_KHZ    50
+//n * 3 + 1 has to fit the length byte of the hybrid list command
+#define MAX_HYBRID_SRCH_CNT     84
+#define MAX_HYBRID_SRCH_ENTRIES 256
+
+#define HYBRID_SRCH_PINNED      0xff
+//Hits a scan adds; one missing the station halves them
+#define HYBRID_SRCH_HIT         64
+
+class FmHybridSrchList
+{
+    private:
+        uint16_t chans[MAX_HYBRID_SRCH_ENTRIES];
+        int8_t sinrs[MAX_HYBRID_SRCH_ENTRIES];
+        uint8_t hits[MAX_HYBRID_SRCH_ENTRIES];
+        unsigned int cnt;
+        unsigned int lower_bound(uint16_t chan) const;
+    public:
+        FmHybridSrchList() : cnt(0) {}
+        void clear(void) { cnt = 0; }
+        unsigned int count(void) const { return cnt; }
+        //Channel of khz, -1 when it is off the 50 kHz grid or out of range
+        static int to_chan(unsigned long khz);
+        /*
+         * Takes comma separated freqs (kHz) and sinrs as pinned entries,
+         * sorted, the last one kept for a channel given twice. Returns
+         * the number of entries or -EINVAL when the lists do not pair up.
+         */
+        int parse(const char *freq_list, const char *sinr_list);
+        //Pinned entries, already sorted and unique as store gives them
+        int load(const uint16_t *ch, const int8_t *th, unsigned int n);
+        unsigned int store(uint16_t *ch, int8_t *th, unsigned int max) const;
+        /*
+         * Ages the learned entries and counts a hit for each of the n
+         * stations a scan found. Returns true when what select can
+         * return changed.
+         */
+        bool update_from_scan(const unsigned long *khz, unsigned int n);
+        /*
+         * Entries inside [low_khz, high_khz] and on the spacing grid, in
+         * channel order. When more than max qualify the pinned ones and
+         * then the most often found ones are kept.
+         */
+        unsigned int select(unsigned long low_khz, unsigned long high_khz,
+                            unsigned long spacing_khz, uint16_t *ch,
+                            int8_t *th, unsigned int max) const;
+};
+
+#endif //__FM_HYBRID_SRCH_LIST_H__
@@ -27,6 +27,8 @@
  */
 
 #include "FmIoctlsInterface.h"
+#include "FmPerformanceParams.h"
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -38,6 +40,9 @@
 #include <math.h>
 
 char const * const FmIoctlsInterface::LOGTAG = "FmIoctlsInterface";
+bool FmIoctlsInterface::ext_ctrls_unsupported = false;
+pthread_mutex_t FmIoctlsInterface::tuner_lock = PTHREAD_MUTEX_INITIALIZER;
+struct fm_tuner_cache_t FmIoctlsInterface::tuner_cache[MAX_TUNER_CACHE];
 
 int  FmIoctlsInterface :: get_cur_freq
 (
@@ -85,6 +90,7 @@ int FmIoctlsInterface :: set_control
     int ret;
     struct v4l2_control control;
 
+    invalidate_ctrl(fd, id);
     control.value = val;
     control.id = id;
 
@@ -192,6 +198,7 @@ int  FmIoctlsInterface :: set_band
     tuner.rangehigh = (high * TUNE_MULT);
 
     ret = ioctl(fd, VIDIOC_S_TUNER, &tuner);
+    //set_control drops the cached limits with the region
     ret = set_control(fd, V4L2_CID_PRV_REGION, 0);
     if(ret < IOCTL_SUCC) {
         return FM_FAILURE;
@@ -206,6 +213,7 @@ int FmIoctlsInterface :: get_rmssi
 )
 {
     struct v4l2_tuner tuner;
+    UINT gen = tuner_gen(fd);
     int ret;
 
     tuner.index = 0;
@@ -215,6 +223,7 @@ int FmIoctlsInterface :: get_rmssi
         ret = FM_FAILURE;
     }else {
         rmssi = tuner.signal;
+        store_tuner(fd, tuner, gen);
         ret = FM_SUCCESS;
     }
     return ret;
@@ -228,9 +237,8 @@ int FmIoctlsInterface :: get_upperband_limit
     int ret;
     struct v4l2_tuner tuner;
 
-    tuner.index = 0;
-    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
-    if(ret < IOCTL_SUCC) {
+    ret = get_tuner(fd, tuner);
+    if(ret != FM_SUCCESS) {
         return FM_FAILURE;
     }else {
         freq = (tuner.rangehigh / TUNE_MULT);
@@ -246,9 +254,8 @@ int FmIoctlsInterface :: get_lowerband_limit
     int ret;
     struct v4l2_tuner tuner;
 
-    tuner.index = 0;
-    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
-    if(ret < IOCTL_SUCC) {
+    ret = get_tuner(fd, tuner);
+    if(ret != FM_SUCCESS) {
         return FM_FAILURE;
     }else {
         freq = (tuner.rangelow / TUNE_MULT);
@@ -263,17 +270,19 @@ int FmIoctlsInterface :: set_audio_mode
 {
     int ret;
     struct v4l2_tuner tuner;
+    UINT gen = tuner_gen(fd);
 
-    tuner.index = 0;
-    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
-    if(ret < IOCTL_SUCC) {
+    ret = get_tuner(fd, tuner);
+    if(ret != FM_SUCCESS) {
         return FM_FAILURE;
     }else {
         tuner.audmode = mode;
         ret = ioctl(fd, VIDIOC_S_TUNER, &tuner);
         if(ret < IOCTL_SUCC) {
+            invalidate_tuner(fd);
             return FM_FAILURE;
         }else {
+            store_tuner(fd, tuner, gen);
             return FM_SUCCESS;
         }
     }
@@ -321,3 +330,212 @@ int FmIoctlsInterface :: set_ext_control
     }
 }
 
+FmCtrlBatch :: FmCtrlBatch
+(
+)
+{
+    clear();
+}
+
+void FmCtrlBatch :: clear
+(
+    void
+)
+{
+    memset(ctrls, 0, sizeof(ctrls));
+    count = 0;
+}
+
+int FmCtrlBatch :: add
+(
+    UINT id, int val
+)
+{
+    UINT i;
+
+    for(i = 0; i < count; i++) {
+        if(ctrls[i].id == id)
+            break;
+    }
+    if(i == MAX_BATCH_CTRLS) {
+        return FM_FAILURE;
+    }else {
+        ctrls[i].id = id;
+        ctrls[i].value = val;
+        if(i == count)
+            count++;
+        return FM_SUCCESS;
+    }
+}
+
+//Drivers that only take private controls through VIDIOC_S_CTRL fail the
+//batch; they get the controls one by one, and no more batches once the
+//one by one path has worked
+int FmIoctlsInterface :: set_controls
+(
+    UINT fd, FmCtrlBatch &batch
+)
+{
+    int ret;
+    bool no_ext_ctrls = false;
+    struct v4l2_ext_controls v4l2_ctls;
+
+    if(batch.count == 0)
+        return FM_SUCCESS;
+
+    for(UINT i = 0; i < batch.count; i++)
+        invalidate_ctrl(fd, batch.ctrls[i].id);
+
+    if(!ext_ctrls_unsupported) {
+        memset(&v4l2_ctls, 0, sizeof(v4l2_ctls));
+        //0 lets controls of different classes share the batch
+        v4l2_ctls.ctrl_class = 0;
+        v4l2_ctls.count = batch.count;
+        v4l2_ctls.controls = batch.ctrls;
+        ret = ioctl(fd, VIDIOC_S_EXT_CTRLS, &v4l2_ctls);
+        if(ret >= IOCTL_SUCC)
+            return FM_SUCCESS;
+        //error_idx >= count: the request itself was refused, not a control,
+        //whatever errno the driver picked for it
+        no_ext_ctrls = (v4l2_ctls.error_idx >= batch.count);
+        ALOGE("%s: VIDIOC_S_EXT_CTRLS failed at %u of %u\n", LOGTAG,
+              v4l2_ctls.error_idx, batch.count);
+    }
+
+    ret = FM_SUCCESS;
+    for(UINT i = 0; i < batch.count; i++) {
+        if(set_control(fd, batch.ctrls[i].id, batch.ctrls[i].value) != FM_SUCCESS) {
+            ALOGE("%s: set control 0x%x failed\n", LOGTAG, batch.ctrls[i].id);
+            ret = FM_FAILURE;
+        }
+    }
+    if((ret == FM_SUCCESS) && no_ext_ctrls) {
+        ALOGI("%s: no batched controls, using VIDIOC_S_CTRL\n", LOGTAG);
+        ext_ctrls_unsupported = true;
+    }
+    return ret;
+}
+
+//Reads the current value of every control in the batch into it
+int FmIoctlsInterface :: get_controls
+(
+    UINT fd, FmCtrlBatch &batch
+)
+{
+    int ret;
+    long val;
+    struct v4l2_ext_controls v4l2_ctls;
+
+    if(batch.count == 0)
+        return FM_SUCCESS;
+
+    if(!ext_ctrls_unsupported) {
+        memset(&v4l2_ctls, 0, sizeof(v4l2_ctls));
+        v4l2_ctls.ctrl_class = 0;
+        v4l2_ctls.count = batch.count;
+        v4l2_ctls.controls = batch.ctrls;
+        ret = ioctl(fd, VIDIOC_G_EXT_CTRLS, &v4l2_ctls);
+        if(ret >= IOCTL_SUCC)
+            return FM_SUCCESS;
+    }
+
+    ret = FM_SUCCESS;
+    for(UINT i = 0; i < batch.count; i++) {
+        if(get_control(fd, batch.ctrls[i].id, val) == FM_SUCCESS) {
+            batch.ctrls[i].value = val;
+        }else {
+            ret = FM_FAILURE;
+        }
+    }
+    return ret;
+}
+
+//Direct mapped on the fd; the radio is normally the only fd in use
+int FmIoctlsInterface :: get_tuner
+(
+    UINT fd, struct v4l2_tuner &tuner
+)
+{
+    int ret;
+    UINT gen;
+    struct fm_tuner_cache_t *entry = &tuner_cache[fd % MAX_TUNER_CACHE];
+
+    pthread_mutex_lock(&tuner_lock);
+    if(entry->valid && (entry->fd == fd)) {
+        tuner = entry->tuner;
+        pthread_mutex_unlock(&tuner_lock);
+        return FM_SUCCESS;
+    }
+    gen = entry->gen;
+    pthread_mutex_unlock(&tuner_lock);
+
+    memset(&tuner, 0, sizeof(tuner));
+    tuner.index = 0;
+    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
+    if(ret < IOCTL_SUCC) {
+        return FM_FAILURE;
+    }else {
+        store_tuner(fd, tuner, gen);
+        return FM_SUCCESS;
+    }
+}
+
+//Taken before a tuner ioctl, handed back to store_tuner with its result
+UINT FmIoctlsInterface :: tuner_gen
+(
+    UINT fd
+)
+{
+    UINT gen;
+
+    pthread_mutex_lock(&tuner_lock);
+    gen = tuner_cache[fd % MAX_TUNER_CACHE].gen;
+    pthread_mutex_unlock(&tuner_lock);
+    return gen;
+}
+
+//Dropped if the entry was invalidated since gen was taken
+void FmIoctlsInterface :: store_tuner
+(
+    UINT fd, const struct v4l2_tuner &tuner, UINT gen
+)
+{
+    struct fm_tuner_cache_t *entry = &tuner_cache[fd % MAX_TUNER_CACHE];
+
+    pthread_mutex_lock(&tuner_lock);
+    if(entry->gen == gen) {
+        entry->fd = fd;
+        entry->tuner = tuner;
+        entry->valid = true;
+    }
+    pthread_mutex_unlock(&tuner_lock);
+}
+
+void FmIoctlsInterface :: invalidate_tuner
+(
+    UINT fd
+)
+{
+    struct fm_tuner_cache_t *entry = &tuner_cache[fd % MAX_TUNER_CACHE];
+
+    pthread_mutex_lock(&tuner_lock);
+    if(entry->fd == fd)
+        entry->valid = false;
+    entry->gen++;
+    pthread_mutex_unlock(&tuner_lock);
+}
+
+//The region and the power state both reprogram the band, and may
+//reset what the SoC holds for the performance params
+void FmIoctlsInterface :: invalidate_ctrl
+(
+    UINT fd, UINT id
+)
+{
+    if((id == V4L2_CID_PRV_REGION) || (id == V4L2_CID_PRV_STATE)) {
+        invalidate_tuner(fd);
+        FmPerformanceParams::InvalidateShadow(fd);
+    }else {
+        FmPerformanceParams::InvalidateShadowCtrl(fd, id);
+    }
+}
@@ -31,12 +31,58 @@
 
 #include "FmConst.h"
 
+#include <pthread.h>
 #include <linux/videodev2.h>
 
+#define MAX_BATCH_CTRLS 16
+
+/*
+ * Controls collected to be programmed, or read back, with one
+ * VIDIOC_S_EXT_CTRLS/VIDIOC_G_EXT_CTRLS instead of one ioctl each.
+ */
+class FmCtrlBatch
+{
+    private:
+        struct v4l2_ext_control ctrls[MAX_BATCH_CTRLS];
+        UINT count;
+        friend class FmIoctlsInterface;
+    public:
+        FmCtrlBatch();
+        /* A control already in the batch gets the new value */
+        int add(UINT id, int val);
+        void clear(void);
+        UINT size(void) { return count; }
+        UINT get_id(UINT i) { return ctrls[i].id; }
+        int get_value(UINT i) { return ctrls[i].value; }
+};
+
+#define MAX_TUNER_CACHE 4
+
+/*
+ * Last VIDIOC_G_TUNER result of an fd. Band limits, audmode and
+ * capabilities only change through set_band, set_audio_mode, the region
+ * and the power state, so those are served from here; only the signal
+ * strength is read from the driver every time. gen moves on with every
+ * invalidation, a result read before one is not stored.
+ */
+struct fm_tuner_cache_t {
+    bool valid;
+    UINT fd;
+    UINT gen;
+    struct v4l2_tuner tuner;
+};
+
 class FmIoctlsInterface
 {
     private:
         static char const * const LOGTAG;
+        static bool ext_ctrls_unsupported;
+        static pthread_mutex_t tuner_lock;
+        static struct fm_tuner_cache_t tuner_cache[MAX_TUNER_CACHE];
+        static int get_tuner(UINT fd, struct v4l2_tuner &tuner);
+        static UINT tuner_gen(UINT fd);
+        static void store_tuner(UINT fd, const struct v4l2_tuner &tuner, UINT gen);
+        static void invalidate_ctrl(UINT fd, UINT id);
     public:
         static int start_fm_patch_dl(UINT fd);
         static int close_fm_patch_dl(void);
@@ -53,6 +99,11 @@ class FmIoctlsInterface
         static int get_buffer(UINT fd, char *buff, UINT len, UINT index);
         static int get_rmssi(UINT fd, long &rmssi);
         static int set_ext_control(UINT fd, struct v4l2_ext_controls *v4l2_ctls);
+        static int set_controls(UINT fd, FmCtrlBatch &batch);
+        static int get_controls(UINT fd, FmCtrlBatch &batch);
+        static bool batched_controls(void) { return !ext_ctrls_unsupported; }
+        /* Drops what is cached for fd, e.g. when it is (re)opened */
+        static void invalidate_tuner(UINT fd);
 };
 
 //char const *FmIoctlsInterface::LOGTAG = "FmIoctlsInterface";
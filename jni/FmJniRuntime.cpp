@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FmJniRuntime.h"
+#include <pthread.h>
+#include <utils/Log.h>
+
+char const * const FmJniRuntime::LOGTAG = "FmJniRuntime";
+JavaVM *FmJniRuntime::vm = NULL;
+thread_local JNIEnv *FmJniRuntime::thread_env = NULL;
+
+static pthread_key_t detach_key;
+static pthread_once_t detach_key_once = PTHREAD_ONCE_INIT;
+
+/* Runs when an attached thread exits, the VM aborts on a thread that
+ * exits attached */
+void FmJniRuntime :: detach_thread
+(
+    void *arg
+)
+{
+    if (vm != NULL)
+        vm->DetachCurrentThread();
+}
+
+void FmJniRuntime :: create_detach_key
+(
+    void
+)
+{
+    pthread_key_create(&detach_key, detach_thread);
+}
+
+JNIEnv *FmJniRuntime :: on_load
+(
+    JavaVM *jvm
+)
+{
+    JNIEnv *env = NULL;
+
+    vm = jvm;
+    if (jvm->GetEnv((void **)&env, JNI_VERSION_1_6) != JNI_OK) {
+        ALOGE("%s: JNI version mismatch error", LOGTAG);
+        return NULL;
+    }
+    return env;
+}
+
+JNIEnv *FmJniRuntime :: attach
+(
+    const char *name
+)
+{
+    JavaVMAttachArgs args;
+    JNIEnv *env = NULL;
+
+    if (vm == NULL)
+        return NULL;
+
+    args.version = JNI_VERSION_1_6;
+    args.name = name;
+    args.group = NULL;
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("%s: failed to attach %s", LOGTAG, name);
+        return NULL;
+    }
+    pthread_once(&detach_key_once, create_detach_key);
+    pthread_setspecific(detach_key, env);
+    thread_env = env;
+    ALOGD("%s: %s attached: %p", LOGTAG, name, env);
+    return env;
+}
+
+#ifdef FM_JNI_DEBUG
+JNIEnv *FmJniRuntime :: checked_env
+(
+    void
+)
+{
+    JNIEnv *env = NULL;
+
+    if (thread_env == NULL) {
+        ALOGE("%s: callback on a thread that is not attached", LOGTAG);
+        return NULL;
+    }
+    if (vm->GetEnv((void **)&env, JNI_VERSION_1_6) != JNI_OK || env != thread_env) {
+        ALOGE("%s: callback env check fail: env: %p, callback: %p",
+              LOGTAG, env, thread_env);
+        return NULL;
+    }
+    return thread_env;
+}
+#endif
+
+jclass FmJniRuntime :: cache_class
+(
+    JNIEnv *env, const char *name
+)
+{
+    jclass cls = env->FindClass(name);
+    jclass ref;
+
+    if (cls == NULL) {
+        ALOGE("%s: class %s not found", LOGTAG, name);
+        env->ExceptionClear();
+        return NULL;
+    }
+    ref = (jclass)env->NewGlobalRef(cls);
+    env->DeleteLocalRef(cls);
+    return ref;
+}
+
+int FmJniRuntime :: cache_methods
+(
+    JNIEnv *env, jclass cls, const FmJniMethod *methods, size_t count
+)
+{
+    int ret = JNI_OK;
+
+    for (size_t i = 0; i < count; i++) {
+        *methods[i].id = env->GetMethodID(cls, methods[i].name, methods[i].signature);
+        if (*methods[i].id == NULL) {
+            env->ExceptionClear();
+            if (!methods[i].optional) {
+                ALOGE("%s: method %s%s not found", LOGTAG,
+                      methods[i].name, methods[i].signature);
+                ret = JNI_ERR;
+            }
+        }
+    }
+    return ret;
+}
+
+int FmJniRuntime :: register_natives
+(
+    JNIEnv *env, const char *class_name, const JNINativeMethod *methods, int count
+)
+{
+    jclass cls = env->FindClass(class_name);
+    int ret;
+
+    if (cls == NULL) {
+        ALOGE("%s: class %s not found", LOGTAG, class_name);
+        env->ExceptionClear();
+        return JNI_ERR;
+    }
+    ret = env->RegisterNatives(cls, methods, count) < 0 ? JNI_ERR : JNI_OK;
+    if (ret != JNI_OK)
+        ALOGE("%s: RegisterNatives failed for %s", LOGTAG, class_name);
+    env->DeleteLocalRef(cls);
+    return ret;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_JNI_RUNTIME_H__
+#define __FM_JNI_RUNTIME_H__
+
+#include <jni.h>
+#include <stddef.h>
+
+/*
+ * JNI plumbing shared by libqcomfm_jni (jni/) and libfmjni (libfm_jni/).
+ *
+ * Classes and method IDs are looked up once from JNI_OnLoad
+ * through tables, so nothing is resolved on the callback path. A native
+ * callback thread is attached to the VM the first time it asks for an
+ * env and stays attached until it exits; callback_env() is then a plain
+ * thread-local read. The env is only cross-checked against the VM in
+ * FM_JNI_DEBUG builds.
+ */
+
+struct FmJniMethod {
+    const char *name;
+    const char *signature;
+    jmethodID *id;
+    bool optional;      /* missing in older Java code, left NULL */
+};
+
+class FmJniRuntime
+{
+    private:
+        static char const * const LOGTAG;
+        static JavaVM *vm;
+        static thread_local JNIEnv *thread_env;
+        static JNIEnv *attach(const char *name);
+        static void detach_thread(void *arg);
+        static void create_detach_key(void);
+    public:
+        /* From JNI_OnLoad; returns the env of the loading thread */
+        static JNIEnv *on_load(JavaVM *jvm);
+        static jclass cache_class(JNIEnv *env, const char *name);
+        static int cache_methods(JNIEnv *env, jclass cls,
+                                 const FmJniMethod *methods, size_t count);
+        static int register_natives(JNIEnv *env, const char *class_name,
+                                    const JNINativeMethod *methods, int count);
+
+        /* Attaches the calling native thread once, under the given name */
+        static JNIEnv *attach_callback_thread(const char *name)
+        {
+            return thread_env ? thread_env : attach(name);
+        }
+
+        /* Env of an attached callback thread, NULL on any other thread */
+        static JNIEnv *callback_env(void)
+        {
+#ifdef FM_JNI_DEBUG
+            return checked_env();
+#else
+            return thread_env;
+#endif
+        }
+#ifdef FM_JNI_DEBUG
+        static JNIEnv *checked_env(void);
+#endif
+};
+
+#endif //__FM_JNI_RUNTIME_H__
@@ -33,6 +33,226 @@
 #include <linux/videodev2.h>
 #include <utils/Log.h>
 
+//Controls kept in the shadow, indexed like fm_perf_shadow_t::values
+static const UINT SHADOW_CTRLS[MAX_SHADOW_CTRLS] =
+{
+   V4L2_CID_PRV_AF_RMSSI_TH,
+   V4L2_CID_PRV_AF_RMSSI_SAMPLES,
+   V4L2_CID_PRV_GOOD_CH_RMSSI_TH,
+   V4L2_CID_PRV_SRCHALGOTYPE,
+   V4L2_CID_PRV_CF0TH12,
+   V4L2_CID_PRV_SINRFIRSTSTAGE,
+   V4L2_CID_PRV_RMSSIFIRSTSTAGE,
+   V4L2_CID_PRV_SINR_SAMPLES,
+   V4L2_CID_PRV_ON_CHANNEL_THRESHOLD,
+   V4L2_CID_PRV_OFF_CHANNEL_THRESHOLD,
+   V4L2_CID_PRV_SINR_THRESHOLD,
+};
+
+pthread_mutex_t FmPerformanceParams::shadow_lock = PTHREAD_MUTEX_INITIALIZER;
+struct fm_perf_shadow_t FmPerformanceParams::shadow[MAX_SHADOW_FDS];
+
+static int shadow_index
+(
+   UINT id
+)
+{
+   for(int i = 0; i < MAX_SHADOW_CTRLS; i++) {
+      if(SHADOW_CTRLS[i] == id)
+         return i;
+   }
+   return -1;
+}
+
+FmPerformanceParams :: FmPerformanceParams
+(
+)
+{
+   batching = false;
+}
+
+//Direct mapped on the fd, called with shadow_lock held
+struct fm_perf_shadow_t *FmPerformanceParams :: get_shadow
+(
+   UINT fd
+)
+{
+   struct fm_perf_shadow_t *entry = &shadow[fd % MAX_SHADOW_FDS];
+
+   if(!entry->valid || (entry->fd != fd)) {
+      entry->valid = true;
+      entry->fd = fd;
+      entry->known = 0;
+      entry->hybrd_len = 0;
+   }
+   return entry;
+}
+
+bool FmPerformanceParams :: shadow_holds
+(
+   UINT fd, UINT id, int val
+)
+{
+   struct fm_perf_shadow_t *entry;
+   int i = shadow_index(id);
+   bool ret;
+
+   if(i < 0)
+      return false;
+   pthread_mutex_lock(&shadow_lock);
+   entry = get_shadow(fd);
+   ret = (entry->known & (1 << i)) && (entry->values[i] == val);
+   pthread_mutex_unlock(&shadow_lock);
+   return ret;
+}
+
+void FmPerformanceParams :: store_shadow
+(
+   UINT fd, FmCtrlBatch &ctrls
+)
+{
+   struct fm_perf_shadow_t *entry;
+   int idx;
+
+   pthread_mutex_lock(&shadow_lock);
+   entry = get_shadow(fd);
+   for(UINT i = 0; i < ctrls.size(); i++) {
+      idx = shadow_index(ctrls.get_id(i));
+      if(idx >= 0) {
+         entry->values[idx] = ctrls.get_value(i);
+         entry->known |= (1 << idx);
+      }
+   }
+   pthread_mutex_unlock(&shadow_lock);
+}
+
+//Learns what the controller holds for the controls of ctrls not in
+//the shadow yet, with one read when the driver takes batches
+void FmPerformanceParams :: seed_shadow
+(
+   UINT fd, FmCtrlBatch &ctrls
+)
+{
+   FmCtrlBatch unknown;
+   struct fm_perf_shadow_t *entry;
+   int idx;
+
+   if(!FmIoctlsInterface::batched_controls())
+      return;
+   pthread_mutex_lock(&shadow_lock);
+   entry = get_shadow(fd);
+   for(UINT i = 0; i < ctrls.size(); i++) {
+      idx = shadow_index(ctrls.get_id(i));
+      if((idx >= 0) && !(entry->known & (1 << idx)))
+         unknown.add(ctrls.get_id(i), 0);
+   }
+   pthread_mutex_unlock(&shadow_lock);
+
+   if((unknown.size() > 0)
+      && (FmIoctlsInterface::get_controls(fd, unknown) == FM_SUCCESS))
+      store_shadow(fd, unknown);
+}
+
+void FmPerformanceParams :: InvalidateShadow
+(
+   UINT fd
+)
+{
+   struct fm_perf_shadow_t *entry = &shadow[fd % MAX_SHADOW_FDS];
+
+   pthread_mutex_lock(&shadow_lock);
+   if(entry->fd == fd)
+      entry->valid = false;
+   pthread_mutex_unlock(&shadow_lock);
+}
+
+void FmPerformanceParams :: InvalidateShadowCtrl
+(
+   UINT fd, UINT id
+)
+{
+   struct fm_perf_shadow_t *entry = &shadow[fd % MAX_SHADOW_FDS];
+   int i = shadow_index(id);
+
+   if(i < 0)
+      return;
+   pthread_mutex_lock(&shadow_lock);
+   if(entry->fd == fd)
+      entry->known &= ~(1 << i);
+   pthread_mutex_unlock(&shadow_lock);
+}
+
+signed char FmPerformanceParams :: set_control
+(
+   UINT fd, UINT id, int val
+)
+{
+   FmCtrlBatch ctrl;
+   signed char ret;
+
+   if(batching)
+      return batch.add(id, val);
+   if(shadow_holds(fd, id, val))
+      return FM_SUCCESS;
+   ret = FmIoctlsInterface::set_control(fd, id, val);
+   if(ret == FM_SUCCESS) {
+      ctrl.add(id, val);
+      store_shadow(fd, ctrl);
+   }
+   return ret;
+}
+
+void FmPerformanceParams :: BeginBatch
+(
+   void
+)
+{
+   batch.clear();
+   batching = true;
+}
+
+//Programs the queued controls the shadow does not already
+//match at once, and takes what the controller reads back
+//for them as the new shadow
+signed char FmPerformanceParams :: CommitBatch
+(
+   UINT fd
+)
+{
+   signed char ret;
+   FmCtrlBatch delta;
+   FmCtrlBatch readback;
+
+   batching = false;
+   seed_shadow(fd, batch);
+   for(UINT i = 0; i < batch.size(); i++) {
+      if(!shadow_holds(fd, batch.get_id(i), batch.get_value(i)))
+         delta.add(batch.get_id(i), batch.get_value(i));
+   }
+   ALOGD("%u of %u controls to write\n", delta.size(), batch.size());
+   batch.clear();
+
+   ret = FmIoctlsInterface::set_controls(fd, delta);
+   if((ret != FM_SUCCESS) || (delta.size() == 0))
+      return ret;
+   if(!FmIoctlsInterface::batched_controls()) {
+      store_shadow(fd, delta);
+      return ret;
+   }
+   readback = delta;
+   if(FmIoctlsInterface::get_controls(fd, readback) == FM_SUCCESS) {
+      for(UINT i = 0; i < readback.size(); i++) {
+         if(readback.get_value(i) != delta.get_value(i))
+            ALOGE("ctrl 0x%x set to %d, reads %d\n", delta.get_id(i),
+                  delta.get_value(i), readback.get_value(i));
+      }
+      store_shadow(fd, readback);
+   }else {
+      ALOGE("Error in reading back controls\n");
+   }
+   return ret;
+}
+
 signed char FmPerformanceParams :: SetAfRmssiTh
 (
    UINT fd, unsigned short th
@@ -40,7 +260,7 @@ signed char FmPerformanceParams :: SetAfRmssiTh
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_AF_RMSSI_TH, th);
 
    return ret;
@@ -53,7 +273,7 @@ signed char FmPerformanceParams :: SetAfRmssiSamplesCnt
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_AF_RMSSI_SAMPLES, cnt);
 
    return ret;
@@ -66,7 +286,7 @@ signed char FmPerformanceParams :: SetGoodChannelRmssiTh
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_GOOD_CH_RMSSI_TH, th);
 
    return ret;
@@ -79,7 +299,7 @@ signed char FmPerformanceParams :: SetSrchAlgoType
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_SRCHALGOTYPE, algo);
 
    return ret;
@@ -92,7 +312,7 @@ signed char FmPerformanceParams :: SetSinrFirstStage
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_SINRFIRSTSTAGE, th);
 
    return ret;
@@ -105,7 +325,7 @@ signed char FmPerformanceParams :: SetRmssiFirstStage
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_RMSSIFIRSTSTAGE, th);
 
    return ret;
@@ -118,7 +338,7 @@ signed char FmPerformanceParams :: SetCf0Th12
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_CF0TH12, th);
    return ret;
 }
@@ -130,7 +350,7 @@ signed char FmPerformanceParams :: SetSinrSamplesCnt
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_SINR_SAMPLES, cnt);
 
    return ret;
@@ -143,7 +363,7 @@ signed char FmPerformanceParams :: SetIntfLowTh
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_ON_CHANNEL_THRESHOLD, th);
 
    return ret;
@@ -156,7 +376,7 @@ signed char FmPerformanceParams :: SetIntfHighTh
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_OFF_CHANNEL_THRESHOLD, th);
    return ret;
 }
@@ -168,7 +388,7 @@ signed char FmPerformanceParams :: SetSinrFinalStage
 {
    signed char ret = FM_FAILURE;
 
-   ret = FmIoctlsInterface::set_control(fd,
+   ret = set_control(fd,
                 V4L2_CID_PRV_SINR_THRESHOLD, th);
 
    return ret;
@@ -366,57 +586,88 @@ signed char FmPerformanceParams :: GetSinrFinalStage
    return ret;
 }
 
+//Channel spacing control values in kHz
+static ULINT spacing_khz
+(
+   long spacing
+)
+{
+   switch(spacing) {
+   case 0:
+      return 200;
+   case 1:
+      return 100;
+   default:
+      return HYBRID_SRCH_STEP_KHZ;
+   }
+}
+
 signed char FmPerformanceParams :: SetHybridSrchList
 (
    UINT fd,
-   unsigned int *freqs,
-   signed char *sinrs,
-   unsigned int n
+   const FmHybridSrchList &list
 )
 {
    struct v4l2_ext_control ext_ctl;
    struct v4l2_ext_controls v4l2_ctls;
-   unsigned int freq;
-   signed char sinr;
+   struct fm_perf_shadow_t *entry;
+   uint16_t chans[MAX_HYBRID_SRCH_CNT];
+   int8_t sinrs[MAX_HYBRID_SRCH_CNT];
+   char data[MAX_HYBRID_SRCH_CNT * 3 + 3];
+   ULINT low, high;
+   long spacing = -1;
+   unsigned int n, i;
    unsigned int size = 0;
-   char *data = NULL;
+   bool held;
    signed char ret = FM_FAILURE;
 
-   if(n <= 0) {
+   if((FmIoctlsInterface::get_lowerband_limit(fd, low) != FM_SUCCESS)
+      || (FmIoctlsInterface::get_upperband_limit(fd, high) != FM_SUCCESS)) {
+      ALOGE("hybrid srch list needs the band limits\n");
       return ret;
    }
-   data = new char[(n * 3 + 3)];
-
-   if(data != NULL) {
-      data[size++] = 0x40;
-      data[size++] = ((n * 3) + 1);
-      data[size++] = n;
-      while((size < (n * 3 + 2)) && (freqs != NULL)
-            && (sinrs != NULL)) {
-            freq = (*freqs - 76000) / 50;
-            data[size++] = (freq & 0xff);
-            data[size++] = ((freq >> 8) & 0xff);
-            data[size++] = *sinrs;
-            freqs++;
-            sinrs++;
-      }
-      if(size == (n * 3 + 3)) {
-         ext_ctl.id = V4L2_CID_PRV_IRIS_WRITE_DEFAULT;
-         ext_ctl.string = data;
-         ext_ctl.size = size;
-         v4l2_ctls.ctrl_class = V4L2_CTRL_CLASS_USER;
-         v4l2_ctls.count = 1;
-         v4l2_ctls.controls  = &ext_ctl;
-         ret =  FmIoctlsInterface::set_ext_control(fd, &v4l2_ctls);
-         if(ret == FM_SUCCESS) {
-            ALOGE("hybrid srch list sent successfully\n");
-         }else {
-            ALOGE("hybrid srch list setting failed\n");
-         }
-      }
+   FmIoctlsInterface::get_control(fd, V4L2_CID_PRV_CHAN_SPACING, spacing);
+
+   n = list.select(low, high, spacing_khz(spacing), chans, sinrs,
+                   MAX_HYBRID_SRCH_CNT);
+   if(n == 0) {
+      ALOGE("no hybrid srch list entry in %lu - %lu\n", low, high);
+      return ret;
+   }
+   data[size++] = 0x40;
+   data[size++] = ((n * 3) + 1);
+   data[size++] = n;
+   for(i = 0; i < n; i++) {
+       data[size++] = (chans[i] & 0xff);
+       data[size++] = ((chans[i] >> 8) & 0xff);
+       data[size++] = sinrs[i];
+   }
+
+   pthread_mutex_lock(&shadow_lock);
+   entry = get_shadow(fd);
+   held = (entry->hybrd_len == size) && !memcmp(entry->hybrd, data, size);
+   pthread_mutex_unlock(&shadow_lock);
+   if(held) {
+      return FM_SUCCESS;
    }
 
-   delete []data;
+   ext_ctl.id = V4L2_CID_PRV_IRIS_WRITE_DEFAULT;
+   ext_ctl.string = data;
+   ext_ctl.size = size;
+   v4l2_ctls.ctrl_class = V4L2_CTRL_CLASS_USER;
+   v4l2_ctls.count = 1;
+   v4l2_ctls.controls  = &ext_ctl;
+   ret =  FmIoctlsInterface::set_ext_control(fd, &v4l2_ctls);
+   if(ret == FM_SUCCESS) {
+      ALOGE("hybrid srch list of %u sent successfully\n", n);
+      pthread_mutex_lock(&shadow_lock);
+      entry = get_shadow(fd);
+      memcpy(entry->hybrd, data, size);
+      entry->hybrd_len = size;
+      pthread_mutex_unlock(&shadow_lock);
+   }else {
+      ALOGE("hybrid srch list setting failed\n");
+   }
 
    return ret;
 }
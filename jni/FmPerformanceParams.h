@@ -30,11 +30,48 @@
 #define __FM_PERFORMANCE_PARAMS_H__
 
 #include "FmConst.h"
+#include "FmIoctlsInterface.h"
+#include "FmHybridSrchList.h"
+#include <pthread.h>
+
+#define MAX_SHADOW_FDS 4
+#define MAX_SHADOW_CTRLS 11
+
+/*
+ * What the controller holds for the controls FmPerformanceParams writes,
+ * as far as this process knows. Filled from what was written and read
+ * back, dropped when the fd is (re)opened, the SoC is powered or the
+ * region changes, and per control on any other write.
+ */
+struct fm_perf_shadow_t {
+    bool valid;
+    UINT fd;
+    UINT known;     /* bit per SHADOW_CTRLS entry */
+    int values[MAX_SHADOW_CTRLS];
+    UINT hybrd_len;     /* 0 until a hybrid list was sent */
+    char hybrd[MAX_HYBRID_SRCH_CNT * 3 + 3];
+};
 
 class FmPerformanceParams
 {
       private:
+          FmCtrlBatch batch;
+          bool batching;
+          static pthread_mutex_t shadow_lock;
+          static struct fm_perf_shadow_t shadow[MAX_SHADOW_FDS];
+          signed char set_control(UINT fd, UINT id, int val);
+          static struct fm_perf_shadow_t *get_shadow(UINT fd);
+          static bool shadow_holds(UINT fd, UINT id, int val);
+          static void store_shadow(UINT fd, FmCtrlBatch &ctrls);
+          static void seed_shadow(UINT fd, FmCtrlBatch &ctrls);
       public:
+          FmPerformanceParams();
+          //Set* calls in between only queue their control
+          void BeginBatch(void);
+          //Writes only the queued controls the controller does not hold yet
+          signed char CommitBatch(UINT fd);
+          static void InvalidateShadow(UINT fd);
+          static void InvalidateShadowCtrl(UINT fd, UINT id);
           signed char SetAfRmssiTh(UINT fd, unsigned short th);
           signed char SetAfRmssiSamplesCnt(UINT fd, unsigned char cnt);
           signed char SetGoodChannelRmssiTh(UINT fd, signed char th);
@@ -46,7 +83,8 @@ class FmPerformanceParams
           signed char SetIntfLowTh(UINT fd, unsigned char th);
           signed char SetIntfHighTh(UINT fd, unsigned char th);
           signed char SetSinrFinalStage(UINT fd, signed char th);
-          signed char SetHybridSrchList(UINT fd, unsigned int *freqs, signed char *sinrs, unsigned int n);
+          //Sends what list selects for the band and spacing fd is set to
+          signed char SetHybridSrchList(UINT fd, const FmHybridSrchList &list);
 
           signed char GetAfRmssiTh(UINT fd, unsigned short &th);
           signed char GetAfRmssiSamplesCnt(UINT fd, unsigned char &cnt);
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "android_hardware_fm"
+
+#include "FmPropertyWait.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+#include <sys/system_properties.h>
+#include <utils/Log.h>
+
+/* __system_property_wait is there from O on */
+#if defined(__ANDROID_API__) && (__ANDROID_API__ >= 26)
+#define FM_HAVE_PROP_WAIT
+#else
+#define FM_PROP_POLL_US     10000
+#endif
+
+char const * const FmPropertyWait::LOGTAG = "FmPropertyWait";
+
+static int64_t now_ms
+(
+    void
+)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool prop_is
+(
+    const char *name, const char *value
+)
+{
+    char cur[PROPERTY_VALUE_MAX] = {'\0'};
+
+    property_get(name, cur, NULL);
+    return strcmp(cur, value) == 0;
+}
+
+int FmPropertyWait :: wait_for
+(
+    const char *name, const char *value, int timeout_ms
+)
+{
+    int64_t start = now_ms();
+    int64_t left;
+#ifdef FM_HAVE_PROP_WAIT
+    const prop_info *pi = NULL;
+    uint32_t serial;
+    struct timespec ts;
+#endif
+
+    while (1) {
+#ifdef FM_HAVE_PROP_WAIT
+        /* Take the serial before reading, so a set in between still
+         * ends the wait below. Until the property exists, any new
+         * property moves the global serial. */
+        if (pi == NULL)
+            pi = __system_property_find(name);
+        serial = pi ? __system_property_serial(pi) : __system_property_area_serial();
+#endif
+        if (prop_is(name, value)) {
+            left = now_ms() - start;
+            ALOGI("%s: %s=%s after %lld ms", LOGTAG, name, value, (long long)left);
+            return (int)left;
+        }
+        left = timeout_ms - (now_ms() - start);
+        if (left <= 0)
+            break;
+#ifdef FM_HAVE_PROP_WAIT
+        ts.tv_sec = left / 1000;
+        ts.tv_nsec = (left % 1000) * 1000000;
+        __system_property_wait(pi, serial, &serial, &ts);
+#else
+        usleep(left * 1000 < FM_PROP_POLL_US ? left * 1000 : FM_PROP_POLL_US);
+#endif
+    }
+    ALOGE("%s: %s not %s after %d ms", LOGTAG, name, value, timeout_ms);
+    return -ETIMEDOUT;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2014-2017, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *        * Redistributions of source code must retain the above copyright
+ *            notice, this list of conditions and the following disclaimer.
+ *        * Redistributions in binary form must reproduce the above copyright
+ *            notice, this list of conditions and the following disclaimer in the
+ *            documentation and/or other materials provided with the distribution.
+ *        * Neither the name of The Linux Foundation nor
+ *            the names of its contributors may be used to endorse or promote
+ *            products derived from this software without specific prior written
+ *            permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.    IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FM_PROPERTY_WAIT_H__
+#define __FM_PROPERTY_WAIT_H__
+
+/*
+ * Waits for the fm_dl service to report the SoC ready through hw.fm.init.
+ *
+ * The wait sleeps on the property area serial, so it returns as soon as
+ * the service sets the property rather than on the next poll tick, and it
+ * stops at the exact timeout asked for.
+ */
+
+#define FM_INIT_PROP_NAME       "hw.fm.init"
+/* Firmware download and calibration at power on */
+#define FM_INIT_WAIT_MS         9000
+/* fm_dl runs started to reconfigure a powered SoC */
+#define FM_RECONFIG_WAIT_MS     2000
+
+class FmPropertyWait
+{
+    private:
+        static char const * const LOGTAG;
+    public:
+        /*
+         * Returns the ms it took for name to read value, -ETIMEDOUT
+         * when it did not within timeout_ms
+         */
+        static int wait_for(const char *name, const char *value, int timeout_ms);
+};
+
+#endif //__FM_PROPERTY_WAIT_H__
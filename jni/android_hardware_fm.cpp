@@ -34,6 +34,10 @@
 #include "utils/misc.h"
 #include "FmIoctlsInterface.h"
 #include "ConfigFmThs.h"
+#include "FmPerformanceParams.h"
+#include "FmJniRuntime.h"
+#include "FmEventLoop.h"
+#include "FmPropertyWait.h"
 #include <cutils/properties.h>
 #include <fcntl.h>
 #include <math.h>
@@ -59,6 +63,7 @@
 #define V4L2_CID_PRIVATE_IRIS_SET_SPURTABLE             (V4L2_CTRL_CLASS_USER + 0x92D)
 #define TX_RT_LENGTH       63
 #define WAIT_TIMEOUT 200000 /* 200*1000us */
+#define FM_CTRL_READ_TIMEOUT_MS 1000
 #define TX_RT_DELIMITER    0x0d
 #define PS_LEN    9
 #define V4L2_CID_PRIVATE_TAVARUA_STOP_RDS_TX_RT 0x08000017
@@ -78,9 +83,6 @@ enum search_dir_t {
     SCAN_DN
 };
 
-static JNIEnv *g_jEnv = NULL;
-static JavaVM *g_jVM = NULL;
-
 namespace android {
 
 #ifdef FM_SOC_TYPE_CHEROKEE
@@ -121,8 +123,11 @@ typedef void (*fm_set_blnd_cb) (int status);
 typedef void (*fm_get_stn_prm_cb) (int val, int status);
 typedef void (*fm_get_stn_dbg_prm_cb) (int val, int status);
 typedef void (*fm_enable_sb_cb) (int status);
+typedef void (*rds_ct_cb) (void *ct);
+typedef void (*rds_ptyn_cb) (char *ptyn);
+typedef void (*rds_eon_cb) (void *eon);
+typedef void (*callback_batch_event) (unsigned int evt);
 
-static JNIEnv *mCallbackEnv = NULL;
 static jobject mCallbacksObj = NULL;
 static bool mCallbacksObjCreated = false;
 static jfieldID sCallbacksField;
@@ -153,52 +158,162 @@ jmethodID method_setBlendCallback;
 jmethodID method_getStnParamCallback;
 jmethodID method_getStnDbgParamCallback;
 jmethodID method_enableSlimbusCallback;
+static jmethodID method_eventBatchCallback;
+
+/* Resolved once from JNI_OnLoad, see cacheCallbackIds() */
+static const FmJniMethod sCallbackMethods[] = {
+    { "PsInfoCallback", "([B)V", &method_psInfoCallback, false },
+    { "RtCallback", "([B)V", &method_rtCallback, false },
+    { "ErtCallback", "([B)V", &method_ertCallback, false },
+    { "EccCallback", "([B)V", &method_eccCallback, false },
+    { "RtPlusCallback", "([B)V", &method_rtplusCallback, false },
+    { "AflistCallback", "([B)V", &method_aflistCallback, false },
+    { "enableCallback", "()V", &method_enableCallback, false },
+    { "tuneCallback", "(I)V", &method_tuneCallback, false },
+    { "seekCmplCallback", "(I)V", &method_seekCmplCallback, false },
+    { "scanNxtCallback", "()V", &method_scanNxtCallback, false },
+    { "srchListCallback", "([B)V", &method_srchListCallback, false },
+    { "stereostsCallback", "(Z)V", &method_stereostsCallback, false },
+    { "rdsAvlStsCallback", "(Z)V", &method_rdsAvlStsCallback, false },
+    { "disableCallback", "()V", &method_disableCallback, false },
+    { "getSigThCallback", "(II)V", &method_getSigThCallback, false },
+    { "getChDetThCallback", "(II)V", &method_getChDetThrCallback, false },
+    { "DefDataRdCallback", "(II)V", &method_defDataRdCallback, false },
+    { "getBlendCallback", "(II)V", &method_getBlendCallback, false },
+    { "setChDetThCallback", "(I)V", &method_setChDetThrCallback, false },
+    { "DefDataWrtCallback", "(I)V", &method_defDataWrtCallback, false },
+    { "setBlendCallback", "(I)V", &method_setBlendCallback, false },
+    { "getStnParamCallback", "(II)V", &method_getStnParamCallback, false },
+    { "getStnDbgParamCallback", "(II)V", &method_getStnDbgParamCallback, false },
+    { "enableSlimbusCallback", "(I)V", &method_enableSlimbusCallback, false },
+    /* older FmReceiverJNI, keep one up-call per event */
+    { "eventBatchCallback", "(Ljava/nio/ByteBuffer;I)V", &method_eventBatchCallback, true },
+};
 
-static bool checkCallbackThread() {
-   JNIEnv* env = AndroidRuntime::getJNIEnv();
-   if (mCallbackEnv != env || mCallbackEnv == NULL)
-   {
-       ALOGE("Callback env check fail: env: %p, callback: %p", env, mCallbackEnv);
-       return false;
-   }
+/*
+ * Batched delivery of the RDS/list callbacks.
+ *
+ * Between the hal's batch_evt_cb(0) and batch_evt_cb(1) these callbacks
+ * append {type, 0, len lo, len hi, payload} records to one native buffer
+ * that Java sees as a direct ByteBuffer, and FmReceiverJNI gets a single
+ * eventBatchCallback() per batch instead of a byte[] per event. Any other
+ * callback flushes first so Java still sees events in hal order.
+ * The search list record carries no payload, srchListCallback() does not
+ * look at the table.
+ */
+#define EVT_BATCH_SIZE      4096
+#define EVT_REC_HDR         4
+#define EVT_REC_MAX         (3 + 255)   /* eRT: 3 header bytes and its text */
+
+enum evt_batch_type {
+    EVT_BATCH_PS = 1,
+    EVT_BATCH_RT,
+    EVT_BATCH_ERT,
+    EVT_BATCH_RT_PLUS,
+    EVT_BATCH_AF_LIST,
+    EVT_BATCH_ECC,
+    EVT_BATCH_SRCH_LIST,
+};
+
+static uint8_t sEvtBatch[EVT_BATCH_SIZE];
+static jobject sEvtBatchBuffer = NULL;
+static int sEvtBatchLen;
+static bool sEvtInBatch;
+
+
+static void fm_evt_batch_flush(JNIEnv *env)
+{
+    int len = sEvtBatchLen;
+
+    if (len == 0)
+        return;
+    sEvtBatchLen = 0;
+    env->CallVoidMethod(mCallbacksObj, method_eventBatchCallback,
+                                 sEvtBatchBuffer, (jint) len);
+}
+
+/* Returns false when batching is not available and the caller has to
+ * deliver the event itself */
+static bool fm_evt_batch_put(JNIEnv *env, int type, const void *data, int len)
+{
+    if (sEvtBatchBuffer == NULL || method_eventBatchCallback == NULL)
+        return false;
+    if (len > EVT_REC_MAX)
+        len = EVT_REC_MAX;
+    if (sEvtBatchLen + EVT_REC_HDR + len > EVT_BATCH_SIZE)
+        fm_evt_batch_flush(env);
+
+    uint8_t *rec = &sEvtBatch[sEvtBatchLen];
+    rec[0] = type;
+    rec[1] = 0;
+    rec[2] = len & 0xff;
+    rec[3] = len >> 8;
+    if (len > 0)
+        memcpy(&rec[EVT_REC_HDR], data, len);
+    sEvtBatchLen += EVT_REC_HDR + len;
+
+    if (!sEvtInBatch)
+        fm_evt_batch_flush(env);
     return true;
 }
 
+static void fm_batch_evt_cb(unsigned int evt)
+{
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
+        return;
+
+    if (evt == 0) {
+        sEvtInBatch = true;
+    } else {
+        sEvtInBatch = false;
+        fm_evt_batch_flush(env);
+    }
+}
+
 void fm_enabled_cb() {
     ALOGD("Entered %s", __func__);
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_enableCallback);
+    env->CallVoidMethod(mCallbacksObj, method_enableCallback);
     ALOGD("exit  %s", __func__);
 }
 
 void fm_tune_cb(int Freq)
 {
     ALOGD("TUNE:Freq:%d", Freq);
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_tuneCallback, (jint) Freq);
+    env->CallVoidMethod(mCallbacksObj, method_tuneCallback, (jint) Freq);
 }
 
 void fm_seek_cmpl_cb(int Freq)
 {
     ALOGI("SEEK_CMPL: Freq: %d", Freq);
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_seekCmplCallback, (jint) Freq);
+    env->CallVoidMethod(mCallbacksObj, method_seekCmplCallback, (jint) Freq);
 }
 
 void fm_scan_next_cb()
 {
     ALOGI("SCAN_NEXT");
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_scanNxtCallback);
+    env->CallVoidMethod(mCallbacksObj, method_scanNxtCallback);
 }
 
 void fm_srch_list_cb(uint16_t *scan_tbl)
@@ -206,35 +321,42 @@ void fm_srch_list_cb(uint16_t *scan_tbl)
     ALOGI("SRCH_LIST");
     jbyteArray srch_buffer = NULL;
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
+        return;
+    if (fm_evt_batch_put(env, EVT_BATCH_SRCH_LIST, NULL, 0))
         return;
 
-    srch_buffer = mCallbackEnv->NewByteArray(STD_BUF_SIZE);
+    srch_buffer = env->NewByteArray(STD_BUF_SIZE);
     if (srch_buffer == NULL) {
         ALOGE(" af list allocate failed :");
         return;
     }
-    mCallbackEnv->SetByteArrayRegion(srch_buffer, 0, STD_BUF_SIZE, (jbyte *)scan_tbl);
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_srchListCallback, srch_buffer);
-    mCallbackEnv->DeleteLocalRef(srch_buffer);
+    env->SetByteArrayRegion(srch_buffer, 0, STD_BUF_SIZE, (jbyte *)scan_tbl);
+    env->CallVoidMethod(mCallbacksObj, method_srchListCallback, srch_buffer);
+    env->DeleteLocalRef(srch_buffer);
 }
 
 void fm_stereo_status_cb(bool stereo)
 {
     ALOGI("STEREO: %d", stereo);
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_stereostsCallback, (jboolean) stereo);
+    env->CallVoidMethod(mCallbacksObj, method_stereostsCallback, (jboolean) stereo);
 }
 
 void fm_rds_avail_status_cb(bool rds_avl)
 {
     ALOGD("fm_rds_avail_status_cb: %d", rds_avl);
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_rdsAvlStsCallback, (jboolean) rds_avl);
+    env->CallVoidMethod(mCallbacksObj, method_rdsAvlStsCallback, (jboolean) rds_avl);
 }
 
 void fm_af_list_update_cb(uint16_t *af_list)
@@ -242,18 +364,21 @@ void fm_af_list_update_cb(uint16_t *af_list)
     ALOGD("AF_LIST");
     jbyteArray af_buffer = NULL;
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
+        return;
+    if (fm_evt_batch_put(env, EVT_BATCH_AF_LIST, af_list, STD_BUF_SIZE))
         return;
 
-    af_buffer = mCallbackEnv->NewByteArray(STD_BUF_SIZE);
+    af_buffer = env->NewByteArray(STD_BUF_SIZE);
     if (af_buffer == NULL) {
         ALOGE(" af list allocate failed :");
         return;
     }
 
-    mCallbackEnv->SetByteArrayRegion(af_buffer, 0, STD_BUF_SIZE,(jbyte *)af_list);
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_aflistCallback,af_buffer);
-    mCallbackEnv->DeleteLocalRef(af_buffer);
+    env->SetByteArrayRegion(af_buffer, 0, STD_BUF_SIZE,(jbyte *)af_list);
+    env->CallVoidMethod(mCallbacksObj, method_aflistCallback,af_buffer);
+    env->DeleteLocalRef(af_buffer);
 }
 
 void fm_rt_update_cb(char *rt)
@@ -262,7 +387,8 @@ void fm_rt_update_cb(char *rt)
     jbyteArray rt_buff = NULL;
     int i,len;
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
 
     len  = (int)(rt[0] & 0xFF);
@@ -270,17 +396,17 @@ void fm_rt_update_cb(char *rt)
     len = len+5;
 
     ALOGD(" rt data len=%d :",len);
-    rt_buff = mCallbackEnv->NewByteArray(len);
+    if (fm_evt_batch_put(env, EVT_BATCH_RT, rt, len))
+        return;
+    rt_buff = env->NewByteArray(len);
     if (rt_buff == NULL) {
         ALOGE(" ps data allocate failed :");
         return;
     }
 
-    mCallbackEnv->SetByteArrayRegion(rt_buff, 0, len,(jbyte *)rt);
-    jbyte* bytes= mCallbackEnv->GetByteArrayElements(rt_buff,0);
-
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_rtCallback,rt_buff);
-    mCallbackEnv->DeleteLocalRef(rt_buff);
+    env->SetByteArrayRegion(rt_buff, 0, len,(jbyte *)rt);
+    env->CallVoidMethod(mCallbacksObj, method_rtCallback,rt_buff);
+    env->DeleteLocalRef(rt_buff);
 }
 
 void fm_ps_update_cb(char *ps)
@@ -288,23 +414,25 @@ void fm_ps_update_cb(char *ps)
     jbyteArray ps_data = NULL;
     int i,len;
     int numPs;
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
 
     numPs  = (int)(ps[0] & 0xFF);
     len = (numPs *8)+5;
 
     ALOGD(" ps data len=%d :",len);
-    ps_data = mCallbackEnv->NewByteArray(len);
+    if (fm_evt_batch_put(env, EVT_BATCH_PS, ps, len))
+        return;
+    ps_data = env->NewByteArray(len);
     if(ps_data == NULL) {
        ALOGE(" ps data allocate failed :");
        return;
     }
 
-    mCallbackEnv->SetByteArrayRegion(ps_data, 0, len,(jbyte *)ps);
-    jbyte* bytes= mCallbackEnv->GetByteArrayElements(ps_data,0);
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_psInfoCallback,ps_data);
-    mCallbackEnv->DeleteLocalRef(ps_data);
+    env->SetByteArrayRegion(ps_data, 0, len,(jbyte *)ps);
+    env->CallVoidMethod(mCallbacksObj, method_psInfoCallback,ps_data);
+    env->DeleteLocalRef(ps_data);
 }
 
 void fm_oda_update_cb()
@@ -320,17 +448,20 @@ void fm_rt_plus_update_cb(char *rt_plus)
 
     len =  (int)(rt_plus[0] & 0xFF);
     ALOGD(" rt plus len=%d :",len);
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
+        return;
+    if (fm_evt_batch_put(env, EVT_BATCH_RT_PLUS, rt_plus, len))
         return;
 
-    RtPlus = mCallbackEnv->NewByteArray(len);
+    RtPlus = env->NewByteArray(len);
     if (RtPlus == NULL) {
         ALOGE(" rt plus data allocate failed :");
         return;
     }
-    mCallbackEnv->SetByteArrayRegion(RtPlus, 0, len,(jbyte *)rt_plus);
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_rtplusCallback,RtPlus);
-    mCallbackEnv->DeleteLocalRef(RtPlus);
+    env->SetByteArrayRegion(RtPlus, 0, len,(jbyte *)rt_plus);
+    env->CallVoidMethod(mCallbacksObj, method_rtplusCallback,RtPlus);
+    env->DeleteLocalRef(RtPlus);
 }
 
 void fm_ert_update_cb(char *ert)
@@ -339,23 +470,26 @@ void fm_ert_update_cb(char *ert)
     jbyteArray ert_buff = NULL;
     int i,len;
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
 
     len = (int)(ert[0] & 0xFF);
     len = len+3;
 
     ALOGI(" ert data len=%d :",len);
-    ert_buff = mCallbackEnv->NewByteArray(len);
+    if (fm_evt_batch_put(env, EVT_BATCH_ERT, ert, len))
+        return;
+    ert_buff = env->NewByteArray(len);
     if (ert_buff == NULL) {
         ALOGE(" ert data allocate failed :");
         return;
     }
 
-    mCallbackEnv->SetByteArrayRegion(ert_buff, 0, len,(jbyte *)ert);
-   // jbyte* bytes= mCallbackEnv->GetByteArrayElements(ert_buff,0);
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_ertCallback,ert_buff);
-    mCallbackEnv->DeleteLocalRef(ert_buff);
+    env->SetByteArrayRegion(ert_buff, 0, len,(jbyte *)ert);
+   // jbyte* bytes= env->GetByteArrayElements(ert_buff,0);
+    env->CallVoidMethod(mCallbacksObj, method_ertCallback,ert_buff);
+    env->DeleteLocalRef(ert_buff);
 }
 
 void fm_ext_country_code_cb(char *ecc)
@@ -364,20 +498,23 @@ void fm_ext_country_code_cb(char *ecc)
     jbyteArray ecc_buff = NULL;
     int i,len;
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
 
     len = (int)(ecc[0] & 0xFF);
 
     ALOGI(" ecc data len=%d :",len);
-    ecc_buff = mCallbackEnv->NewByteArray(len);
+    if (fm_evt_batch_put(env, EVT_BATCH_ECC, ecc, len))
+        return;
+    ecc_buff = env->NewByteArray(len);
     if (ecc_buff == NULL) {
         ALOGE(" ecc data allocate failed :");
         return;
     }
-    mCallbackEnv->SetByteArrayRegion(ecc_buff, 0, len,(jbyte *)ecc);
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_eccCallback,ecc_buff);
-    mCallbackEnv->DeleteLocalRef(ecc_buff);
+    env->SetByteArrayRegion(ecc_buff, 0, len,(jbyte *)ecc);
+    env->CallVoidMethod(mCallbacksObj, method_eccCallback,ecc_buff);
+    env->DeleteLocalRef(ecc_buff);
 }
 
 
@@ -394,10 +531,12 @@ void rds_grp_cntrs_ext_rsp_cb(char * evt_buffer)
 void fm_disabled_cb()
 {
     ALOGE("DISABLE");
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_disableCallback);
+    env->CallVoidMethod(mCallbacksObj, method_disableCallback);
     mCallbacksObjCreated = false;
 }
 
@@ -417,130 +556,138 @@ void fm_ch_det_th_rsp_cb(char *ch_det_rsp){
     ALOGD("fm_ch_det_th_rsp_cb");
 }
 
+/* The callback thread stays attached until it exits, so a thread that
+ * comes back for the next FM session does not attach again */
 static void fm_thread_evt_cb(unsigned int event) {
-    JavaVM* vm = AndroidRuntime::getJavaVM();
-    if (event  == 0) {
-        JavaVMAttachArgs args;
-        char name[] = "FM Service Callback Thread";
-        args.version = JNI_VERSION_1_6;
-        args.name = name;
-        args.group = NULL;
-       vm->AttachCurrentThread(&mCallbackEnv, &args);
-        ALOGD("Callback thread attached: %p", mCallbackEnv);
-    } else if (event == 1) {
-        if (!checkCallbackThread()) {
-            ALOGE("Callback: '%s' is not called on the correct thread", __FUNCTION__);
-            return;
-        }
-        vm->DetachCurrentThread();
-    }
+    if (event == 0)
+        FmJniRuntime::attach_callback_thread("FM Service Callback Thread");
 }
 
 static void fm_get_sig_thres_cb(int val, int status)
 {
     ALOGD("Get signal Thres callback");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_getSigThCallback, val, status);
+    env->CallVoidMethod(mCallbacksObj, method_getSigThCallback, val, status);
 }
 
 static void fm_get_ch_det_thr_cb(int val, int status)
 {
     ALOGD("fm_get_ch_det_thr_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_getChDetThrCallback, val, status);
+    env->CallVoidMethod(mCallbacksObj, method_getChDetThrCallback, val, status);
 }
 
 static void fm_set_ch_det_thr_cb(int status)
 {
     ALOGD("fm_set_ch_det_thr_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_setChDetThrCallback, status);
+    env->CallVoidMethod(mCallbacksObj, method_setChDetThrCallback, status);
 }
 
 static void fm_def_data_read_cb(int val, int status)
 {
     ALOGD("fm_def_data_read_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_defDataRdCallback, val, status);
+    env->CallVoidMethod(mCallbacksObj, method_defDataRdCallback, val, status);
 }
 
 static void fm_def_data_write_cb(int status)
 {
     ALOGD("fm_def_data_write_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_defDataWrtCallback, status);
+    env->CallVoidMethod(mCallbacksObj, method_defDataWrtCallback, status);
 }
 
 static void fm_get_blend_cb(int val, int status)
 {
     ALOGD("fm_get_blend_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_getBlendCallback, val, status);
+    env->CallVoidMethod(mCallbacksObj, method_getBlendCallback, val, status);
 }
 
 static void fm_set_blend_cb(int status)
 {
     ALOGD("fm_set_blend_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_setBlendCallback, status);
+    env->CallVoidMethod(mCallbacksObj, method_setBlendCallback, status);
 }
 
 static void fm_get_station_param_cb(int val, int status)
 {
     ALOGD("fm_get_station_param_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_getStnParamCallback, val, status);
+    env->CallVoidMethod(mCallbacksObj, method_getStnParamCallback, val, status);
 }
 
 static void fm_get_station_debug_param_cb(int val, int status)
 {
     ALOGD("fm_get_station_debug_param_cb");
 
-    if (!checkCallbackThread())
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
         return;
+    fm_evt_batch_flush(env);
 
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_getStnDbgParamCallback, val, status);
+    env->CallVoidMethod(mCallbacksObj, method_getStnDbgParamCallback, val, status);
 }
 
 static void fm_enable_slimbus_cb(int status)
 {
     ALOGD("++fm_enable_slimbus_cb mCallbacksObjCreated: %d", mCallbacksObjCreated);
 
+    JNIEnv *env = FmJniRuntime::callback_env();
+    if (env == NULL)
+        return;
+
     if (mCallbacksObjCreated == false) {
-        jobject javaObjectRef =  mCallbackEnv->NewObject(javaClassRef, method_enableSlimbusCallback);
+        jobject javaObjectRef =  env->NewObject(javaClassRef, method_enableSlimbusCallback);
         mCallbacksObj = javaObjectRef;
         mCallbacksObjCreated = true;
         return;
     }
+    fm_evt_batch_flush(env);
 
-    if (!checkCallbackThread())
-        return;
-
-    mCallbackEnv->CallVoidMethod(mCallbacksObj, method_enableSlimbusCallback, status);
+    env->CallVoidMethod(mCallbacksObj, method_enableSlimbusCallback, status);
     ALOGV("--fm_enable_slimbus_cb");
 }
 
@@ -579,12 +726,18 @@ typedef struct {
    fm_get_stn_prm_cb fm_get_station_param_cb;
    fm_get_stn_dbg_prm_cb fm_get_station_debug_param_cb;
    fm_enable_sb_cb fm_enable_slimbus_cb;
+   rds_ct_cb ct_update_cb;
+   rds_ptyn_cb ptyn_update_cb;
+   rds_eon_cb eon_update_cb;
+   callback_batch_event batch_evt_cb;
 } fm_vendor_callbacks_t;
 
 typedef struct {
     int (*hal_init)(fm_vendor_callbacks_t *p_cb);
     int (*set_fm_ctrl)(int ioctl, int val);
     int (*get_fm_ctrl) (int ioctl, int *val);
+    int (*get_fm_ctrl_async) (int ioctl, uint32_t *req);
+    int (*wait_fm_ctrl) (uint32_t req, int timeout_ms, int *val);
 } fm_interface_t;
 
 fm_interface_t *vendor_interface;
@@ -621,15 +774,24 @@ static   fm_vendor_callbacks_t fm_callbacks = {
     fm_set_blend_cb,
     fm_get_station_param_cb,
     fm_get_station_debug_param_cb,
-    fm_enable_slimbus_cb
+    fm_enable_slimbus_cb,
+    NULL,
+    NULL,
+    NULL,
+    fm_batch_evt_cb
 };
 #endif
+
+/* The event listener sleeps here instead of in VIDIOC_DQBUF, so closing
+ * the fd releases it without the driver sending a disabled event */
+static FmEventLoop sEventLoop;
+
 /* native interface */
 static jint android_hardware_fmradio_FmReceiverJNI_acquireFdNative
         (JNIEnv* env, jobject thiz, jstring path)
 {
     int fd;
-    int i, retval=0, err;
+    int retval=0, err;
     char value[PROPERTY_VALUE_MAX] = {'\0'};
     char versionStr[40] = {'\0'};
     int init_success = 0;
@@ -646,6 +808,8 @@ static jint android_hardware_fmradio_FmReceiverJNI_acquireFdNative
     if(fd < 0){
         return FM_JNI_FAILURE;
     }
+    FmIoctlsInterface :: invalidate_tuner(fd);
+    FmPerformanceParams :: InvalidateShadow(fd);
     //Read the driver verions
     err = ioctl(fd, VIDIOC_QUERYCAP, &cap);
 
@@ -674,21 +838,13 @@ static jint android_hardware_fmradio_FmReceiverJNI_acquireFdNative
 #ifndef QCOM_NO_FM_FIRMWARE
        property_set("ctl.start", "fm_dl");
        sched_yield();
-       for(i=0; i<45; i++) {
-         property_get("hw.fm.init", value, NULL);
-         if (strcmp(value, "1") == 0) {
-            init_success = 1;
-            break;
-         } else {
-            usleep(WAIT_TIMEOUT);
-         }
-       }
+       if (FmPropertyWait :: wait_for(FM_INIT_PROP_NAME, "1", FM_INIT_WAIT_MS) >= 0)
+          init_success = 1;
 #else
        property_set("hw.fm.init", "1");
        usleep(WAIT_TIMEOUT);
        init_success = 1;
 #endif
-       ALOGE("init_success:%d after %f seconds \n", init_success, 0.2*i);
        if(!init_success) {
          property_set("ctl.stop", "fm_dl");
          // close the fd(power down)
@@ -696,6 +852,8 @@ static jint android_hardware_fmradio_FmReceiverJNI_acquireFdNative
          return FM_JNI_FAILURE;
        }
     }
+    if (sEventLoop.open(fd) < 0)
+        ALOGE("%s: no event loop, events are read blocking\n", LOG_TAG);
     return fd;
 }
 
@@ -716,6 +874,7 @@ static jint android_hardware_fmradio_FmReceiverJNI_closeFdNative
     {
        property_set("ctl.stop", "fm_dl");
     }
+    sEventLoop.release();
     close(fd);
     return FM_JNI_SUCCESS;
 }
@@ -828,16 +987,72 @@ static jint android_hardware_fmradio_FmReceiverJNI_SetCalibrationNative
    }
    return err;
 }
+#ifdef FM_SOC_TYPE_CHEROKEE
+/* Java callback that reports the controller read behind 'id', if any */
+static jmethodID ctrl_read_callback(int id)
+{
+    switch (id) {
+    case V4L2_CID_PRV_ON_CHANNEL_THRESHOLD:
+    case V4L2_CID_PRV_OFF_CHANNEL_THRESHOLD:
+    case V4L2_CID_PRV_SINR_THRESHOLD:
+    case V4L2_CID_PRV_SINR_SAMPLES:
+        return method_getChDetThrCallback;
+    case V4L2_CID_PRV_AF_RMSSI_TH:
+    case V4L2_CID_PRV_AF_RMSSI_SAMPLES:
+    case V4L2_CID_PRV_GOOD_CH_RMSSI_TH:
+    case V4L2_CID_PRV_SRCHALGOTYPE:
+    case V4L2_CID_PRV_CF0TH12:
+    case V4L2_CID_PRV_SINRFIRSTSTAGE:
+    case V4L2_CID_PRV_RMSSIFIRSTSTAGE:
+        return method_defDataRdCallback;
+    case V4L2_CID_PRV_IOVERC:
+    case V4L2_CID_PRV_INTDET:
+        return method_getStnDbgParamCallback;
+    case V4L2_CID_PRV_SINR:
+    case V4L2_CID_PRV_IRIS_RMSSI:
+        return method_getStnParamCallback;
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Reads a threshold or station parameter from the controller and waits
+ * for the answer, so getControlNative can return the value itself. The
+ * result still goes to the Java callback the hal would have used.
+ */
+static int get_ctrl_read(JNIEnv *env, int id, jmethodID cb, int *val)
+{
+    uint32_t req;
+    int err, status;
+
+    err = vendor_interface->get_fm_ctrl_async(id, &req);
+    if (err >= 0)
+        err = vendor_interface->wait_fm_ctrl(req, FM_CTRL_READ_TIMEOUT_MS, val);
+
+    status = err < 0 ? -err : 0;
+    if (err < 0)
+        *val = -1;
+    if (mCallbacksObj != NULL)
+        env->CallVoidMethod(mCallbacksObj, cb, *val, status);
+    return err;
+}
+#endif
+
 /* native interface */
 static jint android_hardware_fmradio_FmReceiverJNI_getControlNative
     (JNIEnv * env, jobject thiz, jint fd, jint id)
 {
     int err;
-    long val;
+    long val = 0;
 
     ALOGE("id(%x)\n", id);
 #ifdef FM_SOC_TYPE_CHEROKEE
-    err = vendor_interface->get_fm_ctrl(id, (int *)&val);
+    jmethodID cb = ctrl_read_callback(id);
+    if (cb != NULL)
+        err = get_ctrl_read(env, id, cb, (int *)&val);
+    else
+        err = vendor_interface->get_fm_ctrl(id, (int *)&val);
     if (err < 0) {
         ALOGE("%s: get control failed, id: %d\n", LOG_TAG, id);
         err = FM_JNI_FAILURE;
@@ -1103,6 +1318,10 @@ static jint android_hardware_fmradio_FmReceiverJNI_getBufferNative
 
     if ((fd >= 0) && (index >= 0)) {
         ALOGE("index: %d\n", index);
+        if (index == EVENT_IND &&
+            sEventLoop.wait(-1) == FmEventLoop::WAIT_WAKE) {
+            return FM_JNI_FAILURE;
+        }
         byte_buffer = env->GetByteArrayElements(buff, &isCopy);
         err = FmIoctlsInterface :: get_buffer(fd,
                                                (char *)byte_buffer,
@@ -1136,7 +1355,7 @@ static jint android_hardware_fmradio_FmReceiverJNI_getRawRdsNative
 static jint android_hardware_fmradio_FmReceiverJNI_setNotchFilterNative(JNIEnv * env, jobject thiz,jint fd, jint id, jboolean aValue)
 {
     char value[PROPERTY_VALUE_MAX] = {'\0'};
-    int init_success = 0,i;
+    int init_success = 0;
     char notch[PROPERTY_VALUE_MAX] = {0x00};
     int band;
     int err = 0;
@@ -1157,16 +1376,8 @@ static jint android_hardware_fmradio_FmReceiverJNI_setNotchFilterNative(JNIEnv *
 #ifndef QCOM_NO_FM_FIRMWARE
        property_set("ctl.start", "fm_dl");
        sched_yield();
-       for(i=0; i<10; i++) {
-          property_get("hw.fm.init", value, NULL);
-          if (strcmp(value, "1") == 0) {
-             init_success = 1;
-             break;
-          } else {
-             usleep(WAIT_TIMEOUT);
-          }
-       }
-       ALOGE("init_success:%d after %f seconds \n", init_success, 0.2*i);
+       if (FmPropertyWait :: wait_for(FM_INIT_PROP_NAME, "1", FM_RECONFIG_WAIT_MS) >= 0)
+          init_success = 1;
 #else
        usleep(WAIT_TIMEOUT);
 #endif
@@ -1201,7 +1412,6 @@ static jint android_hardware_fmradio_FmReceiverJNI_setNotchFilterNative(JNIEnv *
 /* native interface */
 static jint android_hardware_fmradio_FmReceiverJNI_setAnalogModeNative(JNIEnv * env, jobject thiz, jboolean aValue)
 {
-    int i=0;
     char value[PROPERTY_VALUE_MAX] = {'\0'};
     char firmwareVersion[80];
 
@@ -1221,14 +1431,8 @@ static jint android_hardware_fmradio_FmReceiverJNI_setAnalogModeNative(JNIEnv *
        property_set("hw.fm.mode","config_dac");
        property_set("ctl.start", "fm_dl");
        sched_yield();
-       for(i=0; i<10; i++) {
-          property_get("hw.fm.init", value, NULL);
-          if (strcmp(value, "1") == 0) {
-             return 1;
-          } else {
-             usleep(WAIT_TIMEOUT);
-          }
-       }
+       if (FmPropertyWait :: wait_for(FM_INIT_PROP_NAME, "1", FM_RECONFIG_WAIT_MS) >= 0)
+          return 1;
     }
 
     return 0;
@@ -1530,7 +1734,54 @@ static void android_hardware_fmradio_FmReceiverJNI_configurePerformanceParams
 
      ConfigFmThs thsObj;
 
-     thsObj.SetRxSearchAfThs(FM_PERFORMANCE_PARAMS, fd);
+     thsObj.SetRxSearchAfThs(FM_PERFORMANCE_PARAMS, fd,
+                             FM_PERFORMANCE_PARAMS_CACHE);
+}
+
+static jint android_hardware_fmradio_FmReceiverJNI_setPerformanceProfileNative
+    (JNIEnv * env, jobject thiz, jint fd, jstring name)
+{
+    const char *profile = NULL;
+    int err;
+
+    if (name != NULL) {
+        profile = env->GetStringUTFChars(name, NULL);
+        if (profile == NULL)
+            return FM_JNI_FAILURE;
+    }
+    err = ConfigFmThs::SelectProfile(fd, profile);
+    if (profile != NULL)
+        env->ReleaseStringUTFChars(name, profile);
+
+    return (err == FM_SUCCESS) ? FM_JNI_SUCCESS : FM_JNI_FAILURE;
+}
+
+static jint android_hardware_fmradio_FmReceiverJNI_updateHybridSrchListNative
+    (JNIEnv * env, jobject thiz, jint fd, jintArray freqs, jint count)
+{
+    ULINT khz[MAX_HYBRID_SRCH_ENTRIES];
+    jint *list;
+    int i;
+
+    /* a scan that found nothing still ages the entries it did not hit */
+    if ((freqs == NULL) || (count < 0))
+        count = 0;
+    if ((count > 0) && (count > env->GetArrayLength(freqs)))
+        count = env->GetArrayLength(freqs);
+    if (count > MAX_HYBRID_SRCH_ENTRIES)
+        count = MAX_HYBRID_SRCH_ENTRIES;
+    if (count > 0) {
+        list = env->GetIntArrayElements(freqs, NULL);
+        if (list == NULL)
+            return FM_JNI_FAILURE;
+        for (i = 0; i < count; i++)
+            khz[i] = list[i];
+        env->ReleaseIntArrayElements(freqs, list, JNI_ABORT);
+    }
+
+    if (ConfigFmThs::UpdateHybridSrchList(fd, khz, count) != FM_SUCCESS)
+        return FM_JNI_FAILURE;
+    return FM_JNI_SUCCESS;
 }
 
 /* native interface */
@@ -1587,8 +1838,6 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
 
     ALOGI("ClassInit native called \n");
 #ifdef FM_SOC_TYPE_CHEROKEE
-    jclass dataClass = env->FindClass("qcom/fmradio/FmReceiverJNI");
-    javaClassRef = (jclass) env->NewGlobalRef(dataClass);
     lib_handle = dlopen(FM_LIBRARY_NAME, RTLD_NOW);
     if (!lib_handle) {
         ALOGE("%s unable to open %s: %s", __func__, FM_LIBRARY_NAME, dlerror());
@@ -1602,32 +1851,6 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
         ALOGE("%s unable to find symbol %s in %s: %s", __func__, FM_LIBRARY_SYMBOL_NAME, FM_LIBRARY_NAME, dlerror());
         goto error;
     }
-
-    method_psInfoCallback = env->GetMethodID(javaClassRef, "PsInfoCallback", "([B)V");
-    method_rtCallback = env->GetMethodID(javaClassRef, "RtCallback", "([B)V");
-    method_ertCallback = env->GetMethodID(javaClassRef, "ErtCallback", "([B)V");
-    method_eccCallback = env->GetMethodID(javaClassRef, "EccCallback", "([B)V");
-    method_rtplusCallback = env->GetMethodID(javaClassRef, "RtPlusCallback", "([B)V");
-    method_aflistCallback = env->GetMethodID(javaClassRef, "AflistCallback", "([B)V");
-    method_enableCallback = env->GetMethodID(javaClassRef, "enableCallback", "()V");
-    method_tuneCallback = env->GetMethodID(javaClassRef, "tuneCallback", "(I)V");
-    method_seekCmplCallback = env->GetMethodID(javaClassRef, "seekCmplCallback", "(I)V");
-    method_scanNxtCallback = env->GetMethodID(javaClassRef, "scanNxtCallback", "()V");
-    method_srchListCallback = env->GetMethodID(javaClassRef, "srchListCallback", "([B)V");
-    method_stereostsCallback = env->GetMethodID(javaClassRef, "stereostsCallback", "(Z)V");
-    method_rdsAvlStsCallback = env->GetMethodID(javaClassRef, "rdsAvlStsCallback", "(Z)V");
-    method_disableCallback = env->GetMethodID(javaClassRef, "disableCallback", "()V");
-    method_getSigThCallback = env->GetMethodID(javaClassRef, "getSigThCallback", "(II)V");
-    method_getChDetThrCallback = env->GetMethodID(javaClassRef, "getChDetThCallback", "(II)V");
-    method_defDataRdCallback = env->GetMethodID(javaClassRef, "DefDataRdCallback", "(II)V");
-    method_getBlendCallback = env->GetMethodID(javaClassRef, "getBlendCallback", "(II)V");
-    method_setChDetThrCallback = env->GetMethodID(javaClassRef, "setChDetThCallback","(I)V");
-    method_defDataWrtCallback = env->GetMethodID(javaClassRef, "DefDataWrtCallback", "(I)V");
-    method_setBlendCallback = env->GetMethodID(javaClassRef, "setBlendCallback", "(I)V");
-    method_getStnParamCallback = env->GetMethodID(javaClassRef, "getStnParamCallback", "(II)V");
-    method_getStnDbgParamCallback = env->GetMethodID(javaClassRef, "getStnDbgParamCallback", "(II)V");
-    method_enableSlimbusCallback = env->GetMethodID(javaClassRef, "enableSlimbusCallback", "(I)V");
-
     return;
 error:
     vendor_interface = NULL;
@@ -1643,6 +1866,14 @@ static void initNative(JNIEnv *env, jobject object) {
     int status;
     ALOGI("Init native called \n");
 
+    if (sEvtBatchBuffer == NULL && method_eventBatchCallback != NULL) {
+        jobject buf = env->NewDirectByteBuffer(sEvtBatch, sizeof(sEvtBatch));
+        if (buf != NULL) {
+            sEvtBatchBuffer = env->NewGlobalRef(buf);
+            env->DeleteLocalRef(buf);
+        }
+    }
+
     if (vendor_interface) {
         ALOGI("Initializing the FM HAL module & registering the JNI callback functions...");
         status = vendor_interface->hal_init(&fm_callbacks);
@@ -1731,13 +1962,33 @@ static JNINativeMethod gMethods[] = {
             (void*)android_hardware_fmradio_FmReceiverJNI_setSpurDataNative},
         { "configurePerformanceParams", "(I)V",
              (void*)android_hardware_fmradio_FmReceiverJNI_configurePerformanceParams},
+        { "setPerformanceProfileNative", "(ILjava/lang/String;)I",
+             (void*)android_hardware_fmradio_FmReceiverJNI_setPerformanceProfileNative},
+        { "updateHybridSrchListNative", "(I[II)I",
+             (void*)android_hardware_fmradio_FmReceiverJNI_updateHybridSrchListNative},
         { "enableSlimbus", "(II)I",
              (void*)android_hardware_fmradio_FmReceiverJNI_enableSlimbusNative},
 };
 
+#ifdef FM_SOC_TYPE_CHEROKEE
+static int cacheCallbackIds(JNIEnv *env)
+{
+    javaClassRef = FmJniRuntime::cache_class(env, "qcom/fmradio/FmReceiverJNI");
+    if (javaClassRef == NULL)
+        return -1;
+    return FmJniRuntime::cache_methods(env, javaClassRef, sCallbackMethods,
+                                       NELEM(sCallbackMethods));
+}
+#endif
+
 int register_android_hardware_fm_fmradio(JNIEnv* env)
 {
-        return jniRegisterNativeMethods(env, "qcom/fmradio/FmReceiverJNI", gMethods, NELEM(gMethods));
+#ifdef FM_SOC_TYPE_CHEROKEE
+    if (cacheCallbackIds(env) < 0)
+        return -1;
+#endif
+    return FmJniRuntime::register_natives(env, "qcom/fmradio/FmReceiverJNI",
+                                          gMethods, NELEM(gMethods));
 }
 } // end namespace
 
@@ -1745,10 +1996,9 @@ jint JNI_OnLoad(JavaVM *jvm, void *reserved)
 {
     JNIEnv *e;
     int status;
-    g_jVM = jvm;
 
     ALOGI("FM : Loading QCOMM FM-JNI");
-    if (jvm->GetEnv((void **)&e, JNI_VERSION_1_6)) {
+    if ((e = FmJniRuntime::on_load(jvm)) == NULL) {
         ALOGE("JNI version mismatch error");
         return JNI_ERR;
     }
@@ -8,14 +8,23 @@ LOCAL_SRC_FILES := \
     FmIoctlsInterface.cpp \
     ConfigFmThs.cpp \
     FmPerformanceParams.cpp \
-    ConfFileParser.cpp \
     FmRadioController.cpp \
-    LibfmJni.cpp
+    LibfmJni.cpp \
+    ../jni/ConfFileParser.cpp \
+    ../jni/FmEventLoop.cpp \
+    ../jni/FmHybridSrchList.cpp \
+    ../jni/FmJniRuntime.cpp \
+    ../jni/FmPropertyWait.cpp
 
 LOCAL_C_INCLUDES := $(JNI_H_INCLUDE) \
+    $(LOCAL_PATH)/../jni \
     frameworks/base/core/jni/include \
     frameworks/base/include/media
 
+ifneq ($(TARGET_BUILD_VARIANT),user)
+    LOCAL_CFLAGS += -DFM_JNI_DEBUG
+endif
+
 LOCAL_SHARED_LIBRARIES := \
     libcutils \
     libdl \
@@ -31,8 +31,12 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define __CONFIG_FM_THS_H__
 
 #include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "FM_Const.h"
 #include "ConfFileParser.h"
+#include "FmHybridSrchList.h"
 
 #define MAX_GRPS 4
 #define MAX_SRCH_PARAMS 8
@@ -68,6 +72,13 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 const unsigned char MAX_HYBRID_SRCH_PARAMS = 2;
 
+#define FM_THS_PROFILE_MAGIC 0x50485446 /* "FTHP" */
+//Bump when the maps, the ranges or fm_ths_profile_set change
+#define FM_THS_PROFILE_VERSION 3
+//Profiles in a file, the default one included
+#define MAX_THS_PROFILES 8
+#define MAX_THS_PROFILE_NAME 16
+
 struct NAME_MAP
 {
    const char name[50];
@@ -165,19 +176,76 @@ static struct NAME_MAP HYBRD_SRCH_MAP[] =
    {"Sinrs", SINR_LIST},
 };
 
+//Validated contents of one profile of fm_srch_af_th.conf. The default
+//profile comes from the plain groups, e.g. [SEARCHTHRESHOLDS]; profile
+//"name" is the default one with what [SEARCHTHRESHOLDS.name] and the
+//other groups named so set on top of it.
+struct fm_ths_profile
+{
+    char name[MAX_THS_PROFILE_NAME];   //"" for the default profile
+    uint32_t grps;      //bit per PERFORMANCE_GRPS found in the file
+    uint32_t af_set;    //bit per PERFORMANCE_AF_PARAMS with a valid value
+    int32_t af[MAX_AF_PARAMS];
+    uint32_t srch_set;  //bit per PERFORMANCE_SRCH_PARAMS with a valid value
+    int32_t srch[MAX_SRCH_PARAMS];
+    uint32_t band_set;  //bit per BAND_CFG_PARAMS with a valid value
+    int32_t band[MAX_BAND_PARAMS];
+    uint32_t hybrd_cnt;
+    uint16_t hybrd_chans[MAX_HYBRID_SRCH_ENTRIES];  //as FmHybridSrchList holds them
+    int8_t hybrd_sinrs[MAX_HYBRID_SRCH_ENTRIES];
+};
+
+//All profiles of a file, as applied and as cached on disk.
+//Keyed by the conf file it was compiled from.
+struct fm_ths_profile_set
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t src_ino;
+    int64_t src_size;
+    int64_t src_mtime_ns;
+    uint32_t cnt;
+    fm_ths_profile profiles[MAX_THS_PROFILES];
+    uint32_t hash;      //FNV-1a of everything above
+};
+
 class ConfigFmThs {
    private:
           group_table *keyfile;
-          void set_srch_ths(UINT fd);
-          void set_af_ths(UINT fd);
-          unsigned int extract_comma_sep_freqs(char *freqs, unsigned int **freqs_arr, const char *str);
-          unsigned int extract_comma_sep_sinrs(char *sinrs, signed char **sinrs_arr, const char *str);
-          void set_hybrd_list(UINT fd);
-          void set_band_cfgs(UINT fd);
+          fm_ths_profile_set *set;
+          static pthread_mutex_t profiles_lock;
+          static fm_ths_profile_set *profiles;
+          static char active[MAX_THS_PROFILE_NAME];
+          static bool active_selected;
+          //Hybrid list of the active profile and what scans added to it
+          static FmHybridSrchList hybrd_list;
+          void compile_srch_ths(const char *grp, fm_ths_profile &p);
+          void compile_af_ths(const char *grp, fm_ths_profile &p);
+          void compile_hybrd_list(const char *grp, fm_ths_profile &p);
+          void compile_band_cfgs(const char *grp, fm_ths_profile &p);
+          void compile_grps(char **grps, bool named);
+          fm_ths_profile *get_profile(const char *name);
+          bool compile(const char *file, const struct stat &src);
+          bool load_profiles(const char *cache, const struct stat &src);
+          void store_profiles(const char *cache);
+          static int find_profile(const fm_ths_profile_set *s, const char *name);
+          static void apply_srch_ths(UINT fd, const fm_ths_profile &p);
+          static void apply_af_ths(UINT fd, const fm_ths_profile &p);
+          static void apply_hybrd_list(UINT fd, const fm_ths_profile &p);
+          static void apply_band_cfgs(UINT fd, const fm_ths_profile &p);
+          static void apply_profile(UINT fd, const fm_ths_profile &p);
    public:
           ConfigFmThs();
           ~ConfigFmThs();
-          void SetRxSearchAfThs(const char *file, UINT fd);
+          //Compiles every profile of file, or takes them from cache when
+          //it holds them for file as it is now, and applies the active one
+          void SetRxSearchAfThs(const char *file, UINT fd, const char *cache);
+          //Makes profile name ("" or NULL for the default) the active one
+          //and applies it to fd, from what the last load compiled
+          static int SelectProfile(UINT fd, const char *name);
+          //Feeds the n stations (kHz) a scan found into the hybrid list
+          //of the active profile, and sends it to fd when that changed it
+          static int UpdateHybridSrchList(UINT fd, const ULINT *khz, UINT n);
 };
 
 #endif //__CONFIG_FM_THS_H__
@@ -37,16 +37,16 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PROP_SET_SUCC 0
 
 #define MAX_VER_STR_LEN 40
-#define INIT_LOOP_CNT 45
 
 //Time in us
 #define INIT_WAIT_TIMEOUT 200000
 #define RDS_AVL_INT_WAIT_TIMEOUT 200000
-//Time in secs
-#define READY_EVENT_TIMEOUT 5
-#define SCAN_COMPL_TIMEOUT 1280
-#define TUNE_EVENT_TIMEOUT 2
-#define SEEK_COMPL_TIMEOUT 60
+//Time in ms, enforced by the event thread
+#define READY_EVENT_TIMEOUT_MS 5000
+#define DISABLED_EVENT_TIMEOUT_MS 5000
+#define SCAN_COMPL_TIMEOUT_MS 1280000
+#define TUNE_EVENT_TIMEOUT_MS 2000
+#define SEEK_COMPL_TIMEOUT_MS 60000
 #define FM_SCAN_CH_SIZE_MAX 25
 
 #define TUNE_MULT 16
@@ -130,6 +130,9 @@ const char *const CALIB_DATA_NAME = "/data/misc/fm/Riva_fm_cal";
 const char *const SOC_PATCH_DL_SCRPT = "fm_dl";
 const char *const FM_DEVICE_PATH = "/dev/radio0";
 const char *const FM_PERFORMANCE_PARAMS = "/etc/fm/fm_srch_af_th.conf";
+const char *const FM_PERFORMANCE_PARAMS_CACHE = "/data/misc/fm/fm_srch_af_th.bin";
+//Threshold profile used from power on, the default one when unset
+const char *const FM_THS_PROFILE_PROP = "persist.vendor.fm.ths_profile";
 
 const UINT V4L2_CTRL_CLASS_USER = 0x00980000;
 const UINT V4L2_CID_BASE = (V4L2_CTRL_CLASS_USER | 0x900);
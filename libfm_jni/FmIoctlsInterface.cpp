@@ -30,6 +30,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LOG_TAG "android_hardware_fm"
 
 #include "FmIoctlsInterface.h"
+#include "FmPerformanceParams.h"
+#include "FmPropertyWait.h"
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -40,6 +43,10 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <math.h>
 #include <utils/Log.h>
 
+bool FmIoctlsInterface::ext_ctrls_unsupported = false;
+pthread_mutex_t FmIoctlsInterface::tuner_lock = PTHREAD_MUTEX_INITIALIZER;
+struct fm_tuner_cache_t FmIoctlsInterface::tuner_cache[MAX_TUNER_CACHE];
+
 int FmIoctlsInterface :: start_fm_patch_dl
 (
     UINT fd
@@ -48,7 +55,6 @@ int FmIoctlsInterface :: start_fm_patch_dl
     int ret;
     int init_success = 0;
     char versionStr[MAX_VER_STR_LEN] = {'\0'};
-    char prop_value[PROPERTY_VALUE_MAX] = {'\0'};
     struct v4l2_capability cap;
 
     ALOGI("%s: start_fm_patch_dl = %d\n", __func__, fd);
@@ -75,15 +81,8 @@ int FmIoctlsInterface :: start_fm_patch_dl
             ret = property_set(SCRIPT_START_PROP, SOC_PATCH_DL_SCRPT);
             if(ret != PROP_SET_SUCC)
                return FM_FAILURE;
-            for(int i = 0; i < INIT_LOOP_CNT; i++) {
-                property_get(FM_INIT_PROP, prop_value, NULL);
-                if (strcmp(prop_value, "1") == 0) {
-                    init_success = 1;
-                    break;
-                }else {
-                    usleep(INIT_WAIT_TIMEOUT);
-                }
-            }
+            if(FmPropertyWait :: wait_for(FM_INIT_PROP, "1", FM_INIT_WAIT_MS) >= 0)
+                init_success = 1;
 #else
             ret = property_set(FM_INIT_PROP, "1");
             usleep(INIT_WAIT_TIMEOUT);
@@ -168,6 +167,7 @@ int  FmIoctlsInterface :: set_control
     int ret;
     struct v4l2_control control;
 
+    invalidate_ctrl(fd, id);
     control.value = val;
     control.id = id;
 
@@ -269,6 +269,7 @@ int  FmIoctlsInterface :: set_band
     tuner.rangehigh = (high * TUNE_MULT);
 
     ret = ioctl(fd, VIDIOC_S_TUNER, &tuner);
+    //set_control drops the cached limits with the region
     ret = set_control(fd, V4L2_CID_PRV_REGION, 0);
     if(ret < IOCTL_SUCC) {
         return FM_FAILURE;
@@ -283,6 +284,7 @@ int FmIoctlsInterface :: get_rmssi
 )
 {
     struct v4l2_tuner tuner;
+    UINT gen = tuner_gen(fd);
     int ret;
 
     tuner.index = 0;
@@ -292,6 +294,7 @@ int FmIoctlsInterface :: get_rmssi
         ret = FM_FAILURE;
     }else {
         rmssi = tuner.signal;
+        store_tuner(fd, tuner, gen);
         ret = FM_SUCCESS;
     }
     return ret;
@@ -305,9 +308,8 @@ int  FmIoctlsInterface :: get_upperband_limit
     int ret;
     struct v4l2_tuner tuner;
 
-    tuner.index = 0;
-    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
-    if(ret < IOCTL_SUCC) {
+    ret = get_tuner(fd, tuner);
+    if(ret != FM_SUCCESS) {
         return FM_FAILURE;
     }else {
         freq = (tuner.rangehigh / TUNE_MULT);
@@ -324,9 +326,8 @@ int  FmIoctlsInterface :: get_lowerband_limit
     int ret;
     struct v4l2_tuner tuner;
 
-    tuner.index = 0;
-    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
-    if(ret < IOCTL_SUCC) {
+    ret = get_tuner(fd, tuner);
+    if(ret != FM_SUCCESS) {
         return FM_FAILURE;
     }else {
         freq = (tuner.rangelow / TUNE_MULT);
@@ -342,17 +343,19 @@ int  FmIoctlsInterface :: set_audio_mode
 {
     int ret;
     struct v4l2_tuner tuner;
+    UINT gen = tuner_gen(fd);
 
-    tuner.index = 0;
-    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
-    if(ret < IOCTL_SUCC) {
+    ret = get_tuner(fd, tuner);
+    if(ret != FM_SUCCESS) {
         return FM_FAILURE;
     }else {
         tuner.audmode = mode;
         ret = ioctl(fd, VIDIOC_S_TUNER, &tuner);
         if(ret != IOCTL_SUCC) {
+            invalidate_tuner(fd);
             return FM_FAILURE;
         }else {
+            store_tuner(fd, tuner, gen);
             return FM_SUCCESS;
         }
     }
@@ -400,3 +403,212 @@ int FmIoctlsInterface :: set_ext_control
     }
 }
 
+FmCtrlBatch :: FmCtrlBatch
+(
+)
+{
+    clear();
+}
+
+void FmCtrlBatch :: clear
+(
+    void
+)
+{
+    memset(ctrls, 0, sizeof(ctrls));
+    count = 0;
+}
+
+int FmCtrlBatch :: add
+(
+    UINT id, int val
+)
+{
+    UINT i;
+
+    for(i = 0; i < count; i++) {
+        if(ctrls[i].id == id)
+            break;
+    }
+    if(i == MAX_BATCH_CTRLS) {
+        return FM_FAILURE;
+    }else {
+        ctrls[i].id = id;
+        ctrls[i].value = val;
+        if(i == count)
+            count++;
+        return FM_SUCCESS;
+    }
+}
+
+//Drivers that only take private controls through VIDIOC_S_CTRL fail the
+//batch; they get the controls one by one, and no more batches once the
+//one by one path has worked
+int FmIoctlsInterface :: set_controls
+(
+    UINT fd, FmCtrlBatch &batch
+)
+{
+    int ret;
+    bool no_ext_ctrls = false;
+    struct v4l2_ext_controls v4l2_ctls;
+
+    if(batch.count == 0)
+        return FM_SUCCESS;
+
+    for(UINT i = 0; i < batch.count; i++)
+        invalidate_ctrl(fd, batch.ctrls[i].id);
+
+    if(!ext_ctrls_unsupported) {
+        memset(&v4l2_ctls, 0, sizeof(v4l2_ctls));
+        //0 lets controls of different classes share the batch
+        v4l2_ctls.ctrl_class = 0;
+        v4l2_ctls.count = batch.count;
+        v4l2_ctls.controls = batch.ctrls;
+        ret = ioctl(fd, VIDIOC_S_EXT_CTRLS, &v4l2_ctls);
+        if(ret >= IOCTL_SUCC)
+            return FM_SUCCESS;
+        //error_idx >= count: the request itself was refused, not a control,
+        //whatever errno the driver picked for it
+        no_ext_ctrls = (v4l2_ctls.error_idx >= batch.count);
+        ALOGE("%s: VIDIOC_S_EXT_CTRLS failed at %u of %u\n", __func__,
+              v4l2_ctls.error_idx, batch.count);
+    }
+
+    ret = FM_SUCCESS;
+    for(UINT i = 0; i < batch.count; i++) {
+        if(set_control(fd, batch.ctrls[i].id, batch.ctrls[i].value) != FM_SUCCESS) {
+            ALOGE("%s: set control 0x%x failed\n", __func__, batch.ctrls[i].id);
+            ret = FM_FAILURE;
+        }
+    }
+    if((ret == FM_SUCCESS) && no_ext_ctrls) {
+        ALOGI("%s: no batched controls, using VIDIOC_S_CTRL\n", __func__);
+        ext_ctrls_unsupported = true;
+    }
+    return ret;
+}
+
+//Reads the current value of every control in the batch into it
+int FmIoctlsInterface :: get_controls
+(
+    UINT fd, FmCtrlBatch &batch
+)
+{
+    int ret;
+    long val;
+    struct v4l2_ext_controls v4l2_ctls;
+
+    if(batch.count == 0)
+        return FM_SUCCESS;
+
+    if(!ext_ctrls_unsupported) {
+        memset(&v4l2_ctls, 0, sizeof(v4l2_ctls));
+        v4l2_ctls.ctrl_class = 0;
+        v4l2_ctls.count = batch.count;
+        v4l2_ctls.controls = batch.ctrls;
+        ret = ioctl(fd, VIDIOC_G_EXT_CTRLS, &v4l2_ctls);
+        if(ret >= IOCTL_SUCC)
+            return FM_SUCCESS;
+    }
+
+    ret = FM_SUCCESS;
+    for(UINT i = 0; i < batch.count; i++) {
+        if(get_control(fd, batch.ctrls[i].id, val) == FM_SUCCESS) {
+            batch.ctrls[i].value = val;
+        }else {
+            ret = FM_FAILURE;
+        }
+    }
+    return ret;
+}
+
+//Direct mapped on the fd; the radio is normally the only fd in use
+int FmIoctlsInterface :: get_tuner
+(
+    UINT fd, struct v4l2_tuner &tuner
+)
+{
+    int ret;
+    UINT gen;
+    struct fm_tuner_cache_t *entry = &tuner_cache[fd % MAX_TUNER_CACHE];
+
+    pthread_mutex_lock(&tuner_lock);
+    if(entry->valid && (entry->fd == fd)) {
+        tuner = entry->tuner;
+        pthread_mutex_unlock(&tuner_lock);
+        return FM_SUCCESS;
+    }
+    gen = entry->gen;
+    pthread_mutex_unlock(&tuner_lock);
+
+    memset(&tuner, 0, sizeof(tuner));
+    tuner.index = 0;
+    ret = ioctl(fd, VIDIOC_G_TUNER, &tuner);
+    if(ret < IOCTL_SUCC) {
+        return FM_FAILURE;
+    }else {
+        store_tuner(fd, tuner, gen);
+        return FM_SUCCESS;
+    }
+}
+
+//Taken before a tuner ioctl, handed back to store_tuner with its result
+UINT FmIoctlsInterface :: tuner_gen
+(
+    UINT fd
+)
+{
+    UINT gen;
+
+    pthread_mutex_lock(&tuner_lock);
+    gen = tuner_cache[fd % MAX_TUNER_CACHE].gen;
+    pthread_mutex_unlock(&tuner_lock);
+    return gen;
+}
+
+//Dropped if the entry was invalidated since gen was taken
+void FmIoctlsInterface :: store_tuner
+(
+    UINT fd, const struct v4l2_tuner &tuner, UINT gen
+)
+{
+    struct fm_tuner_cache_t *entry = &tuner_cache[fd % MAX_TUNER_CACHE];
+
+    pthread_mutex_lock(&tuner_lock);
+    if(entry->gen == gen) {
+        entry->fd = fd;
+        entry->tuner = tuner;
+        entry->valid = true;
+    }
+    pthread_mutex_unlock(&tuner_lock);
+}
+
+void FmIoctlsInterface :: invalidate_tuner
+(
+    UINT fd
+)
+{
+    struct fm_tuner_cache_t *entry = &tuner_cache[fd % MAX_TUNER_CACHE];
+
+    pthread_mutex_lock(&tuner_lock);
+    if(entry->fd == fd)
+        entry->valid = false;
+    entry->gen++;
+    pthread_mutex_unlock(&tuner_lock);
+}
+
+//The region and the power state both reprogram the band, and may
+//reset what the SoC holds for the performance params
+void FmIoctlsInterface :: invalidate_ctrl
+(
+    UINT fd, UINT id
+)
+{
+    if((id == V4L2_CID_PRV_REGION) || (id == V4L2_CID_PRV_STATE)) {
+        invalidate_tuner(fd);
+        FmPerformanceParams::InvalidateShadow(fd);
+    }else {
+        FmPerformanceParams::InvalidateShadowCtrl(fd, id);
+    }
+}
@@ -31,6 +31,27 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define __FM_PERFORMANCE_PARAMS_H__
 
 #include "FM_Const.h"
+#include "FmIoctlsInterface.h"
+#include "FmHybridSrchList.h"
+#include <pthread.h>
+
+#define MAX_SHADOW_FDS 4
+#define MAX_SHADOW_CTRLS 15
+
+/*
+ * What the controller holds for the controls FmPerformanceParams writes,
+ * as far as this process knows. Filled from what was written and read
+ * back, dropped when the fd is (re)opened, the SoC is powered or the
+ * region changes, and per control on any other write.
+ */
+struct fm_perf_shadow_t {
+    bool valid;
+    UINT fd;
+    UINT known;     /* bit per SHADOW_CTRLS entry */
+    int values[MAX_SHADOW_CTRLS];
+    UINT hybrd_len;     /* 0 until a hybrid list was sent */
+    char hybrd[MAX_HYBRID_SRCH_CNT * 3 + 3];
+};
 
 #define MIN_BLEND_SINRHI -128
 #define MAX_BLEND_SINRHI  127
@@ -40,7 +61,23 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 class FmPerformanceParams
 {
       private:
+          FmCtrlBatch batch;
+          bool batching;
+          static pthread_mutex_t shadow_lock;
+          static struct fm_perf_shadow_t shadow[MAX_SHADOW_FDS];
+          signed char set_control(UINT fd, UINT id, int val);
+          static struct fm_perf_shadow_t *get_shadow(UINT fd);
+          static bool shadow_holds(UINT fd, UINT id, int val);
+          static void store_shadow(UINT fd, FmCtrlBatch &ctrls);
+          static void seed_shadow(UINT fd, FmCtrlBatch &ctrls);
       public:
+          FmPerformanceParams();
+          //Set* calls in between only queue their control
+          void BeginBatch(void);
+          //Writes only the queued controls the controller does not hold yet
+          signed char CommitBatch(UINT fd);
+          static void InvalidateShadow(UINT fd);
+          static void InvalidateShadowCtrl(UINT fd, UINT id);
           signed char SetBand(UINT fd, unsigned char band);
           signed char SetEmphsis(UINT fd, unsigned char emph);
           signed char SetChannelSpacing(UINT fd, unsigned char spacing);
@@ -55,7 +92,8 @@ class FmPerformanceParams
           signed char SetIntfLowTh(UINT fd, unsigned char th);
           signed char SetIntfHighTh(UINT fd, unsigned char th);
           signed char SetSinrFinalStage(UINT fd, signed char th);
-          signed char SetHybridSrchList(UINT fd, unsigned int *freqs, signed char *sinrs, unsigned int n);
+          //Sends what list selects for the band and spacing fd is set to
+          signed char SetHybridSrchList(UINT fd, const FmHybridSrchList &list);
           signed char SetBlendSinr(UINT fd, signed char bsinr);
           signed char SetBlendRmssi(UINT fd, signed char brmssi);
 
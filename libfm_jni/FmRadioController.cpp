@@ -32,6 +32,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <errno.h>
 #include <fcntl.h>
 #include <utils/Log.h>
 #include <cutils/properties.h>
@@ -40,6 +41,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FmRadioController.h"
 #include "FmIoctlsInterface.h"
 #include "ConfigFmThs.h"
+#include "FmPerformanceParams.h"
 #include <linux/videodev2.h>
 
 //Reset all variables to default value
@@ -59,14 +61,10 @@ FmRadioController :: FmRadioController
     is_rt_event_received = false;
     is_af_jump_received = false;
     mutex_fm_state = PTHREAD_MUTEX_INITIALIZER;
-    mutex_seek_compl_cond = PTHREAD_MUTEX_INITIALIZER;
-    mutex_scan_compl_cond = PTHREAD_MUTEX_INITIALIZER;
-    mutex_tune_compl_cond = PTHREAD_MUTEX_INITIALIZER;
-    mutex_turn_on_cond = PTHREAD_MUTEX_INITIALIZER;
-    turn_on_cond = PTHREAD_COND_INITIALIZER;
-    seek_compl_cond = PTHREAD_COND_INITIALIZER;
-    scan_compl_cond = PTHREAD_COND_INITIALIZER;
-    tune_compl_cond = PTHREAD_COND_INITIALIZER;
+    mutex_wait = PTHREAD_MUTEX_INITIALIZER;
+    wait_cond = PTHREAD_COND_INITIALIZER;
+    memset(waits, 0, sizeof(waits));
+    waits_open = false;
     event_listener_thread = 0;
     fd_driver = -1;
     FmIoct = new FmIoctlsInterface();
@@ -84,8 +82,7 @@ FmRadioController :: ~FmRadioController
                         V4L2_CID_PRV_STATE, FM_DEV_NONE);
     }
     if(event_listener_thread != 0) {
-        event_listener_canceled = true;
-        pthread_join(event_listener_thread, NULL);
+        stop_event_listener();
     }
 }
 
@@ -93,13 +90,15 @@ int FmRadioController ::open_dev()
 {
     int ret = FM_SUCCESS;
 
-    fd_driver = open(FM_DEVICE_PATH, O_RDONLY, O_NONBLOCK);
+    fd_driver = open(FM_DEVICE_PATH, O_RDONLY | O_NONBLOCK);
 
     if (fd_driver < 0) {
         ALOGE("%s failed, [fd=%d] %s\n", __func__, fd_driver, FM_DEVICE_PATH);
         return FM_FAILURE;
     }
 
+    FmIoctlsInterface::invalidate_tuner(fd_driver);
+    FmPerformanceParams::InvalidateShadow(fd_driver);
     ALOGD("%s, [fd=%d] \n", __func__, fd_driver);
     return ret;
 }
@@ -116,20 +115,144 @@ int FmRadioController ::close_dev()
     return ret;
 }
 
-struct timespec FmRadioController :: set_time_out
+static uint64_t now_ms
 (
-    int secs
+    void
 )
 {
     struct timespec ts;
-    struct timeval tp;
 
-    gettimeofday(&tp, NULL);
-    ts.tv_sec = tp.tv_sec;
-    ts.tv_nsec = tp.tv_usec * 1000;
-    ts.tv_sec += secs;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//While closed, i.e. without an event thread to complete
+//them, waits complete as soon as they are armed
+void FmRadioController :: set_waits_open
+(
+    bool open
+)
+{
+    pthread_mutex_lock(&mutex_wait);
+    waits_open = open;
+    if (!open) {
+        for (int i = 0; i < WAIT_OP_MAX; i++) {
+            if (waits[i].armed && !waits[i].done) {
+                waits[i].done = true;
+                waits[i].result = FM_FAILURE;
+            }
+        }
+        pthread_cond_broadcast(&wait_cond);
+    }
+    pthread_mutex_unlock(&mutex_wait);
+}
+
+//Arm before issuing the command that leads to the event,
+//so an early event is not lost
+void FmRadioController :: arm_wait
+(
+    int op, int timeout_ms
+)
+{
+    pthread_mutex_lock(&mutex_wait);
+    waits[op].armed = true;
+    waits[op].done = !waits_open;
+    waits[op].result = FM_FAILURE;
+    waits[op].deadline_ms = now_ms() + timeout_ms;
+    pthread_mutex_unlock(&mutex_wait);
+    //have the event thread pick up the new deadline
+    event_loop.wake();
+}
+
+//Returns the result the event thread completed the wait with,
+//ETIMEDOUT when its deadline passed first
+int FmRadioController :: wait_done
+(
+    int op
+)
+{
+    int result;
+
+    pthread_mutex_lock(&mutex_wait);
+    while (waits[op].armed && !waits[op].done)
+        pthread_cond_wait(&wait_cond, &mutex_wait);
+    result = waits[op].result;
+    waits[op].armed = false;
+    pthread_mutex_unlock(&mutex_wait);
+    return result;
+}
+
+void FmRadioController :: cancel_wait
+(
+    int op
+)
+{
+    pthread_mutex_lock(&mutex_wait);
+    waits[op].armed = false;
+    pthread_mutex_unlock(&mutex_wait);
+}
+
+void FmRadioController :: complete_wait
+(
+    int op, int result
+)
+{
+    pthread_mutex_lock(&mutex_wait);
+    if (waits[op].armed && !waits[op].done) {
+        waits[op].done = true;
+        waits[op].result = result;
+        pthread_cond_broadcast(&wait_cond);
+    }
+    pthread_mutex_unlock(&mutex_wait);
+}
+
+void FmRadioController :: complete_all_waits
+(
+    int result
+)
+{
+    for (int i = 0; i < WAIT_OP_MAX; i++)
+        complete_wait(i, result);
+}
+
+//Times out the waits whose deadline passed and returns the ms
+//left to the nearest remaining one, -1 if none
+int FmRadioController :: next_wait_timeout
+(
+    void
+)
+{
+    uint64_t now = now_ms();
+    int timeout = -1;
+
+    pthread_mutex_lock(&mutex_wait);
+    for (int i = 0; i < WAIT_OP_MAX; i++) {
+        if (!waits[i].armed || waits[i].done)
+            continue;
+        if (waits[i].deadline_ms <= now) {
+            ALOGE("%s: wait %d timed out\n", __func__, i);
+            waits[i].done = true;
+            waits[i].result = ETIMEDOUT;
+            pthread_cond_broadcast(&wait_cond);
+        } else if (timeout < 0 || waits[i].deadline_ms - now < (uint64_t)timeout) {
+            timeout = waits[i].deadline_ms - now;
+        }
+    }
+    pthread_mutex_unlock(&mutex_wait);
+    return timeout;
+}
 
-    return ts;
+void FmRadioController :: stop_event_listener
+(
+    void
+)
+{
+    event_listener_canceled = true;
+    event_loop.wake();
+    pthread_join(event_listener_thread, NULL);
+    event_loop.release();
+    event_listener_thread = 0;
+    event_listener_canceled = false;
 }
 
 //Get current tuned frequency
@@ -159,7 +282,6 @@ long FmRadioController :: GetChannel
 int FmRadioController ::Pwr_Up(int freq)
 {
     int ret = FM_SUCCESS;
-    struct timespec ts;
     ConfigFmThs thsObj;
     char value[PROPERTY_VALUE_MAX] = {'\0'};
 
@@ -176,6 +298,9 @@ int FmRadioController ::Pwr_Up(int freq)
 
     if (cur_fm_state == FM_OFF) {
         ALOGD("%s: cur_fm_state = %d\n", __func__, cur_fm_state);
+        //listener left over from an unexpected disabled event
+        if (event_listener_thread != 0)
+            stop_event_listener();
         if (strcmp(value, "rome") != 0) {
             ret = FmIoctlsInterface::start_fm_patch_dl(fd_driver);
             if (ret != FM_SUCCESS) {
@@ -186,20 +311,22 @@ int FmRadioController ::Pwr_Up(int freq)
             }
         }
         if (event_listener_thread == 0) {
+            if (event_loop.open(fd_driver) < 0) {
+                close_dev();
+                set_fm_state(FM_OFF);
+                return FM_FAILURE;
+            }
+            set_waits_open(true);
             ret = pthread_create(&event_listener_thread, NULL,
                                               handle_events, this);
             if (ret == 0) {
-                ALOGI("Lock the mutex for FM turn on cond\n");
-                pthread_mutex_lock(&mutex_turn_on_cond);
-                ts = set_time_out(READY_EVENT_TIMEOUT);
+                arm_wait(WAIT_TURN_ON, READY_EVENT_TIMEOUT_MS);
                 ret = FmIoctlsInterface::set_control(fd_driver,
                                              V4L2_CID_PRV_STATE, FM_RX);
                 if (ret == FM_SUCCESS) {
                     ALOGI("Waiting for timedout or FM on\n");
-                    pthread_cond_timedwait(&turn_on_cond,
-                                       &mutex_turn_on_cond, &ts);
-                    ALOGI("Unlocked mutex & timedout or condition satisfied\n");
-                    pthread_mutex_unlock(&mutex_turn_on_cond);
+                    wait_done(WAIT_TURN_ON);
+                    ALOGI("Timedout or FM on\n");
                     if (cur_fm_state == FM_ON) {//after READY event
                         ret = SetBand(BAND_87500_108000);
                         if (ret != FM_SUCCESS) {
@@ -219,7 +346,8 @@ int FmRadioController ::Pwr_Up(int freq)
                             ret = FM_FAILURE;
                             goto exit;
                         }
-                        thsObj.SetRxSearchAfThs(FM_PERFORMANCE_PARAMS, fd_driver);
+                        thsObj.SetRxSearchAfThs(FM_PERFORMANCE_PARAMS, fd_driver,
+                                                 FM_PERFORMANCE_PARAMS_CACHE);
                         SetStereo();
                         ret = TuneChannel(freq);
                         if (ret != FM_SUCCESS) {
@@ -241,13 +369,15 @@ int FmRadioController ::Pwr_Up(int freq)
                     }
                 } else {
                     ALOGE("Set FM on control failed\n");
-                    pthread_mutex_unlock(&mutex_turn_on_cond);
-                    ALOGI("Unlocked the FM on cond mutex\n");
+                    cancel_wait(WAIT_TURN_ON);
                     ret = FM_FAILURE;
                     goto close_fd;
                 }
             } else {
                 ALOGE("FM event listener thread failed: %d\n", ret);
+                event_listener_thread = 0;
+                set_waits_open(false);
+                event_loop.release();
                 set_fm_state(FM_OFF);
                 return FM_FAILURE;
             }
@@ -265,9 +395,9 @@ exit:
     FmIoctlsInterface::set_control(fd_driver,
                                      V4L2_CID_PRV_STATE, FM_DEV_NONE);
 close_fd:
-    event_listener_canceled = true;
-    pthread_join(event_listener_thread, NULL);
-    close(fd_driver);
+    stop_event_listener();
+    if (fd_driver >= 0)
+        close(fd_driver);
     fd_driver = -1;
     set_fm_state(FM_OFF);
 
@@ -282,13 +412,17 @@ int FmRadioController ::Pwr_Down()
     if((cur_fm_state != FM_OFF)) {
         Stop_Scan_Seek();
         set_fm_state(FM_OFF_IN_PROGRESS);
-        FmIoctlsInterface::set_control(fd_driver,
-                        V4L2_CID_PRV_STATE, FM_DEV_NONE);
+        arm_wait(WAIT_TURN_OFF, DISABLED_EVENT_TIMEOUT_MS);
+        if (FmIoctlsInterface::set_control(fd_driver,
+                        V4L2_CID_PRV_STATE, FM_DEV_NONE) == FM_SUCCESS) {
+            wait_done(WAIT_TURN_OFF);
+        } else {
+            cancel_wait(WAIT_TURN_OFF);
+        }
     }
     if(event_listener_thread != 0) {
         ALOGD("%s, event_listener_thread cancelled\n", __func__);
-        event_listener_canceled = true;
-        pthread_join(event_listener_thread, NULL);
+        stop_event_listener();
     }
     ALOGD("%s, [ret=%d]\n", __func__, ret);
     return ret;
@@ -302,20 +436,18 @@ int FmRadioController :: TuneChannel
 )
 {
     int ret = FM_SUCCESS;
-    struct timespec ts;
 
     if((cur_fm_state == FM_ON) &&
         (freq > 0)) {
         set_fm_state(FM_TUNE_IN_PROGRESS);
+        arm_wait(WAIT_TUNE, TUNE_EVENT_TIMEOUT_MS);
         ret = FmIoctlsInterface::set_freq(fd_driver,
                                              freq);
         if(ret == FM_SUCCESS) {
            ALOGI("FM set frequency command set successfully\n");
-           pthread_mutex_lock(&mutex_tune_compl_cond);
-           ts = set_time_out(TUNE_EVENT_TIMEOUT);
-           ret = pthread_cond_timedwait(&tune_compl_cond, &mutex_tune_compl_cond, &ts);
-           pthread_mutex_unlock(&mutex_tune_compl_cond);
+           ret = wait_done(WAIT_TUNE);
         }else {
+           cancel_wait(WAIT_TUNE);
            if((cur_fm_state != FM_OFF)) {
               set_fm_state(FM_ON);
            }
@@ -332,7 +464,6 @@ int FmRadioController :: Seek(int dir)
 {
     int ret = 0;
     int freq = -1;
-    struct timespec ts;
 
     if (cur_fm_state != FM_ON) {
         ALOGE("%s error Fm state: %d\n", __func__, cur_fm_state);
@@ -355,6 +486,7 @@ int FmRadioController :: Seek(int dir)
         return FM_FAILURE;
     }
 
+    arm_wait(WAIT_SEEK, SEEK_COMPL_TIMEOUT_MS);
     if (dir == 1) {
         ret = FmIoctlsInterface::start_search(fd_driver,
                                                      SEARCH_UP);
@@ -364,13 +496,11 @@ int FmRadioController :: Seek(int dir)
     }
 
     if (ret != FM_SUCCESS) {
+        cancel_wait(WAIT_SEEK);
         set_fm_state(FM_ON);
         return FM_FAILURE;
     }
-    pthread_mutex_lock(&mutex_seek_compl_cond);
-    ts = set_time_out(SEEK_COMPL_TIMEOUT);
-    ret = pthread_cond_timedwait(&seek_compl_cond, &mutex_seek_compl_cond, &ts);
-    pthread_mutex_unlock(&mutex_seek_compl_cond);
+    wait_done(WAIT_SEEK);
     if ((cur_fm_state != SEEK_IN_PROGRESS) && !seek_scan_canceled) {
         ALOGI("Seek completed without timeout\n");
         freq = GetChannel();
@@ -649,6 +779,7 @@ int FmRadioController :: GetStationList
     ULINT lowBand, highBand;
     int station_num = 0;
     int stationList[FM_RX_SRCHLIST_MAX_STATIONS];
+    ULINT found[STD_BUF_SIZE / NO_OF_BYTES_EACH_FREQ];
     int tmpFreqByte1=0;
     int tmpFreqByte2=0;
     int freq = 0;
@@ -694,10 +825,12 @@ int FmRadioController :: GetStationList
               ALOGI("Frequency out of band limits");
         } else {
             scan_tbl[j] = (real_freq/SRCH_DIV);
+            found[j] = real_freq;
             ALOGI(" scan_tbl: %d", scan_tbl[j]);
             j++;
         }
     }
+    ConfigFmThs::UpdateHybridSrchList(fd_driver, found, j);
     return FM_SUCCESS;
 }
 
@@ -707,7 +840,6 @@ int FmRadioController ::ScanList
 )
 {
     int ret;
-    struct timespec ts;
 
     /* Check current state of FM device */
     if (cur_fm_state == FM_ON) {
@@ -725,18 +857,17 @@ int FmRadioController ::ScanList
             set_fm_state(FM_ON);
             return FM_FAILURE;
         }
+        arm_wait(WAIT_SCAN, SCAN_COMPL_TIMEOUT_MS);
         ret = FmIoctlsInterface::start_search(fd_driver,
                                                      SEARCH_UP);
         if (ret != FM_SUCCESS) {
+            cancel_wait(WAIT_SCAN);
             set_fm_state(FM_ON);
             return FM_FAILURE;
         }
-        pthread_mutex_lock(&mutex_scan_compl_cond);
-        ts = set_time_out(SCAN_COMPL_TIMEOUT);
         ALOGI("Wait for Scan Timeout or scan complete");
-        ret = pthread_cond_timedwait(&scan_compl_cond, &mutex_scan_compl_cond, &ts);
+        ret = wait_done(WAIT_SCAN);
         ALOGI("Scan complete or timedout");
-        pthread_mutex_unlock(&mutex_scan_compl_cond);
         if (cur_fm_state == FM_ON && !seek_scan_canceled) {
             GetStationList(scan_tbl, max_cnt);
         } else {
@@ -977,6 +1108,24 @@ int FmRadioController :: SetChannelSpacing
     return ret;
 }
 
+//switch the search/AF thresholds to a named profile
+int FmRadioController :: SetPerformanceProfile
+(
+    const char *name
+)
+{
+    int ret;
+
+    if ((cur_fm_state != FM_OFF) &&
+        (cur_fm_state != FM_ON_IN_PROGRESS)) {
+        ret = ConfigFmThs::SelectProfile(fd_driver, name);
+    } else {
+        ALOGE("FM is not in proper state to set the threshold profile\n");
+        ret = FM_FAILURE;
+    }
+    return ret;
+}
+
 int FmRadioController :: SetStereo
 (
 )
@@ -1070,13 +1219,30 @@ void* FmRadioController :: handle_events
 )
 {
     int bytesread;
+    int ret;
     char event_buff[STD_BUF_SIZE];
     bool status = true;
     FmRadioController *obj_p = static_cast<FmRadioController*>(arg);
 
     while(status && !obj_p->event_listener_canceled) {
+        ret = obj_p->event_loop.wait(obj_p->next_wait_timeout());
+        if (ret < 0) {
+            break;
+        } else if (ret != FmEventLoop::WAIT_RADIO) {
+            //timeout or wake up, deadlines are redone above
+            continue;
+        }
         bytesread = FmIoctlsInterface::get_buffer(obj_p->fd_driver,
                       event_buff, STD_BUF_SIZE, EVENT_IND);
+        if (bytesread < 0) {
+            if (errno == EAGAIN) {
+                obj_p->event_loop.radio_idle();
+            } else if (errno != EINTR) {
+                ALOGE("%s: event read failed: %d\n", __func__, errno);
+                break;
+            }
+            continue;
+        }
         for(int i = 0; i < bytesread; i++) {
             status = obj_p->process_radio_events(event_buff[i]);
             if(status == false) {
@@ -1084,6 +1250,7 @@ void* FmRadioController :: handle_events
             }
         }
     }
+    obj_p->set_waits_open(false);
     return NULL;
 }
 
@@ -1119,10 +1286,8 @@ void FmRadioController :: handle_enabled_event
      if (strcmp(value, "rome") != 0) {
          FmIoctlsInterface::set_calibration(fd_driver);
      }
-     pthread_mutex_lock(&mutex_turn_on_cond);
      set_fm_state(FM_ON);
-     pthread_cond_broadcast(&turn_on_cond);
-     pthread_mutex_unlock(&mutex_turn_on_cond);
+     complete_wait(WAIT_TURN_ON, FM_SUCCESS);
 }
 
 void FmRadioController :: handle_tuned_event
@@ -1143,16 +1308,12 @@ void FmRadioController :: handle_tuned_event
             }
             break;
          case FM_TUNE_IN_PROGRESS:
-            pthread_mutex_lock(&mutex_tune_compl_cond);
             set_fm_state(FM_ON);
-            pthread_cond_broadcast(&tune_compl_cond);
-            pthread_mutex_unlock(&mutex_tune_compl_cond);
+            complete_wait(WAIT_TUNE, FM_SUCCESS);
             break;
          case SEEK_IN_PROGRESS:
-            pthread_mutex_lock(&mutex_seek_compl_cond);
             set_fm_state(FM_ON);
-            pthread_cond_broadcast(&seek_compl_cond);
-            pthread_mutex_unlock(&mutex_seek_compl_cond);
+            complete_wait(WAIT_SEEK, FM_SUCCESS);
             break;
          case SCAN_IN_PROGRESS:
             break;
@@ -1265,10 +1426,8 @@ void FmRadioController :: handle_srch_list_event
 {
     ALOGI("Got srch list event\n");
     if (cur_fm_state == SCAN_IN_PROGRESS) {
-        pthread_mutex_lock(&mutex_scan_compl_cond);
         set_fm_state(FM_ON);
-        pthread_cond_broadcast(&scan_compl_cond);
-        pthread_mutex_unlock(&mutex_scan_compl_cond);
+        complete_wait(WAIT_SCAN, FM_SUCCESS);
     }
 }
 
@@ -1319,21 +1478,12 @@ void FmRadioController :: handle_disabled_event
      }
 
      set_fm_state(FM_OFF);
+     event_loop.release();
      close(fd_driver);
      fd_driver = -1;
 
-     //allow tune function to exit
-     pthread_mutex_lock(&mutex_tune_compl_cond);
-     pthread_cond_broadcast(&tune_compl_cond);
-     pthread_mutex_unlock(&mutex_tune_compl_cond);
-     //allow scan function to exit
-     pthread_mutex_lock(&mutex_scan_compl_cond);
-     pthread_cond_broadcast(&scan_compl_cond);
-     pthread_mutex_unlock(&mutex_scan_compl_cond);
-     //Allow seek function to exit
-     pthread_mutex_lock(&mutex_seek_compl_cond);
-     pthread_cond_broadcast(&seek_compl_cond);
-     pthread_mutex_unlock(&mutex_seek_compl_cond);
+     //allow tune, seek, scan and power down to exit
+     complete_all_waits(FM_SUCCESS);
 }
 
 void FmRadioController :: handle_rds_grp_mask_req_event
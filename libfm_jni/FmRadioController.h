@@ -31,7 +31,30 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define __FM_RADIO_CTRL_H__
 
 #include <pthread.h>
+#include <stdint.h>
 #include <ctime>
+#include "FmEventLoop.h"
+
+/*
+ * Completions the API calls block on. The event thread completes them
+ * from the matching driver event, or with a timeout once their deadline
+ * passes; it owns every deadline so the callers wait without one.
+ */
+enum fm_wait_op {
+    WAIT_TURN_ON,
+    WAIT_TURN_OFF,
+    WAIT_TUNE,
+    WAIT_SEEK,
+    WAIT_SCAN,
+    WAIT_OP_MAX
+};
+
+struct fm_wait_t {
+    bool armed;
+    bool done;
+    int result;
+    uint64_t deadline_ms;
+};
 
 class FmRadioController
 {
@@ -45,14 +68,11 @@ class FmRadioController
         bool is_af_jump_received = false;
         bool event_listener_canceled;
         pthread_mutex_t mutex_fm_state;
-        pthread_mutex_t mutex_turn_on_cond;
-        pthread_mutex_t mutex_seek_compl_cond;
-        pthread_mutex_t mutex_scan_compl_cond;
-        pthread_mutex_t mutex_tune_compl_cond;
-        pthread_cond_t turn_on_cond;
-        pthread_cond_t seek_compl_cond;
-        pthread_cond_t scan_compl_cond;
-        pthread_cond_t tune_compl_cond;
+        pthread_mutex_t mutex_wait;
+        pthread_cond_t wait_cond;
+        struct fm_wait_t waits[WAIT_OP_MAX];
+        bool waits_open;
+        FmEventLoop event_loop;
         char rds_enabled;
         long int prev_freq;
         int fd_driver;
@@ -81,7 +101,14 @@ class FmRadioController
         void handle_ert_event(void);
         void handle_af_jmp_event(void);
         void set_fm_state(int state);
-        struct timespec set_time_out(int secs);
+        void set_waits_open(bool open);
+        void arm_wait(int op, int timeout_ms);
+        int wait_done(int op);
+        void cancel_wait(int op);
+        void complete_wait(int op, int result);
+        void complete_all_waits(int result);
+        int next_wait_timeout(void);
+        void stop_event_listener(void);
         int GetStationList(uint16_t *scan_tbl, int *max_cnt);
         int EnableRDS(void);
         int DisableRDS(void);
@@ -115,6 +142,7 @@ class FmRadioController
        int Set_mute(bool mute);
        int SetBand(long);
        int SetChannelSpacing(long);
+       int SetPerformanceProfile(const char *name);
        int Stop_Scan_Seek(void);
        int Turn_On_Off_Rds(bool onoff);
        int Antenna_Switch(int antenna);
@@ -33,6 +33,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "JNIHelp.h"
 #include "android_runtime/AndroidRuntime.h"
 #include <utils/Log.h>
+#include "FmJniRuntime.h"
 #include "FmRadioController.h"
 #include "FM_Const.h"
 
@@ -363,7 +364,7 @@ static JNINativeMethod gMethods[] = {
 
 int register_android_hardware_fm(JNIEnv* env)
 {
-        return jniRegisterNativeMethods(env, classPathNameFM, gMethods, NELEM(gMethods));
+        return FmJniRuntime::register_natives(env, classPathNameFM, gMethods, NELEM(gMethods));
 }
 
 jint JNI_OnLoad(JavaVM *jvm, void *reserved)
@@ -372,7 +373,7 @@ jint JNI_OnLoad(JavaVM *jvm, void *reserved)
    int status;
    ALOGI("FM: loading FM-JNI\n");
 
-   if (jvm->GetEnv((void **)&e, JNI_VERSION_1_6)) {
+   if ((e = FmJniRuntime::on_load(jvm)) == NULL) {
        ALOGE("JNI version mismatch error");
        return JNI_ERR;
    }
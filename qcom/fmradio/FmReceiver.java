@@ -2203,6 +2203,19 @@ public class FmReceiver extends FmTransceiver
       return mControl.setBlendRmssi(sFd, rmssiHi);
    }
 
+   /*
+    * Switches the search/AF thresholds to a named profile from the
+    * performance params file, null or "" selects the default one.
+    */
+   public boolean setPerformanceProfile(String name) {
+      int state = getFMState();
+      if (state == FMState_Srch_InProg) {
+          Log.d(TAG, "setPerformanceProfile: Device currently busy in executing another command.");
+          return false;
+      }
+      return (FmReceiverJNI.setPerformanceProfileNative(sFd, name) == 0);
+   }
+
    /*==============================================================
    FUNCTION:  setRdsGroupOptions
    ==============================================================*/
@@ -28,6 +28,7 @@
 
 package qcom.fmradio;
 import android.util.Log;
+import java.nio.ByteBuffer;
 import java.util.Arrays;
 import java.lang.Runnable;
 import qcom.fmradio.FmReceiver;
@@ -61,21 +62,102 @@ class FmReceiverJNI {
     final private FmRxEvCallbacks mCallback;
     static private final int STD_BUF_SIZE = 256;
     static private byte[] mRdsBuffer = new byte[STD_BUF_SIZE];
-
-    public static  byte[]  getPsBuffer(byte[] buff) {
+    static private int mRdsLength = STD_BUF_SIZE;
+
+    /* Record types of eventBatchCallback, as in android_hardware_fm.cpp */
+    static private final int EVT_BATCH_PS = 1;
+    static private final int EVT_BATCH_RT = 2;
+    static private final int EVT_BATCH_ERT = 3;
+    static private final int EVT_BATCH_RT_PLUS = 4;
+    static private final int EVT_BATCH_AF_LIST = 5;
+    static private final int EVT_BATCH_ECC = 6;
+    static private final int EVT_BATCH_SRCH_LIST = 7;
+    static private final int EVT_REC_HDR = 4;
+    static private final int EVT_REC_MAX = 3 + 255;
+
+    public static synchronized byte[] getPsBuffer(byte[] buff) {
         Log.d(TAG, "getPsBuffer enter");
-        buff = Arrays.copyOf(mRdsBuffer, mRdsBuffer.length);
+        buff = Arrays.copyOf(mRdsBuffer, mRdsLength);
         Log.d(TAG, "getPsBuffer exit");
         return buff;
     }
 
+    private static synchronized void setRdsBuffer(byte[] data) {
+        mRdsBuffer = Arrays.copyOf(data, data.length);
+        mRdsLength = data.length;
+    }
+
+    /* A copy, the handlers may read it after the next record is dispatched */
+    private static synchronized void setRdsBuffer(ByteBuffer buf, int offset, int len) {
+        byte[] rec = new byte[len];
+
+        buf.position(offset);
+        buf.get(rec, 0, len);
+        mRdsBuffer = rec;
+        mRdsLength = len;
+    }
+
+    /**
+     * Called once per batch of RDS and search list events instead of the
+     * per event callbacks. buf is a direct buffer owned by the native side
+     * and holds len bytes of {type, 0, length lo, length hi, payload}
+     * records; it is only valid during this call.
+     */
+    public void eventBatchCallback(ByteBuffer buf, int len) {
+        int pos = 0;
+
+        while (pos + EVT_REC_HDR <= len) {
+            int type = buf.get(pos) & 0xFF;
+            int recLen = (buf.get(pos + 2) & 0xFF) | ((buf.get(pos + 3) & 0xFF) << 8);
+
+            pos += EVT_REC_HDR;
+            if (recLen > EVT_REC_MAX || pos + recLen > len) {
+                Log.e(TAG, "eventBatchCallback: bad record " + type + " len " + recLen);
+                return;
+            }
+            switch (type) {
+            case EVT_BATCH_PS:
+                setRdsBuffer(buf, pos, recLen);
+                FmReceiver.mCallback.FmRxEvRdsPsInfo();
+                break;
+            case EVT_BATCH_RT:
+                setRdsBuffer(buf, pos, recLen);
+                FmReceiver.mCallback.FmRxEvRdsRtInfo();
+                break;
+            case EVT_BATCH_ERT:
+                setRdsBuffer(buf, pos, recLen);
+                FmReceiver.mCallback.FmRxEvERTInfo();
+                break;
+            case EVT_BATCH_RT_PLUS:
+                setRdsBuffer(buf, pos, recLen);
+                FmReceiver.mCallback.FmRxEvRTPlus();
+                break;
+            case EVT_BATCH_AF_LIST:
+                setRdsBuffer(buf, pos, recLen);
+                FmReceiver.mCallback.FmRxEvRdsAfInfo();
+                break;
+            case EVT_BATCH_ECC:
+                setRdsBuffer(buf, pos, recLen);
+                FmReceiver.mCallback.FmRxEvECCInfo();
+                break;
+            case EVT_BATCH_SRCH_LIST:
+                srchListCallback(null);
+                break;
+            default:
+                Log.e(TAG, "eventBatchCallback: unknown record " + type);
+                break;
+            }
+            pos += recLen;
+        }
+    }
+
     public void AflistCallback(byte[] aflist) {
         Log.e(TAG, "AflistCallback enter " );
         if (aflist == null) {
             Log.e(TAG, "aflist null return  ");
             return;
         }
-        mRdsBuffer = Arrays.copyOf(aflist, aflist.length);
+        setRdsBuffer(aflist);
         FmReceiver.mCallback.FmRxEvRdsAfInfo();
         Log.e(TAG, "AflistCallback exit " );
     }
@@ -140,7 +222,7 @@ class FmReceiverJNI {
             Log.e(TAG, "psInfo null return  ");
             return;
         }
-        mRdsBuffer = Arrays.copyOf(rtplus, rtplus.length);
+        setRdsBuffer(rtplus);
         FmReceiver.mCallback.FmRxEvRTPlus();
         Log.d(TAG, "RtPlusCallback exit " );
     }
@@ -151,7 +233,7 @@ class FmReceiverJNI {
             Log.e(TAG, "psInfo null return  ");
             return;
         }
-        mRdsBuffer = Arrays.copyOf(rt, rt.length);
+        setRdsBuffer(rt);
         FmReceiver.mCallback.FmRxEvRdsRtInfo();
         Log.d(TAG, "RtCallback exit " );
     }
@@ -162,7 +244,7 @@ class FmReceiverJNI {
             Log.e(TAG, "ERT null return  ");
             return;
         }
-        mRdsBuffer = Arrays.copyOf(ert, ert.length);
+        setRdsBuffer(ert);
         FmReceiver.mCallback.FmRxEvERTInfo();
         Log.d(TAG, "RtCallback exit " );
     }
@@ -173,7 +255,7 @@ class FmReceiverJNI {
             Log.e(TAG, "ECC null return  ");
             return;
         }
-        mRdsBuffer = Arrays.copyOf(ecc, ecc.length);
+        setRdsBuffer(ecc);
         FmReceiver.mCallback.FmRxEvECCInfo();
         Log.i(TAG, "EccCallback exit " );
     }
@@ -185,7 +267,7 @@ class FmReceiverJNI {
             return;
         }
         Log.e(TAG, "length =  " +psInfo.length);
-        mRdsBuffer = Arrays.copyOf(psInfo, psInfo.length);
+        setRdsBuffer(psInfo);
         FmReceiver.mCallback.FmRxEvRdsPsInfo();
         Log.d(TAG, "PsInfoCallback exit");
     }
@@ -554,5 +636,25 @@ class FmReceiverJNI {
      */
     static native int setSpurDataNative(int fd, short  buff[], int len);
     static native void configurePerformanceParams(int fd);
+
+    /**
+     * native method: switch to a named threshold profile
+     * @param fd file descriptor of device
+     * @param name profile name, null or "" for the default profile
+     * @return {@link #FM_JNI_SUCCESS}
+     *         {@link #FM_JNI_FAILURE}
+     */
+    static native int setPerformanceProfileNative(int fd, String name);
+
+    /**
+     * native method: feed the stations a search list found into the
+     * hybrid search list
+     * @param fd file descriptor of device
+     * @param freqs frequencies in kHz
+     * @param count number of frequencies in freqs
+     * @return {@link #FM_JNI_SUCCESS}
+     *         {@link #FM_JNI_FAILURE}
+     */
+    static native int updateHybridSrchListNative(int fd, int[] freqs, int count);
     static native int enableSlimbus(int fd, int val);
 }
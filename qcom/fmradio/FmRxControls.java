@@ -486,6 +486,8 @@ class FmRxControls
             }
          }
 
+        FmReceiverJNI.updateHybridSrchListNative(fd, stationList, j);
+
         try {
           // mark end of list
            stationList[station_num] = 0;